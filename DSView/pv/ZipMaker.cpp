@@ -103,14 +103,20 @@ bool ZipMaker::AddFromBuffer(const char *innerFile, const char *buffer, unsigned
         level = Z_DEFAULT_COMPRESSION;
     }
 
-    zipOpenNewFileInZip((zipFile)m_zDoc,innerFile,(zip_fileinfo*)m_zi,
+    if (zipOpenNewFileInZip((zipFile)m_zDoc,innerFile,(zip_fileinfo*)m_zi,
                                 NULL,0,NULL,0,NULL ,
                                 Z_DEFLATED,
-                                level);
+                                level) != ZIP_OK){
+        strcpy(m_error, "zipOpenNewFileInZip error");
+        return false;
+    }
 
-    zipWriteInFileInZip((zipFile)m_zDoc, buffer, (unsigned int)buferSize);
+    int ret = zipWriteInFileInZip((zipFile)m_zDoc, buffer, (unsigned int)buferSize);
 
-    zipCloseFileInZip((zipFile)m_zDoc);
+    if (zipCloseFileInZip((zipFile)m_zDoc) != ZIP_OK || ret != ZIP_OK){
+        strcpy(m_error, "zipWriteInFileInZip error");
+        return false;
+    }
 
     return true;
 }
@@ -34,6 +34,7 @@
 #include "log.h"
 #include "utility/path.h"
 #include "utility/encoding.h"
+#include "utility/simd.h"
 
 AppControl::AppControl()
 {
@@ -90,6 +91,9 @@ bool AppControl::Init()
     dsv_info("GetDecodeScriptDir:\"%s\"", cs.c_str());
     //---------------end print directorys.
 
+    dsv_info("LogicSnapshot de-interleave kernel: %s",
+             pv::simd::kernel_name(pv::simd::best_kernel()));
+
     _session->init();
 
     srd_log_set_context(dsv_log_context());
@@ -122,6 +122,14 @@ static void _loadApp(AppOptions &o, QSettings &st)
     getFiled("displayProfileInBar", st, o.displayProfileInBar, false);
     getFiled("swapBackBufferAlways", st, o.swapBackBufferAlways, false);
     getFiled("fontSize", st, o.fontSize, 9.0);
+    getFiled("memoryBudget", st, o.memoryBudget, 0);
+    getFiled("recordToFile", st, o.recordToFile, false);
+    getFiled("loopPreTrigger", st, o.loopPreTrigger, 0);
+    getFiled("acqPriority", st, o.acqPriority, 0);
+    getFiled("acqCpu", st, o.acqCpu, -1);
+    getFiled("ingestCpu", st, o.ingestCpu, -1);
+    getFiled("decodeThreads", st, o.decodeThreads, 0);
+    getFiled("segmentDecode", st, o.segmentDecode, false);
 
     o.warnofMultiTrig = true;
 
@@ -148,6 +156,14 @@ static void _saveApp(AppOptions &o, QSettings &st)
     setFiled("displayProfileInBar", st, o.displayProfileInBar);
     setFiled("swapBackBufferAlways", st, o.swapBackBufferAlways);
     setFiled("fontSize", st, o.fontSize);
+    setFiled("memoryBudget", st, o.memoryBudget);
+    setFiled("recordToFile", st, o.recordToFile);
+    setFiled("loopPreTrigger", st, o.loopPreTrigger);
+    setFiled("acqPriority", st, o.acqPriority);
+    setFiled("acqCpu", st, o.acqCpu);
+    setFiled("ingestCpu", st, o.ingestCpu);
+    setFiled("decodeThreads", st, o.decodeThreads);
+    setFiled("segmentDecode", st, o.segmentDecode);
 
     QString fmt =  FormatArrayToString(o.m_protocolFormats);
     setFiled("protocalFormats", st, fmt);
@@ -66,6 +66,14 @@ struct AppOptions
     bool  displayProfileInBar;
     bool  swapBackBufferAlways;
     float fontSize;
+    int   memoryBudget; // MB of logic data kept in memory, 0 is no limit
+    bool  recordToFile; // a logic stream capture goes to a file
+    int   loopPreTrigger; // percent of the loop window kept before a trigger, 0 loops on
+    int   acqPriority; // real-time priority of the acquisition threads, 0 is the default
+    int   acqCpu; // the cpu of the acquisition threads, -1 is any
+    int   ingestCpu; // the cpu of the ingest thread, -1 is any
+    int   decodeThreads; // protocol stacks decoding at once, 0 is auto
+    bool  segmentDecode; // a long decode is split at idle gaps, the parts decode at once
 
     std::vector<StringPair> m_protocolFormats;
 };
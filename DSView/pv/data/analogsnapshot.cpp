@@ -209,14 +209,14 @@ void AnalogSnapshot::append_data(void *data, uint64_t samples, uint16_t pitch)
             _sample_count = _total_sample_count;
 
         if (_ring_sample_count + samples >= _total_sample_count) {
-            memcpy((uint8_t*)_data + _ring_sample_count * bytes_per_sample,
+            move_in((uint8_t*)_data + _ring_sample_count * bytes_per_sample,
                 data, (_total_sample_count - _ring_sample_count) * bytes_per_sample);
             data = (uint8_t*)data + (_total_sample_count - _ring_sample_count) * bytes_per_sample;
             _ring_sample_count = (samples + _ring_sample_count - _total_sample_count) % _total_sample_count;
-            memcpy((uint8_t*)_data,
+            move_in((uint8_t*)_data,
                 data, _ring_sample_count * bytes_per_sample);
         } else {
-            memcpy((uint8_t*)_data + _ring_sample_count * bytes_per_sample,
+            move_in((uint8_t*)_data + _ring_sample_count * bytes_per_sample,
                 data, samples * bytes_per_sample);
             _ring_sample_count += samples;
         }
@@ -237,6 +237,42 @@ void AnalogSnapshot::append_data(void *data, uint64_t samples, uint16_t pitch)
     }
 }
 
+void AnalogSnapshot::move_in(uint8_t *dest, const void *src, uint64_t size)
+{
+    const uint8_t *p = (const uint8_t*)src;
+
+    // A lent buffer is in place, or behind a short packet
+    if (p == dest || size == 0)
+        return;
+
+    if (p >= (uint8_t*)_data && p < (uint8_t*)_data + _capacity)
+        memmove(dest, src, size);
+    else
+        memcpy(dest, src, size);
+}
+
+void* AnalogSnapshot::lend_buffer(uint64_t size, uint64_t ahead)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const uint64_t bytes_per_sample = _unit_bytes * _channel_num;
+
+    if (_data == NULL || _last_ended || _memory_failed || bytes_per_sample == 0)
+        return NULL;
+    if (size % bytes_per_sample != 0 || ahead % bytes_per_sample != 0)
+        return NULL;
+
+    // The packets ahead are never longer, the data can only move back.
+    // The sender lends nothing after a short packet until the transfers
+    // in flight are in, the places lent never overlap.
+    const uint64_t start = _ring_sample_count + ahead / bytes_per_sample;
+
+    if (start + size / bytes_per_sample > _total_sample_count)
+        return NULL;
+
+    return (uint8_t*)_data + start * bytes_per_sample;
+}
+
 const uint8_t* AnalogSnapshot::get_samples(int64_t start_sample)
 {
 	assert(start_sample >= 0);
@@ -111,8 +111,16 @@ public:
 
     bool has_enabled_channel(int index);
 
+    /*
+     * Returns the place of a packet of size bytes that follows ahead
+     * bytes of other packets, to receive it in place. NULL if it
+     * would wrap around the ring.
+     */
+    void* lend_buffer(uint64_t size, uint64_t ahead);
+
 private:
     void append_data(void *data, uint64_t samples, uint16_t pitch);
+    void move_in(uint8_t *dest, const void *src, uint64_t size);
     void free_envelop();
 	void reallocate_envelope(Envelope &l);
 	void append_payload_to_envelope_levels();
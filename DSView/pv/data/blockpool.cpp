@@ -0,0 +1,498 @@
+/*
+ * This file is part of the DSView project.
+ * DSView is based on PulseView.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "blockpool.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#define DSV_POOL_MMAP
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#include <ds_types.h>
+#include "../log.h"
+
+namespace pv {
+namespace data {
+
+BlockPool::BlockPool(uint64_t block_size)
+{
+    assert(block_size > 0);
+
+    _block_size = block_size;
+    memset(&_stats, 0, sizeof(_stats));
+    _stats.block_size = block_size;
+
+    _spill_on = false;
+    _spill_fd = -1;
+    _spill_budget = 0;
+    _file_size = 0;
+    _tick = 0;
+    _slot_size = block_size;
+
+#ifdef DSV_POOL_MMAP
+    // The file offset of a mapping must be page aligned
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    _slot_size = (block_size + page - 1) / page * page;
+#endif
+}
+
+BlockPool::~BlockPool()
+{
+    if (_stats.in_use > 0)
+        dsv_err("BlockPool: %llu blocks are not released.", (u64_t)_stats.in_use);
+
+    trim(0);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    close_spill();
+}
+
+void* BlockPool::alloc(bool &zeroed)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    void *block = NULL;
+    zeroed = false;
+
+    if (!_cache.empty()){
+        block = _cache.back();
+        _cache.pop_back();
+        _stats.cached--;
+
+        auto it = _slots.find(block);
+        if (it != _slots.end() && !it->second.resident){
+            // The disk space of a paged out free block was given back
+            if (!reserve_file(it->second.offset)){
+                unmap_block(block);
+                block = NULL;
+            }
+        }
+    }
+
+    if (block != NULL){
+        _stats.reused++;
+
+        auto it = _slots.find(block);
+        if (it != _slots.end()){
+            it->second.in_use = true;
+            it->second.stamp = ++_tick;
+            if (!it->second.resident){
+                it->second.resident = true;
+                _stats.resident++;
+            }
+        }
+    }
+    else{
+        // A full disk falls back to memory
+        if (_spill_fd != -1)
+            block = map_file_block(zeroed);
+        if (block == NULL)
+            block = map_block(zeroed);
+        if (block == NULL){
+            _stats.failed++;
+            return NULL;
+        }
+        _stats.os_alloc++;
+    }
+
+    _stats.in_use++;
+    if (_stats.in_use > _stats.peak)
+        _stats.peak = _stats.in_use;
+
+    if (_spill_fd != -1)
+        page_out(block);
+
+    return block;
+}
+
+void BlockPool::release(void *block)
+{
+    assert(block);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    assert(_stats.in_use > 0);
+    _stats.in_use--;
+    _stats.cached++;
+    _cache.push_back(block);
+
+    auto it = _slots.find(block);
+    if (it != _slots.end())
+        it->second.in_use = false;
+}
+
+void BlockPool::trim(uint64_t keep)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    while (_cache.size() > keep){
+        unmap_block(_cache.back());
+        _cache.pop_back();
+        _stats.cached--;
+    }
+}
+
+bool BlockPool::set_spill(uint64_t budget, const std::string &dir)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+#ifndef DSV_POOL_MMAP
+    if (budget > 0)
+        dsv_info("BlockPool: no scratch file support, the memory budget is ignored.");
+    return budget == 0;
+#else
+    if (budget == _spill_budget && (budget == 0 || dir == _spill_dir))
+        return true;
+
+    for (auto &it : _slots){
+        if (it.second.in_use){
+            dsv_err("BlockPool: scratch file blocks are in use, keep the old memory budget.");
+            return false;
+        }
+    }
+
+    // The cached blocks of the old file go, new ones come from the new file
+    std::vector<void*> cache;
+    for (void *block : _cache){
+        if (_slots.find(block) != _slots.end()){
+            unmap_block(block);
+            _stats.cached--;
+        }
+        else{
+            cache.push_back(block);
+        }
+    }
+    _cache.swap(cache);
+
+    close_spill();
+    _spill_budget = budget;
+    _spill_dir = dir;
+
+    if (budget == 0)
+        return true;
+
+    std::string path = dir + "/DSView-blocks-XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+
+    int fd = mkstemp(&name[0]);
+    if (fd == -1){
+        dsv_err("BlockPool: failed to create the scratch file in %s", dir.c_str());
+        _spill_budget = 0;
+        return false;
+    }
+
+    // The file goes with the last mapping, a crash leaves nothing behind
+    unlink(&name[0]);
+
+    _spill_fd = fd;
+    _spill_on = true;
+    dsv_info("BlockPool: scratch file in %s, memory budget:%llu MB",
+        dir.c_str(), (u64_t)(budget >> 20));
+
+    return true;
+#endif
+}
+
+void BlockPool::touch_block(void *block)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto it = _slots.find(block);
+    if (it == _slots.end())
+        return;
+
+    it->second.stamp = ++_tick;
+
+    // The access faults it back in
+    if (!it->second.resident){
+        it->second.resident = true;
+        _stats.resident++;
+        page_out(block);
+    }
+}
+
+void BlockPool::page_out(void *keep)
+{
+#ifdef DSV_POOL_MMAP
+    while (_stats.resident * _block_size > _spill_budget)
+    {
+        // The free blocks go first, then the least recently touched one
+        auto victim = _slots.end();
+
+        for (auto it = _slots.begin(); it != _slots.end(); it++){
+            if (!it->second.resident || it->first == keep)
+                continue;
+
+            if (victim == _slots.end()
+                || (victim->second.in_use && !it->second.in_use)
+                || (victim->second.in_use == it->second.in_use && it->second.stamp < victim->second.stamp))
+                victim = it;
+        }
+
+        if (victim == _slots.end())
+            break;
+
+        FileSlot &slot = victim->second;
+
+        if (!slot.in_use){
+#ifdef MADV_REMOVE
+            // The content is not needed, free the disk space too
+            madvise(victim->first, _block_size, MADV_REMOVE);
+#else
+            madvise(victim->first, _block_size, MADV_DONTNEED);
+#endif
+        }
+        else{
+            // Dropping the mapping leaves the dirty pages in the page cache,
+            // write them back first, then the cache can drop them too
+            if (msync(victim->first, _block_size, MS_SYNC) != 0){
+                dsv_err("BlockPool: failed to write a block to the scratch file, error:%d", errno);
+                break;
+            }
+            madvise(victim->first, _block_size, MADV_DONTNEED);
+#ifdef POSIX_FADV_DONTNEED
+            posix_fadvise(_spill_fd, slot.offset, _block_size, POSIX_FADV_DONTNEED);
+#endif
+            _stats.spilled++;
+        }
+
+        slot.resident = false;
+        _stats.resident--;
+    }
+#else
+    (void)keep;
+#endif
+}
+
+void BlockPool::close_spill()
+{
+#ifdef DSV_POOL_MMAP
+    if (_spill_fd != -1)
+        close(_spill_fd);
+#endif
+    _spill_fd = -1;
+    _spill_on = false;
+    _file_size = 0;
+    _free_offsets.clear();
+}
+
+BlockPool::Stats BlockPool::get_stats()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+void BlockPool::log_stats(const char *owner)
+{
+    Stats st = get_stats();
+
+    dsv_info("%s block pool: size:%llu, in use:%llu, cached:%llu, peak:%llu, os alloc:%llu, reused:%llu, failed:%llu, spilled:%llu, resident:%llu, huge page:%d",
+        owner,
+        (u64_t)st.block_size,
+        (u64_t)st.in_use,
+        (u64_t)st.cached,
+        (u64_t)st.peak,
+        (u64_t)st.os_alloc,
+        (u64_t)st.reused,
+        (u64_t)st.failed,
+        (u64_t)st.spilled,
+        (u64_t)st.resident,
+        st.huge_page);
+}
+
+void* BlockPool::map_block(bool &zeroed)
+{
+#ifdef DSV_POOL_MMAP
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t len = (_block_size + page - 1) / page * page;
+    bool huge = false;
+
+#ifdef MADV_HUGEPAGE
+    // A huge page needs an aligned range, map more and cut the ends off
+    huge = _block_size >= HugePageSize && huge_page_allowed();
+#endif
+    uint64_t span = huge ? len + HugePageSize : len;
+
+    void *area = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (area == MAP_FAILED)
+        return NULL;
+
+    uint8_t *block = (uint8_t*)area;
+
+#ifdef MADV_HUGEPAGE
+    if (huge){
+        uint64_t head = (HugePageSize - (uint64_t)block % HugePageSize) % HugePageSize;
+        uint64_t tail = span - head - len;
+
+        block += head;
+        if (head > 0)
+            munmap(area, head);
+        if (tail > 0)
+            munmap(block + len, tail);
+
+        // Before the pages are faulted in, or they are small pages
+        huge = madvise(block, len, MADV_HUGEPAGE) == 0;
+    }
+#endif
+
+    // Fault the pages in now, not in the usb callback.
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(block, len, MADV_POPULATE_WRITE) != 0)
+#endif
+    {
+        for (uint64_t off = 0; off < len; off += page)
+            ((volatile uint8_t*)block)[off] = 0;
+    }
+
+    if (huge)
+        _stats.huge_page = true;
+
+    // Anonymous pages are zero filled.
+    zeroed = true;
+    return block;
+#else
+    zeroed = false;
+    return malloc(_block_size);
+#endif
+}
+
+bool BlockPool::huge_page_allowed()
+{
+#ifdef __linux__
+    // "[never]" takes no madvise() hint
+    static const bool allowed = []{
+        char buf[128] = {0};
+        int fd = open("/sys/kernel/mm/transparent_hugepage/enabled", O_RDONLY);
+        if (fd == -1)
+            return false;
+        ssize_t n = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        return n > 0 && strstr(buf, "[never]") == NULL;
+    }();
+    return allowed;
+#else
+    return false;
+#endif
+}
+
+void* BlockPool::map_file_block(bool &zeroed)
+{
+#ifdef DSV_POOL_MMAP
+    uint64_t offset;
+
+    if (!_free_offsets.empty()){
+        offset = _free_offsets.back();
+        _free_offsets.pop_back();
+        zeroed = false;
+
+        if (!reserve_file(offset)){
+            _free_offsets.push_back(offset);
+            return NULL;
+        }
+    }
+    else{
+        offset = _file_size;
+        if (!reserve_file(offset))
+            return NULL;
+        _file_size += _slot_size;
+        // A file is extended with zeros
+        zeroed = true;
+    }
+
+    void *block = mmap(NULL, _block_size, PROT_READ | PROT_WRITE, MAP_SHARED, _spill_fd, offset);
+    if (block == MAP_FAILED){
+        _free_offsets.push_back(offset);
+        return NULL;
+    }
+
+    FileSlot slot;
+    slot.offset = offset;
+    slot.stamp = ++_tick;
+    slot.resident = true;
+    slot.in_use = true;
+    _slots[block] = slot;
+    _stats.resident++;
+
+    return block;
+#else
+    zeroed = false;
+    return NULL;
+#endif
+}
+
+bool BlockPool::reserve_file(uint64_t offset)
+{
+#ifdef DSV_POOL_MMAP
+    // A write to a hole of the file raises SIGBUS when the disk is full,
+    // so the disk space is taken before the block is used
+#ifdef __linux__
+    int ret = posix_fallocate(_spill_fd, offset, _slot_size);
+#else
+    // No posix_fallocate(), writing the range takes the space
+    static const char zeros[4096] = {0};
+    int ret = 0;
+
+    for (uint64_t pos = 0; pos < _slot_size && ret == 0; pos += sizeof(zeros)){
+        if (pwrite(_spill_fd, zeros, sizeof(zeros), offset + pos) != (ssize_t)sizeof(zeros))
+            ret = errno;
+    }
+#endif
+    if (ret != 0){
+        dsv_err("BlockPool: failed to reserve %llu bytes of the scratch file, error:%d",
+            (u64_t)_slot_size, ret);
+        return false;
+    }
+    return true;
+#else
+    (void)offset;
+    return false;
+#endif
+}
+
+void BlockPool::unmap_block(void *block)
+{
+#ifdef DSV_POOL_MMAP
+    auto it = _slots.find(block);
+    if (it != _slots.end()){
+        if (it->second.resident)
+            _stats.resident--;
+#ifdef MADV_REMOVE
+        madvise(block, _block_size, MADV_REMOVE);
+#endif
+        _free_offsets.push_back(it->second.offset);
+        _slots.erase(it);
+    }
+
+    munmap(block, _block_size);
+#else
+    free(block);
+#endif
+}
+
+} // namespace data
+} // namespace pv
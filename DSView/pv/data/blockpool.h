@@ -0,0 +1,134 @@
+/*
+ * This file is part of the DSView project.
+ * DSView is based on PulseView.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef DSVIEW_PV_DATA_BLOCKPOOL_H
+#define DSVIEW_PV_DATA_BLOCKPOOL_H
+
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace pv {
+namespace data {
+
+/*
+ * Fixed size block allocator.
+ * Released blocks are cached and handed out again, so a repeated capture
+ * does not pay the allocation and page fault costs again.
+ *
+ * With a memory budget the blocks are mapped from a scratch file. Once more
+ * than the budget is resident, the least recently touched blocks are paged
+ * out to the file, the next access faults them back in. The block addresses
+ * never change, so the users do not know about it.
+ */
+class BlockPool
+{
+public:
+    struct Stats
+    {
+        uint64_t block_size;
+        uint64_t in_use;
+        uint64_t cached;
+        uint64_t peak;
+        uint64_t os_alloc;  // blocks got from the system
+        uint64_t reused;    // blocks served from the cache
+        uint64_t failed;
+        uint64_t spilled;   // blocks paged out to the scratch file
+        uint64_t resident;  // scratch file blocks in memory
+        bool     huge_page; // blocks mapped on aligned huge pages
+    };
+
+public:
+    BlockPool(uint64_t block_size);
+
+    ~BlockPool();
+
+    // @zeroed is set when the block content is known to be all zero
+    void* alloc(bool &zeroed);
+
+    void release(void *block);
+
+    // Give the cached blocks back to the system, keep @keep of them.
+    void trim(uint64_t keep);
+
+    // Map new blocks from a scratch file in @dir and keep at most @budget
+    // bytes of them resident, 0 maps them from memory again.
+    // It fails while a scratch file block is in use.
+    bool set_spill(uint64_t budget, const std::string &dir);
+
+    // The block is accessed, it is the last one to be paged out
+    inline void touch(void *block){
+        if (_spill_on.load(std::memory_order_relaxed))
+            touch_block(block);
+    }
+
+    Stats get_stats();
+
+    void log_stats(const char *owner);
+
+    inline uint64_t block_size(){
+        return _block_size;
+    }
+
+private:
+    static const uint64_t HugePageSize = 2 * 1024 * 1024;
+
+    struct FileSlot
+    {
+        uint64_t    offset;     // in the scratch file
+        uint64_t    stamp;      // last touch
+        bool        resident;
+        bool        in_use;
+    };
+
+    void* map_block(bool &zeroed);
+    static bool huge_page_allowed();
+    void* map_file_block(bool &zeroed);
+    bool reserve_file(uint64_t offset);
+    void unmap_block(void *block);
+    void touch_block(void *block);
+    void page_out(void *keep);
+    void close_spill();
+
+private:
+    std::mutex  _mutex;
+    std::vector<void*> _cache;
+    uint64_t    _block_size;
+    Stats       _stats;
+
+    std::atomic<bool> _spill_on;
+    int         _spill_fd;
+    uint64_t    _spill_budget;
+    std::string _spill_dir;
+    uint64_t    _slot_size;
+    uint64_t    _file_size;
+    uint64_t    _tick;
+    std::map<void*, FileSlot> _slots;
+    std::vector<uint64_t> _free_offsets;
+};
+
+} // namespace data
+} // namespace pv
+
+#endif // DSVIEW_PV_DATA_BLOCKPOOL_H
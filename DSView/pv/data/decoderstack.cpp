@@ -22,7 +22,9 @@
   
 
 #include <stdexcept>
+#include <string.h>
 #include <algorithm>
+#include <thread>
 #include <assert.h>
 
 #include "decoderstack.h"
@@ -35,6 +37,7 @@
 #include "../dsvdef.h"
 #include "../log.h"
 #include "../ui/langresource.h"
+#include "../config/appconfig.h"
 #include <ds_types.h>
 
 using namespace pv::data::decode;
@@ -389,6 +392,18 @@ void DecoderStack::stop_decode_work()
      if (_stask_stauts){
          _stask_stauts->_bStop = true;
      }
+
+    // A part may wait for a reader slot
+    LogicSnapshot *snapshot = _snapshot;
+    if (snapshot != NULL)
+        snapshot->wake_decode_readers();
+
+    // A chunk is up to a leaf block, do not wait for the decoders to handle it
+    {
+        std::lock_guard<std::mutex> lock(_srd_session_mutex);
+        for (auto session : _srd_sessions)
+            srd_session_stop(session);
+    }
     _decode_state = Stopped; 
 }
 
@@ -488,13 +503,13 @@ uint64_t DecoderStack::get_max_sample_count()
 	return max_sample_count;
 }
 
-void DecoderStack::decode_data(const uint64_t decode_start, const uint64_t decode_end, srd_session *const session)
+bool DecoderStack::decode_data(decode_segment &seg, srd_session *const session, int reader)
 {
-    decode_task_status *status = _stask_stauts;
+    decode_task_status *status = seg._status;
 
     //uint8_t *chunk = NULL;
-    uint64_t last_cnt = 0;
-    uint64_t notify_cnt = (decode_end - decode_start + 1)/100;
+    uint64_t last_cnt = seg._start;
+    uint64_t notify_cnt = (seg._end - seg._start + 1)/100;
     srd_decoder_inst *logic_di = NULL;
 
     // find the first level decoder instant
@@ -511,13 +526,13 @@ void DecoderStack::decode_data(const uint64_t decode_start, const uint64_t decod
     assert(logic_di);
 
     uint64_t entry_cnt = 0;
-    uint64_t i = decode_start;
+    uint64_t i = seg._start;
     char *error = NULL; 
     bool bError = false;
     bool bEndTime = false;
     //struct srd_push_param push_param;
 
-    if( i >= decode_end){
+    if( i >= seg._end){
         dsv_info("decode data index have been to end");
     }
 
@@ -525,13 +540,10 @@ void DecoderStack::decode_data(const uint64_t decode_start, const uint64_t decod
     std::vector<uint8_t> chunk_const;
 
     bool bCheckEnd = false;
-    uint64_t end_index = decode_end;
-
-    _progress = 0;
-    uint64_t sended_len  = 0;
-    _is_decoding = true;
+    uint64_t end_index = seg._end;
 
     void* lbp_array[35];
+    void* lbps[35];
 
     for (int j =0 ; j < logic_di->dec_num_channels; j++){
         lbp_array[j] = NULL;
@@ -539,9 +551,6 @@ void DecoderStack::decode_data(const uint64_t decode_start, const uint64_t decod
   
     while(i < end_index && !_no_memory && !status->_bStop)
     {
-        chunk.clear();
-        chunk_const.clear();
-
         if (_is_capture_end)
         {
             if (!bCheckEnd){
@@ -552,7 +561,7 @@ void DecoderStack::decode_data(const uint64_t decode_start, const uint64_t decod
                 if (end_index >= align_sample_count){
                     end_index = align_sample_count - 1;
                     dsv_info("Reset the decode end sample, new:%llu, old:%llu", 
-                        (u64_t)end_index, (u64_t)decode_end);
+                        (u64_t)end_index, (u64_t)seg._end);
                 }
             }
         }
@@ -569,42 +578,25 @@ void DecoderStack::decode_data(const uint64_t decode_start, const uint64_t decod
 
         uint64_t chunk_end = end_index;
 
-        for (int j =0 ; j < logic_di->dec_num_channels; j++) {
-            int sig_index = logic_di->dec_channelmap[j];
-            void *lbp = NULL;
+        if (!SegmentDecode::next_chunk(_snapshot, session, i, end_index,
+                                       logic_di->dec_channelmap, logic_di->dec_num_channels,
+                                       reader, chunk, chunk_const, lbps, chunk_end)) {
+            _error_message = L_S(STR_PAGE_MSG, S_ID(IDS_MSG_DECODERSTACK_DECODE_DATA_ERROR),
+                             "At least one of selected channels are not enabled.");
+            return false;
+        }
 
-            if (sig_index == -1) {
-                chunk.push_back(NULL);
-                chunk_const.push_back(0);
-            }
-            else {
-                if (_snapshot->has_data(sig_index)) {
-                    const uint8_t *data_ptr = _snapshot->get_samples(i, chunk_end, sig_index, &lbp);
-                    chunk.push_back(data_ptr);
-                    chunk_const.push_back(_snapshot->get_sample(i, sig_index));
-
-                    if (_snapshot->is_able_free() == false)
-                    {
-                        if (lbp_array[j] != lbp){
-                            if (lbp_array[j] != NULL)
-                                _snapshot->free_decode_lpb(lbp_array[j]);
-                            lbp_array[j] = lbp;
-                        }
-                    }
-                }
-                else {
-                    _error_message = L_S(STR_PAGE_MSG, S_ID(IDS_MSG_DECODERSTACK_DECODE_DATA_ERROR),
-                                     "At least one of selected channels are not enabled.");
-                    return;
+        if (_snapshot->is_able_free() == false)
+        {
+            for (int j =0 ; j < logic_di->dec_num_channels; j++){
+                if (lbps[j] != NULL && lbp_array[j] != lbps[j]){
+                    if (lbp_array[j] != NULL)
+                        _snapshot->free_decode_lpb(lbp_array[j], reader);
+                    lbp_array[j] = lbps[j];
                 }
             }
         }
 
-        if (chunk_end > end_index)
-            chunk_end = end_index;
-        if (chunk_end - i > MaxChunkSize)
-            chunk_end = i + MaxChunkSize;
-
         bEndTime = (chunk_end == end_index);
 
         if (srd_session_send(
@@ -627,16 +619,10 @@ void DecoderStack::decode_data(const uint64_t decode_start, const uint64_t decod
             break;
         }
 
-        sended_len += chunk_end - i; 
-        _progress = (int)(sended_len * 100 / end_index);
-
+        seg._sent = chunk_end - seg._start;
         i = chunk_end;       
 
-        //use mutex
-        {
-            std::lock_guard<std::mutex> lock(_output_mutex);
-            _samples_decoded = i - decode_start + 1;
-        }
+        update_progress();
 
         if ((i - last_cnt) > notify_cnt) {
             last_cnt = i;
@@ -645,52 +631,42 @@ void DecoderStack::decode_data(const uint64_t decode_start, const uint64_t decod
 
         entry_cnt++;
     }
-
-    _progress = 100;
-    _is_decoding = false;
-    
-    new_decode_data();
-
-    // the task is normal ends,so all samples was processed;
-    if (!bError && bEndTime){
-       srd_session_end(session, &error);
-
-        if (error != NULL){
-            _error_message = QString::fromLocal8Bit(error);
-            dsv_err("Failed to call srd_session_end:%s", error);
-        }
-    }
  
     dsv_info("%s%llu", "send to decoder times: ", (u64_t)entry_cnt);
 
     if (error != NULL)
         g_free(error);
-  
-    if (!_session->is_closed())
-        decode_done();
+
+    // the task is normal ends,so all samples was processed;
+    return !bError && bEndTime && !status->_bStop;
 }
 
-void DecoderStack::execute_decode_stack()
-{  
+void DecoderStack::update_progress()
+{
+    int percent = 0;
+    uint64_t decoded = 0;
+
+    // The parts update it from their threads
+    std::lock_guard<std::mutex> lock(_output_mutex);
+    SegmentDecode::progress(_segments, percent, decoded);
+    _progress = percent;
+    _samples_decoded = decoded;
+}
+
+srd_session* DecoderStack::new_decode_session(decode_segment *seg)
+{
 	srd_session *session = NULL;
 	srd_decoder_inst *prev_di = NULL;
-    uint64_t decode_start = 0;
-    uint64_t decode_end = 0;
-
-	assert(_snapshot);
 
 	// Create the session
-    // one decoderstatck onwer one session
-    // all decoderstatck execute in sequence
+    // one decoderstatck onwer one session for each part of the decode range
+    // the decoderstatcks execute on the decode threads of SigSession
 	srd_session_new(&session);
 
     if (session == NULL){
         dsv_err("Failed to call srd_session_new()");
         assert(false);
     }
-    
-    // Get the intial sample count
-    _sample_count = _snapshot->get_ring_sample_count();
  
     // Create the decoders
     for(auto dec : _stack)
@@ -702,24 +678,15 @@ void DecoderStack::execute_decode_stack()
 			_error_message =L_S(STR_PAGE_MSG, S_ID(IDS_MSG_DECODERSTACK_DECODE_STACK_ERROR), 
                             "Failed to create decoder instance");
 			srd_session_destroy(session);
-			return;
+			return NULL;
 		}
 
 		if (prev_di)
 			srd_inst_stack (session, prev_di, di);
 
 		prev_di = di;
-        decode_start = dec->decode_start();
-
-        if (_session->is_realtime_refresh() == false)
-            decode_end = min(dec->decode_end(), _sample_count-1);
-        else
-            decode_end = max(dec->decode_end(), decode_end);
 	}
 
-    dsv_info("decoder start sample:%llu, end sample:%llu, count:%llu", 
-            (u64_t)decode_start, (u64_t)decode_end, (u64_t)(decode_end - decode_start + 1));
-
 	// Start the session
 	srd_session_metadata_set(session, SRD_CONF_SAMPLERATE,
 		g_variant_new_uint64((uint64_t)_samplerate));
@@ -728,23 +695,250 @@ void DecoderStack::execute_decode_stack()
                     session, 
                     SRD_OUTPUT_ANN,
 		            DecoderStack::annotation_callback,
-                    _stask_stauts);
+                    seg);
+
+    srd_session_next_edge_callback_set(session, DecoderStack::next_edge_callback, this);
 
     char *error = NULL;
-    if (srd_session_start(session, &error) == SRD_OK){
-       //need a lot time
-        decode_data(decode_start, decode_end, session);
+    if (srd_session_start(session, &error) != SRD_OK){
+        if (error != NULL){
+            _error_message = QString::fromLocal8Bit(error);
+            g_free(error);
+        }
+        srd_session_destroy(session);
+        return NULL;
     }
-    else if (error != NULL){
-        _error_message = QString::fromLocal8Bit(error);
+
+    return session;
+}
+
+void DecoderStack::decode_segment_proc(decode_segment *seg)
+{
+    srd_session *session = seg->_session;
+    bool bEnd = false;
+
+    {
+        std::lock_guard<std::mutex> lock(_srd_session_mutex);
+        _srd_sessions.push_back(session);
     }
 
-	// Destroy the session
-    if (error != NULL) {
-        g_free(error);
+    // A stop before the session was set
+    if (seg->_status->_bStop)
+        srd_session_stop(session);
+
+    // The stacks decode in parallel, each part reads with its own slot.
+    // The slots of the other stacks and parts are freed as they end.
+    int reader = _snapshot->wait_decode_reader(seg->_status->_bStop);
+
+    if (reader != -1){
+        //need a lot time
+        bEnd = decode_data(*seg, session, reader);
+        _snapshot->close_decode_reader(reader);
     }
 
-	srd_session_destroy(session); 
+    // Only the end of the decode range ends the decoders, the way a serial decode does
+    if (bEnd && seg == &_segments.back()){
+        char *error = NULL;
+        srd_session_end(session, &error);
+
+        if (error != NULL){
+            _error_message = QString::fromLocal8Bit(error);
+            dsv_err("Failed to call srd_session_end:%s", error);
+            g_free(error);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_srd_session_mutex);
+        _srd_sessions.remove(session);
+    }
+    srd_session_destroy(session);
+    seg->_session = NULL;
+
+    std::lock_guard<std::mutex> lock(_segment_mutex);
+    seg->_done = true;
+    stitch_segments();
+}
+
+// The caller holds _segment_mutex
+void DecoderStack::stitch_segments()
+{
+    SegmentDecode::stitch(_segments, [this](decode_segment &seg){
+        for (auto &ra : seg._anns){
+            if (!ra.first->push_annotation(ra.second)){
+                _no_memory = true;
+                delete ra.second;
+            }
+        }
+        std::vector<std::pair<decode::RowData*, decode::Annotation*>>().swap(seg._anns);
+        new_decode_data();
+    });
+}
+
+void DecoderStack::split_decode_range(uint64_t start, uint64_t end, std::vector<uint64_t> &bounds)
+{
+    AppConfig &app = AppConfig::Instance();
+    int num = _session->decode_thread_count();
+    std::vector<int> sigs;
+    std::vector<int> levels;
+
+    if (!app.appOptions.segmentDecode || !_is_capture_end || _session->is_realtime_refresh()
+        || !resync_levels(sigs, levels)) {
+        num = 1;
+    }
+
+    SegmentDecode::split_range(_snapshot, start, end, num, SegmentDecode::MinSegmentSamples,
+                               sigs, levels, bounds);
+}
+
+// The value of a string option of the decoder, its default if it is not set
+static std::string decoder_option(decode::Decoder *dec, const char *id)
+{
+    GVariant *var = NULL;
+    auto it = dec->options().find(id);
+
+    if (it != dec->options().end()){
+        var = it->second;
+    }
+    else {
+        for (const GSList *l = dec->decoder()->options; l; l = l->next){
+            const srd_decoder_option *const opt = (srd_decoder_option*)l->data;
+            if (strcmp(opt->id, id) == 0)
+                var = opt->def;
+        }
+    }
+
+    if (var == NULL || !g_variant_is_of_type(var, G_VARIANT_TYPE("s")))
+        return "";
+    return g_variant_get_string(var, NULL);
+}
+
+// The channels of a decoder that starts over at an idle bus, and the level of
+// each one there, -1 for any level. A gap of still channels is not enough: a
+// SPI word waits with CS# asserted and an I2C slave stretches the clock low.
+// The other decoders, and the stacked ones, keep state across the gaps.
+bool DecoderStack::resync_levels(std::vector<int> &sigs, std::vector<int> &levels)
+{
+    sigs.clear();
+    levels.clear();
+
+    if (_stack.size() != 1)
+        return false;
+
+    decode::Decoder *const dec = _stack.front();
+    const std::string id = dec->decoder()->id;
+    const bool uart = (id == "0:uart" || id == "1:uart");
+    const bool i2c = (id == "0:i2c" || id == "1:i2c");
+    const bool spi = (id == "0:spi" || id == "1:spi");
+    bool cs = false;
+
+    if (!uart && !i2c && !spi)
+        return false;
+
+    for (auto &kv : dec->channels()){
+        if (kv.second == -1)
+            continue;
+
+        int level = -1;
+
+        if (uart){
+            level = (decoder_option(dec, "invert") == "yes") ? 0 : 1;
+        }
+        else if (i2c){
+            level = 1;
+        }
+        else if (strcmp(kv.first->id, "cs") == 0){
+            level = (decoder_option(dec, "cs_polarity") == "active-high") ? 0 : 1;
+            cs = true;
+        }
+
+        sigs.push_back(kv.second);
+        levels.push_back(level);
+    }
+
+    // Without CS# the words run on across any gap
+    if (spi && !cs)
+        return false;
+
+    return !sigs.empty();
+}
+
+void DecoderStack::execute_decode_stack()
+{  
+    uint64_t decode_start = 0;
+    uint64_t decode_end = 0;
+
+	assert(_snapshot);
+    
+    // Get the intial sample count
+    _sample_count = _snapshot->get_ring_sample_count();
+ 
+    for(auto dec : _stack)
+	{
+        decode_start = dec->decode_start();
+
+        if (_session->is_realtime_refresh() == false)
+            decode_end = min(dec->decode_end(), _sample_count-1);
+        else
+            decode_end = max(dec->decode_end(), decode_end);
+	}
+
+    dsv_info("decoder start sample:%llu, end sample:%llu, count:%llu", 
+            (u64_t)decode_start, (u64_t)decode_end, (u64_t)(decode_end - decode_start + 1));
+
+    std::vector<uint64_t> bounds;
+    split_decode_range(decode_start, decode_end, bounds);
+
+    // The parts hold atomics, they are made in place
+    std::vector<decode_segment>(bounds.size() - 1).swap(_segments);
+
+    for (size_t k = 0; k < _segments.size(); k++)
+    {
+        decode_segment &seg = _segments[k];
+        seg._status = _stask_stauts;
+        seg._start = bounds[k];
+        seg._end = bounds[k + 1];
+        seg._sent = 0;
+        seg._direct = (k == 0);
+        seg._done = false;
+        seg._session = new_decode_session(&seg);
+
+        if (seg._session == NULL)
+            break;
+    }
+
+    if (_segments.back()._session != NULL)
+    {
+        if (_segments.size() > 1)
+            dsv_info("decode in %d parts", (int)_segments.size());
+
+        _progress = 0;
+        _is_decoding = true;
+
+        // The parts go to the free decode threads, this one takes the rest
+        _session->run_decode_parts((int)_segments.size(), [this](int k){
+            decode_segment_proc(&_segments[k]);
+        });
+
+        _progress = 100;
+        _is_decoding = false;
+    
+        new_decode_data();
+
+        if (!_session->is_closed())
+            decode_done();
+    }
+
+    // The parts not stitched after a stop, and the sessions of a failed start
+    for (auto &seg : _segments)
+    {
+        for (auto &ra : seg._anns)
+            delete ra.second;
+
+        if (seg._session != NULL)
+            srd_session_destroy(seg._session);
+    }
+    _segments.clear();
 }
 
 uint64_t DecoderStack::sample_count()
@@ -760,13 +954,42 @@ uint64_t DecoderStack::sample_rate()
     return _samplerate;
 }
 
+// The first edge of the channels from start on, asked by the decoders that wait for edges
+uint64_t DecoderStack::next_edge_callback(uint64_t start, const int *channels,
+                                          int num_channels, void *self)
+{
+    assert(self);
+
+    DecoderStack *const d = (DecoderStack*)self;
+    LogicSnapshot::EdgePair edge;
+    LogicSnapshot::EdgeList el;
+    uint64_t next = d->_snapshot->get_ring_sample_count();
+
+    // The sample 0 has no sample before it
+    if (start == 0 || start >= next)
+        return start;
+
+    // One channel at a time, each one searches up to the nearest edge found
+    for (int i = 0; i < num_channels && next > start; i++){
+        el.sig_index = channels[i];
+        el.edges = &edge;
+        el.capacity = 1;
+
+        if (d->_snapshot->get_edges(start - 1, next - 1, &el, 1) && el.count > 0)
+            next = edge.first;
+    }
+
+    return next;
+}
+
 //the decode callback, annotation object will be create
 void DecoderStack::annotation_callback(srd_proto_data *pdata, void *self)
 {
 	assert(pdata);
 	assert(self);
 
-    struct decode_task_status *st = (decode_task_status*)self;
+    decode_segment *seg = (decode_segment*)self;
+    struct decode_task_status *st = seg->_status;
 
 	DecoderStack *const d = st->_decoder;
 	assert(d);
@@ -783,6 +1006,9 @@ void DecoderStack::annotation_callback(srd_proto_data *pdata, void *self)
         return;
     }
 
+    // The parts of a decode share the resource table
+    std::lock_guard<std::mutex> lock(d->_segment_mutex);
+
     Annotation *a = new Annotation(pdata, d->_decoder_status);
     if (a == NULL){
         d->_no_memory = true;
@@ -815,9 +1041,19 @@ void DecoderStack::annotation_callback(srd_proto_data *pdata, void *self)
         return;
     }
 
-	// Add the annotation 
-    if (!(*row_iter).second->push_annotation(a))
-        d->_no_memory = true; 
+	// Add the annotation, a part after the ones not done keeps it
+    if (seg->_direct){
+        if (!(*row_iter).second->push_annotation(a))
+            d->_no_memory = true; 
+    }
+    else {
+        try {
+            seg->_anns.push_back(std::make_pair((*row_iter).second, a));
+        } catch (const std::bad_alloc&) {
+            delete a;
+            d->_no_memory = true;
+        }
+    }
 }
  
 void DecoderStack::frame_ended()
@@ -29,10 +29,13 @@
 #include <QObject>
 #include <QString>
 #include <mutex> 
+#include <vector>
+#include <atomic>
 
 #include "decode/row.h" 
 #include "../data/signaldata.h"
 #include "decode/decoderstatus.h"
+#include "segmentdecode.h"
  
 
 namespace DecoderStackTest {
@@ -75,7 +78,6 @@ private:
 	static const double DecodeThreshold;
 	static const int64_t DecodeChunkLength;
 	static const unsigned int DecodeNotifyPeriod;
-    static const uint64_t MaxChunkSize = 1024 * 16;
 
 public:
     enum decode_state {
@@ -182,9 +184,17 @@ public:
     }
 
 private:
-    void decode_data(const uint64_t decode_start, const uint64_t decode_end, srd_session *const session);
+    bool decode_data(decode_segment &seg, srd_session *const session, int reader);
 	void execute_decode_stack();
+    srd_session* new_decode_session(decode_segment *seg);
+    void decode_segment_proc(decode_segment *seg);
+    void stitch_segments();
+    void update_progress();
+    void split_decode_range(uint64_t start, uint64_t end, std::vector<uint64_t> &bounds);
+    bool resync_levels(std::vector<int> &sigs, std::vector<int> &levels);
 	static void annotation_callback(srd_proto_data *pdata, void *self);
+    static uint64_t next_edge_callback(uint64_t start, const int *channels,
+                                       int num_channels, void *self);
     void do_decode_work();
   
 signals:
@@ -213,8 +223,12 @@ private:
  
     decode_task_status  *_stask_stauts;    
     mutable std::mutex _output_mutex; 
+    std::list<srd_session*> _srd_sessions; // the running decode, to stop it in a chunk
+    std::mutex      _srd_session_mutex;
+    std::vector<decode_segment> _segments;
+    std::mutex      _segment_mutex;
     bool            _is_capture_end;
-    int             _progress;
+    std::atomic<int> _progress;
     bool            _is_decoding;
 
 	friend class DecoderStackTest::TwoDecoderStack;
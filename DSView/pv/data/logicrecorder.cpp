@@ -0,0 +1,404 @@
+/*
+ * This file is part of the DSView project.
+ * DSView is based on PulseView.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "logicrecorder.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <libsigrok.h>
+#include <ds_types.h>
+
+#include "../log.h"
+#include "../utility/simd.h"
+
+namespace pv {
+namespace data {
+
+LogicRecorder::LogicRecorder()
+{
+    _channel_num = 0;
+    _overview_scale = 64;
+    _sample_count = 0;
+    _byte_count = 0;
+    _queue_bytes = 0;
+    _stop = false;
+    _failed = false;
+    _block_words = 0;
+    _block_index = 0;
+    _ov_cell_words = 1;
+    _ov_count = 0;
+    _ov_bits = 0;
+}
+
+LogicRecorder::~LogicRecorder()
+{
+    if (is_recording())
+        cancel();
+}
+
+bool LogicRecorder::start(const std::string &file, const std::vector<int> &ch_indexs,
+                          uint64_t total_samples)
+{
+    assert(!is_recording());
+    assert(ch_indexs.size() > 0);
+
+    _file = file;
+    _error = "";
+    _ch_indexs = ch_indexs;
+    _channel_num = ch_indexs.size();
+    _sample_count = 0;
+    _byte_count = 0;
+    _queue_bytes = 0;
+    _stop = false;
+    _failed = false;
+    _carry.clear();
+    _block_words = 0;
+    _block_index = 0;
+
+    _overview_scale = 64;
+    while (total_samples / _overview_scale > OverviewMaxSamples)
+        _overview_scale <<= 1;
+    _ov_cell_words = _overview_scale / 64;
+    _ov_count = 0;
+    _ov_bits = 0;
+    _ov_or.assign(_channel_num, 0);
+    _ov_and.assign(_channel_num, ~0ULL);
+    _ov_word.assign(_channel_num, 0);
+    _ov_last.assign(_channel_num, 0);
+    _ov_pending.clear();
+
+    try{
+        _blocks.resize(_channel_num);
+        for (auto &b : _blocks)
+            b.resize(BlockSamples / 64);
+        _block_ptrs.resize(_channel_num);
+    }
+    catch (...){
+        _error = "Malloc error.";
+        _blocks.clear();
+        return false;
+    }
+
+    if (!_zip.CreateNew(_file.c_str(), false)){
+        _error = _zip.GetError();
+        _zip.Release();
+        return false;
+    }
+    // The disk is the limit, not the cpu
+    _zip.m_opt_compress_level = Z_NO_COMPRESSION;
+
+    _thread = std::thread(&LogicRecorder::write_proc, this);
+
+    dsv_info("Record to %s, channels:%u, overview scale:%llu",
+        _file.c_str(), _channel_num, (u64_t)_overview_scale);
+
+    return true;
+}
+
+bool LogicRecorder::append_payload(const sr_datafeed_logic &logic)
+{
+    assert(logic.format == LA_CROSS_DATA);
+
+    if (logic.length == 0)
+        return true;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (_failed)
+        return false;
+
+    if (_queue_bytes + logic.length > MaxQueueBytes){
+        dsv_err("LogicRecorder: the disk can not keep up, %llu bytes are waiting.",
+            (u64_t)_queue_bytes);
+        _error = "The disk can not keep up with the capture.";
+        _failed = true;
+        return false;
+    }
+
+    std::vector<uint8_t> buf;
+    if (!_spares.empty()){
+        buf.swap(_spares.back());
+        _spares.pop_back();
+    }
+
+    const uint8_t *data = (const uint8_t*)logic.data;
+    buf.assign(data, data + logic.length);
+
+    _queue.push_back(std::move(buf));
+    _queue_bytes += logic.length;
+    _byte_count += logic.length;
+    _sample_count = _byte_count * 8 / _channel_num;
+    _cond.notify_one();
+
+    return true;
+}
+
+bool LogicRecorder::take_overview(std::vector<uint64_t> &data)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    data.clear();
+    if (_ov_pending.empty())
+        return false;
+
+    data.swap(_ov_pending);
+    return true;
+}
+
+void LogicRecorder::write_proc()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (true)
+    {
+        _cond.wait(lock, [this]{ return _stop || !_queue.empty(); });
+
+        // The queue is written out before it stops
+        if (_queue.empty())
+            break;
+
+        std::vector<uint8_t> buf;
+        buf.swap(_queue.front());
+        _queue.pop_front();
+        bool failed = _failed;
+
+        lock.unlock();
+        if (!failed)
+            write_payload(buf.data(), buf.size());
+        lock.lock();
+
+        _queue_bytes -= buf.size();
+        if (_spares.size() < 8)
+            _spares.push_back(std::move(buf));
+    }
+}
+
+void LogicRecorder::write_payload(const uint8_t *data, uint64_t len)
+{
+    const uint64_t group_bytes = _channel_num * sizeof(uint64_t);
+    const uint64_t block_words = BlockSamples / 64;
+
+    // Complete the channel word group the last payload left
+    if (!_carry.empty()){
+        uint64_t n = std::min(group_bytes - _carry.size(), len);
+        _carry.insert(_carry.end(), data, data + n);
+        data += n;
+        len -= n;
+
+        if (_carry.size() < group_bytes)
+            return;
+
+        for (unsigned int i = 0; i < _channel_num; i++)
+            _block_ptrs[i] = _blocks[i].data() + _block_words;
+        simd::deinterleave_u64((const uint64_t*)_carry.data(), _block_ptrs.data(), _channel_num, 1);
+        add_overview(_block_words, 1);
+        _block_words++;
+        _carry.clear();
+
+        if (_block_words == block_words && !write_block(BlockSamples / 8))
+            return;
+    }
+
+    uint64_t groups = len / group_bytes;
+
+    while (groups > 0)
+    {
+        uint64_t n = std::min(groups, block_words - _block_words);
+
+        for (unsigned int i = 0; i < _channel_num; i++)
+            _block_ptrs[i] = _blocks[i].data() + _block_words;
+        simd::deinterleave_u64((const uint64_t*)data, _block_ptrs.data(), _channel_num, n);
+        add_overview(_block_words, n);
+
+        _block_words += n;
+        data += n * group_bytes;
+        len -= n * group_bytes;
+        groups -= n;
+
+        if (_block_words == block_words && !write_block(BlockSamples / 8))
+            return;
+    }
+
+    if (len > 0)
+        _carry.assign(data, data + len);
+}
+
+void LogicRecorder::add_overview(uint64_t offset, uint64_t words)
+{
+    while (words > 0)
+    {
+        uint64_t n = std::min(words, _ov_cell_words - _ov_count);
+
+        for (unsigned int i = 0; i < _channel_num; i++){
+            const uint64_t *p = _blocks[i].data() + offset;
+            uint64_t v_or = _ov_or[i];
+            uint64_t v_and = _ov_and[i];
+
+            for (uint64_t j = 0; j < n; j++){
+                v_or |= p[j];
+                v_and &= p[j];
+            }
+            _ov_or[i] = v_or;
+            _ov_and[i] = v_and;
+        }
+
+        _ov_count += n;
+        offset += n;
+        words -= n;
+
+        if (_ov_count == _ov_cell_words)
+            end_overview_cell();
+    }
+}
+
+void LogicRecorder::end_overview_cell()
+{
+    for (unsigned int i = 0; i < _channel_num; i++){
+        uint8_t bit;
+
+        // A toggling cell flips the overview, it shows up as an edge
+        if (_ov_and[i] == ~0ULL)
+            bit = 1;
+        else if (_ov_or[i] == 0)
+            bit = 0;
+        else
+            bit = !_ov_last[i];
+
+        _ov_last[i] = bit;
+        _ov_word[i] |= (uint64_t)bit << _ov_bits;
+        _ov_or[i] = 0;
+        _ov_and[i] = ~0ULL;
+    }
+
+    _ov_count = 0;
+    _ov_bits++;
+
+    if (_ov_bits == 64){
+        std::lock_guard<std::mutex> lock(_mutex);
+        _ov_pending.insert(_ov_pending.end(), _ov_word.begin(), _ov_word.end());
+        std::fill(_ov_word.begin(), _ov_word.end(), 0);
+        _ov_bits = 0;
+    }
+}
+
+bool LogicRecorder::write_block(uint64_t bytes)
+{
+    char chunk_name[20] = {0};
+
+    for (unsigned int i = 0; i < _channel_num; i++){
+        snprintf(chunk_name, sizeof(chunk_name), "L-%d/%llu", _ch_indexs[i], (u64_t)_block_index);
+
+        if (!_zip.AddFromBuffer(chunk_name, (const char*)_blocks[i].data(), bytes)){
+            dsv_err("LogicRecorder: failed to write %s, %s", chunk_name, _zip.GetError());
+            std::lock_guard<std::mutex> lock(_mutex);
+            _error = "Failed to write the file. Please check the disk space and the write permission.";
+            _failed = true;
+            return false;
+        }
+    }
+
+    _block_index++;
+    _block_words = 0;
+    return true;
+}
+
+void LogicRecorder::stop_thread()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+        _cond.notify_one();
+    }
+
+    if (_thread.joinable())
+        _thread.join();
+}
+
+bool LogicRecorder::finish(const std::string &header)
+{
+    if (!is_recording())
+        return false;
+
+    stop_thread();
+
+    if (!_carry.empty()){
+        dsv_info("LogicRecorder: drop %llu bytes of a part channel group.", (u64_t)_carry.size());
+        _carry.clear();
+    }
+
+    uint64_t words = _block_index * (BlockSamples / 64) + _block_words;
+    _sample_count = std::min(_sample_count, words * 64);
+
+    if (!_failed && _block_words > 0){
+        uint64_t samples = _sample_count - _block_index * BlockSamples;
+        write_block((samples + 7) / 8);
+    }
+
+    if (_ov_count > 0)
+        end_overview_cell();
+    if (_ov_bits > 0){
+        std::lock_guard<std::mutex> lock(_mutex);
+        _ov_pending.insert(_ov_pending.end(), _ov_word.begin(), _ov_word.end());
+        std::fill(_ov_word.begin(), _ov_word.end(), 0);
+        _ov_bits = 0;
+    }
+
+    if (!_failed && !_zip.AddFromBuffer("header", header.c_str(), header.size())){
+        _error = _zip.GetError();
+        _failed = true;
+    }
+
+    bool ret = _zip.Close() && !_failed;
+    _zip.Release();
+    _blocks.clear();
+    _spares.clear();
+
+    if (ret){
+        dsv_info("Recorded %llu samples in %llu blocks to %s",
+            (u64_t)_sample_count, (u64_t)_block_index, _file.c_str());
+    }
+    else{
+        remove(_file.c_str());
+    }
+
+    return ret;
+}
+
+void LogicRecorder::cancel()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.clear();
+        _queue_bytes = 0;
+        _failed = true;
+    }
+
+    stop_thread();
+
+    _zip.Release();
+    _blocks.clear();
+    _spares.clear();
+    remove(_file.c_str());
+}
+
+} // namespace data
+} // namespace pv
@@ -0,0 +1,148 @@
+/*
+ * This file is part of the DSView project.
+ * DSView is based on PulseView.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef DSVIEW_PV_DATA_LOGICRECORDER_H
+#define DSVIEW_PV_DATA_LOGICRECORDER_H
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../ZipMaker.h"
+
+struct sr_datafeed_logic;
+
+namespace pv {
+namespace data {
+
+/*
+ * Write a logic stream capture straight to a .dsl archive.
+ * The payloads are queued by the datafeed thread, a writer thread splits
+ * them to the per channel blocks of the file. Only a coarse overview,
+ * one sample per get_overview_scale() samples, is kept in memory.
+ */
+class LogicRecorder
+{
+public:
+    // The samples of a block chunk in the file, the same as a saved snapshot
+    static const uint64_t BlockSamples = 1 << 24;
+    // The overview scale grows until the overview fits in it
+    static const uint64_t OverviewMaxSamples = 1 << 24;
+    // The payloads not yet written, more is an overflow
+    static const uint64_t MaxQueueBytes = 256 * 1024 * 1024;
+
+public:
+    LogicRecorder();
+
+    ~LogicRecorder();
+
+    // @ch_indexs are the enabled logic channels, in the payload order
+    bool start(const std::string &file, const std::vector<int> &ch_indexs,
+               uint64_t total_samples);
+
+    // False if the writer can not keep up or has failed
+    bool append_payload(const sr_datafeed_logic &logic);
+
+    // Move the new overview samples to @data, LA_CROSS_DATA of the channels
+    bool take_overview(std::vector<uint64_t> &data);
+
+    // Write the last blocks and the @header, close the file
+    bool finish(const std::string &header);
+
+    // Stop and remove the file
+    void cancel();
+
+    inline bool is_recording(){
+        return _thread.joinable();
+    }
+
+    inline uint64_t get_overview_scale(){
+        return _overview_scale;
+    }
+
+    inline uint64_t get_sample_count(){
+        return _sample_count;
+    }
+
+    inline uint64_t get_block_num(){
+        return (_sample_count + BlockSamples - 1) / BlockSamples;
+    }
+
+    inline const std::string& get_file(){
+        return _file;
+    }
+
+    inline const std::string& get_error(){
+        return _error;
+    }
+
+private:
+    void write_proc();
+    void write_payload(const uint8_t *data, uint64_t len);
+    void add_overview(uint64_t offset, uint64_t words);
+    void end_overview_cell();
+    bool write_block(uint64_t bytes);
+    void stop_thread();
+
+private:
+    std::string     _file;
+    std::string     _error;
+    ZipMaker        _zip;
+    std::vector<int> _ch_indexs;
+    unsigned int    _channel_num;
+    uint64_t        _overview_scale;
+    uint64_t        _sample_count;
+    uint64_t        _byte_count;
+
+    std::thread     _thread;
+    std::mutex      _mutex;
+    std::condition_variable _cond;
+    std::deque<std::vector<uint8_t>> _queue;
+    std::vector<std::vector<uint8_t>> _spares;
+    uint64_t        _queue_bytes;
+    bool            _stop;
+    bool            _failed;
+
+    // Written by the writer thread only
+    std::vector<uint8_t>    _carry;     // a part of a channel word group
+    std::vector<uint64_t*>  _block_ptrs;
+    std::vector<std::vector<uint64_t>> _blocks;
+    uint64_t        _block_words;
+    uint64_t        _block_index;
+
+    std::vector<uint64_t>   _ov_or;
+    std::vector<uint64_t>   _ov_and;
+    std::vector<uint64_t>   _ov_word;
+    uint64_t        _ov_cell_words;
+    uint64_t        _ov_count;      // the words in the current cell
+    uint64_t        _ov_bits;
+    std::vector<uint8_t>    _ov_last;   // the last overview sample
+    std::vector<uint64_t>   _ov_pending;
+};
+
+} // namespace data
+} // namespace pv
+
+#endif // DSVIEW_PV_DATA_LOGICRECORDER_H
@@ -24,11 +24,15 @@
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <algorithm>
+#include <thread>
  
 #include "logicsnapshot.h"
 #include "../dsvdef.h"
 #include "../log.h"
 #include "../utility/array.h"
+#include "../utility/simd.h"
+#include "../utility/workerpool.h"
 
 using namespace std;
 
@@ -49,28 +53,51 @@ const uint64_t LogicSnapshot::LevelOffset[LogicSnapshot::ScaleLevel] = {
 };
 
 LogicSnapshot::LogicSnapshot() :
-    Snapshot(1, 0, 0)
+    Snapshot(1, 0, 0),
+    _block_pool(LeafBlockSpace)
 {
     _channel_num = 0;
     _total_sample_count = 0;
     _is_loop = false;
     _loop_offset = 0;
     _able_free = true;
+    _publish_count = 0;
+    _lockfree_readers = 0;
+    _data_version = 0;
+    _spill_budget = 0;
+    _decode_readers = 0;
+    _search_done = 0;
+    _search_total = 0;
+    _search_canceled = false;
+    _end_deferred = false;
+    _mipmap_base = 0;
+    _mipmap_helpers = 0;
+    _mipmap_ready = 0;
+    _mipmap_filled = 0;
+
+    memset(_mipmap_next, 0, sizeof(_mipmap_next));
+    memset(_mipmap_busy, 0, sizeof(_mipmap_busy));
+    memset(_sparse_decode_cache, 0, sizeof(_sparse_decode_cache));
+    memset(_sparse_store_cache, 0, sizeof(_sparse_store_cache));
 }
 
 LogicSnapshot::~LogicSnapshot()
 {
+    free_data();
 }
 
 void LogicSnapshot::free_data()
 {
+    unpublish_blocks();
+    wait_mipmap(true);
+    _end_deferred = false;
+    _data_version++;
     Snapshot::free_data();
 
     for(auto& iter : _ch_data) {
         for(auto& iter_rn : iter) {
             for (unsigned int k = 0; k < Scale; k++){
-                if (iter_rn.lbp[k] != NULL)
-                    free(iter_rn.lbp[k]);
+                free_leaf_block(iter_rn, k);
             }
         }
         std::vector<struct RootNode> void_vector;
@@ -79,8 +106,20 @@ void LogicSnapshot::free_data()
     _ch_data.clear();
     _sample_count = 0;
 
-    for(void *p : _free_block_list){
-        free(p);
+    for (int i = 0; i < CHANNEL_MAX_COUNT; i++){
+        for (int r = 0; r < MaxDecodeReaders; r++){
+            if (_sparse_decode_cache[r][i].buf != NULL)
+                free(_sparse_decode_cache[r][i].buf);
+        }
+        if (_sparse_store_cache[i].buf != NULL)
+            free(_sparse_store_cache[i].buf);
+    }
+    memset(_sparse_decode_cache, 0, sizeof(_sparse_decode_cache));
+    memset(_sparse_store_cache, 0, sizeof(_sparse_store_cache));
+
+    std::lock_guard<std::mutex> lock(_free_list_mutex);
+    for(auto &b : _free_block_list){
+        _block_pool.release(b.lbp);
     }
     _free_block_list.clear();
 }
@@ -102,9 +141,19 @@ void LogicSnapshot::init_all()
     _last_ended = true;
     _loop_offset = 0;
     _able_free = true;
+    unpublish_blocks();
+    _data_version++;
 }
 
 void LogicSnapshot::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    free_data();
+    init_all();
+    _block_pool.trim(0);
+}
+
+void LogicSnapshot::recycle()
 {
     std::lock_guard<std::mutex> lock(_mutex);
     free_data();
@@ -113,15 +162,26 @@ void LogicSnapshot::clear()
 
 void LogicSnapshot::first_payload(const sr_datafeed_logic &logic, uint64_t total_sample_count, GSList *channels, bool able_free)
 {
+    std::lock_guard<std::mutex> lock(_mutex);
+
     bool channel_changed = false;
     uint16_t channel_num = 0;
+
+    // The blocks are freed or refilled, no reader may be on them
+    unpublish_blocks();
+    wait_mipmap();
+
     _able_free = able_free;
     _lst_free_block_index = 0;
+    _data_version++;
 
-    for(void *p : _free_block_list){
-        free(p);
+    {
+        std::lock_guard<std::mutex> lock(_free_list_mutex);
+        for(auto &b : _free_block_list){
+            _block_pool.release(b.lbp);
+        }
+        _free_block_list.clear();
     }
-    _free_block_list.clear();
 
     for (const GSList *l = channels; l; l = l->next) {
         sr_channel *const probe = (sr_channel*)l->data;
@@ -158,7 +218,10 @@ void LogicSnapshot::first_payload(const sr_datafeed_logic &logic, uint64_t total
                     rn.tog = 0;
                     rn.first = 0;
                     rn.last = 0;
+                    rn.sparse = 0;
                     memset(rn.lbp, 0, sizeof(rn.lbp));
+                    memset(rn.edge_cnt, 0, sizeof(rn.edge_cnt));
+                    memset(rn.edge_pre, 0, sizeof(rn.edge_pre));
                     root_vector.push_back(rn);
                 }
                
@@ -173,10 +236,12 @@ void LogicSnapshot::first_payload(const sr_datafeed_logic &logic, uint64_t total
                 iter_rn.tog = 0;
                 iter_rn.first = 0;
                 iter_rn.last = 0;
+                memset(iter_rn.edge_cnt, 0, sizeof(iter_rn.edge_cnt));
+                memset(iter_rn.edge_pre, 0, sizeof(iter_rn.edge_pre));
 
+                // back to the pool, this capture takes them again
                 for (int j=0; j<64; j++){
-                    if (iter_rn.lbp[j] != NULL)
-                        memset(iter_rn.lbp[j], 0, LeafBlockSpace);
+                    free_leaf_block(iter_rn, j);
                 }
             }
         }
@@ -184,18 +249,36 @@ void LogicSnapshot::first_payload(const sr_datafeed_logic &logic, uint64_t total
 
     assert(_channel_num < CHANNEL_MAX_COUNT);
 
+    // No block is in use now, a changed budget takes effect
+    _block_pool.set_spill(_spill_budget, _spill_dir);
+
+    // Keep as many cached blocks as this capture can use
+    _block_pool.trim(_channel_num * ((_total_sample_count + LeafBlockSamples - 1) / LeafBlockSamples + 1));
+
     _sample_count = 0;
     _ring_sample_count = 0;
 
+    {
+        std::lock_guard<std::mutex> lock(_mipmap_mutex);
+        _mipmap_spans.clear();
+        _mipmap_base = 0;
+        _mipmap_ready = 0;
+        memset(_mipmap_next, 0, sizeof(_mipmap_next));
+    }
+
     for (unsigned int i = 0; i < _channel_num; i++) {
         _last_sample[i] = 0;
         _last_calc_count[i] = 0;
-        _cur_ref_block_indexs[i].root_index = 0;
-        _cur_ref_block_indexs[i].lbp_index = 0;
+        for (int r = 0; r < MaxDecodeReaders; r++){
+            _cur_ref_block_indexs[r][i].root_index = 0;
+            _cur_ref_block_indexs[r][i].lbp_index = 0;
+        }
     }
 
-    append_payload(logic);
+    // The first block is in filling, it is not published
     _last_ended = false;
+    append_cross_payload(logic);
+    publish_blocks();
 }
 
 void LogicSnapshot::append_payload(const sr_datafeed_logic &logic)
@@ -203,6 +286,75 @@ void LogicSnapshot::append_payload(const sr_datafeed_logic &logic)
     std::lock_guard<std::mutex> lock(_mutex);
 
     append_cross_payload(logic);
+    publish_blocks();
+
+    // The loop ring moves the sample window on every payload
+    if (_is_loop)
+        _data_version++;
+}
+
+void LogicSnapshot::publish_blocks()
+{
+    uint64_t count = 0;
+
+    // A loop capture frees and moves the head blocks, keep the readers locked.
+    if (!_is_loop && _loop_offset == 0)
+        count = _last_ended ? _ring_sample_count : (_ring_sample_count & ~LeafMask);
+
+    std::lock_guard<std::mutex> lock(_mipmap_mutex);
+    _mipmap_filled.store(count, std::memory_order_release);
+    publish_ready();
+}
+
+void LogicSnapshot::publish_ready()
+{
+    // A filled block is published once all channels have its mipmap
+    uint64_t count = min(_mipmap_filled.load(std::memory_order_relaxed), _mipmap_ready);
+
+    if (count != _publish_count.load(std::memory_order_relaxed)){
+        _publish_count.store(count, std::memory_order_release);
+        _mipmap_cond.notify_all();
+    }
+}
+
+void LogicSnapshot::unpublish_blocks()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mipmap_mutex);
+        _mipmap_filled.store(0, std::memory_order_relaxed);
+
+        // A reader counts itself before it checks the count, so either it
+        // sees nothing published and waits on the lock, or it is waited for.
+        _publish_count.store(0, std::memory_order_seq_cst);
+        _mipmap_cond.notify_all();
+    }
+
+    while (_lockfree_readers.load(std::memory_order_seq_cst) > 0)
+        std::this_thread::yield();
+}
+
+LogicSnapshot::ReadLock::ReadLock(LogicSnapshot *snapshot, uint64_t index) :
+    _snapshot(snapshot),
+    _lock(snapshot->_mutex, std::defer_lock)
+{
+    _snapshot->wait_block_ready(index);
+
+    _snapshot->_lockfree_readers.fetch_add(1, std::memory_order_seq_cst);
+    _lockfree = index < _snapshot->_publish_count.load(std::memory_order_seq_cst);
+
+    if (!_lockfree){
+        _snapshot->_lockfree_readers.fetch_sub(1, std::memory_order_release);
+        _lock.lock();
+
+        // The block in filling has the mipmap of the spans queued so far
+        _snapshot->wait_mipmap();
+    }
+}
+
+LogicSnapshot::ReadLock::~ReadLock()
+{
+    if (_lockfree)
+        _snapshot->_lockfree_readers.fetch_sub(1, std::memory_order_release);
 }
 
 void LogicSnapshot::append_cross_payload(const sr_datafeed_logic &logic)
@@ -235,6 +387,8 @@ void LogicSnapshot::append_cross_payload(const sr_datafeed_logic &logic)
     if (_is_loop)
     {
         if (_loop_offset + samples >= LeafBlockSamples * Scale){        
+            // The head blocks are freed, their mipmap must be done
+            wait_mipmap();
             move_first_node_to_last();
             _loop_offset -= LeafBlockSamples * Scale;
             _lst_free_block_index = 0;
@@ -242,11 +396,12 @@ void LogicSnapshot::append_cross_payload(const sr_datafeed_logic &logic)
         else{
             int free_count = _loop_offset / LeafBlockSamples;
             if (free_count > _lst_free_block_index){
+                wait_mipmap();
                 free_head_blocks(free_count);
             }
         }
     }
- 
+
     _ring_sample_count += _loop_offset;
  
     // bit align
@@ -269,28 +424,23 @@ void LogicSnapshot::append_cross_payload(const sr_datafeed_logic &logic)
 
             _ch_fraction = (_ch_fraction + 1) % _channel_num;
 
-            lbp = _ch_data[_ch_fraction][index0].lbp[index1];
-            if (lbp == NULL){
-                lbp = malloc(LeafBlockSpace);
-                if (lbp == NULL){
-                    dsv_err("LogicSnapshot::append_cross_payload, Malloc memory failed!");
-                    return;
-                }
-                _ch_data[_ch_fraction][index0].lbp[index1] = lbp;
-                memset(lbp, 0, LeafBlockSpace);
-            }
-
-            _dest_ptr = (uint8_t*)lbp + offset;
-
             // To the last channel.
             if (_ch_fraction == 0){
                 _ring_sample_count += Scale;
+                _dest_ptr = NULL;
 
                 if (_ring_sample_count % LeafBlockSamples == 0){
-                    calc_mipmap(_channel_num - 1, index0, index1, LeafBlockSamples, true);
+                    struct MipmapSpan sp = {index0, index1, LeafBlockSamples, true};
+                    calc_mipmap_spans(&sp, 1);
                 }                                
                 break;
-            }                
+            }
+
+            lbp = get_leaf_block(_ch_fraction, index0, index1);
+            if (lbp == NULL)
+                return;
+
+            _dest_ptr = (uint8_t*)lbp + offset;
         }
     } 
 
@@ -300,134 +450,89 @@ void LogicSnapshot::append_cross_payload(const sr_datafeed_logic &logic)
     assert(_ring_sample_count % Scale == 0);
 
     uint64_t align_sample_count = _ring_sample_count;
-    uint64_t *read_ptr = (uint64_t*)data_src_ptr;
-    void *end_read_ptr = (uint8_t*)data_src_ptr + len;
-  
-    uint64_t filled_sample = align_sample_count % LeafBlockSamples;
-    uint64_t old_filled_sample = filled_sample;     
-    uint64_t* chans_read_addr[CHANNEL_MAX_COUNT];
- 
-    for (unsigned int i = 0; i < _channel_num; i++){
-        chans_read_addr[i] = (uint64_t*)data_src_ptr + i; 
-    }
-    
-    uint16_t fill_chan = _ch_fraction;
-    uint16_t last_chan = _ch_fraction;
-    index0 =  align_sample_count / LeafBlockSamples / RootScale;
-    index1 = (align_sample_count / LeafBlockSamples) % RootScale;
-    offset =  align_sample_count % LeafBlockSamples;
-    
-    lbp = _ch_data[fill_chan][index0].lbp[index1];
-    if (lbp == NULL){
-        lbp = malloc(LeafBlockSpace);
-        if (lbp == NULL){
-            dsv_err("LogicSnapshot::append_cross_payload, Malloc memory failed!");
-            return;
+    const uint64_t *read_ptr = (const uint64_t*)data_src_ptr;
+    uint64_t groups = len / 8 / _channel_num;
+    uint64_t* chans_write_addr[CHANNEL_MAX_COUNT];
+    std::vector<struct MipmapSpan> spans;
+
+    // Copy the whole groups, one leaf block span at a time,
+    // the mipmap of the spans is built after the copy
+    while (groups > 0)
+    {
+        index0 =  align_sample_count / LeafBlockSamples / RootScale;
+        index1 = (align_sample_count / LeafBlockSamples) % RootScale;
+        offset =  align_sample_count % LeafBlockSamples;
+
+        uint64_t span = min(groups, (LeafBlockSamples - offset) / Scale);
+
+        // Reserve the blocks of all channels before the copy
+        for (unsigned int i = 0; i < _channel_num; i++){
+            lbp = get_leaf_block(i, index0, index1);
+            if (lbp == NULL)
+                return;
+            chans_write_addr[i] = (uint64_t*)lbp + offset / Scale;
         }
-        _ch_data[fill_chan][index0].lbp[index1] = lbp;
-        memset(lbp, 0, LeafBlockSpace);
-    }
 
-    uint64_t *write_ptr = (uint64_t*)lbp + offset / Scale;
+        pv::simd::deinterleave_u64(read_ptr, chans_write_addr, _channel_num, span);
 
-    while (len >= 8)
-    {     
-        *write_ptr++ = *read_ptr;
-        read_ptr += _channel_num;
-        len -= 8;
-        filled_sample += Scale;
+        read_ptr += span * _channel_num;
+        len -= span * _channel_num * 8;
+        groups -= span;
+        align_sample_count += span * Scale;
 
-        last_chan++;
-        if (last_chan == _channel_num){
-            last_chan = 0;
-        }
-  
-        if (filled_sample == LeafBlockSamples)
-        {
-            calc_mipmap(fill_chan, index0, index1, LeafBlockSamples, true);
-
-            chans_read_addr[fill_chan] = read_ptr;
-            fill_chan = (fill_chan + 1) % _channel_num;
-
-            if (fill_chan == 0)
-                align_sample_count += (filled_sample - old_filled_sample);
-
-            index0 =  align_sample_count / LeafBlockSamples / RootScale;
-            index1 = (align_sample_count / LeafBlockSamples) % RootScale;
-            offset =  align_sample_count % LeafBlockSamples;
-            filled_sample = align_sample_count % LeafBlockSamples;
-            old_filled_sample = filled_sample;
-
-            lbp = _ch_data[fill_chan][index0].lbp[index1];
-            if (lbp == NULL){
-                lbp = malloc(LeafBlockSpace);
-                if (lbp == NULL){
-                    dsv_err("LogicSnapshot::append_cross_payload, Malloc memory failed!");
-                    return;
-                }
-                _ch_data[fill_chan][index0].lbp[index1] = lbp;
-                memset(lbp, 0, LeafBlockSpace);
-            }
-
-            write_ptr = (uint64_t*)lbp + offset / Scale;
-            read_ptr = chans_read_addr[fill_chan];
-        } 
-        else if (read_ptr >= end_read_ptr) 
-        {  
-            calc_mipmap(fill_chan, index0, index1, filled_sample, false);
-
-            fill_chan = (fill_chan + 1) % _channel_num;    
-
-            if (fill_chan == 0)
-                align_sample_count += (filled_sample - old_filled_sample);
-
-            index0 =  align_sample_count / LeafBlockSamples / RootScale;
-            index1 = (align_sample_count / LeafBlockSamples) % RootScale;
-            offset =  align_sample_count % LeafBlockSamples;
-            filled_sample = align_sample_count % LeafBlockSamples;
-            old_filled_sample = filled_sample;
-
-            lbp = _ch_data[fill_chan][index0].lbp[index1];
-            if (lbp == NULL){
-                lbp = malloc(LeafBlockSpace);
-                if (lbp == NULL){
-                    dsv_err("LogicSnapshot::append_cross_payload, Malloc memory failed!");
-                    return;
-                }
-                _ch_data[fill_chan][index0].lbp[index1] = lbp;
-                memset(lbp, 0, LeafBlockSpace);
-            }
-
-            write_ptr = (uint64_t*)lbp + offset / Scale;   
-            read_ptr = chans_read_addr[fill_chan];
-        }
+        struct MipmapSpan sp;
+        sp.index0 = index0;
+        sp.index1 = index1;
+        sp.samples = offset + span * Scale;
+        sp.is_end = (sp.samples == LeafBlockSamples);
+        spans.push_back(sp);
     }
 
+    if (spans.size() > 0)
+        calc_mipmap_spans(&spans[0], spans.size());
+
     _ring_sample_count = align_sample_count;
     _ring_sample_count -= _loop_offset;
 
     if (align_sample_count > _total_sample_count){
+        // The lock free readers add the offset
+        if (_loop_offset == 0)
+            unpublish_blocks();
         _loop_offset = align_sample_count - _total_sample_count;
         _ring_sample_count = _total_sample_count; 
     }
 
-    _ch_fraction = last_chan;
+    // The rest words belong to the leading channels of an incomplete group
+    index0 =  align_sample_count / LeafBlockSamples / RootScale;
+    index1 = (align_sample_count / LeafBlockSamples) % RootScale;
+    offset =  align_sample_count % LeafBlockSamples;
 
-    lbp = _ch_data[_ch_fraction][index0].lbp[index1];
-    if (lbp == NULL){
-        lbp = malloc(LeafBlockSpace);
-        if (lbp == NULL){
-            dsv_err("LogicSnapshot::append_cross_payload, Malloc memory failed!");
+    uint16_t last_chan = 0;
+
+    while (len >= 8){
+        lbp = get_leaf_block(last_chan, index0, index1);
+        if (lbp == NULL)
             return;
-        }
-        _ch_data[_ch_fraction][index0].lbp[index1] = lbp;
-        memset(lbp, 0, LeafBlockSpace);
+
+        *((uint64_t*)lbp + offset / Scale) = *read_ptr++;
+        len -= 8;
+        last_chan++;
     }
 
+    _ch_fraction = last_chan;
+    _dest_ptr = NULL;
+
+    if (_ch_fraction == 0 && len == 0)
+        return;
+
+    lbp = get_leaf_block(_ch_fraction, index0, index1);
+    if (lbp == NULL)
+        return;
+
     _dest_ptr = (uint8_t*)lbp + offset / 8;  
  
     if (len > 0){
-        uint8_t *src_ptr = (uint8_t*)end_read_ptr - len;
+        uint8_t *src_ptr = (uint8_t*)read_ptr;
         _byte_fraction += len;
 
         while (len > 0){
@@ -437,10 +542,54 @@ void LogicSnapshot::append_cross_payload(const sr_datafeed_logic &logic)
     }   
 }
 
+void* LogicSnapshot::get_leaf_block(unsigned int order, uint64_t index0, uint64_t index1)
+{
+    void *lbp = _ch_data[order][index0].lbp[index1];
+
+    if (lbp == NULL){
+        bool zeroed = false;
+        lbp = _block_pool.alloc(zeroed);
+        if (lbp == NULL){
+            _memory_failed = true;
+            dsv_err("LogicSnapshot::get_leaf_block, Malloc memory failed!");
+            return NULL;
+        }
+        // The samples are always written before calc_mipmap() reads them,
+        // only the mipmap levels and edge counts need to start from zero.
+        if (!zeroed)
+            memset((uint8_t*)lbp + LeafBlockSamples / 8, 0, LeafBlockSpace - LeafBlockSamples / 8);
+        _ch_data[order][index0].lbp[index1] = lbp;
+    }
+    else {
+        _block_pool.touch(lbp);
+    }
+
+    return lbp;
+}
+
 void LogicSnapshot::capture_ended()
 {
     std::lock_guard<std::mutex> lock(_mutex);
+    end_capture();
+}
+
+void LogicSnapshot::defer_capture_end()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _end_deferred = true;
+}
+
+void LogicSnapshot::finish_capture_end()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // Cleared by free_data(), the data is gone
+    if (_end_deferred)
+        end_capture();
+}
 
+void LogicSnapshot::end_capture()
+{
     Snapshot::capture_ended();  
 
     _sample_count = _ring_sample_count;
@@ -452,13 +601,17 @@ void LogicSnapshot::capture_ended()
 
     _ring_sample_count -= _loop_offset;
 
+    // The last block carries on from the queued spans
+    wait_mipmap();
+
     if (offset > 0)
     {
-        for (unsigned int chan=0; chan<_channel_num; chan++)
+        pv::WorkerPool::Instance().parallel_for(_channel_num, [&](int chan)
         { 
             if (_ch_data[chan][index0].lbp[index1] == NULL){
                 dsv_err("ERROR:LogicSnapshot::capture_ended(),buffer is null.");
                 assert(false);
+                return;
             }
             const uint64_t *end_ptr = (uint64_t*)_ch_data[chan][index0].lbp[index1] + (LeafBlockSamples / Scale);
             uint64_t *ptr = (uint64_t*)((uint8_t*)_ch_data[chan][index0].lbp[index1] + offset);
@@ -468,8 +621,19 @@ void LogicSnapshot::capture_ended()
             }
 
             calc_mipmap(chan, index0, index1, offset * 8, true);
-        }  
+        });
     }
+
+    {
+        std::lock_guard<std::mutex> lock(_mipmap_mutex);
+        _mipmap_ready = _ring_sample_count;
+    }
+
+    publish_blocks();
+    _data_version++;
+    _end_deferred = false;
+
+    _block_pool.log_stats("LogicSnapshot");
 }
 
 void LogicSnapshot::calc_mipmap(unsigned int order, uint8_t index0, uint8_t index1, uint64_t samples, bool isEnd)
@@ -482,25 +646,36 @@ void LogicSnapshot::calc_mipmap(unsigned int order, uint8_t index0, uint8_t inde
     // level 1
     uint64_t *src_ptr  = (uint64_t*)lbp;
     uint64_t *dest_ptr = (uint64_t*)level1_ptr;
+    uint32_t *cnt_ptr  = (uint32_t*)((uint8_t*)lbp + LeafMapSpace);
     uint8_t offset = 0;
     uint64_t i = 0;
     uint64_t last_count  = _last_calc_count[order];
+    uint32_t edge_cnt = 0;
 
     if (last_count > 0){
         i        =  last_count / Scale;
         offset   =  i % Scale;
         src_ptr  += i;
         dest_ptr += i / Scale;
+        edge_cnt =  _ch_data[order][index0].edge_cnt[index1];
     }
 
     if (i == 0) {
+        // the edges so far, before the last sample is moved to this block
+        _ch_data[order][index0].edge_pre[index1] = leaf_edge_pre(order, index0, index1);
         _last_sample[order] = (*src_ptr & LSB) ? ~0ULL : 0ULL;
     }
 
     for(; i < samples / Scale; i++)
     {
-        if (_last_sample[order] ^ *src_ptr)
+        // edges before each level 1 word
+        if (offset == 0)
+            cnt_ptr[i / Scale] = edge_cnt;
+
+        if (_last_sample[order] ^ *src_ptr){
             *dest_ptr |= (1ULL << offset);
+            edge_cnt += popcount64(*src_ptr ^ ((*src_ptr << 1) | (_last_sample[order] & LSB)));
+        }
 
         _last_sample[order] = *src_ptr & MSB ? ~0ULL : 0ULL;
         src_ptr++;
@@ -512,6 +687,11 @@ void LogicSnapshot::calc_mipmap(unsigned int order, uint8_t index0, uint8_t inde
         }
     }
 
+    if (offset == 0 && i < LeafBlockSamples / Scale)
+        cnt_ptr[i / Scale] = edge_cnt;
+
+    _ch_data[order][index0].edge_cnt[index1] = edge_cnt;
+
     // level 2
     src_ptr  = (uint64_t*)level1_ptr;
     dest_ptr = (uint64_t*)level2_ptr;  
@@ -553,21 +733,26 @@ void LogicSnapshot::calc_mipmap(unsigned int order, uint8_t index0, uint8_t inde
     if ((*((uint64_t*)lbp) & LSB) != 0)
         _ch_data[order][index0].first |= 1ULL << index1;
 
-    if ((*((uint64_t*)lbp + LeafBlockSamples / Scale - 1) & MSB) != 0)
+    // The tail of a block from the pool is not zeroed until it is filled
+    if (samples == LeafBlockSamples && (*((uint64_t*)lbp + LeafBlockSamples / Scale - 1) & MSB) != 0)
         _ch_data[order][index0].last |= 1ULL << index1;
 
     if (*((uint64_t*)level3_ptr) != 0){
         _ch_data[order][index0].tog |= 1ULL << index1;
-    }
-    else if (isEnd){
-        uint64_t ref_root = _cur_ref_block_indexs[order].root_index;
-        uint64_t ref_lbp  = _cur_ref_block_indexs[order].lbp_index;
 
-        if (_able_free || index0 > ref_root || (index0 == ref_root && index1 > ref_lbp))
-            free(_ch_data[order][index0].lbp[index1]);
-        else
-            _free_block_list.push_back(_ch_data[order][index0].lbp[index1]);
+        // Keep the edge positions only for a block with few edges
+        if (isEnd && edge_cnt <= LeafSparseEdges){
+            void *sbp = make_sparse_block((uint64_t*)lbp, edge_cnt);
 
+            if (sbp != NULL){
+                release_filled_block(order, index0, index1);
+                _ch_data[order][index0].lbp[index1] = sbp;
+                _ch_data[order][index0].sparse |= 1ULL << index1;
+            }
+        }
+    }
+    else if (isEnd){
+        release_filled_block(order, index0, index1);
         _ch_data[order][index0].lbp[index1] = NULL;
     }
 
@@ -577,9 +762,300 @@ void LogicSnapshot::calc_mipmap(unsigned int order, uint8_t index0, uint8_t inde
         _last_calc_count[order] = samples;
 } 
 
-const uint8_t *LogicSnapshot::get_samples(uint64_t start_sample, uint64_t &end_sample, int sig_index, void **lbp)
+void LogicSnapshot::calc_mipmap_spans(const struct MipmapSpan *spans, int count)
+{
+    int helpers = 0;
+
+    // The channels have their own mipmap, the helpers on the worker pool
+    // take a channel each and build its spans in order, each carries on
+    // the last. The ingest thread goes on with the next payload.
+    {
+        std::lock_guard<std::mutex> lock(_mipmap_mutex);
+
+        for (int i = 0; i < count; i++)
+            _mipmap_spans.push_back(spans[i]);
+
+        helpers = min((int)_channel_num, max(pv::WorkerPool::Instance().thread_count() - 1, 1));
+        helpers -= _mipmap_helpers;
+        if (helpers > 0)
+            _mipmap_helpers += helpers;
+    }
+
+    for (int i = 0; i < helpers; i++)
+        pv::WorkerPool::Instance().post([this]{ mipmap_helper(true); });
+}
+
+void LogicSnapshot::mipmap_helper(bool posted)
+{
+    std::unique_lock<std::mutex> lock(_mipmap_mutex);
+
+    while (true)
+    {
+        uint64_t queue_end = _mipmap_base + _mipmap_spans.size();
+        unsigned int chan = 0;
+
+        for (; chan < _channel_num; chan++){
+            if (!_mipmap_busy[chan] && _mipmap_next[chan] < queue_end)
+                break;
+        }
+
+        // A span queued after this is left to a new helper
+        if (chan == _channel_num){
+            if (posted){
+                _mipmap_helpers--;
+                _mipmap_cond.notify_all();
+            }
+            return;
+        }
+
+        _mipmap_busy[chan] = true;
+
+        while (_mipmap_next[chan] < queue_end)
+        {
+            struct MipmapSpan sp = _mipmap_spans[_mipmap_next[chan] - _mipmap_base];
+
+            lock.unlock();
+            calc_mipmap(chan, sp.index0, sp.index1, sp.samples, sp.is_end);
+            lock.lock();
+
+            _mipmap_next[chan]++;
+            mipmap_span_done();
+            queue_end = _mipmap_base + _mipmap_spans.size();
+        }
+
+        _mipmap_busy[chan] = false;
+        _mipmap_cond.notify_all();
+    }
+}
+
+void LogicSnapshot::mipmap_span_done()
+{
+    uint64_t done = _mipmap_next[0];
+
+    for (unsigned int i = 1; i < _channel_num; i++)
+        done = min(done, _mipmap_next[i]);
+
+    if (done == _mipmap_base)
+        return;
+
+    // The spans all channels have built, a block is ready with its last span
+    while (_mipmap_base < done){
+        const struct MipmapSpan &sp = _mipmap_spans.front();
+
+        if (sp.is_end)
+            _mipmap_ready = (sp.index0 * RootScale + sp.index1 + 1) * LeafBlockSamples;
+
+        _mipmap_spans.pop_front();
+        _mipmap_base++;
+    }
+
+    publish_ready();
+}
+
+void LogicSnapshot::wait_mipmap(bool helpers)
+{
+    mipmap_helper();
+
+    std::unique_lock<std::mutex> lock(_mipmap_mutex);
+
+    // The busy channels are built by a running helper
+    _mipmap_cond.wait(lock, [&]{
+        if (helpers && _mipmap_helpers > 0)
+            return false;
+        for (unsigned int i = 0; i < _channel_num; i++){
+            if (_mipmap_busy[i])
+                return false;
+        }
+        return true;
+    });
+}
+
+void LogicSnapshot::wait_block_ready(uint64_t index)
+{
+    if (index < _publish_count.load(std::memory_order_acquire)
+        || index >= _mipmap_filled.load(std::memory_order_acquire))
+        return;
+
+    // The helpers may all wait behind the calling thread on the pool
+    mipmap_helper();
+
+    std::unique_lock<std::mutex> lock(_mipmap_mutex);
+    _mipmap_cond.wait(lock, [&]{
+        return index < _publish_count.load(std::memory_order_relaxed)
+            || index >= _mipmap_filled.load(std::memory_order_relaxed);
+    });
+}
+
+void LogicSnapshot::release_filled_block(unsigned int order, uint64_t index0, uint64_t index1)
+{
+    void *lbp = _ch_data[order][index0].lbp[index1];
+
+    if (_able_free){
+        _block_pool.release(lbp);
+        return;
+    }
+
+    // the channels build their mipmap in parallel
+    std::lock_guard<std::mutex> lock(_free_list_mutex);
+    uint32_t readers = 0;
+
+    // The decoders at or after the block may still read it
+    for (int r = 0; r < MaxDecodeReaders; r++){
+        const struct BlockIndex &ref = _cur_ref_block_indexs[r][order];
+
+        if ((_decode_readers & (1U << r))
+            && (index0 < ref.root_index || (index0 == ref.root_index && index1 <= ref.lbp_index)))
+            readers |= 1U << r;
+    }
+
+    if (readers == 0)
+        _block_pool.release(lbp);
+    else
+        _free_block_list.push_back({lbp, readers});
+}
+
+void LogicSnapshot::free_leaf_block(struct RootNode &rn, int pos, uint32_t readers)
+{
+    void *lbp = rn.lbp[pos];
+
+    if (lbp == NULL)
+        return;
+
+    if (rn.sparse & (1ULL << pos)){
+        for (int i = 0; i < CHANNEL_MAX_COUNT; i++){
+            for (int r = 0; r < MaxDecodeReaders; r++){
+                if (_sparse_decode_cache[r][i].sbp == lbp)
+                    _sparse_decode_cache[r][i].sbp = NULL;
+            }
+            if (_sparse_store_cache[i].sbp == lbp)
+                _sparse_store_cache[i].sbp = NULL;
+        }
+        rn.sparse &= ~(1ULL << pos);
+        free(lbp);
+    }
+    else if (readers != 0){
+        std::lock_guard<std::mutex> lock(_free_list_mutex);
+
+        // a reader closed since is done with it
+        readers &= _decode_readers;
+        if (readers == 0)
+            _block_pool.release(lbp);
+        else
+            _free_block_list.push_back({lbp, readers});
+    }
+    else {
+        _block_pool.release(lbp);
+    }
+
+    rn.lbp[pos] = NULL;
+}
+
+uint32_t LogicSnapshot::decode_block_readers(unsigned int order, uint64_t index0, uint64_t index1)
+{
+    uint32_t readers = 0;
+
+    if (_able_free)
+        return 0;
+
+    for (int r = 0; r < MaxDecodeReaders; r++){
+        if ((_decode_readers & (1U << r))
+            && _cur_ref_block_indexs[r][order].root_index == index0
+            && _cur_ref_block_indexs[r][order].lbp_index == index1)
+            readers |= 1U << r;
+    }
+    return readers;
+}
+
+void* LogicSnapshot::make_sparse_block(const uint64_t *lbp, uint32_t edge_cnt)
+{
+    // [edge count][edge positions in the block]
+    uint32_t *sbp = (uint32_t*)malloc((edge_cnt + 1) * sizeof(uint32_t));
+    if (sbp == NULL)
+        return NULL;
+
+    const uint64_t *level1_ptr = lbp + LeafBlockSamples / Scale;
+    uint32_t *pos_ptr = sbp + 1;
+
+    for (uint64_t i = 0; i < LeafBlockSamples / Scale / Scale; i++)
+    {
+        uint64_t word_tog = level1_ptr[i];
+
+        while (word_tog != 0)
+        {
+            uint64_t word = i * Scale + bsf_folded(word_tog);
+            uint64_t pre = (word == 0) ? (lbp[0] & LSB) : (lbp[word - 1] >> (Scale - 1));
+            uint64_t tog = lbp[word] ^ ((lbp[word] << 1) | pre);
+
+            while (tog != 0){
+                *pos_ptr++ = (uint32_t)(word * Scale + bsf_folded(tog));
+                tog &= tog - 1;
+            }
+            word_tog &= word_tog - 1;
+        }
+    }
+
+    sbp[0] = (uint32_t)(pos_ptr - sbp - 1);
+    assert(sbp[0] == edge_cnt);
+
+    return sbp;
+}
+
+uint8_t* LogicSnapshot::expand_sparse_block(struct SparseCache &cache, const uint32_t *sbp, bool first_sample)
+{
+    if (cache.sbp == sbp)
+        return cache.buf;
+
+    if (cache.buf == NULL){
+        cache.buf = (uint8_t*)malloc(LeafBlockSamples / 8);
+        if (cache.buf == NULL){
+            dsv_err("LogicSnapshot::expand_sparse_block, Malloc memory failed!");
+            return NULL;
+        }
+    }
+
+    uint64_t *buf = (uint64_t*)cache.buf;
+    const uint32_t *pos_ptr = sbp + 1;
+    const uint32_t *end_ptr = pos_ptr + sbp[0];
+    uint64_t start = 0;
+    bool sample = first_sample;
+
+    memset(buf, 0, LeafBlockSamples / 8);
+
+    // fill the high runs between edges
+    while (start < LeafBlockSamples)
+    {
+        uint64_t end = (pos_ptr < end_ptr) ? *pos_ptr++ : LeafBlockSamples;
+
+        if (sample){
+            uint64_t i = start;
+            while (i < end && (i & LevelMask[0]) != 0){
+                buf[i >> ScalePower] |= 1ULL << (i & LevelMask[0]);
+                i++;
+            }
+            while (i + Scale <= end){
+                buf[i >> ScalePower] = ~0ULL;
+                i += Scale;
+            }
+            while (i < end){
+                buf[i >> ScalePower] |= 1ULL << (i & LevelMask[0]);
+                i++;
+            }
+        }
+
+        sample = !sample;
+        start = end;
+    }
+
+    cache.sbp = (void*)sbp;
+    return cache.buf;
+}
+
+const uint8_t *LogicSnapshot::get_samples(uint64_t start_sample, uint64_t &end_sample, int sig_index,
+                                          void **lbp, int reader)
 { 
-    std::lock_guard<std::mutex> lock(_mutex);
+    assert(reader >= 0 && reader < MaxDecodeReaders);
+
+    ReadLock lock(this, start_sample);
 
     uint64_t sample_count = _ring_sample_count;
 
@@ -592,7 +1068,6 @@ const uint8_t *LogicSnapshot::get_samples(uint64_t start_sample, uint64_t &end_s
     assert(start_sample <= end_sample);
 
     start_sample += _loop_offset;
-    _ring_sample_count += _loop_offset;
 
     int order = get_ch_order(sig_index);
     uint64_t index0 = start_sample >> (LeafBlockPower + RootScalePower);
@@ -605,36 +1080,42 @@ const uint8_t *LogicSnapshot::get_samples(uint64_t start_sample, uint64_t &end_s
 
     end_sample = min(end_sample + 1, sample_count);
 
-    _ring_sample_count -= _loop_offset;
-
     if (order == -1 || _ch_data[order][index0].lbp[index1] == NULL)
         return NULL;
     else{
+        struct RootNode &rn = _ch_data[order][index0];
+
         if (lbp != NULL)
-            *lbp = _ch_data[order][index0].lbp[index1];
+            *lbp = rn.lbp[index1];
+
+        // The writer checks the decoder positions before it frees a block
+        {
+            std::lock_guard<std::mutex> ref_lock(_free_list_mutex);
+            _cur_ref_block_indexs[reader][order].root_index = index0;
+            _cur_ref_block_indexs[reader][order].lbp_index  = index1;
+        }
 
-        _cur_ref_block_indexs[order].root_index = index0;
-        _cur_ref_block_indexs[order].lbp_index  = index1;
+        if (rn.sparse & (1ULL << index1)){
+            uint8_t *buf = expand_sparse_block(_sparse_decode_cache[reader][order],
+                                    (uint32_t*)rn.lbp[index1], (rn.first >> index1) & 1);
+            return buf != NULL ? buf + offset : NULL;
+        }
         
-        return (uint8_t*)_ch_data[order][index0].lbp[index1] + offset;
+        _block_pool.touch(rn.lbp[index1]);
+        return (uint8_t*)rn.lbp[index1] + offset;
     }
 }
 
 bool LogicSnapshot::get_sample(uint64_t index, int sig_index)
 {
-    std::lock_guard<std::mutex> lock(_mutex);
+    ReadLock lock(this, index);
+
     return get_sample_unlock(index, sig_index);
 }
 
 bool LogicSnapshot::get_sample_unlock(uint64_t index, int sig_index)
 {
-    index += _loop_offset;
-    _ring_sample_count += _loop_offset;
-
-    bool flag = get_sample_self(index, sig_index);
-
-    _ring_sample_count -= _loop_offset;
-    return flag;
+    return get_sample_self(index + _loop_offset, sig_index);
 }
 
 bool LogicSnapshot::get_sample_self(uint64_t index, int sig_index)
@@ -643,7 +1124,7 @@ bool LogicSnapshot::get_sample_self(uint64_t index, int sig_index)
     assert(order != -1);
     assert(_ch_data[order].size() != 0);
 
-    if (index < _ring_sample_count) {
+    if (index < _ring_sample_count + _loop_offset) {
         uint64_t index_mask = 1ULL << (index & LevelMask[0]);
         uint64_t index0 = index >> (LeafBlockPower + RootScalePower);
         uint64_t index1 = (index & RootMask) >> LeafBlockPower;
@@ -652,6 +1133,11 @@ bool LogicSnapshot::get_sample_self(uint64_t index, int sig_index)
         if ((_ch_data[order][index0].tog & root_pos_mask) == 0) {
             return (_ch_data[order][index0].first & root_pos_mask) != 0;
         }
+        else if (_ch_data[order][index0].sparse & root_pos_mask) {
+            const uint32_t *sbp = (uint32_t*)_ch_data[order][index0].lbp[index1];
+            bool first = (_ch_data[order][index0].first & root_pos_mask) != 0;
+            return first ^ (sparse_edges_before(sbp, index & LeafMask) & 1);
+        }
         else {
             uint64_t *lbp = (uint64_t*)_ch_data[order][index0].lbp[index1];
             return *(lbp + ((index & LeafMask) >> ScalePower)) & index_mask;
@@ -671,7 +1157,7 @@ bool LogicSnapshot::get_display_edges(std::vector<std::pair<bool, bool> > &edges
     if (!togs.empty())
         togs.clear();
 
-    std::lock_guard<std::mutex> lock(_mutex);
+    ReadLock lock(this, end);
 
     if (_ring_sample_count == 0)
         return false;
@@ -726,7 +1212,8 @@ bool LogicSnapshot::get_display_edges(std::vector<std::pair<bool, bool> > &edges
 bool LogicSnapshot::get_nxt_edge(uint64_t &index, bool last_sample, uint64_t end,
                       double min_length, int sig_index)
 {
-    std::lock_guard<std::mutex> lock(_mutex);
+    ReadLock lock(this, end);
+
     return get_nxt_edge_unlock(index, last_sample, end, min_length, sig_index);
 }
 
@@ -735,12 +1222,10 @@ bool LogicSnapshot::get_nxt_edge_unlock(uint64_t &index, bool last_sample, uint6
 {
     index += _loop_offset;
     end += _loop_offset;
-    _ring_sample_count += _loop_offset;
 
     bool flag = get_nxt_edge_self(index, last_sample, end, min_length, sig_index);
 
     index -= _loop_offset;
-    _ring_sample_count -= _loop_offset;
 
     return flag;
 }
@@ -758,6 +1243,8 @@ bool LogicSnapshot::get_nxt_edge_self(uint64_t &index, bool last_sample, uint64_
     const unsigned int min_level = max((int)(log2f(min_length) - 1) / (int)ScalePower, 0);
     uint64_t root_index = index >> (LeafBlockPower + RootScalePower);
     uint8_t root_pos = (index & RootMask) >> LeafBlockPower;
+    uint64_t end_root_index = end >> (LeafBlockPower + RootScalePower);
+    uint8_t end_root_pos = (end & RootMask) >> LeafBlockPower;
     bool root_last = (root_index != 0) ? _ch_data[order][root_index-1].last & MSB :
                                          _ch_data[order][0].first & LSB;
     bool edge_hit = false;
@@ -765,7 +1252,9 @@ bool LogicSnapshot::get_nxt_edge_self(uint64_t &index, bool last_sample, uint64_
     // linear search for the next transition on the root level
     for (uint64_t i = root_index; !edge_hit && (index <= end) && i < (uint64_t)_ch_data[order].size(); i++) 
     {
-        uint64_t cur_mask = (~0ULL << root_pos);
+        // never look into the blocks after end, they may be in filling
+        uint64_t end_mask = (i == end_root_index) ? (~0ULL >> (RootScale - end_root_pos - 1)) : ~0ULL;
+        uint64_t cur_mask = (~0ULL << root_pos) & end_mask;
 
         do {
             uint64_t inner_tog = _ch_data[order][i].tog & cur_mask;
@@ -787,7 +1276,10 @@ bool LogicSnapshot::get_nxt_edge_self(uint64_t &index, bool last_sample, uint64_
 
                     if (min_level < ScaleLevel) {
                         uint64_t block_end = min(index | LeafMask, end);
-                        edge_hit = block_nxt_edge(lbp, index, block_end, last_sample, min_level);
+                        if (_ch_data[order][i].sparse & (1ULL << inner_tog_pos))
+                            edge_hit = sparse_nxt_edge((uint32_t*)lbp, index, block_end, last_sample, min_level, sig_index);
+                        else
+                            edge_hit = block_nxt_edge(lbp, index, block_end, last_sample, min_level);
                     }
                     else {
                         edge_hit = true;
@@ -795,7 +1287,7 @@ bool LogicSnapshot::get_nxt_edge_self(uint64_t &index, bool last_sample, uint64_
 
                     if (inner_tog_pos == RootScale - 1)
                         break;
-                    cur_mask = (~0ULL << (inner_tog_pos + 1));
+                    cur_mask = (~0ULL << (inner_tog_pos + 1)) & end_mask;
                 }
             }
             else if (lbp_tog != 0) {
@@ -827,84 +1319,374 @@ bool LogicSnapshot::get_nxt_edge_self(uint64_t &index, bool last_sample, uint64_
 bool LogicSnapshot::get_pre_edge(uint64_t &index, bool last_sample,
                       double min_length, int sig_index)
 {
-    std::lock_guard<std::mutex> lock(_mutex);
+    ReadLock lock(this, index);
 
     index += _loop_offset;
-    _ring_sample_count += _loop_offset;
 
     bool flag = get_pre_edge_self(index, last_sample, min_length, sig_index);
 
-    index = (index < _loop_offset) ? 0 : index - _loop_offset;
-    _ring_sample_count -= _loop_offset;
-    return flag;
+    index = (index < _loop_offset) ? 0 : index - _loop_offset;
+    return flag;
+}
+
+bool LogicSnapshot::get_pre_edge_self(uint64_t &index, bool last_sample,
+    double min_length, int sig_index)
+{
+    assert(index < _ring_sample_count + _loop_offset);
+
+    int order = get_ch_order(sig_index);
+    if (order == -1)
+        return false;
+
+    //const unsigned int min_level = max((int)floorf(logf(min_length) / logf(Scale)) - 1, 1);
+    const unsigned int min_level = max((int)(log2f(min_length) - 1) / (int)ScalePower, 0);
+    int root_index = index >> (LeafBlockPower + RootScalePower);
+    uint8_t root_pos = (index & RootMask) >> LeafBlockPower;
+    bool root_first = _ch_data[order][root_index].last & MSB;
+    bool edge_hit = false;
+
+    // linear search for the previous transition on the root level
+    for (int64_t i = root_index; !edge_hit && i >= 0; i--)
+    {
+        uint64_t cur_mask = (~0ULL >> (RootScale - root_pos - 1));
+
+        do {
+            uint64_t inner_tog = _ch_data[order][i].tog & cur_mask;
+            uint64_t lbp_tog = (_ch_data[order][i].last & cur_mask) ^ ((((uint64_t)root_first << (RootScale - 1)) + (_ch_data[order][i].first >> 1)) & cur_mask);
+            uint8_t inner_tog_pos = bsr64(inner_tog);
+            uint8_t lbp_tog_pos = bsr64(lbp_tog);
+
+            if (inner_tog != 0)
+            {
+                if (lbp_tog != 0) {
+                    // lbp tog before inner tog
+                    edge_hit = lbp_pre_edge(index, i, lbp_tog, lbp_tog_pos, true, inner_tog_pos, last_sample, sig_index);
+                }
+
+                if (!edge_hit) {
+                    uint64_t *lbp = (uint64_t*)_ch_data[order][i].lbp[inner_tog_pos];
+                    uint64_t blk_end = ((i << (LeafBlockPower + RootScalePower)) +
+                                    (inner_tog_pos << LeafBlockPower)) | LeafMask;
+                    index = min(blk_end, index);
+                    if (min_level < ScaleLevel) {
+                        if (_ch_data[order][i].sparse & (1ULL << inner_tog_pos))
+                            edge_hit = sparse_pre_edge((uint32_t*)lbp, index, last_sample, sig_index);
+                        else
+                            edge_hit = block_pre_edge(lbp, index, last_sample, min_level, sig_index);
+                    } else {
+                        edge_hit = true;
+                    }
+                    if (inner_tog_pos == 0)
+                        break;
+                    cur_mask = (~0ULL >> (RootScale - inner_tog_pos));
+                }
+            }
+            else if (lbp_tog != 0) {
+                // lbp tog
+                edge_hit = lbp_pre_edge(index, i, lbp_tog, lbp_tog_pos, false, 0, last_sample, sig_index);
+                if (lbp_tog_pos == 0)
+                    break;
+            }
+            else {
+                break;
+            }
+        }
+        while (!edge_hit);
+
+        root_pos = RootScale - 1;
+        root_first = _ch_data[order][i].first & LSB;
+    }
+
+    return edge_hit;
+}
+
+bool LogicSnapshot::count_edges(uint64_t start, uint64_t end, int sig_index,
+                                uint64_t &rising, uint64_t &falling)
+{
+    rising = 0;
+    falling = 0;
+
+    if (start > end)
+        std::swap(start, end);
+
+    ReadLock lock(this, end);
+
+    int order = get_ch_order(sig_index);
+    if (order == -1 || _ring_sample_count == 0)
+        return false;
+
+    if (end >= _ring_sample_count)
+        return false;
+
+    start += _loop_offset;
+    end += _loop_offset;
+
+    uint64_t edges = edges_before(order, end) - edges_before(order, start);
+    bool start_sample = get_sample_self(start, sig_index);
+    bool end_sample = get_sample_self(end, sig_index);
+
+    // rising and falling edges alternate, the end values decide the odd one
+    rising = (edges + end_sample - start_sample) / 2;
+    falling = edges - rising;
+
+    return true;
+}
+
+uint64_t LogicSnapshot::edges_before(int order, uint64_t index)
+{
+    // count the edges at positions 1..index
+    uint64_t root_index = index >> (LeafBlockPower + RootScalePower);
+    uint8_t root_pos = (index & RootMask) >> LeafBlockPower;
+    const struct RootNode &rn = _ch_data[order][root_index];
+    uint64_t *lbp = (uint64_t*)rn.lbp[root_pos];
+    uint64_t calc_words = LeafBlockSamples / Scale;
+    uint64_t fill_block = (_ring_sample_count + _loop_offset) >> LeafBlockPower;
+
+    // the block in filling only has mipmap up to the last calc
+    if (!_last_ended && (index >> LeafBlockPower) == fill_block)
+        calc_words = _last_calc_count[order] / Scale;
+
+    // a block without a calc has no count of the edges before it yet
+    uint64_t edges = (calc_words == 0) ? leaf_edge_pre(order, root_index, root_pos)
+                                       : rn.edge_pre[root_pos];
+
+    if (lbp != NULL && (rn.sparse & (1ULL << root_pos)))
+        edges += sparse_edges_before((uint32_t*)lbp, index & LeafMask);
+    else if (lbp != NULL)
+        edges += lbp_edges_before(lbp, calc_words, index & LeafMask);
+
+    return edges;
+}
+
+// The edges up to the first sample of a block, from the block before it.
+// The channel mipmap must be calculated up to the end of the block before.
+uint64_t LogicSnapshot::leaf_edge_pre(int order, uint64_t index0, uint64_t index1)
+{
+    if (index0 == 0 && index1 == 0)
+        return 0;
+
+    const struct RootNode &pre_rn = (index1 == 0) ? _ch_data[order][index0 - 1] : _ch_data[order][index0];
+    uint64_t pre_pos = (index1 == 0) ? Scale - 1 : index1 - 1;
+    uint64_t *lbp = (uint64_t*)_ch_data[order][index0].lbp[index1];
+    uint64_t tog = (lbp != NULL) ? ((*lbp ^ _last_sample[order]) & LSB) : 0;
+
+    return pre_rn.edge_pre[pre_pos] + pre_rn.edge_cnt[pre_pos] + tog;
+}
+
+uint64_t LogicSnapshot::lbp_edges_before(uint64_t *lbp, uint64_t calc_words, uint64_t offset)
+{
+    const uint32_t *cnt_ptr = (uint32_t*)((uint8_t*)lbp + LeafMapSpace);
+    uint64_t word = offset >> ScalePower;
+    uint64_t cnt_index = min(word, calc_words) >> ScalePower;
+    uint64_t edges = cnt_ptr[cnt_index];
+
+    for (uint64_t i = cnt_index * Scale; i <= word; i++)
+    {
+        uint64_t pre = (i == 0) ? (lbp[0] & LSB) : (lbp[i - 1] >> (Scale - 1));
+        uint64_t tog = lbp[i] ^ ((lbp[i] << 1) | pre);
+
+        if (i == word)
+            tog &= ~0ULL >> (Scale - 1 - (offset & LevelMask[0]));
+
+        edges += popcount64(tog);
+    }
+
+    return edges;
+}
+
+bool LogicSnapshot::get_edges(uint64_t start, uint64_t end, struct EdgeList *lists, int list_count)
+{
+    for (int i = 0; i < list_count; i++)
+        lists[i].count = 0;
+
+    ReadLock lock(this, end);
+
+    if (_ring_sample_count == 0 || start > end || end >= _ring_sample_count)
+        return false;
+
+    auto task = [&](int i){
+        struct EdgeList &el = lists[i];
+        int order = get_ch_order(el.sig_index);
+
+        if (order == -1 || el.capacity == 0)
+            return;
+
+        el.first = get_sample_self(start + _loop_offset, el.sig_index);
+        el.count = channel_edges(order, start + _loop_offset, end + _loop_offset,
+                                 el.first, el.edges, el.capacity);
+    };
+
+    if (list_count > 1 && end - start >= EdgeTaskSamples){
+        pv::WorkerPool::Instance().parallel_for(list_count, task);
+    }
+    else {
+        for (int i = 0; i < list_count; i++)
+            task(i);
+    }
+
+    return true;
+}
+
+bool LogicSnapshot::find_idle_gap(uint64_t start, uint64_t end, const std::vector<int> &sig_indexes,
+                                  const std::vector<int> &levels, uint64_t min_idle,
+                                  uint64_t &gap_start, uint64_t &gap_end)
+{
+    const int list_count = (int)sig_indexes.size();
+    std::vector<EdgePair> buf(IdleGapEdges * list_count);
+    std::vector<struct EdgeList> lists(list_count);
+    std::vector<uint64_t> edges;
+    uint64_t last = start; // the last edge of all the channels
+
+    if (list_count == 0 || min_idle == 0 || (int)levels.size() != list_count)
+        return false;
+
+    // The channels keep their levels in a gap, the one of its first sample
+    auto at_levels = [&](uint64_t pos){
+        for (int i = 0; i < list_count; i++){
+            if (levels[i] != -1 && get_sample(pos, sig_indexes[i]) != (levels[i] != 0))
+                return false;
+        }
+        return true;
+    };
+
+    while (last < end)
+    {
+        for (int i = 0; i < list_count; i++){
+            lists[i].sig_index = sig_indexes[i];
+            lists[i].edges = &buf[i * IdleGapEdges];
+            lists[i].capacity = IdleGapEdges;
+        }
+
+        if (!get_edges(last, end, lists.data(), list_count))
+            return false;
+
+        // All the edges are known up to the end of the first full list
+        uint64_t known = end;
+        for (auto &el : lists){
+            if (el.count == el.capacity)
+                known = min(known, el.edges[el.count - 1].first);
+        }
+
+        edges.clear();
+        for (auto &el : lists){
+            for (uint64_t i = 0; i < el.count && el.edges[i].first <= known; i++)
+                edges.push_back(el.edges[i].first);
+        }
+        std::sort(edges.begin(), edges.end());
+
+        for (uint64_t pos : edges){
+            if (pos - last >= min_idle && at_levels(last)){
+                gap_start = last;
+                gap_end = pos;
+                return true;
+            }
+            last = pos;
+        }
+
+        if (known == end){
+            if (end + 1 - last >= min_idle && at_levels(last)){
+                gap_start = last;
+                gap_end = end + 1;
+                return true;
+            }
+            break;
+        }
+        last = known;
+    }
+
+    return false;
 }
 
-bool LogicSnapshot::get_pre_edge_self(uint64_t &index, bool last_sample,
-    double min_length, int sig_index)
+uint64_t LogicSnapshot::channel_edges(int order, uint64_t start, uint64_t end, bool level,
+                                      EdgePair *edges, uint64_t capacity)
 {
-    assert(index < _ring_sample_count);
-
-    int order = get_ch_order(sig_index);
-    if (order == -1)
-        return false;
-
-    //const unsigned int min_level = max((int)floorf(logf(min_length) / logf(Scale)) - 1, 1);
-    const unsigned int min_level = max((int)(log2f(min_length) - 1) / (int)ScalePower, 0);
-    int root_index = index >> (LeafBlockPower + RootScalePower);
-    uint8_t root_pos = (index & RootMask) >> LeafBlockPower;
-    bool root_first = _ch_data[order][root_index].last & MSB;
-    bool edge_hit = false;
+    // level is the sample before pos, each edge flips it
+    const uint64_t fill_block = (_ring_sample_count + _loop_offset) >> LeafBlockPower;
+    uint64_t pos = start + 1;
+    uint64_t count = 0;
 
-    // linear search for the previous transition on the root level
-    for (int64_t i = root_index; !edge_hit && i >= 0; i--)
+    while (pos <= end && count < capacity)
     {
-        uint64_t cur_mask = (~0ULL >> (RootScale - root_pos - 1));
-
-        do {
-            uint64_t inner_tog = _ch_data[order][i].tog & cur_mask;
-            uint64_t lbp_tog = (_ch_data[order][i].last & cur_mask) ^ ((((uint64_t)root_first << (RootScale - 1)) + (_ch_data[order][i].first >> 1)) & cur_mask);
-            uint8_t inner_tog_pos = bsr64(inner_tog);
-            uint8_t lbp_tog_pos = bsr64(lbp_tog);
+        uint64_t index0 = pos >> (LeafBlockPower + RootScalePower);
+        uint64_t index1 = (pos & RootMask) >> LeafBlockPower;
+        uint64_t root_pos_mask = 1ULL << index1;
+        const struct RootNode &rn = _ch_data[order][index0];
+        const uint64_t blk_start = pos & ~LeafMask;
+        const uint64_t blk_end = min(blk_start | LeafMask, end);
+        void *lbp = rn.lbp[index1];
+        bool sparse = (rn.sparse & root_pos_mask) != 0;
+
+        // the edge across the blocks
+        if (pos == blk_start){
+            bool first = (lbp != NULL && !sparse) ? (*(uint64_t*)lbp & LSB) != 0
+                                                  : (rn.first & root_pos_mask) != 0;
+            if (first != level){
+                level = first;
+                edges[count++] = EdgePair(pos - _loop_offset, level);
+                if (count == capacity)
+                    break;
+            }
+        }
 
-            if (inner_tog != 0)
+        if (lbp == NULL){
+            // no edge inside the block
+        }
+        else if (sparse){
+            const uint32_t *pos_ptr = (uint32_t*)lbp + 1;
+            const uint32_t *end_ptr = pos_ptr + ((uint32_t*)lbp)[0];
+            const uint32_t *p = std::lower_bound(pos_ptr, end_ptr, (uint32_t)(pos & LeafMask));
+
+            for (; p < end_ptr && blk_start + *p <= blk_end && count < capacity; p++){
+                level = !level;
+                edges[count++] = EdgePair(blk_start + *p - _loop_offset, level);
+            }
+        }
+        else {
+            const uint64_t *lbp64 = (uint64_t*)lbp;
+            const uint64_t *level1_ptr = lbp64 + LeafBlockSamples / Scale;
+            // the mipmap of the block in filling may lag behind the samples
+            const bool skip = _last_ended || (pos >> LeafBlockPower) != fill_block;
+            uint64_t w = (pos & LeafMask) >> ScalePower;
+            const uint64_t w_end = (blk_end & LeafMask) >> ScalePower;
+
+            while (w <= w_end && count < capacity)
             {
-                if (lbp_tog != 0) {
-                    // lbp tog before inner tog
-                    edge_hit = lbp_pre_edge(index, i, lbp_tog, lbp_tog_pos, true, inner_tog_pos, last_sample, sig_index);
-                }
-
-                if (!edge_hit) {
-                    uint64_t *lbp = (uint64_t*)_ch_data[order][i].lbp[inner_tog_pos];
-                    uint64_t blk_end = ((i << (LeafBlockPower + RootScalePower)) +
-                                    (inner_tog_pos << LeafBlockPower)) | LeafMask;
-                    index = min(blk_end, index);
-                    if (min_level < ScaleLevel) {
-                        edge_hit = block_pre_edge(lbp, index, last_sample, min_level, sig_index);
-                    } else {
-                        edge_hit = true;
+                // a level 1 bit tells the word differs from the sample before
+                if (skip){
+                    uint64_t words = level1_ptr[w >> ScalePower] & (~0ULL << (w & LevelMask[0]));
+                    if (words == 0){
+                        w = (w | LevelMask[0]) + 1;
+                        continue;
                     }
-                    if (inner_tog_pos == 0)
+                    w = (w & ~LevelMask[0]) + bsf_folded(words);
+                    if (w > w_end)
                         break;
-                    cur_mask = (~0ULL >> (RootScale - inner_tog_pos));
                 }
-            }
-            else if (lbp_tog != 0) {
-                // lbp tog
-                edge_hit = lbp_pre_edge(index, i, lbp_tog, lbp_tog_pos, false, 0, last_sample, sig_index);
-                if (lbp_tog_pos == 0)
-                    break;
-            }
-            else {
-                break;
+
+                const uint64_t cur = lbp64[w];
+                const uint64_t word_start = blk_start + (w << ScalePower);
+                uint64_t tog = cur ^ ((cur << 1) | (level ? LSB : 0));
+
+                if (word_start < pos)
+                    tog &= ~0ULL << (pos - word_start);
+                if (word_start + Scale - 1 > blk_end)
+                    tog &= ~0ULL >> (Scale - 1 - (blk_end - word_start));
+
+                while (tog != 0 && count < capacity){
+                    uint8_t bit = bsf_folded(tog);
+                    edges[count++] = EdgePair(word_start + bit - _loop_offset, (cur >> bit) & LSB);
+                    tog &= tog - 1;
+                }
+
+                level = (cur & MSB) != 0;
+                w++;
             }
         }
-        while (!edge_hit);
 
-        root_pos = RootScale - 1;
-        root_first = _ch_data[order][i].first & LSB;
+        pos = blk_start + LeafBlockSamples;
     }
 
-    return edge_hit;
+    return count;
 }
 
 bool LogicSnapshot::lbp_nxt_edge(uint64_t &index, uint64_t root_index, uint64_t lbp_tog, uint8_t lbp_tog_pos,
@@ -1206,20 +1988,81 @@ bool LogicSnapshot::block_pre_edge(uint64_t *lbp, uint64_t &index, bool last_sam
     return (index >= block_start) && (index != 0);
 }
 
+bool LogicSnapshot::sparse_nxt_edge(const uint32_t *sbp, uint64_t &index, uint64_t block_end, bool last_sample,
+                                    unsigned int min_level, int sig_index)
+{
+    const uint32_t *pos_ptr = sbp + 1;
+    const uint32_t *end_ptr = pos_ptr + sbp[0];
+    const uint64_t blk_start = index & ~LeafMask;
+    const uint32_t *edge_ptr;
+
+    if (min_level == 0) {
+        if (get_sample_self(index, sig_index) != last_sample)
+            return (index <= block_end);
+        edge_ptr = std::upper_bound(pos_ptr, end_ptr, (uint32_t)(index & LeafMask));
+    }
+    else {
+        // same as block_nxt_edge(), search from the next group of min_level
+        index = ((index >> min_level*ScalePower) + 1) << min_level*ScalePower;
+        if (index - blk_start >= LeafBlockSamples)
+            return false;
+        edge_ptr = std::lower_bound(pos_ptr, end_ptr, (uint32_t)(index & LeafMask));
+    }
+
+    if (edge_ptr == end_ptr) {
+        index = blk_start + LeafBlockSamples;
+        return false;
+    }
+
+    index = blk_start + ((*edge_ptr >> min_level*ScalePower) << min_level*ScalePower);
+    return (index <= block_end);
+}
+
+bool LogicSnapshot::sparse_pre_edge(const uint32_t *sbp, uint64_t &index, bool last_sample, int sig_index)
+{
+    const uint32_t *pos_ptr = sbp + 1;
+    const uint32_t *end_ptr = pos_ptr + sbp[0];
+    const uint64_t blk_start = index & ~LeafMask;
+
+    if (get_sample_self(index, sig_index) != last_sample) {
+        index++;
+        return true;
+    }
+
+    // the last edge not after index
+    const uint32_t *edge_ptr = std::upper_bound(pos_ptr, end_ptr, (uint32_t)(index & LeafMask));
+
+    if (edge_ptr == pos_ptr) {
+        index = blk_start;
+        return false;
+    }
+
+    index = blk_start + *(edge_ptr - 1);
+    return true;
+}
+
+uint64_t LogicSnapshot::sparse_edges_before(const uint32_t *sbp, uint64_t offset)
+{
+    const uint32_t *pos_ptr = sbp + 1;
+    return std::upper_bound(pos_ptr, pos_ptr + sbp[0], (uint32_t)offset) - pos_ptr;
+}
+
 bool LogicSnapshot::pattern_search(int64_t start, int64_t end, int64_t& index,
                         std::map<uint16_t, QString> &pattern, bool isNext)
 {
-    std::lock_guard<std::mutex> lock(_mutex);
+    ReadLock lock(this, (uint64_t)max(end, index));
+
+    _search_canceled = false;
+    _search_done = 0;
+    _search_total = 0;
     
     start += _loop_offset;
     end += _loop_offset;
     index += _loop_offset;
-    _ring_sample_count += _loop_offset;
 
     bool flag = pattern_search_self(start, end, index, pattern, isNext);
 
     index -= _loop_offset;
-    _ring_sample_count -= _loop_offset;
     return flag;
 }
 
@@ -1233,6 +2076,7 @@ bool LogicSnapshot::pattern_search_self(int64_t start, int64_t end, int64_t &ind
     char flagList[CHANNEL_MAX_COUNT];
     char lstValues[CHANNEL_MAX_COUNT];
     int  chanIndexs[CHANNEL_MAX_COUNT];
+    struct SearchChannel chans[CHANNEL_MAX_COUNT];
     int  count = 0;  
     bool bEdgeFlag = false;
 
@@ -1246,6 +2090,8 @@ bool LogicSnapshot::pattern_search_self(int64_t start, int64_t end, int64_t &ind
          if (flag != 'X' && has_data(channel)){
              flagList[count]  = flag;
              chanIndexs[count] = channel;
+             chans[count].order = get_ch_order(channel);
+             chans[count].flag = flag;
              count++;
 
              if (flag == 'R' || flag == 'F' || flag == 'C'){
@@ -1258,7 +2104,6 @@ bool LogicSnapshot::pattern_search_self(int64_t start, int64_t end, int64_t &ind
     }  
 
     //find
-    bool ret = false;
     char val = 0;
     int macthed = 0;  
 
@@ -1277,60 +2122,341 @@ bool LogicSnapshot::pattern_search_self(int64_t start, int64_t end, int64_t &ind
         index = end;
     }
 
-    while (index != to)
+    if (index == to){
+        return false;
+    }
+
+    // The first position compares with the samples at the start index,
+    // check it alone.
+    for (int i = 0; i < count; i++)
     {
-        macthed = 0;
+        val = (char)get_sample_self(index, chanIndexs[i]);
 
-        for (int i = 0; i < count; i++)
+        if (flagList[i] == '0')
+        {
+            macthed += !val;
+        }
+        else if (flagList[i] == '1')
+        {
+            macthed += val;
+        } 
+        else if (flagList[i] == 'R')
+        {
+            if (isNext)
+                macthed += (lstValues[i] == 0 && val == 1);
+            else
+                macthed += (lstValues[i] == 1 && val == 0);
+        }
+        else if (flagList[i] == 'F')
         {
-            val = (char)get_sample_self(index, chanIndexs[i]);
+            if (isNext)
+                macthed += (lstValues[i] == 1 && val == 0);
+            else
+                macthed += (lstValues[i] == 0 && val == 1);
+        }
+        else if (flagList[i] == 'C')
+        {   
+            macthed += (lstValues[i] != val);
+        }
+    }
 
-            if (flagList[i] == '0')
-            {
-                macthed += !val;
-            }
-            else if (flagList[i] == '1')
-            {
-                macthed += val;
-            } 
-            else if (flagList[i] == 'R')
-            {
-                if (isNext)
-                    macthed += (lstValues[i] == 0 && val == 1);
+    if (macthed == count)
+    {
+        if (!isNext){
+            index++; //move to prev position
+        }
+        return true;
+    }
+
+    index += step;
+    if (index == to){
+        return false;
+    }
+
+    // The others compare with their neighbour, check 64 samples a time
+    uint64_t pos = 0;
+    bool ret = isNext ? pattern_search_words(index, end, pos, chans, count, true)
+                      : pattern_search_words(start, index, pos, chans, count, false);
+
+    if (ret){
+        index = pos;
+        if (!isNext){
+            index++; //move to prev position
+        }
+    }
+
+    return ret;
+}
+
+bool LogicSnapshot::pattern_search_words(uint64_t lo, uint64_t hi, uint64_t &index,
+                    const struct SearchChannel *chans, int count, bool isNext)
+{
+    const uint64_t GroupSamples = Scale * Scale;
+    uint64_t root_index = ~0ULL;
+    uint64_t dead = 0;
+    uint64_t edge_only = 0;
+    uint64_t pos = isNext ? lo : hi;
+
+    _search_total = hi - lo + 1;
+
+    while (pos >= lo && pos <= hi)
+    {
+        if (_search_canceled)
+            return false;
+
+        _search_done = isNext ? pos - lo : hi - pos;
+
+        uint64_t index0 = pos >> (LeafBlockPower + RootScalePower);
+        uint8_t index1 = (pos & RootMask) >> LeafBlockPower;
+        uint64_t root_start = index0 << (LeafBlockPower + RootScalePower);
+
+        // A block where a channel keeps the wrong level can not match,
+        // one where an edge channel does not toggle only at its boundary.
+        if (index0 != root_index){
+            root_index = index0;
+            dead = 0;
+            edge_only = 0;
+
+            for (int i = 0; i < count; i++){
+                const struct RootNode &rn = _ch_data[chans[i].order][index0];
+
+                if (chans[i].flag == '0')
+                    dead |= ~rn.tog & rn.first;
+                else if (chans[i].flag == '1')
+                    dead |= ~rn.tog & ~rn.first;
                 else
-                    macthed += (lstValues[i] == 1 && val == 0);
+                    edge_only |= ~rn.tog;
+            }
+        }
+
+        uint64_t live = isNext ? ~dead & (~0ULL << index1)
+                               : ~dead & (~0ULL >> (RootScale - 1 - index1));
+        if (live == 0){
+            // skip the rest of the root node
+            if (isNext)
+                pos = root_start + RootNodeSamples;
+            else if (root_start == 0)
+                break;
+            else
+                pos = root_start - 1;
+            continue;
+        }
+
+        uint8_t live_pos = isNext ? bsf_folded(live) : bsr64(live);
+        if (live_pos != index1){
+            uint64_t blk_start = root_start + ((uint64_t)live_pos << LeafBlockPower);
+            pos = isNext ? blk_start : (blk_start | LeafMask);
+            continue;
+        }
+
+        uint64_t blk_start = pos & ~LeafMask;
+        uint64_t blk_end = blk_start | LeafMask;
+
+        if (edge_only & (1ULL << index1)){
+            uint64_t edge_pos = isNext ? blk_start : blk_end;
+
+            if (edge_pos == pos){
+                uint64_t match = pattern_match_word(edge_pos & ~LevelMask[0], chans, count, isNext);
+                if (match & (1ULL << (edge_pos & LevelMask[0]))){
+                    index = edge_pos;
+                    return true;
+                }
             }
-            else if (flagList[i] == 'F')
+        }
+        else {
+            uint64_t first = isNext ? pos : max(lo, blk_start);
+            uint64_t last = isNext ? min(hi, blk_end) : pos;
+            uint64_t group = isNext ? (first & ~(GroupSamples - 1)) : (last & ~(GroupSamples - 1));
+
+            while (group >= blk_start && group <= last)
             {
+                uint64_t cand = pattern_candidate_words(group, chans, count, isNext);
+
+                // drop the words out of range
+                if (group < first)
+                    cand &= ~0ULL << ((first - group) >> ScalePower);
+                if (group + GroupSamples - 1 > last)
+                    cand &= ~0ULL >> (Scale - 1 - ((last - group) >> ScalePower));
+
+                while (cand != 0)
+                {
+                    uint8_t word_pos = isNext ? bsf_folded(cand) : bsr64(cand);
+                    uint64_t word_start = group + ((uint64_t)word_pos << ScalePower);
+                    uint64_t match = pattern_match_word(word_start, chans, count, isNext);
+
+                    if (word_start < first)
+                        match &= ~0ULL << (first - word_start);
+                    if (word_start + Scale - 1 > last)
+                        match &= ~0ULL >> (Scale - 1 - (last - word_start));
+
+                    if (match != 0){
+                        index = word_start + (isNext ? bsf_folded(match) : bsr64(match));
+                        return true;
+                    }
+
+                    cand &= ~(1ULL << word_pos);
+                }
+
+                if (_search_canceled)
+                    return false;
+
                 if (isNext)
-                    macthed += (lstValues[i] == 1 && val == 0);
+                    group += GroupSamples;
+                else if (group == blk_start)
+                    break;
                 else
-                    macthed += (lstValues[i] == 0 && val == 1);
+                    group -= GroupSamples;
             }
-            else if (flagList[i] == 'C')
-            {   
-                if (isNext)
-                    macthed += (lstValues[i] == 0 && val == 1) || (lstValues[i] == 1 && val == 0);
-                else
-                    macthed += (lstValues[i] == 1 && val == 0) || (lstValues[i] == 0 && val == 1);
+        }
+
+        if (isNext)
+            pos = blk_end + 1;
+        else if (blk_start == 0)
+            break;
+        else
+            pos = blk_start - 1;
+    }
+
+    _search_done = _search_total.load();
+    return false;
+}
+
+uint64_t LogicSnapshot::pattern_candidate_words(uint64_t group_start, const struct SearchChannel *chans,
+                    int count, bool isNext)
+{
+    const uint64_t GroupSamples = Scale * Scale;
+    uint64_t index0 = group_start >> (LeafBlockPower + RootScalePower);
+    uint64_t index1 = (group_start & RootMask) >> LeafBlockPower;
+    uint64_t blk_start = group_start & ~LeafMask;
+    uint64_t fill_block = (_ring_sample_count + _loop_offset) >> LeafBlockPower;
+    uint64_t cand = ~0ULL;
+
+    // the mipmap of the block in filling may lag behind the samples
+    if (!_last_ended && (group_start >> LeafBlockPower) == fill_block)
+        return cand;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (chans[i].flag == '0' || chans[i].flag == '1')
+            continue;
+
+        const struct RootNode &rn = _ch_data[chans[i].order][index0];
+        uint64_t words = 0;
+
+        if (rn.sparse & (1ULL << index1)){
+            const uint32_t *pos_ptr = (uint32_t*)rn.lbp[index1] + 1;
+            const uint32_t *pos_end = pos_ptr + pos_ptr[-1];
+            uint64_t offset = group_start & LeafMask;
+            const uint32_t *p = std::lower_bound(pos_ptr, pos_end, (uint32_t)offset);
+
+            // backward, an edge at p matches the sample at p - 1
+            for (; p < pos_end && *p < offset + GroupSamples + !isNext; p++)
+                words |= 1ULL << (((*p - offset - !isNext) >> ScalePower) & (Scale - 1));
+        }
+        else {
+            // a level 1 bit tells the word has a different sample from the last one
+            const uint64_t *level1_ptr = (uint64_t*)((uint8_t*)rn.lbp[index1] + LeafBlockSamples / 8);
+            words = level1_ptr[(group_start & LeafMask) >> (2 * ScalePower)];
+
+            if (!isNext)
+                words |= words >> 1;
+        }
+
+        // the edges across the block or group boundary are not recorded above
+        if (isNext && group_start == blk_start)
+            words |= LSB;
+        if (!isNext)
+            words |= MSB;
+
+        cand &= words;
+    }
+
+    return cand;
+}
+
+uint64_t LogicSnapshot::pattern_match_word(uint64_t word_start, const struct SearchChannel *chans,
+                    int count, bool isNext)
+{
+    uint64_t match = ~0ULL;
+
+    for (int i = 0; i < count && match != 0; i++)
+    {
+        uint64_t cur = get_sample_word(chans[i].order, word_start);
+        uint64_t adj = 0;
+
+        // forward the sample before each one, backward the sample after
+        if (chans[i].flag != '0' && chans[i].flag != '1'){
+            if (isNext){
+                adj = cur << 1;
+                if (word_start > 0)
+                    adj |= get_sample_word(chans[i].order, word_start - Scale) >> (Scale - 1);
+            }
+            else {
+                adj = cur >> 1;
+                if (word_start + Scale < _ring_sample_count + _loop_offset)
+                    adj |= get_sample_word(chans[i].order, word_start + Scale) << (Scale - 1);
             }
-            lstValues[i] = val;
         }
 
-        // matched all
-        if (macthed == count)
+        switch (chans[i].flag)
         {
-            ret = true;
-            if (!isNext){
-                index++; //move to prev position
-            }
+        case '0':
+            match &= ~cur;
+            break;
+        case '1':
+            match &= cur;
+            break;
+        case 'R':
+            match &= isNext ? (~adj & cur) : (adj & ~cur);
+            break;
+        case 'F':
+            match &= isNext ? (adj & ~cur) : (~adj & cur);
+            break;
+        case 'C':
+            match &= adj ^ cur;
             break;
         }
-
-        index += step;
     }
 
-    return ret;
+    return match;
+}
+
+uint64_t LogicSnapshot::get_sample_word(int order, uint64_t index)
+{
+    uint64_t index0 = index >> (LeafBlockPower + RootScalePower);
+    uint64_t index1 = (index & RootMask) >> LeafBlockPower;
+    uint64_t root_pos_mask = 1ULL << index1;
+    const struct RootNode &rn = _ch_data[order][index0];
+
+    if ((rn.tog & root_pos_mask) == 0)
+        return (rn.first & root_pos_mask) ? ~0ULL : 0ULL;
+    else if (rn.sparse & root_pos_mask)
+        return sparse_sample_word((uint32_t*)rn.lbp[index1], index & LeafMask, (rn.first & root_pos_mask) != 0);
+    else
+        return *((uint64_t*)rn.lbp[index1] + ((index & LeafMask) >> ScalePower));
+}
+
+uint64_t LogicSnapshot::sparse_sample_word(const uint32_t *sbp, uint64_t offset, bool first_sample)
+{
+    const uint32_t *pos_ptr = sbp + 1;
+    const uint32_t *pos_end = pos_ptr + sbp[0];
+    uint64_t word_start = offset & ~LevelMask[0];
+    const uint32_t *p = std::upper_bound(pos_ptr, pos_end, (uint32_t)word_start);
+    bool sample = first_sample ^ ((p - pos_ptr) & 1);
+    uint64_t tog = 0;
+
+    for (; p < pos_end && *p < word_start + Scale; p++)
+        tog |= 1ULL << (*p - word_start);
+
+    // prefix xor turns the edges into the sample levels
+    tog ^= tog << 1;
+    tog ^= tog << 2;
+    tog ^= tog << 4;
+    tog ^= tog << 8;
+    tog ^= tog << 16;
+    tog ^= tog << 32;
+
+    return sample ? ~tog : tog;
 }
 
 bool LogicSnapshot::has_data(int sig_index)
@@ -1400,6 +2526,11 @@ uint8_t *LogicSnapshot::get_block_buf(int block_index, int sig_index, bool &samp
 
     if (lbp == NULL)
         sample = (_ch_data[order][index].first & 1ULL << pos) != 0;
+    else if (_ch_data[order][index].sparse & (1ULL << pos))
+        lbp = expand_sparse_block(_sparse_store_cache[order], (uint32_t*)lbp,
+                                  (_ch_data[order][index].first & 1ULL << pos) != 0);
+    else
+        _block_pool.touch(lbp);
 
     if (lbp != NULL && _loop_offset > 0 && block_index0 == 0)
     {
@@ -1432,15 +2563,20 @@ void LogicSnapshot::move_first_node_to_last()
 
         for (int x=0; x<(int)Scale; x++)
         {
-            if (rn.lbp[x] != NULL){
-                free(rn.lbp[x]);
-                rn.lbp[x] = NULL;
-            }
+            free_leaf_block(rn, x, decode_block_readers(i, 0, x));
+        }
+
+        // the decoder blocks move down with the nodes
+        for (int r = 0; r < MaxDecodeReaders; r++){
+            if (_cur_ref_block_indexs[r][i].root_index > 0)
+                _cur_ref_block_indexs[r][i].root_index--;
         }
 
         rn.tog = 0;
         rn.first = 0;
         rn.last = 0;
+        memset(rn.edge_cnt, 0, sizeof(rn.edge_cnt));
+        memset(rn.edge_pre, 0, sizeof(rn.edge_pre));
 
         _ch_data[i].push_back(rn);                        
     }
@@ -1448,25 +2584,100 @@ void LogicSnapshot::move_first_node_to_last()
 
 void LogicSnapshot::decode_end()
 {
-   std::lock_guard<std::mutex> lock(_mutex);
+    std::lock_guard<std::mutex> lock(_free_list_mutex);
+
+    // The readers still open keep their blocks
+    release_pinned_blocks(~_decode_readers);
+}
+
+int LogicSnapshot::open_decode_reader()
+{
+    std::lock_guard<std::mutex> lock(_free_list_mutex);
+    return take_decode_reader();
+}
+
+int LogicSnapshot::wait_decode_reader(const volatile bool &stop)
+{
+    std::unique_lock<std::mutex> lock(_free_list_mutex);
+    int reader = -1;
+
+    _reader_cond.wait(lock, [&]{
+        return stop || (reader = take_decode_reader()) != -1;
+    });
+    return reader;
+}
+
+void LogicSnapshot::wake_decode_readers()
+{
+    // The waiter checks its flag under the lock, the wakeup is not lost
+    std::lock_guard<std::mutex> lock(_free_list_mutex);
+    _reader_cond.notify_all();
+}
 
-   for(void *p : _free_block_list){
-        free(p);
+// The caller holds _free_list_mutex
+int LogicSnapshot::take_decode_reader()
+{
+    for (int r = 0; r < MaxDecodeReaders; r++){
+        if ((_decode_readers & (1U << r)) == 0){
+            _decode_readers |= 1U << r;
+            memset(_cur_ref_block_indexs[r], 0, sizeof(_cur_ref_block_indexs[r]));
+            return r;
+        }
+    }
+    return -1;
+}
+
+void LogicSnapshot::close_decode_reader(int reader)
+{
+    assert(reader >= 0 && reader < MaxDecodeReaders);
+
+    std::lock_guard<std::mutex> lock(_free_list_mutex);
+
+    _decode_readers &= ~(1U << reader);
+    release_pinned_blocks(1U << reader);
+
+    for (int i = 0; i < CHANNEL_MAX_COUNT; i++){
+        if (_sparse_decode_cache[reader][i].buf != NULL)
+            free(_sparse_decode_cache[reader][i].buf);
+    }
+    memset(_sparse_decode_cache[reader], 0, sizeof(_sparse_decode_cache[reader]));
+
+    _reader_cond.notify_all();
+}
+
+// The caller holds _free_list_mutex
+void LogicSnapshot::release_pinned_blocks(uint32_t readers)
+{
+    for (auto it = _free_block_list.begin(); it != _free_block_list.end();)
+    {
+        it->readers &= ~readers;
+
+        if (it->readers == 0){
+            _block_pool.release(it->lbp);
+            it = _free_block_list.erase(it);
+        }
+        else {
+            it++;
+        }
     }
-    _free_block_list.clear();
 }
 
-void LogicSnapshot::free_decode_lpb(void *lbp)
+void LogicSnapshot::free_decode_lpb(void *lbp, int reader)
 {
     assert(lbp);
+    assert(reader >= 0 && reader < MaxDecodeReaders);
 
-    std::lock_guard<std::mutex> lock(_mutex);
+    std::lock_guard<std::mutex> lock(_free_list_mutex);
 
     for (auto it = _free_block_list.begin(); it != _free_block_list.end(); it++)
     {
-        if ((*it) == lbp){
-            _free_block_list.erase(it);
-            free(lbp);
+        if (it->lbp == lbp){
+            // another decoder may still read it
+            it->readers &= ~(1U << reader);
+            if (it->readers == 0){
+                _block_pool.release(lbp);
+                _free_block_list.erase(it);
+            }
             break;
         }
     }
@@ -1480,15 +2691,12 @@ void LogicSnapshot::free_head_blocks(int count)
     for (int i = 0; i < (int)_channel_num; i++)
     {
         for (int j=_lst_free_block_index; j<count; j++){
-            if (_ch_data[i][0].lbp[j] != NULL){
-                free(_ch_data[i][0].lbp[j]);
-                _ch_data[i][0].lbp[j] = NULL;
-            }
-
-            _ch_data[i][0].tog = (_ch_data[i][0].tog >> count) << count;
-            _ch_data[i][0].first = (_ch_data[i][0].first >> count) << count;
-            _ch_data[i][0].last = (_ch_data[i][0].last >> count) << count;
+            free_leaf_block(_ch_data[i][0], j, decode_block_readers(i, 0, j));
         }
+
+        _ch_data[i][0].tog = (_ch_data[i][0].tog >> count) << count;
+        _ch_data[i][0].first = (_ch_data[i][0].first >> count) << count;
+        _ch_data[i][0].last = (_ch_data[i][0].last >> count) << count;
     }
     _lst_free_block_index = count;
 }
@@ -26,10 +26,15 @@
 
 #include <libsigrok.h> 
 #include "snapshot.h"
+#include "blockpool.h"
 #include <QString>
 #include <utility>
 #include <vector>
 #include <map>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 #define CHANNEL_MAX_COUNT 64
 
@@ -53,12 +58,21 @@ private:
     static const uint64_t ScaleSize = Scale / 8;
     static const uint64_t RootScalePower = ScalePower;
     static const uint64_t RootScale = 1 << RootScalePower;
-    static const uint64_t LeafBlockSpace = (Scale + Scale*Scale +
+    static const uint64_t LeafMapSpace = (Scale + Scale*Scale +
             Scale*Scale*Scale + Scale*Scale*Scale*Scale) / 8;
+    // Edge count before each level 1 word, see calc_mipmap()
+    static const uint64_t LeafCountSpace = Scale*Scale*sizeof(uint32_t);
+    static const uint64_t LeafBlockSpace = LeafMapSpace + LeafCountSpace;
+    // A leaf block with less edges is kept as an edge position list
+    static const uint64_t LeafSparseEdges = 16384;
 
     static const uint64_t LeafBlockPower = ScaleLevel*ScalePower;
     static const uint64_t LeafBlockSamples = 1 << LeafBlockPower;
     static const uint64_t RootNodeSamples = LeafBlockSamples*RootScale;
+    // Smaller ranges get the edges of all channels on the caller thread
+    static const uint64_t EdgeTaskSamples = 1 << 20;
+    // Edges of a channel read at a time by find_idle_gap()
+    static const uint64_t IdleGapEdges = 4096;
 
     static const uint64_t RootMask = ~(~0ULL << RootScalePower) << LeafBlockPower;
     static const uint64_t LeafMask = ~(~0ULL << LeafBlockPower);
@@ -74,7 +88,16 @@ private:
         uint64_t tog;
         uint64_t first;
         uint64_t last;
+        uint64_t sparse; // lbp[i] is a sparse block
         void *lbp[Scale];
+        uint32_t edge_cnt[Scale]; // edges inside each leaf block
+        uint64_t edge_pre[Scale]; // edges up to the first sample of each leaf block
+    };
+
+    struct SparseCache
+    {
+        void    *sbp;
+        uint8_t *buf;
     };
 
     struct BlockIndex
@@ -83,9 +106,43 @@ private:
         uint64_t    lbp_index;
     };
 
+    // A block kept for the decoders that may still read it
+    struct PinnedBlock
+    {
+        void        *lbp;
+        uint32_t    readers;    // bit mask of the decode readers
+    };
+
+    struct MipmapSpan
+    {
+        uint64_t    index0;
+        uint64_t    index1;
+        uint64_t    samples;        // samples in the block after the copy
+        bool        is_end;
+    };
+
+    struct SearchChannel
+    {
+        int     order;
+        char    flag;
+    };
+
 public:
+    // Decoders reading the samples at once, see open_decode_reader()
+    static const int MaxDecodeReaders = 16;
+
     typedef std::pair<uint64_t, bool> EdgePair;
 
+    // One channel of get_edges()
+    struct EdgeList
+    {
+        int         sig_index;
+        EdgePair   *edges;      // caller owned, the position and the new level
+        uint64_t    capacity;
+        uint64_t    count;      // edges filled
+        bool        first;      // the sample at start
+    };
+
 private:
     void init_all();
 
@@ -98,18 +155,31 @@ public:
 
     void clear();
 
+    // Drop the data, the blocks stay in the pool for the next capture
+    void recycle();
+
     void init();   
 
     void first_payload(const sr_datafeed_logic &logic, uint64_t total_sample_count, GSList *channels, bool able_free);
 
 	void append_payload(const sr_datafeed_logic &logic);
 
-    const uint8_t * get_samples(uint64_t start_sample, uint64_t& end_sample, int sig_index, void **lbp=NULL);
+    const uint8_t * get_samples(uint64_t start_sample, uint64_t& end_sample, int sig_index,
+                                void **lbp=NULL, int reader=0);
 
     bool get_sample(uint64_t index, int sig_index);
 
     void capture_ended();
 
+    // The data is complete, finish_capture_end() ends it on another thread.
+    // Until then the last block reads like a block in filling.
+    void defer_capture_end();
+    void finish_capture_end();
+
+    inline bool end_deferred(){
+        return _end_deferred.load();
+    }
+
     bool get_display_edges(std::vector<std::pair<bool, bool>> &edges,
                            std::vector<std::pair<uint16_t, bool>> &togs,
                            uint64_t start, uint64_t end, uint16_t width,
@@ -122,6 +192,21 @@ public:
     bool get_pre_edge(uint64_t &index, bool last_sample,
                       double min_length, int sig_index);
 
+    bool count_edges(uint64_t start, uint64_t end, int sig_index,
+                     uint64_t &rising, uint64_t &falling);
+
+    // Fill each list with the edges of its channel in (start, end], an edge is
+    // a sample that differs from the one before. The channels are scanned in
+    // parallel. A full list goes on with its last edge as the next start.
+    bool get_edges(uint64_t start, uint64_t end, struct EdgeList *lists, int list_count);
+
+    // The first stretch in [start, end] where none of the channels changes for
+    // min_idle samples and each one is at its level, -1 for any level, the
+    // samples of [gap_start, gap_end) keep their levels
+    bool find_idle_gap(uint64_t start, uint64_t end, const std::vector<int> &sig_indexes,
+                       const std::vector<int> &levels, uint64_t min_idle,
+                       uint64_t &gap_start, uint64_t &gap_end);
+
     bool has_data(int sig_index);
     int get_block_num();
     uint64_t get_block_size(int block_index);
@@ -130,6 +215,16 @@ public:
     bool pattern_search(int64_t start, int64_t end, int64_t& index,
                         std::map<uint16_t, QString> &pattern, bool isNext);
 
+    // Samples searched and samples to search of the running pattern search
+    inline std::pair<uint64_t, uint64_t> search_progress(){
+        return std::make_pair(_search_done.load(std::memory_order_relaxed),
+                              _search_total.load(std::memory_order_relaxed));
+    }
+
+    inline void cancel_search(){
+        _search_canceled = true;
+    }
+
     inline void set_loop(bool bLoop){
         _is_loop = bLoop;
     }
@@ -140,7 +235,15 @@ public:
 
     void decode_end();
 
-    void free_decode_lpb(void *lbp);
+    // Each running decoder reads with its own slot, -1 if all are taken
+    int open_decode_reader();
+    void close_decode_reader(int reader);
+
+    // Waits for a free slot, -1 once @stop is set and wake_decode_readers() is called
+    int wait_decode_reader(const volatile bool &stop);
+    void wake_decode_readers();
+
+    void free_decode_lpb(void *lbp, int reader=0);
 
     inline bool is_able_free(){
         return _able_free;
@@ -150,7 +253,47 @@ public:
         return _loop_offset;
     }
 
+    // Changes whenever samples already read may have been replaced
+    inline uint64_t get_data_version(){
+        return _data_version.load(std::memory_order_acquire);
+    }
+
+    inline BlockPool::Stats get_pool_stats(){
+        return _block_pool.get_stats();
+    }
+
+    // Leaf blocks over @budget bytes are paged out to a scratch file in @dir,
+    // 0 keeps them in memory. It takes effect on the next capture.
+    inline void set_memory_budget(uint64_t budget, const std::string &dir){
+        _spill_budget = budget;
+        _spill_dir = dir;
+    }
+
 private:
+    // Samples below the published count sit in completed leaf blocks,
+    // which the writer no longer touches, so they are read without the lock.
+    // A block is published when the helpers have built its mipmap, a reader
+    // of a filled block waits for that, a locked reader for all queued spans.
+    // A lock free reader is counted, the writer takes the published blocks
+    // back with unpublish_blocks() and waits for the readers to leave
+    // before it frees a block or moves the loop offset.
+    class ReadLock
+    {
+    public:
+        ReadLock(LogicSnapshot *snapshot, uint64_t index);
+        ~ReadLock();
+
+    private:
+        LogicSnapshot *_snapshot;
+        std::unique_lock<std::mutex> _lock;
+        bool _lockfree;
+    };
+
+    void publish_blocks();
+
+    // The caller holds _mutex
+    void unpublish_blocks();
+
     bool get_sample_unlock(uint64_t index, int sig_index);
     bool get_sample_self(uint64_t index, int sig_index);
 
@@ -162,15 +305,63 @@ private:
     bool get_pre_edge_self(uint64_t &index, bool last_sample,
                       double min_length, int sig_index);
 
+    uint64_t edges_before(int order, uint64_t index);
+
+    uint64_t leaf_edge_pre(int order, uint64_t index0, uint64_t index1);
+
+    uint64_t lbp_edges_before(uint64_t *lbp, uint64_t calc_words, uint64_t offset);
+
+    uint64_t channel_edges(int order, uint64_t start, uint64_t end, bool level,
+                        EdgePair *edges, uint64_t capacity);
+
     bool pattern_search_self(int64_t start, int64_t end, int64_t& index,
                         std::map<uint16_t, QString> &pattern, bool isNext);
 
+    bool pattern_search_words(uint64_t lo, uint64_t hi, uint64_t &index,
+                        const struct SearchChannel *chans, int count, bool isNext);
+
+    uint64_t pattern_match_word(uint64_t word_start, const struct SearchChannel *chans,
+                        int count, bool isNext);
+
+    uint64_t pattern_candidate_words(uint64_t group_start, const struct SearchChannel *chans,
+                        int count, bool isNext);
+
+    uint64_t get_sample_word(int order, uint64_t index);
+
+    uint64_t sparse_sample_word(const uint32_t *sbp, uint64_t offset, bool first_sample);
+
     int get_ch_order(int sig_index);
 
     void calc_mipmap(unsigned int order, uint8_t index0, uint8_t index1, uint64_t samples, bool isEnd);
 
+    // Queues the mipmap of the spans for all channels and returns,
+    // the caller holds _mutex
+    void calc_mipmap_spans(const struct MipmapSpan *spans, int count);
+
+    // Builds the queued spans of the channels nobody else builds,
+    // a @posted helper is counted in _mipmap_helpers
+    void mipmap_helper(bool posted=false);
+
+    // The caller holds _mipmap_mutex
+    void mipmap_span_done();
+
+    // Waits until the queued spans are built, the calling thread helps.
+    // With @helpers it also waits for the posted helpers to return.
+    void wait_mipmap(bool helpers=false);
+
+    // Waits until the filled block of the sample has its mipmap
+    void wait_block_ready(uint64_t index);
+
+    // The caller holds _mipmap_mutex
+    void publish_ready();
+
     void append_cross_payload(const sr_datafeed_logic &logic);
 
+    // The caller holds _mutex
+    void end_capture();
+
+    void* get_leaf_block(unsigned int order, uint64_t index0, uint64_t index1);
+
     bool lbp_nxt_edge(uint64_t &index, uint64_t root_index, uint64_t lbp_tog, uint8_t lbp_tog_pos,
                       bool aft_tog, uint8_t aft_pos, bool last_sample, int sig_index);
 
@@ -183,6 +374,30 @@ private:
     bool block_pre_edge(uint64_t *lbp, uint64_t &index, bool last_sample,
                         unsigned int min_level, int sig_index);
 
+    bool sparse_nxt_edge(const uint32_t *sbp, uint64_t &index, uint64_t block_end, bool last_sample,
+                        unsigned int min_level, int sig_index);
+
+    bool sparse_pre_edge(const uint32_t *sbp, uint64_t &index, bool last_sample, int sig_index);
+
+    uint64_t sparse_edges_before(const uint32_t *sbp, uint64_t offset);
+
+    void* make_sparse_block(const uint64_t *lbp, uint32_t edge_cnt);
+
+    uint8_t* expand_sparse_block(struct SparseCache &cache, const uint32_t *sbp, bool first_sample);
+
+    void release_filled_block(unsigned int order, uint64_t index0, uint64_t index1);
+
+    // A block read by the @readers is freed when they all move on
+    void free_leaf_block(struct RootNode &rn, int pos, uint32_t readers=0);
+
+    // The decode readers on the block
+    uint32_t decode_block_readers(unsigned int order, uint64_t index0, uint64_t index1);
+
+    void release_pinned_blocks(uint32_t readers);
+
+    // The caller holds _free_list_mutex
+    int take_decode_reader();
+
     inline uint8_t bsf_folded (uint64_t bb)
     {
         static const uint8_t lsb_64_table[64] = {
@@ -201,6 +416,11 @@ private:
         return lsb_64_table[folded * 0x78291ACF >> 26];
     }
 
+    inline uint8_t popcount64(uint64_t bb)
+    {
+        return (uint8_t)__builtin_popcountll(bb);
+    }
+
     inline uint8_t bsr32(uint32_t bb)
     {
         static const uint8_t msb_256_table[256] = {
@@ -249,9 +469,35 @@ private:
     bool        _is_loop;
     uint64_t    _loop_offset;
     bool        _able_free;
-    std::vector<void*> _free_block_list;
-    struct BlockIndex _cur_ref_block_indexs[CHANNEL_MAX_COUNT];
+    std::vector<struct PinnedBlock> _free_block_list;
+    std::mutex  _free_list_mutex;
+    std::condition_variable _reader_cond; // a slot is closed
+    uint32_t    _decode_readers; // the open reader slots
+    struct BlockIndex _cur_ref_block_indexs[MaxDecodeReaders][CHANNEL_MAX_COUNT];
+    struct SparseCache _sparse_decode_cache[MaxDecodeReaders][CHANNEL_MAX_COUNT];
+    struct SparseCache _sparse_store_cache[CHANNEL_MAX_COUNT];
     int         _lst_free_block_index;
+    BlockPool   _block_pool;
+    std::atomic<uint64_t> _publish_count;
+    // The spans queued for the channel mipmaps, _mipmap_next[i] is the next
+    // span of channel i, the spans done by all channels are popped
+    std::deque<struct MipmapSpan> _mipmap_spans;
+    uint64_t    _mipmap_base;
+    uint64_t    _mipmap_next[CHANNEL_MAX_COUNT];
+    bool        _mipmap_busy[CHANNEL_MAX_COUNT];
+    int         _mipmap_helpers;    // posted and not returned
+    uint64_t    _mipmap_ready;      // the blocks before have their mipmap
+    std::atomic<uint64_t> _mipmap_filled; // the blocks before can be published
+    std::mutex  _mipmap_mutex;
+    std::condition_variable _mipmap_cond;
+    std::atomic<int> _lockfree_readers;
+    std::atomic<uint64_t> _data_version;
+    uint64_t    _spill_budget;
+    std::string _spill_dir;
+    std::atomic<uint64_t> _search_done;
+    std::atomic<uint64_t> _search_total;
+    std::atomic<bool> _search_canceled;
+    std::atomic<bool> _end_deferred;
  
 	friend class LogicSnapshotTest::Pow2;
 	friend class LogicSnapshotTest::Basic;
@@ -0,0 +1,202 @@
+/*
+ * This file is part of the DSView project.
+ * DSView is based on PulseView.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "segmentdecode.h"
+
+#include <libsigrokdecode.h>
+#include <algorithm>
+
+#include "logicsnapshot.h"
+
+using namespace std;
+
+namespace pv {
+namespace data {
+
+void SegmentDecode::split_range(LogicSnapshot *snapshot, uint64_t start, uint64_t end,
+                                int num, uint64_t min_samples,
+                                const std::vector<int> &sigs, const std::vector<int> &levels,
+                                std::vector<uint64_t> &bounds)
+{
+    bounds.clear();
+    bounds.push_back(start);
+
+    num = (int)min((uint64_t)max(num, 1), (end - start) / max(min_samples, (uint64_t)1));
+
+    if (num < 2 || sigs.empty()) {
+        bounds.push_back(end);
+        return;
+    }
+
+    const uint64_t last = min(end, snapshot->get_ring_sample_count()) - 1;
+    const uint64_t min_idle = resync_idle_samples(snapshot, start, last, sigs);
+
+    // Fresh decoders start in the middle of a gap where the bus is idle,
+    // the decoder of the part before is waiting there too
+    for (int k = 1; k < num && min_idle > 0; k++)
+    {
+        uint64_t pos = start + (end - start) * k / num;
+        uint64_t win_end = min(last, pos + (end - start) / num / 2);
+        uint64_t gap_start = 0;
+        uint64_t gap_end = 0;
+
+        if (pos > bounds.back() && pos < win_end
+            && snapshot->find_idle_gap(pos, win_end, sigs, levels, min_idle, gap_start, gap_end)) {
+            bounds.push_back(gap_start + (gap_end - gap_start) / 2);
+        }
+    }
+
+    bounds.push_back(end);
+}
+
+// The idle samples that resync the decoders, some times the common edge
+// interval, 0 if the channels have too few edges to tell
+uint64_t SegmentDecode::resync_idle_samples(LogicSnapshot *snapshot, uint64_t start, uint64_t end,
+                                            const std::vector<int> &sigs)
+{
+    std::vector<LogicSnapshot::EdgePair> buf(ResyncEdges * sigs.size());
+    std::vector<LogicSnapshot::EdgeList> lists(sigs.size());
+    std::vector<uint64_t> edges;
+    std::vector<uint64_t> intervals;
+    uint64_t known = end;
+
+    for (size_t i = 0; i < sigs.size(); i++){
+        lists[i].sig_index = sigs[i];
+        lists[i].edges = &buf[i * ResyncEdges];
+        lists[i].capacity = ResyncEdges;
+    }
+
+    if (!snapshot->get_edges(start, end, lists.data(), (int)lists.size()))
+        return 0;
+
+    for (auto &el : lists){
+        if (el.count == el.capacity)
+            known = min(known, el.edges[el.count - 1].first);
+    }
+    for (auto &el : lists){
+        for (uint64_t i = 0; i < el.count && el.edges[i].first <= known; i++)
+            edges.push_back(el.edges[i].first);
+    }
+    std::sort(edges.begin(), edges.end());
+
+    for (size_t i = 1; i < edges.size(); i++){
+        if (edges[i] != edges[i - 1])
+            intervals.push_back(edges[i] - edges[i - 1]);
+    }
+
+    if (intervals.size() < MinResyncIntervals)
+        return 0;
+
+    auto mid = intervals.begin() + intervals.size() / 2;
+    std::nth_element(intervals.begin(), mid, intervals.end());
+
+    return max(MinResyncIdle, (*mid) * ResyncIdleFactor);
+}
+
+bool SegmentDecode::next_chunk(LogicSnapshot *snapshot, srd_session *session,
+                               uint64_t i, uint64_t end, const int *sigs, int num_sigs, int reader,
+                               std::vector<const uint8_t*> &chunk, std::vector<uint8_t> &chunk_const,
+                               void **lbps, uint64_t &chunk_end)
+{
+    uint64_t idle_end = srd_session_idle_end(session);
+
+    chunk.clear();
+    chunk_const.clear();
+    chunk_end = end;
+
+    if (idle_end > i) {
+        // The decoders wait for edges that come at idle_end,
+        // the samples before it are sent as one chunk of constants.
+        chunk_end = min(idle_end, end);
+
+        for (int j = 0; j < num_sigs; j++) {
+            lbps[j] = NULL;
+            chunk.push_back(NULL);
+            chunk_const.push_back(sigs[j] == -1 ? 0 : snapshot->get_sample(chunk_end - 1, sigs[j]));
+        }
+        return true;
+    }
+
+    for (int j = 0; j < num_sigs; j++) {
+        lbps[j] = NULL;
+
+        if (sigs[j] == -1) {
+            chunk.push_back(NULL);
+            chunk_const.push_back(0);
+        }
+        else if (snapshot->has_data(sigs[j])) {
+            chunk.push_back(snapshot->get_samples(i, chunk_end, sigs[j], &lbps[j], reader));
+            chunk_const.push_back(snapshot->get_sample(i, sigs[j]));
+        }
+        else {
+            return false;
+        }
+    }
+
+    if (chunk_end > end)
+        chunk_end = end;
+    if (chunk_end - i > MaxChunkSize)
+        chunk_end = i + MaxChunkSize;
+
+    return true;
+}
+
+void SegmentDecode::stitch(std::vector<decode_segment> &segs,
+                           const std::function<void(decode_segment&)> &flush)
+{
+    // The annotations of a part go to the rows after all the parts before it
+    for (size_t k = 1; k < segs.size(); k++)
+    {
+        decode_segment &seg = segs[k];
+
+        if (seg._direct)
+            continue;
+        if (!segs[k - 1]._done || !segs[k - 1]._direct)
+            break;
+
+        flush(seg);
+        seg._direct = true;
+    }
+}
+
+void SegmentDecode::progress(const std::vector<decode_segment> &segs, int &percent, uint64_t &decoded)
+{
+    uint64_t sent = 0;
+    uint64_t total = 0;
+    uint64_t end = segs.front()._start;
+
+    for (auto &seg : segs){
+        sent += seg._sent;
+        total += seg._end - seg._start;
+    }
+    percent = total > 0 ? (int)(sent * 100 / total) : 100;
+
+    // The samples are decoded up to the first part not finished
+    for (auto &seg : segs){
+        end = seg._start + seg._sent;
+        if (end < seg._end)
+            break;
+    }
+    decoded = end - segs.front()._start + 1;
+}
+
+} // namespace data
+} // namespace pv
@@ -0,0 +1,100 @@
+/*
+ * This file is part of the DSView project.
+ * DSView is based on PulseView.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef DSVIEW_PV_DATA_SEGMENTDECODE_H
+#define DSVIEW_PV_DATA_SEGMENTDECODE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <utility>
+#include <vector>
+
+struct srd_session;
+
+namespace pv {
+namespace data {
+
+class LogicSnapshot;
+struct decode_task_status;
+
+namespace decode {
+class Annotation;
+class RowData;
+}
+
+// A part of the decode range, on its own session
+struct decode_segment
+{
+    decode_task_status  *_status;
+    srd_session         *_session;
+    uint64_t            _start;
+    uint64_t            _end;
+    std::atomic<uint64_t> _sent;    // samples sent to the decoders
+    bool                _direct;    // the parts before are stitched, the annotations go to the rows
+    bool                _done;
+    std::vector<std::pair<decode::RowData*, decode::Annotation*>> _anns;
+};
+
+// The rules of a decode split in parts, DecoderStack runs the parts
+class SegmentDecode
+{
+public:
+    // A leaf block of LogicSnapshot, the samples are read in place
+    static const uint64_t MaxChunkSize = 1024 * 1024 * 16;
+    static const uint64_t MinSegmentSamples = 1024 * 1024 * 64;
+    static const uint64_t ResyncEdges = 4096;
+    static const uint64_t MinResyncIntervals = 16;
+    static const uint64_t ResyncIdleFactor = 256;
+    static const uint64_t MinResyncIdle = 1024;
+
+public:
+    // The bounds of up to @num parts of [start, end], no part is shorter
+    // than @min_samples. The channels @sigs idle at @levels, -1 for any.
+    static void split_range(LogicSnapshot *snapshot, uint64_t start, uint64_t end,
+                            int num, uint64_t min_samples,
+                            const std::vector<int> &sigs, const std::vector<int> &levels,
+                            std::vector<uint64_t> &bounds);
+
+    static uint64_t resync_idle_samples(LogicSnapshot *snapshot, uint64_t start, uint64_t end,
+                                        const std::vector<int> &sigs);
+
+    // The next chunk from @i for the channels @sigs, -1 for none. An idle
+    // run of the session goes as constants. @lbps gets the blocks read in
+    // place. False if a channel has no data.
+    static bool next_chunk(LogicSnapshot *snapshot, srd_session *session,
+                           uint64_t i, uint64_t end, const int *sigs, int num_sigs, int reader,
+                           std::vector<const uint8_t*> &chunk, std::vector<uint8_t> &chunk_const,
+                           void **lbps, uint64_t &chunk_end);
+
+    // Gives the parts after the stitched ones to @flush in order, as long
+    // as the part before is done. The caller holds the lock of the parts.
+    static void stitch(std::vector<decode_segment> &segs,
+                       const std::function<void(decode_segment&)> &flush);
+
+    // The percent sent, and the samples decoded up to the first part not done
+    static void progress(const std::vector<decode_segment> &segs, int &percent, uint64_t &decoded);
+};
+
+} // namespace data
+} // namespace pv
+
+#endif // DSVIEW_PV_DATA_SEGMENTDECODE_H
@@ -0,0 +1,259 @@
+/*
+ * This file is part of the DSView project.
+ * DSView is based on PulseView.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "syncmerger.h"
+#include <assert.h>
+#include <algorithm>
+#include <libsigrok.h>
+#include <ds_types.h>
+
+#include "../log.h"
+#include "../utility/simd.h"
+
+namespace pv {
+namespace data {
+
+SyncMerger::SyncMerger()
+{
+    _channel_num = 0;
+    _trig_pos = 0;
+    _aligned = false;
+}
+
+void SyncMerger::start(const std::vector<unsigned int> &channel_nums)
+{
+    clear();
+
+    for (unsigned int num : channel_nums){
+        assert(num > 0);
+
+        Source s;
+        s.channel_num = num;
+        s.trig_pos = 0;
+        s.has_data = false;
+        s.ended = false;
+        s.words.resize(num);
+        s.head = 0;
+        s.drop_words = 0;
+        s.shift = 0;
+
+        _sources.push_back(std::move(s));
+        _channel_num += num;
+    }
+}
+
+void SyncMerger::clear()
+{
+    _sources.clear();
+    _channel_num = 0;
+    _trig_pos = 0;
+    _aligned = false;
+}
+
+void SyncMerger::set_trigger(int src, uint64_t pos)
+{
+    assert(src >= 0 && src < (int)_sources.size());
+
+    if (_aligned){
+        dsv_info("SyncMerger: source %d triggered after the alignment.", src);
+        return;
+    }
+    _sources[src].trig_pos = pos;
+}
+
+void SyncMerger::append(int src, const sr_datafeed_logic &logic)
+{
+    assert(logic.format == LA_CROSS_DATA);
+    assert(src >= 0 && src < (int)_sources.size());
+
+    Source &s = _sources[src];
+    const uint8_t *data = (const uint8_t*)logic.data;
+    uint64_t len = logic.length;
+    const uint64_t group_bytes = s.channel_num * sizeof(uint64_t);
+
+    if (len == 0 || s.ended)
+        return;
+
+    s.has_data = true;
+
+    // Complete the channel word group the last payload left
+    if (!s.carry.empty()){
+        uint64_t n = std::min(group_bytes - s.carry.size(), len);
+        s.carry.insert(s.carry.end(), data, data + n);
+        data += n;
+        len -= n;
+
+        if (s.carry.size() < group_bytes)
+            return;
+
+        const uint64_t *group = (const uint64_t*)s.carry.data();
+        for (unsigned int i = 0; i < s.channel_num; i++)
+            s.words[i].push_back(group[i]);
+        s.carry.clear();
+    }
+
+    uint64_t groups = len / group_bytes;
+
+    if (groups > 0){
+        uint64_t size = s.words[0].size();
+
+        _ptrs.resize(s.channel_num);
+        for (unsigned int i = 0; i < s.channel_num; i++){
+            s.words[i].resize(size + groups);
+            _ptrs[i] = s.words[i].data() + size;
+        }
+        simd::deinterleave_u64((const uint64_t*)data, _ptrs.data(), s.channel_num, groups);
+
+        data += groups * group_bytes;
+        len -= groups * group_bytes;
+    }
+
+    if (len > 0)
+        s.carry.assign(data, data + len);
+
+    if (_aligned)
+        drop_words(s);
+}
+
+void SyncMerger::end(int src)
+{
+    assert(src >= 0 && src < (int)_sources.size());
+
+    Source &s = _sources[src];
+    s.ended = true;
+
+    if (!s.carry.empty()){
+        dsv_info("SyncMerger: drop %llu bytes of a part channel group of source %d.",
+            (u64_t)s.carry.size(), src);
+        s.carry.clear();
+    }
+}
+
+bool SyncMerger::all_ended()
+{
+    for (auto &s : _sources){
+        if (!s.ended)
+            return false;
+    }
+    return true;
+}
+
+bool SyncMerger::align()
+{
+    uint64_t trig_min = UINT64_MAX;
+
+    // The trigger packet comes before the data, wait for all sources
+    for (auto &s : _sources){
+        if (!s.has_data && !s.ended)
+            return false;
+        trig_min = std::min(trig_min, s.trig_pos);
+    }
+
+    for (unsigned int i = 0; i < _sources.size(); i++){
+        Source &s = _sources[i];
+        uint64_t drop = s.trig_pos - trig_min;
+
+        s.drop_words = drop / 64;
+        s.shift = drop % 64;
+        drop_words(s);
+
+        dsv_info("SyncMerger: source %u, trigger at %llu, drop %llu samples.",
+            i, (u64_t)s.trig_pos, (u64_t)drop);
+    }
+
+    _trig_pos = trig_min;
+    _aligned = true;
+    return true;
+}
+
+void SyncMerger::drop_words(Source &s)
+{
+    uint64_t n = std::min(s.drop_words, (uint64_t)s.words[0].size() - s.head);
+    s.head += n;
+    s.drop_words -= n;
+}
+
+bool SyncMerger::take(std::vector<uint64_t> &data)
+{
+    data.clear();
+
+    if (!_aligned && !align())
+        return false;
+
+    bool is_end = all_ended();
+    uint64_t n = is_end ? 0 : UINT64_MAX;
+
+    for (auto &s : _sources){
+        uint64_t avail = 0;
+
+        if (s.drop_words == 0){
+            avail = s.words[0].size() - s.head;
+            // A shifted word takes the bits of the next one, until the end
+            if (s.shift > 0 && !is_end && avail > 0)
+                avail--;
+        }
+        n = is_end ? std::max(n, avail) : std::min(n, avail);
+    }
+
+    if (n == 0)
+        return false;
+
+    data.resize(n * _channel_num);
+    unsigned int base = 0;
+
+    for (auto &s : _sources){
+        const unsigned int shift = s.shift;
+
+        for (unsigned int i = 0; i < s.channel_num; i++){
+            const std::vector<uint64_t> &w = s.words[i];
+            const uint64_t size = (s.drop_words == 0) ? w.size() : 0;
+            uint64_t *dst = data.data() + base + i;
+
+            for (uint64_t j = 0; j < n; j++){
+                uint64_t index = s.head + j;
+                uint64_t v = index < size ? w[index] : 0;
+
+                if (shift > 0){
+                    uint64_t next = index + 1 < size ? w[index + 1] : 0;
+                    v = (v >> shift) | (next << (64 - shift));
+                }
+                *dst = v;
+                dst += _channel_num;
+            }
+        }
+        base += s.channel_num;
+
+        if (s.drop_words == 0)
+            s.head = std::min(s.head + n, (uint64_t)s.words[0].size());
+
+        // Keep the buffers small
+        if (s.head >= CompactWords && s.head * 2 >= s.words[0].size()){
+            for (auto &w : s.words)
+                w.erase(w.begin(), w.begin() + s.head);
+            s.head = 0;
+        }
+    }
+
+    return true;
+}
+
+} // namespace data
+} // namespace pv
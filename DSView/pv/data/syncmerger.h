@@ -0,0 +1,113 @@
+/*
+ * This file is part of the DSView project.
+ * DSView is based on PulseView.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef DSVIEW_PV_DATA_SYNCMERGER_H
+#define DSVIEW_PV_DATA_SYNCMERGER_H
+
+#include <stdint.h>
+#include <vector>
+
+struct sr_datafeed_logic;
+
+namespace pv {
+namespace data {
+
+/*
+ * Merge the logic streams of the devices of a sync capture into one.
+ * Each source sends LA_CROSS_DATA of its own channels. The streams are
+ * aligned on their trigger positions: the source that triggered earliest
+ * in its stream keeps all samples, the others drop the samples before.
+ * The merged stream is LA_CROSS_DATA of the channels of all sources,
+ * in the source order.
+ */
+class SyncMerger
+{
+public:
+    // The merged words are erased from a source buffer past this
+    static const uint64_t CompactWords = 1 << 16;
+
+private:
+    struct Source
+    {
+        unsigned int    channel_num;
+        uint64_t        trig_pos;
+        bool            has_data;
+        bool            ended;
+        std::vector<uint8_t>    carry;  // a part of a channel word group
+        std::vector<std::vector<uint64_t>> words;
+        uint64_t        head;       // the first word not merged yet
+        uint64_t        drop_words; // the words still to drop
+        unsigned int    shift;      // the samples to drop in the next word
+    };
+
+public:
+    SyncMerger();
+
+    // One source per device, the channel count of each
+    void start(const std::vector<unsigned int> &channel_nums);
+
+    void clear();
+
+    void set_trigger(int src, uint64_t pos);
+
+    void append(int src, const sr_datafeed_logic &logic);
+
+    void end(int src);
+
+    // Move the merged words to @data. Once all sources have ended, the
+    // shorter ones are padded with zeros up to the longest.
+    bool take(std::vector<uint64_t> &data);
+
+    bool all_ended();
+
+    inline bool is_active(){
+        return _sources.size() > 0;
+    }
+
+    inline bool is_aligned(){
+        return _aligned;
+    }
+
+    // The trigger position in the merged stream
+    inline uint64_t get_trigger_pos(){
+        return _trig_pos;
+    }
+
+    inline unsigned int get_channel_num(){
+        return _channel_num;
+    }
+
+private:
+    bool align();
+    void drop_words(Source &s);
+
+private:
+    std::vector<Source> _sources;
+    std::vector<uint64_t*>  _ptrs;
+    unsigned int    _channel_num;
+    uint64_t        _trig_pos;
+    bool            _aligned;
+};
+
+} // namespace data
+} // namespace pv
+
+#endif // DSVIEW_PV_DATA_SYNCMERGER_H
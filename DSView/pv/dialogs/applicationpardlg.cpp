@@ -29,6 +29,7 @@
 #include <QFontDatabase>
 #include <QGroupBox>
 #include <QLabel>
+#include <QSpinBox>
 #include <vector>
 #include <QGridLayout>
 
@@ -124,6 +125,45 @@ bool ApplicationParamDlg::ShowDlg(QWidget *parent)
     QCheckBox *ck_abortData = new QCheckBox();
     ck_abortData->setChecked(app.appOptions.swapBackBufferAlways);
 
+    QSpinBox *sb_memBudget = new QSpinBox();
+    sb_memBudget->setRange(0, 1024 * 1024);
+    sb_memBudget->setSingleStep(256);
+    sb_memBudget->setSuffix(" MB");
+    sb_memBudget->setSpecialValueText(L_S(STR_PAGE_DLG, S_ID(IDS_DLG_MEMORY_BUDGET_NONE), "No limit"));
+    sb_memBudget->setValue(app.appOptions.memoryBudget);
+
+    QCheckBox *ck_recordToFile = new QCheckBox();
+    ck_recordToFile->setChecked(app.appOptions.recordToFile);
+
+    QSpinBox *sb_loopPreTrig = new QSpinBox();
+    sb_loopPreTrig->setRange(0, 99);
+    sb_loopPreTrig->setSuffix(" %");
+    sb_loopPreTrig->setSpecialValueText(L_S(STR_PAGE_DLG, S_ID(IDS_DLG_LOOP_PRE_TRIGGER_OFF), "Off"));
+    sb_loopPreTrig->setValue(app.appOptions.loopPreTrigger);
+
+    QSpinBox *sb_decodeThreads = new QSpinBox();
+    sb_decodeThreads->setRange(0, pv::data::LogicSnapshot::MaxDecodeReaders);
+    sb_decodeThreads->setSpecialValueText(L_S(STR_PAGE_DLG, S_ID(IDS_DLG_DECODE_THREADS_AUTO), "Auto"));
+    sb_decodeThreads->setValue(app.appOptions.decodeThreads);
+
+    QCheckBox *ck_segmentDecode = new QCheckBox();
+    ck_segmentDecode->setChecked(app.appOptions.segmentDecode);
+
+    QSpinBox *sb_acqPriority = new QSpinBox();
+    sb_acqPriority->setRange(0, 99);
+    sb_acqPriority->setSpecialValueText(L_S(STR_PAGE_DLG, S_ID(IDS_DLG_ACQ_PRIORITY_NORMAL), "Normal"));
+    sb_acqPriority->setValue(app.appOptions.acqPriority);
+
+    QSpinBox *sb_acqCpu = new QSpinBox();
+    sb_acqCpu->setRange(-1, 255);
+    sb_acqCpu->setSpecialValueText(L_S(STR_PAGE_DLG, S_ID(IDS_DLG_CPU_ANY), "Any"));
+    sb_acqCpu->setValue(app.appOptions.acqCpu);
+
+    QSpinBox *sb_ingestCpu = new QSpinBox();
+    sb_ingestCpu->setRange(-1, 255);
+    sb_ingestCpu->setSpecialValueText(L_S(STR_PAGE_DLG, S_ID(IDS_DLG_CPU_ANY), "Any"));
+    sb_ingestCpu->setValue(app.appOptions.ingestCpu);
+
     QComboBox *ftCbSize = new DsComboBox();
     ftCbSize->setFixedWidth(50);
     bind_font_size_list(ftCbSize, app.appOptions.fontSize);
@@ -137,6 +177,16 @@ bool ApplicationParamDlg::ShowDlg(QWidget *parent)
     logicLay->addWidget(ck_quickScroll, 0, 1, Qt::AlignRight);
     logicLay->addWidget(new QLabel(L_S(STR_PAGE_DLG, S_ID(IDS_DLG_USE_ABORT_DATA_REPEAT), "Used abort data")), 1, 0, Qt::AlignLeft); 
     logicLay->addWidget(ck_abortData, 1, 1, Qt::AlignRight);
+    logicLay->addWidget(new QLabel(L_S(STR_PAGE_DLG, S_ID(IDS_DLG_MEMORY_BUDGET), "Memory budget")), 2, 0, Qt::AlignLeft); 
+    logicLay->addWidget(sb_memBudget, 2, 1, Qt::AlignRight);
+    logicLay->addWidget(new QLabel(L_S(STR_PAGE_DLG, S_ID(IDS_DLG_RECORD_TO_FILE), "Record stream capture to file")), 3, 0, Qt::AlignLeft); 
+    logicLay->addWidget(ck_recordToFile, 3, 1, Qt::AlignRight);
+    logicLay->addWidget(new QLabel(L_S(STR_PAGE_DLG, S_ID(IDS_DLG_LOOP_PRE_TRIGGER), "Loop stops at trigger, keep before")), 4, 0, Qt::AlignLeft); 
+    logicLay->addWidget(sb_loopPreTrig, 4, 1, Qt::AlignRight);
+    logicLay->addWidget(new QLabel(L_S(STR_PAGE_DLG, S_ID(IDS_DLG_DECODE_THREADS), "Decoders running at once")), 5, 0, Qt::AlignLeft); 
+    logicLay->addWidget(sb_decodeThreads, 5, 1, Qt::AlignRight);
+    logicLay->addWidget(new QLabel(L_S(STR_PAGE_DLG, S_ID(IDS_DLG_SEGMENT_DECODE), "Split long decodes at idle gaps")), 6, 0, Qt::AlignLeft); 
+    logicLay->addWidget(ck_segmentDecode, 6, 1, Qt::AlignRight);
     lay->addWidget(logicGroup);
 
     //Scope group
@@ -148,6 +198,19 @@ bool ApplicationParamDlg::ShowDlg(QWidget *parent)
     dsoLay->addWidget(ck_trigInMid, 0, 1, Qt::AlignRight);
     lay->addWidget(dsoGroup);
 
+    //Acquisition group
+    QGroupBox *acqGroup = new QGroupBox(L_S(STR_PAGE_DLG, S_ID(IDS_DLG_GROUP_ACQUISITION), "Acquisition"));
+    QGridLayout *acqLay = new QGridLayout();
+    acqLay->setContentsMargins(10,15,15,10);
+    acqGroup->setLayout(acqLay);
+    acqLay->addWidget(new QLabel(L_S(STR_PAGE_DLG, S_ID(IDS_DLG_ACQ_PRIORITY), "Real-time priority")), 0, 0, Qt::AlignLeft);
+    acqLay->addWidget(sb_acqPriority, 0, 1, Qt::AlignRight);
+    acqLay->addWidget(new QLabel(L_S(STR_PAGE_DLG, S_ID(IDS_DLG_ACQ_CPU), "Acquisition CPU")), 1, 0, Qt::AlignLeft);
+    acqLay->addWidget(sb_acqCpu, 1, 1, Qt::AlignRight);
+    acqLay->addWidget(new QLabel(L_S(STR_PAGE_DLG, S_ID(IDS_DLG_INGEST_CPU), "Ingest CPU")), 2, 0, Qt::AlignLeft);
+    acqLay->addWidget(sb_ingestCpu, 2, 1, Qt::AlignRight);
+    lay->addWidget(acqGroup);
+
     //UI
     QGroupBox *uiGroup = new QGroupBox(L_S(STR_PAGE_DLG, S_ID(IDS_DLG_GROUP_UI), "UI"));
     QGridLayout *uiLay = new QGridLayout();
@@ -186,6 +249,35 @@ bool ApplicationParamDlg::ShowDlg(QWidget *parent)
             app.appOptions.swapBackBufferAlways = ck_abortData->isChecked();
             bAppChanged = true;
         }        
+        if (app.appOptions.memoryBudget != sb_memBudget->value()){
+            app.appOptions.memoryBudget = sb_memBudget->value();
+            bAppChanged = true;
+        }
+        if (app.appOptions.recordToFile != ck_recordToFile->isChecked()){
+            app.appOptions.recordToFile = ck_recordToFile->isChecked();
+            bAppChanged = true;
+        }
+        if (app.appOptions.loopPreTrigger != sb_loopPreTrig->value()){
+            app.appOptions.loopPreTrigger = sb_loopPreTrig->value();
+            bAppChanged = true;
+        }
+        if (app.appOptions.decodeThreads != sb_decodeThreads->value()){
+            app.appOptions.decodeThreads = sb_decodeThreads->value();
+            bAppChanged = true;
+        }
+        if (app.appOptions.segmentDecode != ck_segmentDecode->isChecked()){
+            app.appOptions.segmentDecode = ck_segmentDecode->isChecked();
+            bAppChanged = true;
+        }
+        if (app.appOptions.acqPriority != sb_acqPriority->value()
+            || app.appOptions.acqCpu != sb_acqCpu->value()
+            || app.appOptions.ingestCpu != sb_ingestCpu->value()){
+            app.appOptions.acqPriority = sb_acqPriority->value();
+            app.appOptions.acqCpu = sb_acqCpu->value();
+            app.appOptions.ingestCpu = sb_ingestCpu->value();
+            AppControl::Instance()->GetSession()->apply_thread_sched();
+            bAppChanged = true;
+        }
         if (app.appOptions.fontSize != fSize){
             app.appOptions.fontSize = fSize;
             bFontChanged = true;
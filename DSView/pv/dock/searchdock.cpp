@@ -36,6 +36,7 @@
 #include <QMouseEvent>
 #include <QFuture>
 #include <QProgressDialog>
+#include <QTimer>
 #include <QtConcurrent/QtConcurrent>
 #include <stdint.h> 
 #include "../config/appconfig.h"
@@ -55,6 +56,10 @@ SearchDock::SearchDock(QWidget *parent, View &view, SigSession *session) :
     _session(session),
     _view(view)
 { 
+    _search_snapshot = NULL;
+    _search_dlg = NULL;
+    _search_canceled = false;
+
     _search_button = new QPushButton(this);
     _search_button->setFixedWidth(_search_button->height());
     _search_button->setDisabled(true);
@@ -149,25 +154,14 @@ void SearchDock::on_previous()
         return;
     }
     else {
-        QFuture<void> future;
-        future = QtConcurrent::run([&]{
-            last_pos -= last_hit;
-            ret = logic_snapshot->pattern_search(0, end, last_pos, _pattern, false);
-        });
-        Qt::WindowFlags flags = Qt::CustomizeWindowHint;
-        QProgressDialog dlg(L_S(STR_PAGE_DLG, S_ID(IDS_DLG_SEARCH_PREVIOUS), "Search Previous..."),
-                            L_S(STR_PAGE_DLG, S_ID(IDS_DLG_CANCEL), "Cancel"),0,0,this,flags);
-        dlg.setWindowModality(Qt::WindowModal);
-        dlg.setWindowFlags(Qt::Dialog | Qt::FramelessWindowHint | Qt::WindowSystemMenuHint |
-                           Qt::WindowMinimizeButtonHint | Qt::WindowMaximizeButtonHint);
-        dlg.setCancelButton(NULL);
-
-        QFutureWatcher<void> watcher;
-        connect(&watcher,SIGNAL(finished()),&dlg,SLOT(cancel()));
-        watcher.setFuture(future);
-        dlg.exec();
-
-        if (!ret) {
+        bool canceled = false;
+        last_pos -= last_hit;
+        ret = run_search(logic_snapshot, end, last_pos, false, canceled);
+
+        if (canceled) {
+            return;
+        }
+        else if (!ret) {
             QString strMsg(L_S(STR_PAGE_MSG, S_ID(IDS_MSG_PATTERN_NOT_FOUND), "Pattern not found!"));
             MsgBox::Show(strMsg);
             return;
@@ -198,24 +192,13 @@ void SearchDock::on_next()
         MsgBox::Show(strMsg);
         return;
     } else {
-        QFuture<void> future;
-        future = QtConcurrent::run([&]{
-            ret = logic_snapshot->pattern_search(0, end, last_pos, _pattern, true);
-        });
-        Qt::WindowFlags flags = Qt::CustomizeWindowHint;
-        QProgressDialog dlg(L_S(STR_PAGE_DLG, S_ID(IDS_DLG_SEARCH_NEXT), "Search Next..."),
-                            L_S(STR_PAGE_DLG, S_ID(IDS_DLG_CANCEL), "Cancel"),0,0,this,flags);
-        dlg.setWindowModality(Qt::WindowModal);
-        dlg.setWindowFlags(Qt::Dialog | Qt::FramelessWindowHint | Qt::WindowSystemMenuHint |
-                           Qt::WindowMinimizeButtonHint | Qt::WindowMaximizeButtonHint);
-        dlg.setCancelButton(NULL);
-
-        QFutureWatcher<void> watcher;
-        connect(&watcher,SIGNAL(finished()),&dlg,SLOT(cancel()));
-        watcher.setFuture(future);
-        dlg.exec();
-
-        if (!ret) {
+        bool canceled = false;
+        ret = run_search(logic_snapshot, end, last_pos, true, canceled);
+
+        if (canceled) {
+            return;
+        }
+        else if (!ret) {
             QString strMsg(L_S(STR_PAGE_MSG, S_ID(IDS_MSG_PATTERN_NOT_FOUND), "Pattern not found!"));
             MsgBox::Show(strMsg);
             return;
@@ -225,6 +208,68 @@ void SearchDock::on_next()
     }
 }
 
+bool SearchDock::run_search(data::LogicSnapshot *snapshot, int64_t end, int64_t &last_pos,
+                            bool isNext, bool &canceled)
+{
+    bool ret = false;
+
+    QFuture<void> future;
+    future = QtConcurrent::run([&]{
+        ret = snapshot->pattern_search(0, end, last_pos, _pattern, isNext);
+    });
+    Qt::WindowFlags flags = Qt::CustomizeWindowHint;
+    QString title = isNext ? L_S(STR_PAGE_DLG, S_ID(IDS_DLG_SEARCH_NEXT), "Search Next...")
+                           : L_S(STR_PAGE_DLG, S_ID(IDS_DLG_SEARCH_PREVIOUS), "Search Previous...");
+    QProgressDialog dlg(title, L_S(STR_PAGE_DLG, S_ID(IDS_DLG_CANCEL), "Cancel"),0,100,this,flags);
+    dlg.setWindowModality(Qt::WindowModal);
+    dlg.setWindowFlags(Qt::Dialog | Qt::FramelessWindowHint | Qt::WindowSystemMenuHint |
+                       Qt::WindowMinimizeButtonHint | Qt::WindowMaximizeButtonHint);
+
+    _search_snapshot = snapshot;
+    _search_dlg = &dlg;
+    _search_canceled = false;
+
+    QTimer timer;
+    connect(&timer, SIGNAL(timeout()), this, SLOT(on_search_progress()));
+    connect(&dlg, SIGNAL(canceled()), this, SLOT(on_search_cancel()));
+    timer.start(100);
+
+    QFutureWatcher<void> watcher;
+    connect(&watcher,SIGNAL(finished()),&dlg,SLOT(cancel()));
+    watcher.setFuture(future);
+    dlg.exec();
+
+    // the dialog closes at once on cancel, the search stops soon after
+    future.waitForFinished();
+    timer.stop();
+
+    _search_dlg = NULL;
+    _search_snapshot = NULL;
+    canceled = _search_canceled;
+
+    return ret;
+}
+
+void SearchDock::on_search_progress()
+{
+    if (_search_dlg == NULL || _search_snapshot == NULL)
+        return;
+
+    std::pair<uint64_t, uint64_t> progress = _search_snapshot->search_progress();
+
+    // reaching the maximum would reset the dialog
+    if (progress.second > 0)
+        _search_dlg->setValue(std::min(progress.first * 100 / progress.second, (uint64_t)99));
+}
+
+void SearchDock::on_search_cancel()
+{
+    _search_canceled = true;
+
+    if (_search_snapshot != NULL)
+        _search_snapshot->cancel_search();
+}
+
 void SearchDock::on_set()
 {
     dialogs::Search dlg(this, _session, _pattern);
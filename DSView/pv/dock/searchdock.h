@@ -38,6 +38,7 @@
 #include <QGridLayout>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
+#include <QProgressDialog>
 
 #include <vector>
 
@@ -53,6 +54,10 @@ namespace view {
     class View;
 }
 
+namespace data {
+    class LogicSnapshot;
+}
+
 namespace widgets {
     class FakeLineEdit;
 }
@@ -77,11 +82,18 @@ private:
     //IFontForm
     void update_font() override;
 
+    bool run_search(data::LogicSnapshot *snapshot, int64_t end, int64_t &last_pos,
+                    bool isNext, bool &canceled);
+
 public slots:
     void on_previous();
     void on_next();
     void on_set();
 
+private slots:
+    void on_search_progress();
+    void on_search_cancel();
+
 private:
     SigSession *_session;
     view::View &_view;
@@ -91,6 +103,10 @@ private:
     QPushButton _nxt_button;
     widgets::FakeLineEdit* _search_value;
     QPushButton *_search_button;
+
+    data::LogicSnapshot *_search_snapshot;
+    QProgressDialog *_search_dlg;
+    bool _search_canceled;
 };
 
 } // namespace dock
@@ -91,6 +91,7 @@ public:
 #define DSV_MSG_TRIG_NEXT_COLLECT       7001
 #define DSV_MSG_SAVE_COMPLETE           7002
 #define DSV_MSG_STORE_CONF_PREV         7003
+#define DSV_MSG_LOOP_STOPPED            7004
 
 #define DSV_MSG_CLEAR_DECODE_DATA       8001
 
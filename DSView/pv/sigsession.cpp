@@ -24,6 +24,7 @@
 
 #include "sigsession.h"
 #include "mainwindow.h"
+#include "storesession.h"
 
 #include "data/analogsnapshot.h"
 #include "data/dsosnapshot.h"
@@ -44,10 +45,17 @@
 #include "view/mathtrace.h"
 
 #include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+#include <algorithm>
 #include <stdexcept>
 #include <sys/stat.h>
 #include <map>
+#include <atomic>
+#include <memory>
+#include <condition_variable>
 #include <QString>
+#include <QDir>
 
 #include "data/decode/decoderstatus.h"
 #include "dsvdef.h"
@@ -56,6 +64,7 @@
 #include "utility/path.h"
 #include "ui/msgbox.h"
 #include "ui/langresource.h"
+#include <ds_types.h>
 
 namespace pv
 {
@@ -74,6 +83,14 @@ namespace pv
         _trig_pos = 0;
     }
 
+    void SessionData::recycle()
+    {
+        logic.recycle();
+        analog.clear();
+        dso.clear();
+        _trig_pos = 0;
+    }
+
     // TODO: This should not be necessary
     SigSession *SigSession::_session = NULL;
 
@@ -103,6 +120,17 @@ namespace pv
         _decoder_pannel = NULL;
         _is_triged = false;
         _dso_status_valid = false;
+        _is_recording = false;
+        _record_trig_pos = 0;
+        _loop_bytes = 0;
+        _loop_stop_bytes = 0;
+        _loop_trig_pos = 0;
+        _loop_frozen = false;
+        _sync_device_num = 0;
+        _sync_channels = NULL;
+        _capture_channels = NULL;
+        _sync_first_index = 0;
+        _sync_end_ok = true;
 
         _data_list.push_back(new SessionData());
         _data_list.push_back(new SessionData());
@@ -116,12 +144,14 @@ namespace pv
         _lissajous_trace = NULL;
         _math_trace = NULL;
         _is_decoding = false;
+        _decode_workers = 0;
         _bClose = false;
         _callback = NULL;
         _work_time_id = 0;
         _capture_times = 0;
         _confirm_store_time_id = 0;
         _repeat_wait_prog_step = 10;
+        _repeat_end_time = 0;
 
         _device_agent.set_callback(this);
 
@@ -139,11 +169,16 @@ namespace pv
 
     SigSession::~SigSession()
     {
+        if (_end_thread.joinable())
+            _end_thread.join();
+
         for(auto p : _data_list){
             p->clear();
             delete p;
         }
         _data_list.clear();
+
+        free_sync_channels();
     }
 
     bool SigSession::init()
@@ -154,11 +189,16 @@ namespace pv
 
         ds_set_datafeed_callback(data_feed_callback);
 
+        ds_set_datafeed_lend_callback(data_lend_callback);
+
         // firmware resource directory
         QString resdir = GetFirmwareDir();
         std::string res_path = pv::path::ToUnicodePath(resdir);
         ds_set_firmware_resource_dir(res_path.c_str());
 
+        // Before the hotplug thread starts
+        apply_thread_sched();
+
         if (ds_lib_init() != SR_OK)
         {
             dsv_err("DSView run ERROR: collect lib init failed.");
@@ -168,6 +208,14 @@ namespace pv
         return true;
     }
 
+    void SigSession::apply_thread_sched()
+    {
+        AppConfig &app = AppConfig::Instance();
+
+        ds_set_thread_sched(DS_THREAD_ACQUISITION, app.appOptions.acqPriority, app.appOptions.acqCpu);
+        ds_set_thread_sched(DS_THREAD_INGEST, app.appOptions.acqPriority, app.appOptions.ingestCpu);
+    }
+
     void SigSession::uninit()
     {
         this->Close();
@@ -235,6 +283,9 @@ namespace pv
         _device_agent.update();
         set_collect_mode(COLLECT_SINGLE);
 
+        if (_device_agent.get_work_mode() != LOGIC || _device_agent.is_file())
+            clear_sync_devices();
+
         if (_device_agent.is_file()){
             std::string dev_name = pv::path::ToUnicodePath(_device_agent.name());
             dsv_info("Switch to file \"%s\" done.", dev_name.c_str());
@@ -446,6 +497,13 @@ namespace pv
         set_cur_snap_samplerate(_device_agent.get_sample_rate());
         set_cur_samplelimits(_device_agent.get_sample_limit());
 
+        // The view shows one overview sample per scale samples
+        if (_is_recording){
+            uint64_t scale = _recorder.get_overview_scale();
+            set_cur_snap_samplerate(std::max(_device_agent.get_sample_rate() / scale, (uint64_t)1));
+            set_cur_samplelimits((_device_agent.get_sample_limit() + scale - 1) / scale);
+        }
+
         _data_updated = false;
         _trigger_flag = false;
         _trigger_ch = 0;
@@ -453,13 +511,37 @@ namespace pv
         _rt_refresh_time_id = 0;
         _rt_ck_refresh_time_id = 0; 
         _noData_cnt = 0;
+        _loop_bytes = 0;
+        _loop_stop_bytes = 0;
+        _loop_trig_pos = 0;
+        _loop_frozen = false;
         
         data_unlock();
 
-        // Init data container
-        _capture_data->clear();
-
         int mode = _device_agent.get_work_mode();
+
+        // Init data container, a repeated capture takes the blocks of the last one
+        if (mode == LOGIC && is_repeat_mode())
+            _capture_data->recycle();
+        else
+            _capture_data->clear();
+
+        // Each capture aligns the devices again
+        _sync_merger.clear();
+        _sync_end_ok = true;
+
+        if (mode == LOGIC && _sync_channel_nums.size() > 0)
+        {
+            std::vector<unsigned int> nums(1, 0);
+
+            for (const GSList *l = _device_agent.get_channels(); l; l = l->next){
+                const sr_channel *const probe = (const sr_channel *)l->data;
+                if (probe->type == SR_CHANNEL_LOGIC && probe->enabled)
+                    nums[0]++;
+            }
+            nums.insert(nums.end(), _sync_channel_nums.begin(), _sync_channel_nums.end());
+            _sync_merger.start(nums);
+        }
         if (mode == DSO)
         { 
             for (auto m : _spectrum_traces){ 
@@ -539,6 +621,7 @@ namespace pv
         set_cur_samplelimits(_device_agent.get_sample_limit());
 
         set_session_time(QDateTime::currentDateTime());
+        _is_recording = false;
 
         int mode = _device_agent.get_work_mode();
         if (mode == LOGIC)
@@ -572,6 +655,18 @@ namespace pv
                 bool bv = is_loop_mode() && _is_stream_mode;
                 _device_agent.set_config_bool(SR_CONF_LOOP_MODE, bv);
             }
+
+            if (!prepare_sync_capture())
+                return false;
+
+            // A sync capture is kept in memory
+            AppConfig &app = AppConfig::Instance();
+            if (app.appOptions.recordToFile && is_single_mode()
+                && _is_stream_mode && !_device_agent.is_file()
+                && _sync_device_num == 0){
+                if (!start_record())
+                    return false;
+            }
         }
        
         update_view();
@@ -598,6 +693,11 @@ namespace pv
             return true;
         }
 
+        if (_is_recording){
+            _recorder.cancel();
+            _is_recording = false;
+        }
+
         return false;
     }
 
@@ -637,7 +737,7 @@ namespace pv
         {    
             if (is_single_mode())
             {
-                if (_is_stream_mode)
+                if (_is_stream_mode && !_is_recording)
                     bAddDecoder = true;
             }
             else if (is_repeat_mode())
@@ -680,9 +780,9 @@ namespace pv
                 }
             }
 
+            // The other buffer, capture_init() clears it
             buf_index = (buf_index + 1) % 2;
             _capture_data = _data_list[buf_index];
-            _capture_data->clear();
 
             set_cur_snap_samplerate(_device_agent.get_sample_rate());
             set_cur_samplelimits(_device_agent.get_sample_limit());
@@ -861,10 +961,13 @@ namespace pv
         set_cur_snap_samplerate(_device_agent.get_sample_rate());
         set_cur_samplelimits(_device_agent.get_sample_limit());    
 
+        // The sync channels follow the channels of the device
+        update_sync_channels();
+
         // Detect what data types we will receive
         if (_device_agent.have_instance())
         {
-            for (const GSList *l = _device_agent.get_channels(); l; l = l->next)
+            for (const GSList *l = get_capture_channels(); l; l = l->next)
             {
                 const sr_channel *const probe = (const sr_channel *)l->data;
 
@@ -887,7 +990,7 @@ namespace pv
             }
         }
 
-        for (GSList *l = _device_agent.get_channels(); l; l = l->next)
+        for (GSList *l = get_capture_channels(); l; l = l->next)
         {
             sr_channel *probe = (sr_channel *)l->data;
             assert(probe); 
@@ -946,8 +1049,10 @@ namespace pv
         set_cur_snap_samplerate(_device_agent.get_sample_rate());
         set_cur_samplelimits(_device_agent.get_sample_limit());
 
+        update_sync_channels();
+
         // Make the logic probe list
-        for (GSList *l = _device_agent.get_channels(); l; l = l->next)
+        for (GSList *l = get_capture_channels(); l; l = l->next)
         {
             sr_channel *probe = (sr_channel *)l->data;
   
@@ -1118,7 +1223,29 @@ namespace pv
             _trigger_flag = (trigger_pos.status & 0x01);
             if (_trigger_flag)
             {
-                _capture_data->_trig_pos = trigger_pos.real_pos;
+                uint64_t trig_pos = trigger_sample(trigger_pos);
+
+                // The merged position is known when all devices have data
+                if (_sync_merger.is_active()){
+                    _sync_merger.set_trigger(0, trig_pos);
+                    return;
+                }
+
+                // The position in the window is known when the ring stops.
+                // A loop capture streams, its trigger is matched on the host
+                // by the soft trigger of libsigrok4DSL.
+                if (is_loop_mode() && !_is_recording
+                    && AppConfig::Instance().appOptions.loopPreTrigger > 0){
+                    arm_loop_stop(trig_pos);
+                    return;
+                }
+
+                _capture_data->_trig_pos = trig_pos;
+
+                if (_is_recording){
+                    _record_trig_pos = trig_pos;
+                    _capture_data->_trig_pos = trig_pos / _recorder.get_overview_scale();
+                }
 
                 // Update trig position for current view.
                 if (_capture_data == _view_data){
@@ -1147,8 +1274,42 @@ namespace pv
         }
     }
 
+    uint64_t SigSession::trigger_sample(const ds_trigger_pos &trigger_pos)
+    {
+        uint64_t pos = trigger_pos.real_pos;
+
+        // The software trigger has the high bits of a long capture
+        if (trigger_pos.check_id == DS_SOFT_TRIGGER_CHECK_ID)
+            pos |= (uint64_t)trigger_pos.ram_saddr << 32;
+
+        return pos;
+    }
+
     void SigSession::feed_in_logic(const sr_datafeed_logic &o)
-    {  
+    {
+        if (_loop_frozen)
+            return;
+
+        // Take the samples up to the stop, then the ring stays as it is
+        if (_loop_stop_bytes > 0 && _loop_bytes + o.length >= _loop_stop_bytes)
+        {
+            sr_datafeed_logic part = o;
+            part.length = _loop_stop_bytes > _loop_bytes ? _loop_stop_bytes - _loop_bytes : 0;
+            _loop_stop_bytes = 0;
+
+            if (part.length >= get_ch_num(SR_CHANNEL_LOGIC) * sizeof(uint64_t))
+                feed_in_logic(part);
+
+            freeze_loop();
+            return;
+        }
+        _loop_bytes += o.length;
+
+        if (_is_recording){
+            feed_in_record(o);
+            return;
+        }
+
         if (_capture_data->get_logic()->memory_failed())
         {
             dsv_err("Unexpected logic packet");
@@ -1167,9 +1328,13 @@ namespace pv
 
             bool bNotFree = _is_decoding && _view_data == _capture_data;
 
+            AppConfig &app = AppConfig::Instance();
+            _capture_data->get_logic()->set_memory_budget((uint64_t)app.appOptions.memoryBudget << 20,
+                            pv::path::ConvertPath(QDir::tempPath()));
+
             _capture_data->get_logic()->first_payload(o, 
                             _device_agent.get_sample_limit(),
-                            _device_agent.get_channels(),
+                            get_capture_channels(),
                             !bNotFree);
 
             // @todo Putting this here means that only listeners querying
@@ -1196,6 +1361,407 @@ namespace pv
         _data_updated = true;
     }
 
+    void SigSession::arm_loop_stop(uint64_t trig_pos)
+    {
+        if (_loop_stop_bytes > 0 || _loop_frozen)
+            return;
+
+        AppConfig &app = AppConfig::Instance();
+        uint64_t window = _device_agent.get_sample_limit();
+        uint64_t post = window / 100 * (100 - app.appOptions.loopPreTrigger);
+        uint64_t groups = (trig_pos + post + 63) / 64;
+
+        _loop_trig_pos = trig_pos;
+        _loop_stop_bytes = std::max(groups, (uint64_t)1) * get_ch_num(SR_CHANNEL_LOGIC) * sizeof(uint64_t);
+
+        dsv_info("Loop trigger at %llu, keep %llu samples after it.",
+            (u64_t)trig_pos, (u64_t)post);
+    }
+
+    void SigSession::freeze_loop()
+    {
+        _loop_frozen = true;
+
+        uint64_t ch_num = get_ch_num(SR_CHANNEL_LOGIC);
+        uint64_t received = ch_num > 0 ? _loop_bytes * 8 / ch_num : 0;
+        uint64_t ring = _capture_data->get_logic()->get_ring_sample_count();
+        uint64_t start = received > ring ? received - ring : 0;
+
+        _capture_data->_trig_pos = _loop_trig_pos > start ? _loop_trig_pos - start : 0;
+
+        if (_capture_data == _view_data){
+            _callback->receive_trigger(_capture_data->_trig_pos);
+        }
+
+        dsv_info("Loop ring stopped, samples %llu to %llu are kept.",
+            (u64_t)start, (u64_t)received);
+
+        _callback->trigger_message(DSV_MSG_LOOP_STOPPED);
+    }
+
+    void SigSession::feed_in_record(const sr_datafeed_logic &o)
+    {
+        if (!_is_triged && o.length > 0)
+        {
+            _is_triged = true;
+            _trig_time = QDateTime::currentDateTime();
+        }
+
+        if (!_recorder.append_payload(o))
+        {
+            if (_error == No_err){
+                dsv_err("Record error: %s", _recorder.get_error().c_str());
+                _error = Data_overflow;
+                _callback->session_error();
+            }
+            return;
+        }
+
+        feed_in_overview();
+    }
+
+    void SigSession::feed_in_overview()
+    {
+        if (!_recorder.take_overview(_record_overview))
+            return;
+
+        sr_datafeed_logic logic;
+        memset(&logic, 0, sizeof(logic));
+        logic.format = LA_CROSS_DATA;
+        logic.length = _record_overview.size() * sizeof(uint64_t);
+        logic.data = _record_overview.data();
+
+        if (_capture_data->get_logic()->last_ended())
+        {
+            _capture_data->get_logic()->set_loop(false);
+            _capture_data->get_logic()->first_payload(logic, cur_samplelimits(),
+                            _device_agent.get_channels(), true);
+            _callback->frame_began();
+        }
+        else
+        {
+            _capture_data->get_logic()->append_payload(logic);
+        }
+
+        if (_capture_data->get_logic()->memory_failed())
+        {
+            _error = Malloc_err;
+            _callback->session_error();
+            return;
+        }
+
+        set_receive_data_len(logic.length * 8 / get_ch_num(SR_CHANNEL_LOGIC));
+        _data_updated = true;
+    }
+
+    bool SigSession::start_record()
+    {
+        AppConfig &app = AppConfig::Instance();
+        std::vector<int> ch_indexs;
+
+        for (const GSList *l = _device_agent.get_channels(); l; l = l->next)
+        {
+            const sr_channel *const probe = (const sr_channel *)l->data;
+            if (probe->type == SR_CHANNEL_LOGIC && probe->enabled)
+                ch_indexs.push_back(probe->index);
+        }
+
+        // Nothing to record, the capture reports it
+        if (ch_indexs.empty())
+            return true;
+
+        QString dir = app.userHistory.saveDir;
+        if (dir == "")
+            dir = QDir::home().path();
+
+        _record_file = dir + "/" + _device_agent.name() + "-LA"
+                    + get_session_time().toString("-yyMMdd-hhmmss") + ".dsl";
+
+        if (!_recorder.start(path::ConvertPath(_record_file), ch_indexs, _device_agent.get_sample_limit()))
+        {
+            dsv_err("Failed to start the record: %s", _recorder.get_error().c_str());
+            QString err_str(L_S(STR_PAGE_MSG, S_ID(IDS_MSG_RECORD_START_ERROR), "Failed to create the record file:"));
+            MsgBox::Show(err_str + "\n" + _record_file);
+            return false;
+        }
+
+        _is_recording = true;
+        _record_trig_pos = 0;
+        _record_msg = "";
+        return true;
+    }
+
+    void SigSession::end_record(bool bOk)
+    {
+        std::string header;
+        make_record_header(header);
+
+        if (bOk && _recorder.finish(header)){
+            _record_msg = L_S(STR_PAGE_MSG, S_ID(IDS_MSG_RECORD_DONE), "The capture is recorded to the file:")
+                        + "\n" + _record_file;
+        }
+        else{
+            if (_recorder.is_recording())
+                _recorder.cancel();
+            _record_msg = L_S(STR_PAGE_MSG, S_ID(IDS_MSG_RECORD_ERROR), "Failed to record the capture.")
+                        + "\n" + QString(_recorder.get_error().c_str());
+        }
+
+        // The tail of the overview
+        feed_in_overview();
+
+        _is_recording = false;
+    }
+
+    void SigSession::make_record_header(std::string &str)
+    {
+        StoreSession::MetaInfo info;
+
+        info.snapshot = NULL;
+        info.sample_count = _recorder.get_sample_count();
+        info.block_num = _recorder.get_block_num();
+        info.samplerate = _device_agent.get_sample_rate();
+        info.trig_pos = _record_trig_pos;
+
+        StoreSession::meta_gen(this, info, str);
+    }
+
+    bool SigSession::set_sync_device(ds_device_handle dev_handle, bool bSync)
+    {
+        if (_is_working)
+            return false;
+
+        if (bSync)
+        {
+            if (_device_agent.get_work_mode() != LOGIC || _device_agent.is_file()){
+                dsv_err("Only a logic device can capture with sync devices.");
+                return false;
+            }
+
+            if (ds_add_sync_device(dev_handle) != SR_OK){
+                dsv_err("Failed to add the sync device.");
+                return false;
+            }
+
+            if (ds_set_sync_device_config(dev_handle, SR_CONF_DEVICE_MODE, g_variant_new_int16(LOGIC)) != SR_OK){
+                dsv_err("The sync device has no logic mode.");
+                ds_remove_sync_device(dev_handle);
+                return false;
+            }
+        }
+        else if (ds_remove_sync_device(dev_handle) != SR_OK)
+        {
+            return false;
+        }
+
+        update_sync_channels();
+        return true;
+    }
+
+    bool SigSession::is_sync_device(ds_device_handle dev_handle)
+    {
+        return ds_is_sync_device(dev_handle) > 0;
+    }
+
+    void SigSession::clear_sync_devices()
+    {
+        struct ds_device_base_info *array = NULL;
+        int count = 0;
+
+        if (ds_get_sync_device_list(&array, &count) == SR_OK && array != NULL)
+        {
+            for (int i = 0; i < count; i++){
+                ds_remove_sync_device(array[i].handle);
+            }
+            free(array);
+        }
+
+        update_sync_channels();
+    }
+
+    void SigSession::update_sync_channels()
+    {
+        struct ds_device_base_info *array = NULL;
+        int count = 0;
+
+        free_sync_channels();
+
+        if (ds_get_sync_device_list(&array, &count) != SR_OK || array == NULL)
+            return;
+
+        int index = g_slist_length(_device_agent.get_channels());
+        int logic_num = 0;
+
+        for (const GSList *l = _device_agent.get_channels(); l; l = l->next){
+            const sr_channel *const probe = (const sr_channel *)l->data;
+            if (probe->type == SR_CHANNEL_LOGIC && probe->enabled)
+                logic_num++;
+        }
+
+        _sync_device_num = count;
+        _sync_first_index = index;
+
+        for (int i = 0; i < count; i++)
+        {
+            std::vector<const sr_channel*> probes;
+
+            for (const GSList *l = ds_get_sync_device_channels(array[i].handle); l; l = l->next){
+                const sr_channel *const probe = (const sr_channel *)l->data;
+                if (probe->type == SR_CHANNEL_LOGIC && probe->enabled)
+                    probes.push_back(probe);
+            }
+
+            // The device still runs, its data is dropped
+            if (probes.empty() || logic_num + probes.size() >= CHANNEL_MAX_COUNT){
+                dsv_err("The sync device \"%s\" adds %d channels, drop it.",
+                    array[i].name, (int)probes.size());
+                _sync_sources.push_back(-1);
+                continue;
+            }
+
+            for (auto probe : probes){
+                sr_channel *ch = (sr_channel*)g_malloc0(sizeof(sr_channel));
+                ch->index = index++;
+                ch->type = SR_CHANNEL_LOGIC;
+                ch->enabled = TRUE;
+                ch->name = g_strdup_printf("%d:%s", i + 1, probe->name);
+                _sync_channels = g_slist_append(_sync_channels, ch);
+            }
+
+            logic_num += probes.size();
+            _sync_sources.push_back(_sync_channel_nums.size() + 1);
+            _sync_channel_nums.push_back(probes.size());
+        }
+        free(array);
+
+        if (_sync_channels != NULL){
+            _capture_channels = g_slist_concat(g_slist_copy(_device_agent.get_channels()),
+                                               g_slist_copy(_sync_channels));
+        }
+    }
+
+    void SigSession::free_sync_channels()
+    {
+        for (GSList *l = _sync_channels; l; l = l->next){
+            sr_channel *ch = (sr_channel*)l->data;
+            g_free(ch->name);
+            g_free(ch);
+        }
+        g_slist_free(_sync_channels);
+        g_slist_free(_capture_channels);
+
+        _sync_channels = NULL;
+        _capture_channels = NULL;
+        _sync_device_num = 0;
+        _sync_channel_nums.clear();
+        _sync_sources.clear();
+    }
+
+    bool SigSession::prepare_sync_capture()
+    {
+        struct ds_device_base_info *array = NULL;
+        int count = 0;
+        bool ret = true;
+
+        update_sync_channels();
+
+        if (_sync_device_num == 0)
+            return true;
+
+        if (ds_get_sync_device_list(&array, &count) != SR_OK || array == NULL)
+            return true;
+
+        // The devices run at the same samplerate and sample count
+        uint64_t samplerate = _device_agent.get_sample_rate();
+        uint64_t limit = _device_agent.get_sample_limit();
+
+        for (int i = 0; i < count; i++)
+        {
+            GVariant *gvar = NULL;
+            uint64_t rate = 0;
+
+            ds_set_sync_device_config(array[i].handle, SR_CONF_SAMPLERATE, g_variant_new_uint64(samplerate));
+            ds_set_sync_device_config(array[i].handle, SR_CONF_LIMIT_SAMPLES, g_variant_new_uint64(limit));
+
+            if (ds_get_sync_device_config(array[i].handle, SR_CONF_SAMPLERATE, &gvar) == SR_OK && gvar != NULL){
+                rate = g_variant_get_uint64(gvar);
+                g_variant_unref(gvar);
+            }
+
+            if (rate != samplerate){
+                dsv_err("The sync device \"%s\" runs at %llu, not at %llu.",
+                    array[i].name, (u64_t)rate, (u64_t)samplerate);
+                QString err_str(L_S(STR_PAGE_MSG, S_ID(IDS_MSG_SYNC_SAMPLERATE_ERROR),
+                                "The sync device does not support the samplerate:"));
+                MsgBox::Show(err_str + "\n" + QString(array[i].name));
+                ret = false;
+                break;
+            }
+        }
+        free(array);
+
+        return ret;
+    }
+
+    void SigSession::feed_in_sync(int src, const struct sr_datafeed_packet *packet)
+    {
+        switch (packet->type)
+        {
+        case SR_DF_TRIGGER:
+            {
+                const ds_trigger_pos *pos = (const ds_trigger_pos *)packet->payload;
+                if (packet->status == SR_PKT_OK && pos != NULL && (pos->status & 0x01))
+                    _sync_merger.set_trigger(src, trigger_sample(*pos));
+            }
+            break;
+
+        case SR_DF_LOGIC:
+            if (packet->status != SR_PKT_OK){
+                dsv_err("The sync device %d sent a bad packet.", src);
+                break;
+            }
+            _sync_merger.append(src, *(const sr_datafeed_logic *)packet->payload);
+            feed_in_merged();
+            break;
+
+        case SR_DF_END:
+            if (packet->status != SR_PKT_OK){
+                dsv_err("The sync device %d ended with an error.", src);
+                if (src == 0)
+                    _sync_end_ok = false;
+            }
+            _sync_merger.end(src);
+            feed_in_merged();
+            break;
+        }
+    }
+
+    void SigSession::feed_in_merged()
+    {
+        bool bAligned = _sync_merger.is_aligned();
+
+        if (!_sync_merger.take(_sync_data))
+            return;
+
+        // The trigger position is known once all devices have data
+        if (!bAligned && _trigger_flag)
+        {
+            _capture_data->_trig_pos = _sync_merger.get_trigger_pos();
+
+            if (_capture_data == _view_data){
+                _callback->receive_trigger(_capture_data->_trig_pos);
+            }
+        }
+
+        sr_datafeed_logic logic;
+        memset(&logic, 0, sizeof(logic));
+        logic.format = LA_CROSS_DATA;
+        logic.length = _sync_data.size() * sizeof(uint64_t);
+        logic.data = _sync_data.data();
+
+        feed_in_logic(logic);
+    }
+
     void SigSession::feed_in_dso(const sr_datafeed_dso &o)
     {
         if (_capture_data->get_dso()->memory_failed())
@@ -1343,6 +1909,35 @@ namespace pv
         if (_data_lock && packet->type != SR_DF_END)
             return;
 
+        // The packets of the sync devices go to the merger,
+        // the capture ends with the last device.
+        if (_sync_device_num > 0)
+        {
+            int sync_index = ds_get_sync_device_index(sdi);
+
+            if (sync_index >= 0)
+            {
+                int src = -1;
+                if (_sync_merger.is_active() && sync_index < (int)_sync_sources.size())
+                    src = _sync_sources[sync_index];
+
+                if (src < 0)
+                    return;
+
+                feed_in_sync(src, packet);
+
+                if (packet->type != SR_DF_END || !_sync_merger.all_ended())
+                    return;
+            }
+            else if (packet->type == SR_DF_END && _sync_merger.is_active())
+            {
+                feed_in_sync(0, packet);
+
+                if (!_sync_merger.all_ended())
+                    return;
+            }
+        }
+
         if (packet->type != SR_DF_END &&
             packet->status != SR_PKT_OK)
         {
@@ -1370,7 +1965,10 @@ namespace pv
 
         case SR_DF_LOGIC:
             assert(packet->payload);
-            feed_in_logic(*(const sr_datafeed_logic *)packet->payload);
+            if (_sync_merger.is_active())
+                feed_in_sync(0, packet);
+            else
+                feed_in_logic(*(const sr_datafeed_logic *)packet->payload);
             break;
 
         case SR_DF_DSO:
@@ -1396,21 +1994,42 @@ namespace pv
         {
             dsv_info("------------SR_DF_END packet.");
 
-            _capture_data->get_logic()->capture_ended();
+            // The status of the current device
+            bool bEndOk = packet->status == SR_PKT_OK;
+            if (_sync_merger.is_active())
+                bEndOk = _sync_end_ok;
+
+            if (_is_recording)
+                end_record(bEndOk);
+
+            int mode = _device_agent.get_work_mode();
+
+            // A repeat frame out of view ends on its own thread, the device
+            // rearms meanwhile. It goes to view at once, the readers of its
+            // last block wait on the snapshot lock.
+            if (mode == LOGIC && bEndOk && is_repeat_mode() && _capture_data != _view_data)
+                end_logic_later(_capture_data->get_logic());
+            else
+                _capture_data->get_logic()->capture_ended();
+
             _capture_data->get_dso()->capture_ended();
             _capture_data->get_analog()->capture_ended();
 
-            if (packet->status != SR_PKT_OK)
+            if (!bEndOk)
             {
                 _error = Pkt_data_err;
                 _callback->session_error();
             }
             else
             {
-                int mode = _device_agent.get_work_mode();
-
                 // Post a message to start all decode tasks.
                 if (mode == LOGIC){
+                    _repeat_end_time = QDateTime::currentMSecsSinceEpoch();
+
+                    uint64_t hwm = 0;
+                    if (_device_agent.get_config_uint64(SR_CONF_INGEST_HWM, hwm))
+                        dsv_info("Ingest ring high-water mark:%llu", (u64_t)hwm);
+
                     _callback->trigger_message(DSV_MSG_REV_END_PACKET);
                 }
                 else{
@@ -1439,6 +2058,23 @@ namespace pv
         _session->data_feed_in(sdi, packet);
     }
 
+    void* SigSession::data_lend(int type, uint64_t size, uint64_t ahead)
+    {
+        // Analog packets can go straight into the snapshot ring
+        if (type != SR_DF_ANALOG || _capture_data->get_analog()->last_ended())
+            return NULL;
+
+        return _capture_data->get_analog()->lend_buffer(size, ahead);
+    }
+
+    void* SigSession::data_lend_callback(const struct sr_dev_inst *sdi,
+                                         int type, uint64_t size, uint64_t ahead)
+    {
+        (void)sdi;
+        assert(_session);
+        return _session->data_lend(type, size, ahead);
+    }
+
     uint16_t SigSession::get_ch_num(int type)
     {
         uint16_t num_channels = 0;
@@ -1816,16 +2452,111 @@ namespace pv
         std::lock_guard<std::mutex> lock(_decode_task_mutex);
         _decode_tasks.push_back(trace);
 
-        if (!_is_decoding)
-        {
-            if (_decode_thread.joinable())
-                _decode_thread.join();
+        join_done_decode_threads();
 
-            _decode_thread = std::thread(&SigSession::decode_task_proc, this);
+        // The decoder stacks are independent, each thread runs one at a time
+        start_decode_thread();
+    }
+
+    // The caller holds _decode_task_mutex
+    void SigSession::start_decode_thread()
+    {
+        if (_decode_workers < decode_thread_count())
+        {
+            _decode_threads.push_back(std::thread(&SigSession::decode_task_proc, this));
+            _decode_workers++;
             _is_decoding = true;
         }
     }
 
+    namespace
+    {
+        struct DecodeParts
+        {
+            std::function<void(int)> task;
+            std::atomic<int> next;
+            int count;
+            int done;
+            std::mutex mutex;
+            std::condition_variable cond;
+        };
+
+        void run_parts(DecodeParts &st)
+        {
+            int finished = 0;
+            int i;
+
+            while ((i = st.next++) < st.count){
+                st.task(i);
+                finished++;
+            }
+
+            if (finished > 0){
+                std::lock_guard<std::mutex> lock(st.mutex);
+                st.done += finished;
+                if (st.done == st.count)
+                    st.cond.notify_all();
+            }
+        }
+    }
+
+    void SigSession::run_decode_parts(int count, const std::function<void(int)> &task)
+    {
+        if (count <= 0)
+            return;
+
+        std::shared_ptr<DecodeParts> st = std::make_shared<DecodeParts>();
+        st->task = task;
+        st->next = 0;
+        st->count = count;
+        st->done = 0;
+
+        // A decode thread that takes a job late finds no part left
+        {
+            std::lock_guard<std::mutex> lock(_decode_task_mutex);
+            join_done_decode_threads();
+
+            for (int i = 1; i < count; i++){
+                _decode_jobs.push_back([st]{ run_parts(*st); });
+                start_decode_thread();
+            }
+        }
+
+        run_parts(*st);
+
+        std::unique_lock<std::mutex> lock(st->mutex);
+        st->cond.wait(lock, [&st]{ return st->done == st->count; });
+    }
+
+    int SigSession::decode_thread_count()
+    {
+        int num = AppConfig::Instance().appOptions.decodeThreads;
+
+        if (num <= 0)
+            num = std::min((int)std::thread::hardware_concurrency(), MaxAutoDecodeThreads);
+
+        // each stack reads the snapshot with its own slot
+        return std::max(1, std::min(num, pv::data::LogicSnapshot::MaxDecodeReaders));
+    }
+
+    // The caller holds _decode_task_mutex
+    void SigSession::join_done_decode_threads()
+    {
+        for (auto id : _decode_done_threads)
+        {
+            for (auto it = _decode_threads.begin(); it != _decode_threads.end(); it++)
+            {
+                if ((*it).get_id() == id)
+                {
+                    (*it).join();
+                    _decode_threads.erase(it);
+                    break;
+                }
+            }
+        }
+        _decode_done_threads.clear();
+    }
+
     void SigSession::remove_decode_task(view::DecodeTrace *trace)
     {
         std::lock_guard<std::mutex> lock(_decode_task_mutex);
@@ -1851,19 +2582,19 @@ namespace pv
             return;
 
         // create the wait task deque
-        int dex = -1;
-        clear_all_decode_task(dex);
+        std::vector<int> dexs;
+        clear_all_decode_task(dexs);
 
-        view::DecodeTrace *runningTrace = NULL;
-        if (dex != -1)
+        std::set<view::DecodeTrace*> runningTraces;
+        for (int dex : dexs)
         {
-            runningTrace = _decode_traces[dex];
-            runningTrace->_delete_flag = true; // destroy it in thread
+            _decode_traces[dex]->_delete_flag = true; // destroy it in thread
+            runningTraces.insert(_decode_traces[dex]);
         }
 
         for (auto trace : _decode_traces)
         {
-            if (trace != runningTrace)
+            if (runningTraces.find(trace) == runningTraces.end())
                 delete trace;
         }
         _decode_traces.clear();
@@ -1872,7 +2603,7 @@ namespace pv
             signals_changed();
     }
 
-    void SigSession::clear_all_decode_task(int &runningDex)
+    void SigSession::clear_all_decode_task(std::vector<int> &runningDexs)
     {
         if (true)
         {
@@ -1884,24 +2615,39 @@ namespace pv
                 trace->decoder()->stop_decode_work(); // set decode proc stop flag
             }
             _decode_tasks.clear();
+
+            // The running stacks take their parts left
+            _decode_jobs.clear();
         }
 
-        // make sure the running task can stop
-        runningDex = -1;
+        // make sure the running tasks can stop
+        runningDexs.clear();
         int dex = 0;
         for (auto trace : _decode_traces)
         {
             if (trace->decoder()->IsRunning())
             {
                 trace->decoder()->stop_decode_work();
-                runningDex = dex;
+                runningDexs.push_back(dex);
             }
             dex++;
         }
 
-        // Wait the thread end.
-        if (_decode_thread.joinable())
-            _decode_thread.join();
+        // Wait the threads end.
+        std::list<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> lock(_decode_task_mutex);
+            threads.swap(_decode_threads);
+        }
+
+        for (auto &th : threads)
+        {
+            if (th.joinable())
+                th.join();
+        }
+
+        std::lock_guard<std::mutex> lock(_decode_task_mutex);
+        _decode_done_threads.clear();
     }
 
     view::DecodeTrace *SigSession::get_decoder_trace(int index)
@@ -1913,10 +2659,19 @@ namespace pv
         assert(false);
     }
 
-    view::DecodeTrace *SigSession::get_top_decode_task()
+    // No task left ends the calling decode thread
+    view::DecodeTrace *SigSession::get_top_decode_task(std::function<void()> &job)
     {
         std::lock_guard<std::mutex> lock(_decode_task_mutex);
 
+        // The parts of a running stack go first
+        if (!_decode_jobs.empty())
+        {
+            job = _decode_jobs.front();
+            _decode_jobs.pop_front();
+            return NULL;
+        }
+
         auto it = _decode_tasks.begin();
         if (it != _decode_tasks.end())
         {
@@ -1925,17 +2680,46 @@ namespace pv
             return p;
         }
 
+        _decode_done_threads.push_back(std::this_thread::get_id());
+        if (--_decode_workers == 0)
+            _is_decoding = false;
+
         return NULL;
     }
 
+    void SigSession::end_logic_later(LogicSnapshot *logic)
+    {
+        // One frame ends at a time, the last one had a whole capture to end
+        if (_end_thread.joinable())
+            _end_thread.join();
+
+        logic->defer_capture_end();
+        _end_thread = std::thread([logic]{ logic->finish_capture_end(); });
+    }
+
+    bool SigSession::logic_ended(LogicSnapshot *logic)
+    {
+        // The deferred end is cleared after the snapshot is ended
+        return logic->end_deferred() || logic->last_ended();
+    }
+
     // the decode task thread proc
     void SigSession::decode_task_proc()
     {
         dsv_info("------->decode thread start");
-        auto task = get_top_decode_task();
+        std::function<void()> job;
+        auto task = get_top_decode_task(job);
 
-        while (task != NULL)
+        while (task != NULL || job)
         {
+            if (job)
+            {
+                job();
+                job = nullptr;
+                task = get_top_decode_task(job);
+                continue;
+            }
+
             if (!task->_delete_flag)
             {
                 task->decoder()->begin_decode_work();
@@ -1953,13 +2737,13 @@ namespace pv
                 }
             }
 
-            task = get_top_decode_task();
+            task = get_top_decode_task(job);
         }
 
+        // the blocks of the stacks that ended
         _view_data->get_logic()->decode_end();
 
         dsv_info("------->decode thread end");
-        _is_decoding = false;        
     }
 
     Snapshot *SigSession::get_signal_snapshot()
@@ -2001,7 +2785,7 @@ namespace pv
         case DS_EV_DEVICE_STOPPED:
             _device_status = ST_STOPPED;
             // Confirm that SR_DF_END was received
-            if (   !_capture_data->get_logic()->last_ended() 
+            if (   !logic_ended(_capture_data->get_logic())
                 || !_capture_data->get_dso()->last_ended()
                 || !_capture_data->get_analog()->last_ended())
             {
@@ -2020,7 +2804,7 @@ namespace pv
         {
             _callback->trigger_message(DSV_MSG_COLLECT_END);
 
-            if (_capture_data->get_logic()->last_ended() == false)
+            if (logic_ended(_capture_data->get_logic()) == false)
                 dsv_err("The collected data is error!");
 
             if (_capture_data->get_dso()->last_ended() == false)
@@ -2131,14 +2915,28 @@ namespace pv
             reload();
             break;
 
+        case DSV_MSG_LOOP_STOPPED:
+            if (_is_working && is_loop_mode()){
+                dsv_info("SigSession::OnMessage, the loop ring stopped, stop capture");
+                stop_capture();
+            }
+            break;
+
         case DSV_MSG_TRIG_NEXT_COLLECT:
             {
                 if (_is_working && is_repeat_mode())
                 {
-                    if (_repeat_intvl > 0)
+                    // The hold counts from the end of the data, the time spent
+                    // to end the last capture is a part of it.
+                    // The last frame may still build its mipmap, see end_logic_later().
+                    qint64 hold = _repeat_intvl * 1000;
+                    if (_repeat_end_time > 0)
+                        hold -= QDateTime::currentMSecsSinceEpoch() - _repeat_end_time;
+
+                    if (_repeat_intvl > 0 && hold > 0)
                     {
-                        _repeat_hold_prg = 100;
-                        _repeat_timer.Start(_repeat_intvl * 1000);
+                        _repeat_hold_prg = std::max((int)(hold * 100 / (qint64)(_repeat_intvl * 1000)), 1);
+                        _repeat_timer.Start((int)hold);
                         int intvl = _repeat_intvl * 1000 / 20;
 
                         if (intvl >= 100){
@@ -2166,6 +2964,11 @@ namespace pv
 
         case DSV_MSG_REV_END_PACKET:
             {
+                if (_record_msg != ""){
+                    _callback->delay_prop_msg(_record_msg);
+                    _record_msg = "";
+                }
+
                 if (_device_agent.get_work_mode() == LOGIC)
                 {  
                     bool bAddDecoder = false;
@@ -2213,8 +3016,13 @@ namespace pv
                     //Switch the caputrued data buffer to view.
                     if (bSwapBuffer)
                     {
-                        if (_view_data != _capture_data)
-                            _view_data->clear();
+                        // The next capture goes to this buffer, it keeps the blocks
+                        if (_view_data != _capture_data){
+                            if (is_repeat_mode())
+                                _view_data->recycle();
+                            else
+                                _view_data->clear();
+                        }
                         
                         _view_data = _capture_data; 
                         attach_data_to_signal(_view_data); 
@@ -2271,6 +3079,7 @@ namespace pv
             if (cur_mode == LOGIC){
                 clear_all_decode_task2();
                 clear_decode_result();
+                clear_sync_devices();
             }
 
             _is_stream_mode = false;
@@ -2420,7 +3229,9 @@ namespace pv
 
         if (traceType == SR_CHANNEL_LOGIC || traceType == SR_CHANNEL_ANALOG)
         { 
-            _device_agent.set_channel_name(trace->get_index(), name.toUtf8());
+            // A sync channel is only named in the view
+            if (_sync_channels == NULL || trace->get_index() < _sync_first_index)
+                _device_agent.set_channel_name(trace->get_index(), name.toUtf8());
         }
         else if (traceType == SR_CHANNEL_DECODER && _decoder_pannel != NULL){
             _decoder_pannel->update_deocder_item_name(trace, name.toUtf8().data());
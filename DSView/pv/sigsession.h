@@ -31,6 +31,8 @@
 #include <thread>
 #include <QDateTime>
 #include <list>
+#include <deque>
+#include <functional>
 
 #include "view/mathtrace.h"
 #include "data/mathstack.h"
@@ -42,6 +44,8 @@
 #include "data/logicsnapshot.h"
 #include "data/analogsnapshot.h"
 #include "data/dsosnapshot.h"
+#include "data/logicrecorder.h"
+#include "data/syncmerger.h"
  
 struct srd_decoder;
 struct srd_channel;
@@ -107,6 +111,9 @@ public:
 
     void clear();
 
+    // Clear it for the next capture, the logic blocks are kept
+    void recycle();
+
 public:
     uint64_t       _cur_snap_samplerate;
     uint64_t       _cur_samplelimits;
@@ -127,6 +134,9 @@ class SigSession:
 {
 private:
     static constexpr float Oversampling = 2.0f;
+    // The python code of the decoders runs under the GIL, only the sample
+    // matching of wait() runs free, more threads wait on the GIL
+    static const int MaxAutoDecodeThreads = 4;
 
 public:
     static const int RefreshTime = 500;
@@ -172,6 +182,20 @@ public:
     bool stop_capture();
     bool switch_work_mode(int mode);
 
+    // Hand the thread options of the app to the lib, a collect thread
+    // takes them when it starts
+    void apply_thread_sched();
+
+    // A sync device captures along with the current one, in logic mode.
+    // Its channels follow the channels of the current device.
+    bool set_sync_device(ds_device_handle dev_handle, bool bSync);
+    bool is_sync_device(ds_device_handle dev_handle);
+
+    // The logic channels of the capture, with the sync devices
+    inline GSList* get_capture_channels(){
+        return _capture_channels != NULL ? _capture_channels : _device_agent.get_channels();
+    }
+
     uint64_t cur_samplerate();
     uint64_t cur_snap_samplerate();
     uint64_t cur_samplelimits();
@@ -352,6 +376,15 @@ public:
     }
 
     bool is_realtime_refresh();
+    int decode_thread_count();
+
+    // Runs @task(0..count-1) on the calling decode thread and the free ones
+    void run_decode_parts(int count, const std::function<void(int)> &task);
+
+    // A logic stream capture goes to a file, the view gets an overview
+    inline bool is_recording(){
+        return _is_recording;
+    }
 
     inline bool is_repeating(){
         return _clt_mode == COLLECT_REPEAT && !_is_instant;
@@ -461,17 +494,24 @@ private:
   
     void add_decode_task(view::DecodeTrace *trace);
     void remove_decode_task(view::DecodeTrace *trace);
-    void clear_all_decode_task(int &runningDex);
+    void clear_all_decode_task(std::vector<int> &runningDexs);
 
     inline void clear_all_decode_task2(){
-        int run_dex = 0;
-        clear_all_decode_task(run_dex);
+        std::vector<int> run_dexs;
+        clear_all_decode_task(run_dexs);
     }
    
     void decode_task_proc();
-    view::DecodeTrace* get_top_decode_task();    
+    view::DecodeTrace* get_top_decode_task(std::function<void()> &job);
+    void join_done_decode_threads();
+    void start_decode_thread();
 
     void capture_init(); 
+
+    // Ends the logic data of a repeat frame on _end_thread
+    void end_logic_later(LogicSnapshot *logic);
+    bool logic_ended(LogicSnapshot *logic);
+
     void nodata_timeout();
     void feed_timeout();    
     void clear_decode_result();
@@ -504,7 +544,22 @@ private:
 	void feed_in_header(const sr_dev_inst *sdi);
 	void feed_in_meta(const sr_dev_inst *sdi, const sr_datafeed_meta &meta);
     void feed_in_trigger(const ds_trigger_pos &trigger_pos);
+    static uint64_t trigger_sample(const ds_trigger_pos &trigger_pos);
 	void feed_in_logic(const sr_datafeed_logic &o);
+    void feed_in_record(const sr_datafeed_logic &o);
+    void feed_in_overview();
+    void arm_loop_stop(uint64_t trig_pos);
+    void freeze_loop();
+    bool start_record();
+    void end_record(bool bOk);
+    void make_record_header(std::string &str);
+
+    void update_sync_channels();
+    void free_sync_channels();
+    void clear_sync_devices();
+    bool prepare_sync_capture();
+    void feed_in_sync(int src, const struct sr_datafeed_packet *packet);
+    void feed_in_merged();
 
     void feed_in_dso(const sr_datafeed_dso &o);
 	void feed_in_analog(const sr_datafeed_analog &o);    
@@ -514,6 +569,11 @@ private:
 	static void data_feed_callback(const struct sr_dev_inst *sdi,
 		        const struct sr_datafeed_packet *packet);
 
+    void* data_lend(int type, uint64_t size, uint64_t ahead);
+
+    static void* data_lend_callback(const struct sr_dev_inst *sdi,
+                int type, uint64_t size, uint64_t ahead);
+
     static void device_lib_event_callback(int event);
     
     void on_device_lib_event(int event);
@@ -540,12 +600,16 @@ private:
     mutable std::mutex      _sampling_mutex;
     mutable std::mutex      _data_mutex;
     mutable std::mutex      _decode_task_mutex;  
-    std::thread             _decode_thread;
+    std::list<std::thread>  _decode_threads;
+    std::vector<std::thread::id> _decode_done_threads; // ended, not joined yet
+    int                     _decode_workers; // the running decode threads
+    std::thread             _end_thread; // ends a repeat frame, see end_logic_later()
     volatile bool           _is_decoding;
  
 	std::vector<view::Signal*>      _signals; 
     std::vector<view::DecodeTrace*> _decode_traces;
     std::vector<view::DecodeTrace*> _decode_tasks;
+    std::deque<std::function<void()>> _decode_jobs; // the parts of a split decode, before the tasks
     pv::data::DecoderModel          *_decoder_model;
     std::vector<view::SpectrumTrace*> _spectrum_traces;
     view::LissajousTrace            *_lissajous_trace;
@@ -581,6 +645,7 @@ private:
     double      _repeat_intvl; // The progress wait timer interval.
     int         _repeat_hold_prg; // The time sleep progress
     int         _repeat_wait_prog_step;
+    qint64      _repeat_end_time; // When the last capture ended, the hold counts from it
     bool        _is_saving;
     bool        _is_instant;
     volatile int  _device_status;
@@ -606,6 +671,29 @@ private:
     IDecoderPannel  *_decoder_pannel;
     sr_status       _dso_status;
     bool            _dso_status_valid;
+
+    data::LogicRecorder _recorder;
+    bool            _is_recording;
+    uint64_t        _record_trig_pos;
+    std::vector<uint64_t> _record_overview;
+    QString         _record_file;
+    QString         _record_msg;
+
+    // The loop ring stops at a trigger, the window keeps the pre-trigger samples
+    uint64_t        _loop_bytes; // logic payload bytes of the capture
+    uint64_t        _loop_stop_bytes; // 0 is not armed
+    uint64_t        _loop_trig_pos;
+    bool            _loop_frozen;
+
+    data::SyncMerger _sync_merger;
+    int             _sync_device_num;
+    GSList          *_sync_channels; // owned copies, indexed after the device channels
+    GSList          *_capture_channels;
+    std::vector<unsigned int> _sync_channel_nums;
+    std::vector<int> _sync_sources; // the merger source of each sync device
+    std::vector<uint64_t> _sync_data;
+    int             _sync_first_index;
+    bool            _sync_end_ok;
    
 private:
 	// TODO: This should not be necessary. Multiple concurrent
@@ -459,46 +459,58 @@ void StoreSession::save_proc(data::Snapshot *snapshot)
 }
 
 bool StoreSession::meta_gen(data::Snapshot *snapshot, std::string &str)
+{
+    MetaInfo info;
+
+    info.snapshot = snapshot;
+    info.sample_count = snapshot->get_sample_count();
+    info.block_num = snapshot->get_block_num();
+    info.samplerate = _session->cur_snap_samplerate();
+    info.trig_pos = _session->get_trigger_pos();
+
+    meta_gen(_session, info, str);
+    return true;
+}
+
+void StoreSession::meta_gen(SigSession *session, const MetaInfo &info, std::string &str)
 {
     GSList *l;
     struct sr_channel *probe;
     int probecnt;
     char *s;
-    struct sr_status status;
     char meta[300] = {0};
+    data::Snapshot *snapshot = info.snapshot;
   
     sprintf(meta, "%s", "[version]\n"); str += meta;
     sprintf(meta, "version = %d\n", HEADER_FORMAT_VERSION); str += meta;
     sprintf(meta, "%s", "[header]\n"); str += meta;
 
-    int mode = _session->get_device()->get_work_mode();
+    int mode = session->get_device()->get_work_mode();
 
     if (true) {
-        sprintf(meta, "driver = %s\n", _session->get_device()->driver_name().toLocal8Bit().data()); str += meta;
+        sprintf(meta, "driver = %s\n", session->get_device()->driver_name().toLocal8Bit().data()); str += meta;
         sprintf(meta, "device mode = %d\n", mode); str += meta;
     }
  
     sprintf(meta, "capturefile = data\n"); str += meta;
-    sprintf(meta, "total samples = %" PRIu64 "\n", snapshot->get_sample_count()); str += meta;
+    sprintf(meta, "total samples = %" PRIu64 "\n", info.sample_count); str += meta;
 
     if (mode != LOGIC) {
         sprintf(meta, "total probes = %d\n", snapshot->get_channel_num()); str += meta;
-        sprintf(meta, "total blocks = %d\n", snapshot->get_block_num()); str += meta;
+        sprintf(meta, "total blocks = %" PRIu64 "\n", info.block_num); str += meta;
     }
-
-    data::LogicSnapshot *logic_snapshot = NULL;
-    if ((logic_snapshot = dynamic_cast<data::LogicSnapshot*>(snapshot))) {
+    else {
         uint16_t to_save_probes = 0;
-        for (l = _session->get_device()->get_channels(); l; l = l->next) {
+        for (l = session->get_device()->get_channels(); l; l = l->next) {
             probe = (struct sr_channel *)l->data;
-            if (probe->enabled && logic_snapshot->has_data(probe->index))
+            if (probe->enabled && (snapshot == NULL || snapshot->has_data(probe->index)))
                 to_save_probes++;
         }
         sprintf(meta, "total probes = %d\n", to_save_probes); str += meta;
-        sprintf(meta, "total blocks = %d\n", logic_snapshot->get_block_num()); str += meta;
+        sprintf(meta, "total blocks = %" PRIu64 "\n", info.block_num); str += meta;
     }
 
-    s = sr_samplerate_string(_session->cur_snap_samplerate());
+    s = sr_samplerate_string(info.samplerate);
 
     sprintf(meta, "samplerate = %s\n", s); str += meta;
 
@@ -507,32 +519,32 @@ bool StoreSession::meta_gen(data::Snapshot *snapshot, std::string &str)
     uint32_t tmp_u32;
 
     if (mode == DSO) {
-        if (_session->get_device()->get_config_uint64(SR_CONF_TIMEBASE, tmp_u64)) {
+        if (session->get_device()->get_config_uint64(SR_CONF_TIMEBASE, tmp_u64)) {
             sprintf(meta, "hDiv = %" PRIu64 "\n", tmp_u64); str += meta;
         }
 
-        if (_session->get_device()->get_config_uint64(SR_CONF_MAX_TIMEBASE, tmp_u64)) {
+        if (session->get_device()->get_config_uint64(SR_CONF_MAX_TIMEBASE, tmp_u64)) {
             sprintf(meta, "hDiv max = %" PRIu64 "\n", tmp_u64); str += meta;
         }
 
-        if (_session->get_device()->get_config_uint64(SR_CONF_MIN_TIMEBASE, tmp_u64)) {
+        if (session->get_device()->get_config_uint64(SR_CONF_MIN_TIMEBASE, tmp_u64)) {
             sprintf(meta, "hDiv min = %" PRIu64 "\n", tmp_u64); str += meta;
         }
  
-        if (_session->get_device()->get_config_byte(SR_CONF_UNIT_BITS, tmp_u8)) {
+        if (session->get_device()->get_config_byte(SR_CONF_UNIT_BITS, tmp_u8)) {
             sprintf(meta, "bits = %d\n", tmp_u8); str += meta;
         }
  
-        if (_session->get_device()->get_config_uint32(SR_CONF_REF_MIN, tmp_u32)) {
+        if (session->get_device()->get_config_uint32(SR_CONF_REF_MIN, tmp_u32)) {
             sprintf(meta, "ref min = %d\n", tmp_u32); str += meta;
         }
 
-        if (_session->get_device()->get_config_uint32(SR_CONF_REF_MAX, tmp_u32)) {
+        if (session->get_device()->get_config_uint32(SR_CONF_REF_MAX, tmp_u32)) {
             sprintf(meta, "ref max = %d\n", tmp_u32); str += meta;
         }
     }
     else if (mode == LOGIC) {
-        sprintf(meta, "trigger time = %lld\n", _session->get_session_time().toMSecsSinceEpoch()); str += meta;
+        sprintf(meta, "trigger time = %lld\n", session->get_session_time().toMSecsSinceEpoch()); str += meta;
     }
     else if (mode == ANALOG) {
         data::AnalogSnapshot *analog_snapshot = NULL;
@@ -541,23 +553,23 @@ bool StoreSession::meta_gen(data::Snapshot *snapshot, std::string &str)
             sprintf(meta, "bits = %d\n", tmp_u8*8); str += meta;
         }
 
-        if (_session->get_device()->get_config_uint32(SR_CONF_REF_MIN, tmp_u32)) {
+        if (session->get_device()->get_config_uint32(SR_CONF_REF_MIN, tmp_u32)) {
             sprintf(meta, "ref min = %d\n", tmp_u32); str += meta;
         }
 
-        if (_session->get_device()->get_config_uint32(SR_CONF_REF_MAX, tmp_u32)) {
+        if (session->get_device()->get_config_uint32(SR_CONF_REF_MAX, tmp_u32)) {
             sprintf(meta, "ref max = %d\n", tmp_u32); str += meta;
         }
     }
-    sprintf(meta, "trigger pos = %" PRIu64 "\n", _session->get_trigger_pos()); str += meta;
+    sprintf(meta, "trigger pos = %" PRIu64 "\n", info.trig_pos); str += meta;
 
     probecnt = 0; 
 
-    for (l = _session->get_device()->get_channels(); l; l = l->next) {
+    for (l = session->get_device()->get_channels(); l; l = l->next) {
         
         probe = (struct sr_channel *)l->data;
         
-        if (!snapshot->has_data(probe->index))
+        if (snapshot != NULL && !snapshot->has_data(probe->index))
             continue;
 
         if (mode == LOGIC && !probe->enabled)
@@ -590,9 +602,9 @@ bool StoreSession::meta_gen(data::Snapshot *snapshot, std::string &str)
             sprintf(meta, " vTrig%d = %d\n", probecnt, probe->trig_value);
             str += meta;
 
-            if (_session->dso_status_is_valid())
+            if (session->dso_status_is_valid())
             {
-                sr_status status = _session->get_dso_status();
+                sr_status status = session->get_dso_status();
                 
                 if (probe->index == 0)
                 {
@@ -678,7 +690,7 @@ bool StoreSession::meta_gen(data::Snapshot *snapshot, std::string &str)
         probecnt++;
     } 
 
-    return true;
+    g_free(s);
 }
 
 //export as csv file
@@ -51,6 +51,17 @@ class ProtocolDock;
 class StoreSession : public QObject
 {
 	Q_OBJECT
+
+public:
+    // What the header of a .dsl file tells of the data
+    struct MetaInfo
+    {
+        data::Snapshot *snapshot;   // NULL when all enabled channels have data
+        uint64_t    sample_count;
+        uint64_t    block_num;
+        uint64_t    samplerate;
+        uint64_t    trig_pos;
+    };
   
 public:
     StoreSession(SigSession *session);
@@ -82,6 +93,9 @@ private:
  
 
 public:    
+    // The header of a .dsl file, a saved capture and a record share it
+    static void meta_gen(SigSession *session, const MetaInfo &info, std::string &str);
+
     bool gen_decoders_json(QJsonArray &array);
     bool load_decoders(dock::ProtocolDock *widget, QJsonArray &dec_array);
     QString MakeSaveFile(bool bDlg);
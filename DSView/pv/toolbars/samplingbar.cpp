@@ -90,6 +90,7 @@ namespace pv
             _sample_rate.setSizeAdjustPolicy(DsComboBox::AdjustToContents);
             _sample_count.setSizeAdjustPolicy(DsComboBox::AdjustToContents);
             _device_selector.setMaximumWidth(ComboBoxMaxWidth);
+            _device_selector.setContextMenuPolicy(Qt::CustomContextMenu);
 
             //tr
             _run_stop_button.setObjectName("run_stop_button");
@@ -131,6 +132,7 @@ namespace pv
             update_font();
 
             connect(&_device_selector, SIGNAL(currentIndexChanged(int)), this, SLOT(on_device_selected()));
+            connect(&_device_selector, SIGNAL(customContextMenuRequested(const QPoint&)), this, SLOT(on_sync_device_menu(const QPoint&)));
             connect(&_configure_button, SIGNAL(clicked()), this, SLOT(on_configure()));
             connect(&_run_stop_button, SIGNAL(clicked()), this, SLOT(on_run_stop()));
             connect(&_instant_button, SIGNAL(clicked()), this, SLOT(on_instant_stop()));
@@ -966,6 +968,47 @@ namespace pv
             }
         }
 
+        void SamplingBar::on_sync_device_menu(const QPoint &pos)
+        {
+            if (_session->is_working() || _device_agent->get_work_mode() != LOGIC
+                || _device_agent->is_file())
+            {
+                return;
+            }
+
+            int dev_count = 0;
+            int select_index = 0;
+            struct ds_device_base_info *array = _session->get_device_list(dev_count, select_index);
+
+            if (array == NULL)
+                return;
+
+            QMenu menu(this);
+            menu.addSection(L_S(STR_PAGE_TOOLBAR, S_ID(IDS_TOOLBAR_SYNC_DEVICE), "Capture in sync with"));
+
+            for (int i = 0; i < dev_count; i++)
+            {
+                if (i == select_index)
+                    continue;
+
+                QAction *action = menu.addAction(QString(array[i].name));
+                action->setCheckable(true);
+                action->setChecked(_session->is_sync_device(array[i].handle));
+                action->setData(QVariant::fromValue((unsigned long long)array[i].handle));
+            }
+            free(array);
+
+            QAction *action = menu.exec(_device_selector.mapToGlobal(pos));
+            if (action == NULL || !action->isCheckable())
+                return;
+
+            ds_device_handle devHandle = (ds_device_handle)action->data().toULongLong();
+
+            // The view takes the channels of the sync devices
+            if (_session->set_sync_device(devHandle, action->isChecked()))
+                _session->broadcast_msg(DSV_MSG_DEVICE_OPTIONS_UPDATED);
+        }
+
         void SamplingBar::enable_toggle(bool enable)
         {
             bool test = false;
@@ -131,6 +131,7 @@ namespace pv
             void on_run_stop();
             void on_instant_stop();
             void on_device_selected();
+            void on_sync_device_menu(const QPoint &pos);
             void on_samplerate_sel(int index);
             void on_samplecount_sel(int index);
             void on_configure();
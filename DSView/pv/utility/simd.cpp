@@ -0,0 +1,200 @@
+/*
+ * This file is part of the DSView project.
+ * DSView is based on PulseView.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "simd.h"
+#include <assert.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DSV_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace pv
+{
+    namespace simd
+    {
+        typedef void (*deinterleave_func)(const uint64_t*, uint64_t**, unsigned int, uint64_t);
+
+        static void deinterleave_scalar(const uint64_t *src, uint64_t **dst,
+                                        unsigned int channels, uint64_t groups)
+        {
+            for (unsigned int ch = 0; ch < channels; ch++){
+                const uint64_t *rd = src + ch;
+                uint64_t *wr = dst[ch];
+
+                for (uint64_t i = 0; i < groups; i++){
+                    *wr++ = *rd;
+                    rd += channels;
+                }
+            }
+        }
+
+#ifdef DSV_SIMD_X86
+
+        // Two groups at a time, transposing 2x2 word blocks.
+        __attribute__((target("sse2")))
+        static void deinterleave_sse2(const uint64_t *src, uint64_t **dst,
+                                      unsigned int channels, uint64_t groups)
+        {
+            uint64_t i = 0;
+
+            for (; i + 2 <= groups; i += 2)
+            {
+                const uint64_t *r0 = src + i * channels;
+                const uint64_t *r1 = r0 + channels;
+                unsigned int ch = 0;
+
+                for (; ch + 2 <= channels; ch += 2){
+                    __m128i a = _mm_loadu_si128((const __m128i*)(r0 + ch));
+                    __m128i b = _mm_loadu_si128((const __m128i*)(r1 + ch));
+                    _mm_storeu_si128((__m128i*)(dst[ch] + i), _mm_unpacklo_epi64(a, b));
+                    _mm_storeu_si128((__m128i*)(dst[ch + 1] + i), _mm_unpackhi_epi64(a, b));
+                }
+                if (ch < channels){
+                    __m128i a = _mm_loadl_epi64((const __m128i*)(r0 + ch));
+                    __m128i b = _mm_loadl_epi64((const __m128i*)(r1 + ch));
+                    _mm_storeu_si128((__m128i*)(dst[ch] + i), _mm_unpacklo_epi64(a, b));
+                }
+            }
+
+            for (; i < groups; i++){
+                const uint64_t *r0 = src + i * channels;
+                for (unsigned int ch = 0; ch < channels; ch++)
+                    dst[ch][i] = r0[ch];
+            }
+        }
+
+        // Four groups at a time, transposing 4x4 word blocks.
+        __attribute__((target("avx2")))
+        static void deinterleave_avx2(const uint64_t *src, uint64_t **dst,
+                                      unsigned int channels, uint64_t groups)
+        {
+            uint64_t i = 0;
+
+            for (; i + 4 <= groups; i += 4)
+            {
+                const uint64_t *r0 = src + i * channels;
+                const uint64_t *r1 = r0 + channels;
+                const uint64_t *r2 = r1 + channels;
+                const uint64_t *r3 = r2 + channels;
+                unsigned int ch = 0;
+
+                for (; ch + 4 <= channels; ch += 4){
+                    __m256i a = _mm256_loadu_si256((const __m256i*)(r0 + ch));
+                    __m256i b = _mm256_loadu_si256((const __m256i*)(r1 + ch));
+                    __m256i c = _mm256_loadu_si256((const __m256i*)(r2 + ch));
+                    __m256i d = _mm256_loadu_si256((const __m256i*)(r3 + ch));
+
+                    __m256i t0 = _mm256_unpacklo_epi64(a, b);
+                    __m256i t1 = _mm256_unpackhi_epi64(a, b);
+                    __m256i t2 = _mm256_unpacklo_epi64(c, d);
+                    __m256i t3 = _mm256_unpackhi_epi64(c, d);
+
+                    _mm256_storeu_si256((__m256i*)(dst[ch] + i), _mm256_permute2x128_si256(t0, t2, 0x20));
+                    _mm256_storeu_si256((__m256i*)(dst[ch + 1] + i), _mm256_permute2x128_si256(t1, t3, 0x20));
+                    _mm256_storeu_si256((__m256i*)(dst[ch + 2] + i), _mm256_permute2x128_si256(t0, t2, 0x31));
+                    _mm256_storeu_si256((__m256i*)(dst[ch + 3] + i), _mm256_permute2x128_si256(t1, t3, 0x31));
+                }
+                for (; ch < channels; ch++){
+                    __m256i v = _mm256_set_epi64x((long long)r3[ch], (long long)r2[ch],
+                                                  (long long)r1[ch], (long long)r0[ch]);
+                    _mm256_storeu_si256((__m256i*)(dst[ch] + i), v);
+                }
+            }
+
+            for (; i < groups; i++){
+                const uint64_t *r0 = src + i * channels;
+                for (unsigned int ch = 0; ch < channels; ch++)
+                    dst[ch][i] = r0[ch];
+            }
+        }
+
+#endif
+
+        static deinterleave_func get_kernel(int type)
+        {
+#ifdef DSV_SIMD_X86
+            if (type == KERNEL_AVX2)
+                return deinterleave_avx2;
+            if (type == KERNEL_SSE2)
+                return deinterleave_sse2;
+#endif
+            (void)type;
+            return deinterleave_scalar;
+        }
+
+        bool kernel_supported(int type)
+        {
+            switch (type)
+            {
+            case KERNEL_SCALAR:
+                return true;
+#ifdef DSV_SIMD_X86
+            case KERNEL_SSE2:
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("sse2");
+            case KERNEL_AVX2:
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx2");
+#endif
+            default:
+                return false;
+            }
+        }
+
+        int best_kernel()
+        {
+            static const int type = kernel_supported(KERNEL_AVX2) ? KERNEL_AVX2 :
+                                    kernel_supported(KERNEL_SSE2) ? KERNEL_SSE2 :
+                                    KERNEL_SCALAR;
+            return type;
+        }
+
+        const char* kernel_name(int type)
+        {
+            switch (type)
+            {
+            case KERNEL_AVX2:
+                return "avx2";
+            case KERNEL_SSE2:
+                return "sse2";
+            default:
+                return "scalar";
+            }
+        }
+
+        void deinterleave_u64(const uint64_t *src, uint64_t **dst,
+                              unsigned int channels, uint64_t groups)
+        {
+            static const deinterleave_func func = get_kernel(best_kernel());
+
+            assert(src);
+            assert(dst);
+            func(src, dst, channels, groups);
+        }
+
+        void deinterleave_u64_by(int type, const uint64_t *src, uint64_t **dst,
+                                 unsigned int channels, uint64_t groups)
+        {
+            assert(kernel_supported(type));
+            get_kernel(type)(src, dst, channels, groups);
+        }
+    }
+}
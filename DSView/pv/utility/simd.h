@@ -0,0 +1,58 @@
+/*
+ * This file is part of the DSView project.
+ * DSView is based on PulseView.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef UTILITY_SIMD_H
+#define UTILITY_SIMD_H
+
+#include <stdint.h>
+
+namespace pv
+{
+    namespace simd
+    {
+        enum KernelType
+        {
+            KERNEL_SCALAR = 0,
+            KERNEL_SSE2,
+            KERNEL_AVX2,
+        };
+
+        bool kernel_supported(int type);
+
+        // The fastest kernel the running cpu supports.
+        int best_kernel();
+
+        const char* kernel_name(int type);
+
+        /*
+         * De-interleave LA_CROSS_DATA words.
+         * The source holds @groups groups of @channels 64-bit words, one word
+         * per channel. Word @ch of group @g is written to dst[ch][g].
+         */
+        void deinterleave_u64(const uint64_t *src, uint64_t **dst,
+                              unsigned int channels, uint64_t groups);
+
+        void deinterleave_u64_by(int type, const uint64_t *src, uint64_t **dst,
+                                 unsigned int channels, uint64_t groups);
+    }
+}
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ * This file is part of the DSView project.
+ * DSView is based on PulseView.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "workerpool.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace pv
+{
+    namespace
+    {
+        struct ParallelState
+        {
+            std::function<void(int)> task;
+            std::atomic<int> next;
+            int count;
+            int done;
+            std::mutex mutex;
+            std::condition_variable cond;
+        };
+
+        void run_tasks(ParallelState &st)
+        {
+            int finished = 0;
+            int i;
+
+            while ((i = st.next++) < st.count){
+                st.task(i);
+                finished++;
+            }
+
+            if (finished > 0){
+                std::lock_guard<std::mutex> lock(st.mutex);
+                st.done += finished;
+                if (st.done == st.count)
+                    st.cond.notify_all();
+            }
+        }
+    }
+
+    WorkerPool::WorkerPool()
+    {
+        // no worker on a single core, parallel_for() runs inline then
+        int num = (int)std::thread::hardware_concurrency() - 1;
+        if (num < 0)
+            num = 0;
+
+        _exit = false;
+
+        for (int i = 0; i < num; i++)
+            _threads.push_back(std::thread(&WorkerPool::worker_proc, this));
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _exit = true;
+        }
+        _cond.notify_all();
+
+        for (auto &th : _threads)
+            th.join();
+    }
+
+    WorkerPool& WorkerPool::Instance()
+    {
+        static WorkerPool ins;
+        return ins;
+    }
+
+    void WorkerPool::worker_proc()
+    {
+        while (true)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cond.wait(lock, [this]{ return _exit || !_jobs.empty(); });
+
+                if (_exit)
+                    return;
+
+                job = std::move(_jobs.front());
+                _jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    void WorkerPool::post(const std::function<void()> &job)
+    {
+        if (_threads.empty()){
+            job();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _jobs.push_back(job);
+        }
+        _cond.notify_one();
+    }
+
+    void WorkerPool::parallel_for(int count, const std::function<void(int)> &task)
+    {
+        if (count <= 0)
+            return;
+
+        if (count == 1){
+            task(0);
+            return;
+        }
+
+        std::shared_ptr<ParallelState> st = std::make_shared<ParallelState>();
+        st->task = task;
+        st->next = 0;
+        st->count = count;
+        st->done = 0;
+
+        // A helper that starts late finds nothing left and returns at once
+        int helpers = std::min(count - 1, (int)_threads.size());
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (int i = 0; i < helpers; i++)
+                _jobs.push_back([st]{ run_tasks(*st); });
+        }
+        _cond.notify_all();
+
+        run_tasks(*st);
+
+        std::unique_lock<std::mutex> lock(st->mutex);
+        st->cond.wait(lock, [&st]{ return st->done == st->count; });
+    }
+}
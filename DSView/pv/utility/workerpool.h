@@ -0,0 +1,69 @@
+/*
+ * This file is part of the DSView project.
+ * DSView is based on PulseView.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef UTILITY_WORKERPOOL_H
+#define UTILITY_WORKERPOOL_H
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+namespace pv
+{
+    /*
+     * A fixed set of worker threads shared by the data code.
+     */
+    class WorkerPool
+    {
+    public:
+        static WorkerPool& Instance();
+
+        // Run task(0) .. task(count - 1), the calling thread takes part.
+        // Returns when all of them are done.
+        void parallel_for(int count, const std::function<void(int)> &task);
+
+        // Run the job on a worker and return at once, inline without a worker.
+        // A job must not wait for another job.
+        void post(const std::function<void()> &job);
+
+        inline int thread_count(){
+            return (int)_threads.size() + 1;
+        }
+
+    private:
+        WorkerPool();
+        ~WorkerPool();
+
+        void worker_proc();
+
+    private:
+        std::vector<std::thread> _threads;
+        std::deque<std::function<void()>> _jobs;
+        std::mutex  _mutex;
+        std::condition_variable _cond;
+        bool        _exit;
+    };
+}
+
+#endif
@@ -46,6 +46,9 @@ LogicSignal::LogicSignal(data::LogicSnapshot *data,
 {
     _trig = NONTRIG; 
     _paint_align_sample_count = 0;
+    _edge_cache_valid = false;
+    _edge_cache_offset = 0;
+    _edge_cache_width = 0;
 }
 
 LogicSignal::LogicSignal(view::LogicSignal *s,
@@ -56,6 +59,9 @@ LogicSignal::LogicSignal(view::LogicSignal *s,
     _trig(s->get_trig())
 { 
     _paint_align_sample_count = 0;
+    _edge_cache_valid = false;
+    _edge_cache_offset = 0;
+    _edge_cache_width = 0;
 }
 
 LogicSignal::~LogicSignal()
@@ -148,10 +154,8 @@ void LogicSignal::paint_mid_align(QPainter &p, int left, int right, QColor fore,
     width = min(width, (uint16_t)ceil((end_index + 1)/samples_per_pixel - offset));
     const uint16_t max_togs = width / TogMaxScale;
 
-    const bool first_sample = _data->get_display_edges(_cur_pulses, _cur_edges,
-                                                          start_index, end_index, width, max_togs,
-                                                          offset,
-                                                          samples_per_pixel, _probe->index);
+    const bool first_sample = get_display_edges_cached(start_index, end_index, width, max_togs,
+                                                       offset, samples_per_pixel, last_sample);
     assert(_cur_pulses.size() >= width);
 
     int preX = 0;
@@ -190,6 +194,97 @@ void LogicSignal::paint_mid_align(QPainter &p, int left, int right, QColor fore,
     p.drawLines(wave_lines.data(), wave_lines.size());
 }
 
+bool LogicSignal::get_display_edges_cached(uint64_t start, uint64_t end, uint16_t width,
+                                           uint16_t max_togs, int64_t offset,
+                                           double samples_per_pixel, int64_t last_sample)
+{
+    const uint64_t version = _data->get_data_version();
+    const int sig_index = _probe->index;
+
+    bool same_data = _edge_cache_valid
+                    && _edge_cache_version == version
+                    && _edge_cache_spp == samples_per_pixel;
+
+    if (same_data && _edge_cache_offset == offset
+        && _edge_cache_width == width && _edge_cache_last == last_sample
+        && _cur_pulses.size() >= width)
+        return _edge_cache_first;
+
+    // Columns [lo, hi) are taken from the cache. The first column of a query
+    // misses an edge on its start sample and the last one may be clamped to
+    // the last sample, so these columns are always computed again.
+    int64_t lo = max(offset, _edge_cache_offset) + 1;
+    int64_t hi = min(offset + width - 1, _edge_cache_offset + (int64_t)_edge_cache_width - 1);
+    uint64_t right_start = 0;
+    bool first_sample = false;
+    bool shifted = same_data
+                    && last_sample >= _edge_cache_last
+                    && offset >= 0 && _edge_cache_offset >= 0
+                    && lo < hi
+                    && _cur_pulses.size() >= _edge_cache_width;
+
+    if (shifted) {
+        // Start on the sample before column hi, an edge on its first sample is found then
+        right_start = (uint64_t)ceil(hi * samples_per_pixel) - 1;
+        shifted = (right_start >= start && right_start <= end);
+    }
+
+    if (shifted) {
+        _edge_pulses.clear();
+
+        uint16_t n = lo - offset;
+        uint64_t left_end = min((uint64_t)floor((lo + 1) * samples_per_pixel), end);
+        first_sample = _data->get_display_edges(_edge_part, _edge_togs, start, left_end,
+                                                n, 0, offset, samples_per_pixel, sig_index);
+        if (_edge_part.size() >= n)
+            _edge_pulses.insert(_edge_pulses.end(), _edge_part.begin(), _edge_part.begin() + n);
+        else
+            shifted = false;
+
+        _edge_pulses.insert(_edge_pulses.end(),
+                            _cur_pulses.begin() + (lo - _edge_cache_offset),
+                            _cur_pulses.begin() + (hi - _edge_cache_offset));
+
+        n = offset + width - hi;
+        _data->get_display_edges(_edge_part, _edge_togs, right_start, end,
+                                 n, 0, hi, samples_per_pixel, sig_index);
+        if (_edge_part.size() >= n)
+            _edge_pulses.insert(_edge_pulses.end(), _edge_part.begin(), _edge_part.end());
+        else
+            shifted = false;
+    }
+
+    if (shifted) {
+        _cur_pulses.swap(_edge_pulses);
+
+        // Same toggle list get_display_edges() gives
+        _cur_edges.clear();
+        _cur_edges.push_back(pair<uint16_t, bool>(0, first_sample));
+        for (uint16_t i = 0; i < _cur_pulses.size() && _cur_edges.size() < max_togs; i++) {
+            if (_cur_pulses[i].first)
+                _cur_edges.push_back(pair<uint16_t, bool>(i, _cur_pulses[i].second));
+        }
+        if (_cur_edges.size() < max_togs)
+            _cur_edges.push_back(pair<uint16_t, bool>(_cur_pulses.size() - 1,
+                                                      _data->get_sample(end, sig_index)));
+    }
+    else {
+        first_sample = _data->get_display_edges(_cur_pulses, _cur_edges,
+                                                start, end, width, max_togs,
+                                                offset, samples_per_pixel, sig_index);
+    }
+
+    _edge_cache_valid = true;
+    _edge_cache_first = first_sample;
+    _edge_cache_version = version;
+    _edge_cache_last = last_sample;
+    _edge_cache_offset = offset;
+    _edge_cache_width = width;
+    _edge_cache_spp = samples_per_pixel;
+
+    return first_sample;
+}
+
 void LogicSignal::paint_caps(QPainter &p, QLineF *const lines,
     std::vector< pair<uint64_t, bool> > &edges, bool level,
 	double samples_per_pixel, double pixels_offset, float x_offset,
@@ -408,24 +503,7 @@ bool LogicSignal::edges(uint64_t end, uint64_t start, uint64_t &rising, uint64_t
     if (end > (sample_count - 1))
         return false;
 
-    const int ch_index = get_index();
-    bool sample = _data->get_sample(start, ch_index);
-
-    rising = 0;
-    falling = 0;
-    do {
-        if (_data->get_nxt_edge(index, sample, sample_count, 1, ch_index)) {
-            if (index > end)
-                break;
-            rising += !sample;
-            falling += sample;
-            sample = !sample;
-        } else {
-            break;
-        }
-    } while(index <= end);
-
-    return true;
+    return _data->count_edges(start, end, get_index(), rising, falling);
 }
 
 bool LogicSignal::mouse_press(int right, const QPoint pt)
@@ -523,6 +601,7 @@ void LogicSignal::set_data(data::LogicSnapshot* data)
 {
     assert(data);
     _data = data;
+    _edge_cache_valid = false;
 }
 
 } // namespace view
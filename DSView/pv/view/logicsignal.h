@@ -120,12 +120,28 @@ private:
 
     void paint_mid_align(QPainter &p, int left, int right, QColor fore, QColor back, uint64_t end_align_sample);
 
+    bool get_display_edges_cached(uint64_t start, uint64_t end, uint16_t width,
+                                  uint16_t max_togs, int64_t offset,
+                                  double samples_per_pixel, int64_t last_sample);
+
 private:
 	pv::data::LogicSnapshot* _data;
     std::vector< std::pair<uint16_t, bool> > _cur_edges;
     std::vector<std::pair<bool, bool>> _cur_pulses;
     LogicSetRegions _trig;
     uint64_t    _paint_align_sample_count;
+
+    // The query _cur_pulses and _cur_edges were made for
+    bool        _edge_cache_valid;
+    bool        _edge_cache_first;
+    uint64_t    _edge_cache_version;
+    int64_t     _edge_cache_last;
+    int64_t     _edge_cache_offset;
+    uint16_t    _edge_cache_width;
+    double      _edge_cache_spp;
+    std::vector<std::pair<bool, bool>> _edge_pulses;
+    std::vector<std::pair<bool, bool>> _edge_part;
+    std::vector<std::pair<uint16_t, bool>> _edge_togs;
 };
 
 } // namespace view
@@ -0,0 +1,98 @@
+/*
+ * This file is part of the DSView project.
+ * DSView is based on PulseView.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Micro benchmark of the LA_CROSS_DATA de-interleave kernels.
+ *
+ * Build and run from the repository root:
+ *   g++ -O3 -std=c++11 -I DSView DSView/test/bench/deinterleave.cpp \
+ *       DSView/pv/utility/simd.cpp -o deinterleave-bench
+ *   ./deinterleave-bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "pv/utility/simd.h"
+
+using namespace pv::simd;
+
+static const uint64_t PacketBytes = 16 * 1024 * 1024;
+static const int Rounds = 20;
+
+int main()
+{
+    const unsigned int chan_list[] = {1, 2, 3, 4, 8, 9, 16, 32};
+    const int kernel_list[] = {KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2};
+
+    std::vector<uint64_t> src(PacketBytes / 8);
+    for (size_t i = 0; i < src.size(); i++)
+        src[i] = ((uint64_t)rand() << 32) ^ (uint64_t)rand() ^ i;
+
+    printf("best kernel: %s\n", kernel_name(best_kernel()));
+    printf("%8s %8s %10s\n", "channels", "kernel", "GB/s");
+
+    for (unsigned int channels : chan_list)
+    {
+        uint64_t groups = src.size() / channels;
+        std::vector<std::vector<uint64_t>> ref(channels, std::vector<uint64_t>(groups));
+        std::vector<std::vector<uint64_t>> out(channels, std::vector<uint64_t>(groups));
+        uint64_t *ref_ptr[64];
+        uint64_t *out_ptr[64];
+
+        for (unsigned int ch = 0; ch < channels; ch++){
+            ref_ptr[ch] = ref[ch].data();
+            out_ptr[ch] = out[ch].data();
+        }
+
+        deinterleave_u64_by(KERNEL_SCALAR, src.data(), ref_ptr, channels, groups);
+
+        for (int type : kernel_list)
+        {
+            if (!kernel_supported(type))
+                continue;
+
+            for (unsigned int ch = 0; ch < channels; ch++)
+                memset(out_ptr[ch], 0, groups * 8);
+
+            auto begin = std::chrono::steady_clock::now();
+            for (int r = 0; r < Rounds; r++)
+                deinterleave_u64_by(type, src.data(), out_ptr, channels, groups);
+            auto end = std::chrono::steady_clock::now();
+
+            for (unsigned int ch = 0; ch < channels; ch++){
+                if (memcmp(out_ptr[ch], ref_ptr[ch], groups * 8) != 0){
+                    printf("kernel %s mismatch at %u channels\n", kernel_name(type), channels);
+                    return 1;
+                }
+            }
+
+            double sec = std::chrono::duration<double>(end - begin).count();
+            double bytes = (double)groups * channels * 8 * Rounds;
+            printf("%8u %8s %10.2f\n", channels, kernel_name(type), bytes / sec / 1e9);
+        }
+    }
+
+    return 0;
+}
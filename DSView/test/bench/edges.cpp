@@ -0,0 +1,162 @@
+/*
+ * This file is part of the DSView project.
+ * DSView is based on PulseView.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Benchmark of LogicSnapshot::get_edges() against a get_nxt_edge() loop.
+ *
+ * Build and run from the repository root:
+ *   gcc -c -O2 -I common common/log/xlog.c -o xlog.o
+ *   g++ -O3 -std=c++11 -fPIC -I DSView -I common -I libsigrok4DSL \
+ *       DSView/test/bench/edges.cpp DSView/pv/data/logicsnapshot.cpp \
+ *       DSView/pv/data/snapshot.cpp DSView/pv/data/blockpool.cpp \
+ *       DSView/pv/utility/simd.cpp DSView/pv/utility/workerpool.cpp \
+ *       DSView/pv/utility/array.cpp xlog.o \
+ *       $(pkg-config --cflags --libs Qt5Core glib-2.0) -lpthread -o edges-bench
+ *   ./edges-bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "pv/data/logicsnapshot.h"
+
+using namespace pv::data;
+
+xlog_writer *dsv_log = xlog_create_writer(xlog_new2(1), "bench");
+
+static const unsigned int Channels = 8;
+static const uint64_t Samples = 256ULL * 1024 * 1024;
+static const uint64_t ListCapacity = 1ULL << 24;
+
+static uint64_t run_length(unsigned int ch)
+{
+    // from busy clocks to nearly idle lines
+    static const uint64_t scale[] = {4, 64, 1024, 16384, 1 << 20, 1 << 22, 1 << 24, Samples};
+    return rand() % scale[ch % 8] + 1;
+}
+
+int main()
+{
+    const uint64_t words = Samples / 64;
+    std::vector<uint64_t> cross(words * Channels, 0);
+
+    for (unsigned int ch = 0; ch < Channels; ch++){
+        uint64_t i = 0;
+        bool level = false;
+
+        while (i < Samples){
+            uint64_t end = std::min(Samples, i + run_length(ch));
+            for (; i < end; i++){
+                if (level)
+                    cross[(i / 64) * Channels + ch] |= 1ULL << (i % 64);
+            }
+            level = !level;
+        }
+    }
+
+    std::vector<sr_channel> probes(Channels);
+    std::vector<GSList> nodes(Channels);
+
+    for (unsigned int ch = 0; ch < Channels; ch++){
+        memset(&probes[ch], 0, sizeof(sr_channel));
+        probes[ch].index = ch;
+        probes[ch].type = SR_CHANNEL_LOGIC;
+        probes[ch].enabled = TRUE;
+        nodes[ch].data = &probes[ch];
+        nodes[ch].next = (ch + 1 < Channels) ? &nodes[ch + 1] : NULL;
+    }
+
+    LogicSnapshot snapshot;
+    snapshot.init();
+
+    const uint64_t packet = 4 * 1024 * 1024 * Channels;
+    uint8_t *src = (uint8_t*)cross.data();
+
+    for (uint64_t pos = 0; pos < cross.size() * 8; pos += packet){
+        sr_datafeed_logic logic;
+        memset(&logic, 0, sizeof(logic));
+        logic.format = LA_CROSS_DATA;
+        logic.unitsize = 1;
+        logic.length = packet;
+        logic.data = src + pos;
+
+        if (pos == 0)
+            snapshot.first_payload(logic, Samples, &nodes[0], true);
+        else
+            snapshot.append_payload(logic);
+    }
+    snapshot.capture_ended();
+
+    const uint64_t end = snapshot.get_ring_sample_count() - 1;
+    std::vector<std::vector<LogicSnapshot::EdgePair>> loop_edges(Channels);
+    std::vector<std::vector<LogicSnapshot::EdgePair>> bulk_edges(Channels,
+        std::vector<LogicSnapshot::EdgePair>(ListCapacity));
+    std::vector<LogicSnapshot::EdgeList> lists(Channels);
+
+    // the loop a caller writes with get_nxt_edge()
+    auto begin = std::chrono::steady_clock::now();
+    for (unsigned int ch = 0; ch < Channels; ch++){
+        uint64_t index = 0;
+        bool level = snapshot.get_sample(0, ch);
+
+        while (loop_edges[ch].size() < ListCapacity
+               && snapshot.get_nxt_edge(index, level, end, 1, ch)){
+            level = !level;
+            loop_edges[ch].push_back(LogicSnapshot::EdgePair(index, level));
+        }
+    }
+    double loop_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    for (unsigned int ch = 0; ch < Channels; ch++){
+        lists[ch].sig_index = ch;
+        lists[ch].edges = bulk_edges[ch].data();
+        lists[ch].capacity = ListCapacity;
+    }
+
+    begin = std::chrono::steady_clock::now();
+    snapshot.get_edges(0, end, lists.data(), Channels);
+    double bulk_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    uint64_t total = 0;
+
+    for (unsigned int ch = 0; ch < Channels; ch++){
+        if (lists[ch].count != loop_edges[ch].size()
+            || !std::equal(loop_edges[ch].begin(), loop_edges[ch].end(), lists[ch].edges)){
+            printf("channel %u mismatch: %llu edges, the loop has %llu\n", ch,
+                   (unsigned long long)lists[ch].count,
+                   (unsigned long long)loop_edges[ch].size());
+            return 1;
+        }
+        total += lists[ch].count;
+    }
+
+    printf("%u channels, %llu samples, %llu edges\n", Channels,
+           (unsigned long long)Samples, (unsigned long long)total);
+    printf("%12s %10s %12s\n", "method", "ms", "Medges/s");
+    printf("%12s %10.1f %12.1f\n", "get_nxt_edge", loop_sec * 1e3, total / loop_sec / 1e6);
+    printf("%12s %10.1f %12.1f\n", "get_edges", bulk_sec * 1e3, total / bulk_sec / 1e6);
+
+    return 0;
+}
@@ -0,0 +1,382 @@
+/*
+ * This file is part of the DSView project.
+ * DSView is based on PulseView.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Benchmark of a UART decode split at idle gaps against one serial decode,
+ * the parts must give the same annotations as the serial decode. The line
+ * is held low for a break at each split position, the parts must start
+ * where the line idles high. The split, the chunks and the stitch are the
+ * ones of SegmentDecode. ctest runs it on fewer samples.
+ *
+ * Build and run from the repository root:
+ *   gcc -c -O2 -I common common/log/xlog.c -o xlog.o
+ *   mkdir -p srd && (cd srd && gcc -c -O2 -I ../common \
+ *       ../libsigrokdecode4DSL/*.c $(pkg-config --cflags glib-2.0 python3-embed))
+ *   g++ -O3 -std=c++11 -fPIC -I DSView -I common -I libsigrok4DSL -I libsigrokdecode4DSL \
+ *       DSView/test/bench/segmentdecode.cpp DSView/pv/data/segmentdecode.cpp \
+ *       DSView/pv/data/logicsnapshot.cpp \
+ *       DSView/pv/data/snapshot.cpp DSView/pv/data/blockpool.cpp \
+ *       DSView/pv/utility/simd.cpp DSView/pv/utility/workerpool.cpp \
+ *       DSView/pv/utility/array.cpp xlog.o srd/*.o \
+ *       $(pkg-config --cflags --libs Qt5Core glib-2.0 python3-embed) -lpthread -o segmentdecode-bench
+ *   ./segmentdecode-bench libsigrokdecode4DSL/decoders [samples]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <libsigrokdecode.h>
+#include "pv/data/logicsnapshot.h"
+#include "pv/data/segmentdecode.h"
+
+using namespace pv::data;
+
+xlog_writer *dsv_log = xlog_create_writer(xlog_new2(1), "bench");
+
+static const uint64_t DefaultSamples = 256ULL * 1024 * 1024;
+static const uint64_t Packet = 4 * 1024 * 1024;
+static const uint64_t BreakSamples = 1024 * 1024;
+static const uint64_t SampleRate = 100000000;
+static const uint64_t BaudRate = 1000000;
+static const uint64_t BitSamples = SampleRate / BaudRate;
+static const int Parts = 4;
+
+struct ann_key
+{
+    uint64_t start;
+    uint64_t end;
+    int ann_class;
+    std::string text;
+
+    bool operator==(const ann_key &o) const {
+        return start == o.start && end == o.end
+            && ann_class == o.ann_class && text == o.text;
+    }
+};
+
+// The parts of one decode, the annotations of a part not stitched wait in it
+struct split_decode
+{
+    std::vector<decode_segment> segs;
+    std::vector<std::vector<ann_key>> anns;
+    std::vector<ann_key> stitched;
+    std::mutex mutex;
+};
+
+struct part
+{
+    split_decode *dec;
+    size_t index;
+};
+
+static LogicSnapshot snapshot;
+
+// As DecoderStack::annotation_callback()
+static void annotation_callback(srd_proto_data *pdata, void *self)
+{
+    part *p = (part*)self;
+    srd_proto_data_annotation *pda = (srd_proto_data_annotation*)pdata->data;
+    ann_key a;
+
+    a.start = pdata->start_sample;
+    a.end = pdata->end_sample;
+    a.ann_class = pda->ann_class;
+    a.text = pda->str_number_hex;
+    if (pda->ann_text != NULL && pda->ann_text[0] != NULL)
+        a.text += pda->ann_text[0];
+
+    std::lock_guard<std::mutex> lock(p->dec->mutex);
+    if (p->dec->segs[p->index]._direct)
+        p->dec->stitched.push_back(a);
+    else
+        p->dec->anns[p->index].push_back(a);
+}
+
+static srd_session* new_session(part *p)
+{
+    srd_session *session = NULL;
+    srd_session_new(&session);
+
+    GHashTable *const opt_hash = g_hash_table_new_full(g_str_hash,
+        g_str_equal, g_free, (GDestroyNotify)g_variant_unref);
+    GVariant *const baud = g_variant_new_int64(BaudRate);
+    g_variant_ref_sink(baud);
+    g_hash_table_replace(opt_hash, (void*)g_strdup("baudrate"), baud);
+
+    srd_decoder_inst *const di = srd_inst_new(session, "1:uart", opt_hash);
+    g_hash_table_destroy(opt_hash);
+
+    if (di == NULL)
+        return NULL;
+
+    GHashTable *const probes = g_hash_table_new_full(g_str_hash,
+        g_str_equal, g_free, (GDestroyNotify)g_variant_unref);
+    GVariant *const gvar = g_variant_new_int32(0);
+    g_variant_ref_sink(gvar);
+    g_hash_table_insert(probes, (void*)g_strdup("rxtx"), gvar);
+    srd_inst_channel_set_all(di, probes);
+
+    srd_session_metadata_set(session, SRD_CONF_SAMPLERATE, g_variant_new_uint64(SampleRate));
+    srd_pd_output_callback_add(session, SRD_OUTPUT_ANN, annotation_callback, p);
+
+    char *error = NULL;
+    if (srd_session_start(session, &error) != SRD_OK){
+        printf("failed to start the session: %s\n", error ? error : "");
+        return NULL;
+    }
+    return session;
+}
+
+// As DecoderStack::decode_segment_proc(), one channel
+static void decode_part(part *p)
+{
+    split_decode *dec = p->dec;
+    decode_segment &seg = dec->segs[p->index];
+    int reader = snapshot.open_decode_reader();
+    const int sig = 0;
+    std::vector<const uint8_t*> chunk;
+    std::vector<uint8_t> chunk_const;
+    void *lbp = NULL;
+    uint64_t i = seg._start;
+    char *error = NULL;
+
+    while (i < seg._end)
+    {
+        uint64_t chunk_end = seg._end;
+
+        SegmentDecode::next_chunk(&snapshot, seg._session, i, seg._end, &sig, 1, reader,
+                                  chunk, chunk_const, &lbp, chunk_end);
+
+        if (srd_session_send(seg._session, i, chunk_end, chunk.data(), chunk_const.data(),
+                             chunk_end - i, &error) != SRD_OK){
+            printf("failed to send the samples: %s\n", error ? error : "");
+            break;
+        }
+        seg._sent = chunk_end - seg._start;
+        i = chunk_end;
+    }
+
+    if (&seg == &dec->segs.back())
+        srd_session_end(seg._session, &error);
+
+    snapshot.close_decode_reader(reader);
+
+    std::lock_guard<std::mutex> lock(dec->mutex);
+    seg._done = true;
+    SegmentDecode::stitch(dec->segs, [dec](decode_segment &s){
+        std::vector<ann_key> &anns = dec->anns[&s - &dec->segs[0]];
+        dec->stitched.insert(dec->stitched.end(), anns.begin(), anns.end());
+        anns.clear();
+    });
+}
+
+// The parts of @bounds on their threads, or one at a time from the last
+static double run(split_decode &dec, const std::vector<uint64_t> &bounds, bool reverse)
+{
+    const size_t n = bounds.size() - 1;
+    std::vector<part> parts(n);
+
+    std::vector<decode_segment>(n).swap(dec.segs);
+    dec.anns.assign(n, std::vector<ann_key>());
+    dec.stitched.clear();
+
+    for (size_t k = 0; k < n; k++){
+        decode_segment &seg = dec.segs[k];
+        seg._status = NULL;
+        seg._start = bounds[k];
+        seg._end = bounds[k + 1];
+        seg._sent = 0;
+        seg._direct = (k == 0);
+        seg._done = false;
+        parts[k].dec = &dec;
+        parts[k].index = k;
+        seg._session = new_session(&parts[k]);
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+
+    if (reverse){
+        for (size_t k = n; k > 0; k--)
+            decode_part(&parts[k - 1]);
+    }
+    else {
+        std::vector<std::thread> threads;
+        for (auto &p : parts)
+            threads.push_back(std::thread(decode_part, &p));
+        for (auto &th : threads)
+            th.join();
+    }
+
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    for (auto &seg : dec.segs)
+        srd_session_destroy(seg._session);
+
+    return sec;
+}
+
+static bool same_anns(const split_decode &dec, const split_decode &serial, const char *name)
+{
+    for (auto &seg : dec.segs){
+        if (!seg._direct){
+            printf("%s: a part is not stitched\n", name);
+            return false;
+        }
+    }
+
+    if (dec.stitched.size() != serial.stitched.size()
+        || !std::equal(dec.stitched.begin(), dec.stitched.end(), serial.stitched.begin())){
+        printf("%s: annotation mismatch: %llu in parts, %llu serial\n", name,
+               (unsigned long long)dec.stitched.size(),
+               (unsigned long long)serial.stitched.size());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t samples = argc > 2 ? strtoull(argv[2], NULL, 0) : DefaultSamples;
+    samples = std::max(Packet, samples / Packet * Packet);
+
+    const uint64_t words = samples / 64;
+    std::vector<uint64_t> cross(words, ~0ULL);
+    uint64_t bytes = 0;
+    uint64_t i = 1024;
+
+    // bursts of frames with idle gaps between them, the line idles high
+    while (i + 100000 < samples){
+        int burst = rand() % 256 + 1;
+
+        for (int b = 0; b < burst && i + 10 * BitSamples < samples; b++, bytes++){
+            uint16_t frame = (uint16_t)((rand() & 0xff) << 1) | 0x200;
+            for (int bit = 0; bit < 10; bit++, i += BitSamples){
+                if (frame & (1 << bit))
+                    continue;
+                for (uint64_t s = i; s < i + BitSamples; s++)
+                    cross[s / 64] &= ~(1ULL << (s % 64));
+            }
+        }
+        i += rand() % (1 << 20) + 50000;
+    }
+
+    // a break at each split position, the channel keeps still there but the
+    // decoder of the part before is not waiting for a start bit
+    for (int k = 1; k < Parts; k++){
+        uint64_t pos = samples * k / Parts;
+        for (uint64_t s = pos - BreakSamples / 2; s < pos + BreakSamples / 2; s++)
+            cross[s / 64] &= ~(1ULL << (s % 64));
+    }
+
+    sr_channel probe;
+    GSList node;
+
+    memset(&probe, 0, sizeof(sr_channel));
+    probe.index = 0;
+    probe.type = SR_CHANNEL_LOGIC;
+    probe.enabled = TRUE;
+    node.data = &probe;
+    node.next = NULL;
+
+    snapshot.init();
+
+    uint8_t *src = (uint8_t*)cross.data();
+
+    for (uint64_t pos = 0; pos < cross.size() * 8; pos += Packet){
+        sr_datafeed_logic logic;
+        memset(&logic, 0, sizeof(logic));
+        logic.format = LA_CROSS_DATA;
+        logic.unitsize = 1;
+        logic.length = Packet;
+        logic.data = src + pos;
+
+        if (pos == 0)
+            snapshot.first_payload(logic, samples, &node, true);
+        else
+            snapshot.append_payload(logic);
+    }
+    snapshot.capture_ended();
+
+    if (srd_init(argc > 1 ? argv[1] : NULL) != SRD_OK
+        || srd_decoder_load_all() != SRD_OK){
+        printf("failed to load the decoders\n");
+        return 1;
+    }
+
+    // the bounds of DecoderStack::split_decode_range(), a part may be
+    // shorter than SegmentDecode::MinSegmentSamples on fewer samples
+    const uint64_t last = snapshot.get_ring_sample_count() - 1;
+    std::vector<uint64_t> bounds;
+    std::vector<int> sigs(1, 0);
+    std::vector<int> levels(1, 1);
+
+    SegmentDecode::split_range(&snapshot, 0, last, Parts, samples / Parts / 2, sigs, levels, bounds);
+
+    for (size_t k = 1; k + 1 < bounds.size(); k++){
+        if (!snapshot.get_sample(bounds[k], 0)){
+            printf("part %d starts in a break at %llu\n", (int)k, (unsigned long long)bounds[k]);
+            return 1;
+        }
+    }
+    if ((int)bounds.size() != Parts + 1){
+        printf("%d parts, no idle gap after a split position\n", (int)bounds.size() - 1);
+        return 1;
+    }
+
+    split_decode serial;
+    split_decode split;
+    split_decode reverse;
+
+    double serial_sec = run(serial, std::vector<uint64_t>{0, last}, false);
+    double split_sec = run(split, bounds, false);
+    run(reverse, bounds, true);
+
+    // the parts done last to first wait to be stitched until part 0 ends
+    if (!same_anns(split, serial, "split") || !same_anns(reverse, serial, "reverse"))
+        return 1;
+
+    int percent = 0;
+    uint64_t decoded = 0;
+    SegmentDecode::progress(split.segs, percent, decoded);
+    if (percent != 100 || decoded != last + 1){
+        printf("progress %d%%, %llu samples decoded of %llu\n", percent,
+               (unsigned long long)decoded, (unsigned long long)last + 1);
+        return 1;
+    }
+
+    srd_exit();
+
+    printf("%llu samples, %llu bytes, %llu annotations, %d parts\n",
+           (unsigned long long)samples, (unsigned long long)bytes,
+           (unsigned long long)split.stitched.size(), (int)split.segs.size());
+    printf("%12s %10s %12s\n", "decode", "ms", "Msamples/s");
+    printf("%12s %10.1f %12.1f\n", "serial", serial_sec * 1e3, last / serial_sec / 1e6);
+    printf("%12s %10.1f %12.1f\n", "split", split_sec * 1e3, last / split_sec / 1e6);
+
+    return 0;
+}
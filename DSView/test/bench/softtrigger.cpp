@@ -0,0 +1,262 @@
+/*
+ * This file is part of the DSView project.
+ * DSView is based on PulseView.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Benchmark of the software trigger of libsigrok4DSL on 16 channels,
+ * against the 100 MS/s of a stream capture. The trigger position is
+ * checked with a sample by sample match.
+ *
+ * Build and run from the repository root:
+ *   gcc -c -O2 -I common common/log/xlog.c -o xlog.o
+ *   gcc -c -O3 -I common -I libsigrok4DSL $(pkg-config --cflags glib-2.0 libusb-1.0) \
+ *       libsigrok4DSL/soft_trigger.c libsigrok4DSL/log.c
+ *   g++ -O3 -std=c++11 -I common -I libsigrok4DSL DSView/test/bench/softtrigger.cpp \
+ *       soft_trigger.o log.o xlog.o \
+ *       $(pkg-config --cflags --libs glib-2.0 libusb-1.0) -o softtrigger-bench
+ *   ./softtrigger-bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+extern "C" {
+#include "libsigrok-internal.h"
+}
+
+static const unsigned int Channels = 16;
+static const uint64_t Samples = 64ULL * 1024 * 1024;
+static const double StreamRate = 100e6;
+// Not a multiple of a channel group, the groups are split by the packets
+static const uint64_t PacketBytes = 1024 * 1024 + 24;
+
+struct TestCase
+{
+    const char *name;
+    ds_trigger trig;
+};
+
+static inline int sample(const std::vector<uint64_t> &cross, uint64_t i, unsigned int ch)
+{
+    return (cross[(i / 64) * Channels + ch] >> (i % 64)) & 1;
+}
+
+static bool cond_match(char c, int cur, int pre)
+{
+    switch (c){
+    case '1': return cur;
+    case '0': return !cur;
+    case 'R': return cur && !pre;
+    case 'F': return !cur && pre;
+    case 'C': return cur != pre;
+    }
+    return true;
+}
+
+static bool expr_match(const char *conds, bool inv, const std::vector<uint64_t> &cross, uint64_t i)
+{
+    bool m = true;
+
+    for (unsigned int ch = 0; ch < Channels; ch++){
+        int cur = sample(cross, i, ch);
+        int pre = i > 0 ? sample(cross, i - 1, ch) : cur;
+        m = m && cond_match(conds[ch], cur, pre);
+    }
+    return inv ? !m : m;
+}
+
+static bool has_cond(const char *conds)
+{
+    for (unsigned int ch = 0; ch < MaxTriggerProbes; ch++){
+        if (conds[ch] != 'X')
+            return true;
+    }
+    return false;
+}
+
+// One sample at a time, the way the trigger reads
+static int64_t reference_pos(const ds_trigger &trig, const std::vector<uint64_t> &cross)
+{
+    int stages = trig.trigger_mode == SIMPLE_TRIGGER ? 1 : trig.trigger_stages + 1;
+    int stage = 0;
+    uint32_t matched = 0;
+
+    for (uint64_t i = 0; i < Samples; i++){
+        bool m;
+        bool contiguous = false;
+        uint32_t count = 1;
+
+        if (trig.trigger_mode == SIMPLE_TRIGGER){
+            m = expr_match(trig.trigger0[TriggerStages], false, cross, i);
+        }
+        else {
+            bool has0 = has_cond(trig.trigger0[stage]);
+            bool has1 = has_cond(trig.trigger1[stage]);
+            bool m0 = expr_match(trig.trigger0[stage], trig.trigger0_inv[stage], cross, i);
+            bool m1 = expr_match(trig.trigger1[stage], trig.trigger1_inv[stage], cross, i);
+
+            if (has0 && has1)
+                m = (trig.trigger_logic[stage] & 1) ? (m0 && m1) : (m0 || m1);
+            else
+                m = has1 ? m1 : m0;
+
+            contiguous = (trig.trigger_logic[stage] >> 1) & 1;
+            count = std::max(trig.trigger0_count[stage], (uint32_t)1);
+        }
+
+        if (m)
+            matched++;
+        else if (contiguous)
+            matched = 0;
+
+        if (matched == count){
+            matched = 0;
+            if (++stage == stages)
+                return i;
+        }
+    }
+    return -1;
+}
+
+static void init_trigger(ds_trigger &trig, int mode)
+{
+    memset(&trig, 0, sizeof(trig));
+    memset(trig.trigger0, 'X', sizeof(trig.trigger0));
+    memset(trig.trigger1, 'X', sizeof(trig.trigger1));
+    memset(trig.trigger_logic, 1, sizeof(trig.trigger_logic));
+    trig.trigger_en = 1;
+    trig.trigger_mode = mode;
+}
+
+int main()
+{
+    const uint64_t words = Samples / 64;
+    std::vector<uint64_t> cross(words * Channels, 0);
+
+    // channel 0 is a clock, the others toggle slower and slower
+    for (unsigned int ch = 0; ch < Channels - 1; ch++){
+        uint64_t i = 0;
+        bool level = false;
+
+        while (i < Samples){
+            uint64_t run = rand() % (4ULL << ch) + 1;
+            uint64_t end = std::min(Samples, i + run);
+            for (; i < end; i++){
+                if (level)
+                    cross[(i / 64) * Channels + ch] |= 1ULL << (i % 64);
+            }
+            level = !level;
+        }
+    }
+
+    // channel 15 rises once, near the end of the capture
+    const uint64_t rise = Samples - 12345;
+    for (uint64_t i = rise; i < Samples; i++)
+        cross[(i / 64) * Channels + 15] |= 1ULL << (i % 64);
+
+    std::vector<TestCase> cases(4);
+
+    cases[0].name = "simple";
+    init_trigger(cases[0].trig, SIMPLE_TRIGGER);
+    cases[0].trig.trigger0[TriggerStages][15] = 'R';
+    cases[0].trig.trigger0[TriggerStages][3] = '1';
+
+    cases[1].name = "count";
+    init_trigger(cases[1].trig, ADV_TRIGGER);
+    cases[1].trig.trigger_stages = 1;
+    cases[1].trig.trigger0[0][15] = '1';
+    cases[1].trig.trigger0[0][0] = 'R';
+    cases[1].trig.trigger0_count[0] = 1000;
+    cases[1].trig.trigger0[1][2] = 'F';
+
+    cases[2].name = "contiguous";
+    init_trigger(cases[2].trig, ADV_TRIGGER);
+    cases[2].trig.trigger_stages = 1;
+    cases[2].trig.trigger0[0][15] = 'R';
+    cases[2].trig.trigger0[1][6] = '1';
+    cases[2].trig.trigger0[1][7] = '1';
+    cases[2].trig.trigger_logic[1] = 3;
+    cases[2].trig.trigger0_count[1] = 100;
+
+    cases[3].name = "4 stages";
+    init_trigger(cases[3].trig, ADV_TRIGGER);
+    cases[3].trig.trigger_stages = 3;
+    cases[3].trig.trigger0[0][15] = 'R';
+    cases[3].trig.trigger0[1][1] = 'R';
+    cases[3].trig.trigger1[1][2] = 'F';
+    cases[3].trig.trigger_logic[1] = 0;
+    cases[3].trig.trigger0[2][4] = '0';
+    cases[3].trig.trigger0_inv[2] = 1;
+    cases[3].trig.trigger0_count[2] = 50;
+    cases[3].trig.trigger0[3][5] = 'C';
+
+    std::vector<uint16_t> ch_index(Channels);
+    for (unsigned int ch = 0; ch < Channels; ch++)
+        ch_index[ch] = ch;
+
+    const uint8_t *src = (const uint8_t*)cross.data();
+    const uint64_t bytes = cross.size() * sizeof(uint64_t);
+    int ret = 0;
+
+    printf("%u channels, %llu samples, target %.0f MS/s\n", Channels,
+           (unsigned long long)Samples, StreamRate / 1e6);
+    printf("%12s %12s %10s %10s\n", "trigger", "position", "ms", "MS/s");
+
+    for (TestCase &c : cases){
+        sr_soft_trigger *st = sr_soft_trigger_new(&c.trig, ch_index.data(), Channels);
+        uint64_t pos = 0;
+        int fired = 0;
+
+        auto begin = std::chrono::steady_clock::now();
+        for (uint64_t off = 0; off < bytes && !fired; off += PacketBytes){
+            sr_datafeed_logic logic;
+            memset(&logic, 0, sizeof(logic));
+            logic.format = LA_CROSS_DATA;
+            logic.unitsize = 1;
+            logic.length = std::min(PacketBytes, bytes - off);
+            logic.data = (void*)(src + off);
+
+            fired = sr_soft_trigger_feed(st, &logic, &pos);
+        }
+        double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        sr_soft_trigger_free(st);
+
+        int64_t ref = reference_pos(c.trig, cross);
+        double rate = (fired ? pos + 1 : Samples) / sec;
+
+        if ((fired ? (int64_t)pos : -1) != ref){
+            printf("%12s mismatch: %lld, the reference has %lld\n", c.name,
+                   fired ? (long long)pos : -1LL, (long long)ref);
+            ret = 1;
+            continue;
+        }
+
+        printf("%12s %12lld %10.1f %10.1f %s\n", c.name, (long long)ref, sec * 1e3,
+               rate / 1e6, rate >= StreamRate ? "" : "too slow");
+        if (rate < StreamRate)
+            ret = 1;
+    }
+
+    return ret;
+}
@@ -36,6 +36,7 @@ SR_PRIV gboolean dsl_isSecuReady(const struct sr_dev_inst *sdi);
 SR_PRIV gboolean dsl_isSecuPass(const struct sr_dev_inst *sdi);
 SR_PRIV uint16_t dsl_secuRead(const struct sr_dev_inst *sdi);
 static unsigned int to_bytes_per_ms(struct DSL_context *devc);
+static void receive_transfer(struct libusb_transfer *transfer);
 
 static const int32_t probeOptions[] = {
     SR_CONF_PROBE_COUPLING,
@@ -1703,6 +1704,11 @@ SR_PRIV int dsl_config_get(int id, GVariant **data, const struct sr_dev_inst *sd
             return SR_ERR;
         *data = g_variant_new_uint64(devc->actual_samples);
         break;
+    case SR_CONF_INGEST_HWM:
+        if (!sdi)
+            return SR_ERR;
+        *data = g_variant_new_uint64(g_atomic_int_get(&devc->ingest_hwm));
+        break;
     case SR_CONF_BANDWIDTH:
         if (!sdi)
             return SR_ERR;
@@ -2096,6 +2102,14 @@ SR_PRIV int dsl_header_size(const struct DSL_context *devc)
     return size;
 }
 
+static size_t round_to_packet(const struct DSL_context *devc, size_t s)
+{
+    if (devc->profile->usb_speed == LIBUSB_SPEED_SUPER)
+        return (s + 1023ULL) & ~1023ULL;
+    else
+        return (s + 511ULL) & ~511ULL;
+}
+
 static size_t get_buffer_size(const struct sr_dev_inst *sdi)
 {
     size_t s;
@@ -2112,10 +2126,7 @@ static size_t get_buffer_size(const struct sr_dev_inst *sdi)
         s = (devc->stream) ? get_single_buffer_time(devc) * to_bytes_per_ms(devc) : 1024*1024;
     }
 
-    if (devc->profile->usb_speed == LIBUSB_SPEED_SUPER)
-        return (s + 1023ULL) & ~1023ULL;
-    else
-        return (s + 511ULL) & ~511ULL;
+    return round_to_packet(devc, s);
 }
 
 static unsigned int get_number_of_transfers(const struct sr_dev_inst *sdi)
@@ -2154,10 +2165,242 @@ SR_PRIV unsigned int dsl_get_timeout(const struct sr_dev_inst *sdi)
         return 20;
 }
 
+static int ingest_ring_push(struct DSL_ingest_ring *ring, uint8_t *buf, uint32_t len)
+{
+    int head = g_atomic_int_get(&ring->head);
+    int next = (head + 1) % INGEST_RING_SIZE;
+
+    if (next == g_atomic_int_get(&ring->tail))
+        return 0;
+
+    ring->buf[head] = buf;
+    ring->len[head] = len;
+    g_atomic_int_set(&ring->head, next);
+    return 1;
+}
+
+static int ingest_ring_pop(struct DSL_ingest_ring *ring, uint8_t **buf, uint32_t *len)
+{
+    int tail = g_atomic_int_get(&ring->tail);
+
+    if (tail == g_atomic_int_get(&ring->head))
+        return 0;
+
+    *buf = ring->buf[tail];
+    *len = ring->len[tail];
+    g_atomic_int_set(&ring->tail, (tail + 1) % INGEST_RING_SIZE);
+    return 1;
+}
+
+static unsigned int ingest_ring_count(struct DSL_ingest_ring *ring)
+{
+    int head = g_atomic_int_get(&ring->head);
+    int tail = g_atomic_int_get(&ring->tail);
+
+    return (head - tail + INGEST_RING_SIZE) % INGEST_RING_SIZE;
+}
+
+/*
+ * Wakes the other side if it sleeps on the flag. The sleeper sets the
+ * flag and checks its ring again under the mutex, no wakeup gets lost.
+ */
+static void ingest_wake(struct DSL_context *devc, gint *flag)
+{
+    if (g_atomic_int_get(flag)) {
+        g_mutex_lock(&devc->ingest_mutex);
+        g_cond_broadcast(&devc->ingest_cond);
+        g_mutex_unlock(&devc->ingest_mutex);
+    }
+}
+
+static gpointer ingest_proc(gpointer data)
+{
+    struct DSL_context *devc = data;
+    struct sr_dev_inst *sdi = devc->cb_data;
+    struct sr_datafeed_packet packet;
+    struct sr_datafeed_logic logic;
+    uint8_t *buf;
+    uint32_t len;
+    int stop;
+
+    sr_info("%s: ingest thread running.", __func__);
+
+    sr_thread_sched_apply(DS_THREAD_INGEST, "Ingest");
+
+    for (;;) {
+        /* Read the flag first, the ring is drained when it is set */
+        stop = g_atomic_int_get(&devc->ingest_stop);
+
+        if (!ingest_ring_pop(&devc->ingest_full, &buf, &len)) {
+            if (stop)
+                break;
+
+            g_mutex_lock(&devc->ingest_mutex);
+            g_atomic_int_set(&devc->ingest_idle, 1);
+            if (ingest_ring_count(&devc->ingest_full) == 0 &&
+                !g_atomic_int_get(&devc->ingest_stop))
+                g_cond_wait_until(&devc->ingest_cond, &devc->ingest_mutex,
+                                  g_get_monotonic_time() + 10 * G_TIME_SPAN_MILLISECOND);
+            g_atomic_int_set(&devc->ingest_idle, 0);
+            g_mutex_unlock(&devc->ingest_mutex);
+            continue;
+        }
+
+        /* The usb callback dropped data here, see ingest_push() */
+        if (buf == NULL) {
+            packet.type = SR_DF_OVERFLOW;
+            packet.status = SR_PKT_OK;
+            packet.payload = NULL;
+            ds_data_forward(sdi, &packet);
+            continue;
+        }
+
+        packet.type = SR_DF_LOGIC;
+        packet.status = SR_PKT_OK;
+        packet.payload = &logic;
+        logic.length = len;
+        logic.format = LA_CROSS_DATA;
+        logic.data_error = 0;
+        logic.data = buf;
+        ds_data_forward(sdi, &packet);
+
+        ingest_ring_push(&devc->ingest_free, buf, 0);
+        ingest_wake(devc, &devc->ingest_starved);
+    }
+
+    sr_info("%s: ingest thread exit.", __func__);
+    return NULL;
+}
+
+/*
+ * Queues the transfer buffer for the ingest thread and gives the
+ * transfer a spare one, it can be resubmitted at once.
+ * With no spare left, a stream capture drops the data of the transfer
+ * and counts an overrun, the device can't hold it back. The first
+ * overrun of a capture queues an overflow mark, the ingest thread
+ * reports it in order with the data, like an overflow of the device
+ * buffer.
+ * A buffered capture reads the device memory, nothing is lost when the
+ * usb callback waits for a spare, so it stays lossless.
+ */
+static void ingest_push(struct DSL_context *devc, struct libusb_transfer *transfer, uint32_t length)
+{
+    uint8_t *spare;
+    uint32_t n;
+    unsigned int depth;
+
+    if (!ingest_ring_pop(&devc->ingest_free, &spare, &n)) {
+        if (devc->stream) {
+            if (g_atomic_int_add(&devc->ingest_overruns, 1) == 0) {
+                sr_err("%s: the ingest thread lags, drop the data.", __func__);
+                ingest_ring_push(&devc->ingest_full, NULL, 0);
+                ingest_wake(devc, &devc->ingest_idle);
+            }
+            return;
+        }
+
+        g_atomic_int_inc(&devc->ingest_stalls);
+
+        g_mutex_lock(&devc->ingest_mutex);
+        g_atomic_int_set(&devc->ingest_starved, 1);
+        while (!ingest_ring_pop(&devc->ingest_free, &spare, &n))
+            g_cond_wait(&devc->ingest_cond, &devc->ingest_mutex);
+        g_atomic_int_set(&devc->ingest_starved, 0);
+        g_mutex_unlock(&devc->ingest_mutex);
+    }
+
+    ingest_ring_push(&devc->ingest_full, transfer->buffer, length);
+    transfer->buffer = spare;
+
+    depth = ingest_ring_count(&devc->ingest_full);
+    if ((gint)depth > g_atomic_int_get(&devc->ingest_hwm))
+        g_atomic_int_set(&devc->ingest_hwm, depth);
+    if (depth > devc->xfer_win_queue)
+        devc->xfer_win_queue = depth;
+
+    ingest_wake(devc, &devc->ingest_idle);
+}
+
+static void ingest_start(const struct sr_dev_inst *sdi, unsigned int spares, size_t size)
+{
+    struct DSL_context *devc = sdi->priv;
+    unsigned int i;
+    uint8_t *buf;
+    uint32_t len;
+
+    devc->ingest_thread = NULL;
+    memset(&devc->ingest_full, 0, sizeof(devc->ingest_full));
+    memset(&devc->ingest_free, 0, sizeof(devc->ingest_free));
+    devc->ingest_stop = 0;
+    devc->ingest_idle = 0;
+    devc->ingest_starved = 0;
+    devc->ingest_buffers = 0;
+    g_atomic_int_set(&devc->ingest_hwm, 0);
+    g_atomic_int_set(&devc->ingest_overruns, 0);
+    g_atomic_int_set(&devc->ingest_stalls, 0);
+
+    for (i = 0; i < spares; i++) {
+        if (!(buf = g_try_malloc(size)))
+            break;
+        ingest_ring_push(&devc->ingest_free, buf, 0);
+        devc->ingest_buffers++;
+    }
+
+    g_mutex_init(&devc->ingest_mutex);
+    g_cond_init(&devc->ingest_cond);
+
+    if (devc->ingest_buffers > 0)
+        devc->ingest_thread = g_thread_new("ingest_proc", ingest_proc, devc);
+
+    if (devc->ingest_thread == NULL) {
+        sr_err("%s: no ingest thread, forward the data in the usb callback.", __func__);
+        while (ingest_ring_pop(&devc->ingest_free, &buf, &len))
+            g_free(buf);
+        g_mutex_clear(&devc->ingest_mutex);
+        g_cond_clear(&devc->ingest_cond);
+    }
+}
+
+static void ingest_finish(struct DSL_context *devc)
+{
+    uint8_t *buf;
+    uint32_t len;
+
+    if (devc->ingest_thread == NULL)
+        return;
+
+    g_atomic_int_set(&devc->ingest_stop, 1);
+    ingest_wake(devc, &devc->ingest_idle);
+    g_thread_join(devc->ingest_thread);
+    devc->ingest_thread = NULL;
+
+    while (ingest_ring_pop(&devc->ingest_free, &buf, &len))
+        g_free(buf);
+
+    g_mutex_clear(&devc->ingest_mutex);
+    g_cond_clear(&devc->ingest_cond);
+
+    sr_info("Ingest ring: spare buffers:%u, high-water mark:%d, overruns:%d, stalls:%d",
+            devc->ingest_buffers, g_atomic_int_get(&devc->ingest_hwm),
+            g_atomic_int_get(&devc->ingest_overruns),
+            g_atomic_int_get(&devc->ingest_stalls));
+}
+
 static void finish_acquisition(struct DSL_context *devc)
 {
     struct sr_datafeed_packet packet;
 
+    struct libusb_transfer *transfer;
+
+    /* The queued data goes before the end packet */
+    ingest_finish(devc);
+
+    while (devc->xfer_parked > 0) {
+        transfer = devc->xfer_park[--devc->xfer_parked];
+        g_free(transfer->buffer);
+        libusb_free_transfer(transfer);
+    }
+
     sr_info("%s: send SR_DF_END packet", __func__);
     /* Terminate session. */
     packet.type = SR_DF_END;
@@ -2179,10 +2422,6 @@ static void free_transfer(struct libusb_transfer *transfer, int force)
 
     devc = transfer->user_data;
 
-    g_free(transfer->buffer);
-    transfer->buffer = NULL;
-    libusb_free_transfer(transfer);
-
     for (i = 0; i < devc->num_transfers; i++) {
         if (devc->transfers[i] == transfer) {
             devc->transfers[i] = NULL;
@@ -2190,6 +2429,17 @@ static void free_transfer(struct libusb_transfer *transfer, int force)
         }
     }
 
+    /* A lent buffer belongs to the receiver */
+    if (devc->lend && i < devc->num_transfers && devc->own_buffers[i] != NULL) {
+        g_free(devc->own_buffers[i]);
+        devc->own_buffers[i] = NULL;
+    }
+    else {
+        g_free(transfer->buffer);
+    }
+    transfer->buffer = NULL;
+    libusb_free_transfer(transfer);
+
     if (!devc->is_loop || devc->status != DSL_DATA || force)
         devc->submitted_transfers--;
 
@@ -2212,6 +2462,208 @@ static void resubmit_transfer(struct libusb_transfer *transfer)
     sr_err("%s: %s", __func__, libusb_error_name(ret));
 }
 
+static size_t xfer_length(struct DSL_context *devc, unsigned int ms)
+{
+    size_t len = round_to_packet(devc, (size_t)ms * to_bytes_per_ms(devc));
+
+    return min(max(len, round_to_packet(devc, 1)), devc->xfer_cap);
+}
+
+/*
+ * Picks the transfer size and the number in flight for a stream capture.
+ * A transfer is as short as the latency allows, until the consumer falls
+ * behind. The data in flight must outlast twice the longest gap between
+ * two callbacks, and it is never less than the fixed scheme had.
+ */
+static void xfer_schedule(struct DSL_context *devc)
+{
+    unsigned int bpms = to_bytes_per_ms(devc);
+    unsigned int cap_ms = max(devc->xfer_cap / bpms, 1);
+    unsigned int gap_ms = devc->xfer_win_gap / 1000;
+    unsigned int need_ms, len_ms, active;
+    size_t len;
+    gboolean lagging;
+
+    need_ms = 2 * gap_ms + devc->xfer_len / bpms;
+    need_ms = min(max(need_ms, get_total_buffer_time(devc)), XFER_MAX_TOTAL);
+
+    /* Grow at once, shrink slowly, a long stall may come back */
+    if (need_ms < devc->xfer_need_ms)
+        need_ms = max(need_ms, devc->xfer_need_ms - devc->xfer_need_ms / 8);
+
+    /* Bigger packets cost the consumer less per sample */
+    lagging = (uint64_t)g_atomic_int_get(&devc->ingest_overruns) > devc->xfer_win_overruns ||
+              (devc->ingest_buffers > 0 && devc->xfer_win_queue > devc->ingest_buffers / 2);
+
+    if (lagging) {
+        devc->xfer_lat_ms = min(devc->xfer_lat_ms * 2, cap_ms);
+        devc->xfer_quiet = 0;
+    }
+    else if (++devc->xfer_quiet >= XFER_QUIET_WINDOWS) {
+        devc->xfer_lat_ms = max(devc->xfer_lat_ms / 2, XFER_MIN_TIME);
+        devc->xfer_quiet = 0;
+    }
+
+    len_ms = max(devc->xfer_lat_ms, (need_ms + devc->xfer_max - 1) / devc->xfer_max);
+    len = xfer_length(devc, len_ms);
+
+    active = ceil((double)need_ms * bpms / len);
+    active = min(max(active, 2), devc->xfer_max);
+
+    if (len != devc->xfer_len || active != devc->xfer_active || need_ms != devc->xfer_need_ms) {
+        sr_info("%s: transfer %llu bytes x %u, %u ms in flight, callback gap %u ms, queued %u%s",
+                __func__, (u64_t)len, active, need_ms, gap_ms, devc->xfer_win_queue,
+                lagging ? ", consumer lags" : "");
+    }
+
+    devc->xfer_len = len;
+    devc->xfer_active = active;
+    devc->xfer_need_ms = need_ms;
+
+    devc->xfer_win_gap = 0;
+    devc->xfer_win_queue = 0;
+    devc->xfer_win_overruns = g_atomic_int_get(&devc->ingest_overruns);
+}
+
+static void xfer_init(const struct sr_dev_inst *sdi, size_t cap)
+{
+    struct DSL_context *devc = sdi->priv;
+    unsigned int bpms = to_bytes_per_ms(devc);
+    uint64_t memory;
+
+    /* Every buffer has the size of the fixed scheme, the length varies */
+    devc->xfer_cap = cap;
+    memory = max(XFER_MAX_MEMORY, (uint64_t)get_total_buffer_time(devc) * bpms);
+    devc->xfer_max = min(max(memory / cap, 2), NUM_SIMUL_TRANSFERS);
+
+    devc->xfer_lat_ms = XFER_MIN_TIME;
+    devc->xfer_need_ms = get_total_buffer_time(devc);
+    devc->xfer_len = xfer_length(devc, max(devc->xfer_lat_ms,
+                        (devc->xfer_need_ms + devc->xfer_max - 1) / devc->xfer_max));
+    devc->xfer_active = ceil((double)devc->xfer_need_ms * bpms / devc->xfer_len);
+    devc->xfer_active = min(max(devc->xfer_active, 2), devc->xfer_max);
+
+    devc->xfer_parked = 0;
+    devc->xfer_last_time = 0;
+    devc->xfer_win_start = 0;
+    devc->xfer_win_gap = 0;
+    devc->xfer_win_queue = 0;
+    devc->xfer_win_overruns = 0;
+    devc->xfer_quiet = 0;
+
+    sr_info("%s: transfer %llu bytes x %u, at most %u of %llu bytes",
+            __func__, (u64_t)devc->xfer_len, devc->xfer_active,
+            devc->xfer_max, (u64_t)devc->xfer_cap);
+}
+
+static struct libusb_transfer *xfer_new(struct DSL_context *devc)
+{
+    struct sr_dev_inst *sdi = devc->cb_data;
+    struct sr_usb_dev_inst *usb = sdi->conn;
+    struct libusb_transfer *transfer;
+    unsigned char *buf;
+
+    /* The header transfer has the first slot */
+    if (devc->num_transfers >= devc->xfer_max + 1)
+        return NULL;
+
+    if (!(buf = g_try_malloc(devc->xfer_cap))) {
+        sr_err("%s: USB transfer buffer malloc failed.", __func__);
+        return NULL;
+    }
+
+    transfer = libusb_alloc_transfer(0);
+    libusb_fill_bulk_transfer(transfer, usb->devhdl,
+            6 | LIBUSB_ENDPOINT_IN, buf, devc->xfer_len,
+            (libusb_transfer_cb_fn)receive_transfer, devc, 0);
+    devc->transfers[devc->num_transfers++] = transfer;
+
+    return transfer;
+}
+
+/*
+ * Resubmits a stream transfer with the scheduled length, and parks it or
+ * brings more transfers in, to keep the scheduled number in flight.
+ */
+static void xfer_resubmit(struct libusb_transfer *transfer)
+{
+    struct DSL_context *devc = transfer->user_data;
+    struct libusb_transfer *more;
+    int64_t now = g_get_monotonic_time();
+
+    if (devc->xfer_last_time != 0 && now - devc->xfer_last_time > devc->xfer_win_gap)
+        devc->xfer_win_gap = now - devc->xfer_last_time;
+    devc->xfer_last_time = now;
+
+    if (devc->xfer_win_start == 0)
+        devc->xfer_win_start = now;
+    else if (now - devc->xfer_win_start >= XFER_WINDOW * G_TIME_SPAN_MILLISECOND) {
+        xfer_schedule(devc);
+        devc->xfer_win_start = now;
+    }
+
+    if (devc->submitted_transfers > (int)devc->xfer_active) {
+        devc->xfer_park[devc->xfer_parked++] = transfer;
+        devc->submitted_transfers--;
+        return;
+    }
+
+    transfer->length = devc->xfer_len;
+    resubmit_transfer(transfer);
+
+    while (devc->status == DSL_DATA &&
+           devc->submitted_transfers < (int)devc->xfer_active) {
+        if (devc->xfer_parked > 0)
+            more = devc->xfer_park[--devc->xfer_parked];
+        else if (!(more = xfer_new(devc)))
+            break;
+
+        more->length = devc->xfer_len;
+        if (libusb_submit_transfer(more) != LIBUSB_SUCCESS) {
+            devc->xfer_park[devc->xfer_parked++] = more;
+            break;
+        }
+        devc->submitted_transfers++;
+    }
+}
+
+/*
+ * Receives the next analog packet straight into the snapshot, when the
+ * receiver lends the place of it.
+ */
+static void lend_buffer(struct libusb_transfer *transfer)
+{
+    struct DSL_context *devc = transfer->user_data;
+    struct sr_dev_inst *sdi = devc->cb_data;
+    uint8_t *buf = NULL;
+    unsigned int i;
+
+    for (i = 1; i < devc->num_transfers; i++) {
+        if (devc->transfers[i] == transfer)
+            break;
+    }
+    if (i == devc->num_transfers || devc->own_buffers[i] == NULL)
+        return;
+
+    /*
+     * A place is lent as if the transfers in flight bring full packets.
+     * After a short packet the ring is behind, a place lent now would
+     * overlap the places of the transfers still in flight. Until all of
+     * them have come in, the transfers go out with their own buffers.
+     */
+    if (transfer->actual_length < transfer->length)
+        devc->lend_hold = devc->submitted_transfers - 1;
+    else if (devc->lend_hold > 0)
+        devc->lend_hold--;
+
+    /* The other transfers in flight come first, a decimated packet is not in place */
+    if (devc->unit_pitch <= 1 && devc->lend_hold == 0)
+        buf = ds_data_lend(sdi, SR_DF_ANALOG, transfer->length,
+                           (uint64_t)(devc->submitted_transfers - 1) * transfer->length);
+
+    transfer->buffer = (buf != NULL) ? buf : devc->own_buffers[i];
+}
+
 static void get_measure(const struct sr_dev_inst *sdi, uint8_t *buf, uint32_t offset)
 {
     uint64_t u64_tmp;
@@ -2401,7 +2853,9 @@ static void receive_transfer(struct libusb_transfer *transfer)
             }
 
             /* send data to session bus */
-            if (packet.status == SR_PKT_OK)
+            if (sdi->mode == LOGIC && devc->ingest_thread != NULL)
+                ingest_push(devc, transfer, logic.length);
+            else if (packet.status == SR_PKT_OK)
                 ds_data_forward(sdi, &packet);
         }
 
@@ -2426,10 +2880,15 @@ static void receive_transfer(struct libusb_transfer *transfer)
         }
     }
 
-    if (devc->status == DSL_DATA)
-        resubmit_transfer(transfer);
-    else
+    if (devc->status != DSL_DATA)
         free_transfer(transfer, 0);
+    else if (devc->xfer_adaptive)
+        xfer_resubmit(transfer);
+    else {
+        if (devc->lend)
+            lend_buffer(transfer);
+        resubmit_transfer(transfer);
+    }
 
     devc->trf_completed = 1;
 }
@@ -2488,7 +2947,7 @@ SR_PRIV int dsl_start_transfers(const struct sr_dev_inst *sdi)
     struct DSL_context *devc;
     struct sr_usb_dev_inst *usb;
     struct libusb_transfer *transfer;
-    unsigned int i, num_transfers;
+    unsigned int i, num_transfers, spares;
     int ret;
     unsigned char *buf;
     size_t size;
@@ -2500,13 +2959,25 @@ SR_PRIV int dsl_start_transfers(const struct sr_dev_inst *sdi)
     num_transfers = get_number_of_transfers(sdi);
     size = get_buffer_size(sdi);
 
+    /* A stream capture adapts its transfers to the host */
+    devc->xfer_adaptive = (sdi->mode == LOGIC && devc->stream);
+    devc->xfer_parked = 0;
+    devc->lend = (sdi->mode == ANALOG);
+    devc->lend_hold = 0;
+    memset(devc->own_buffers, 0, sizeof(devc->own_buffers));
+    if (devc->xfer_adaptive) {
+        xfer_init(sdi, size);
+        num_transfers = devc->xfer_active;
+    }
+
     /* trigger packet transfer */
-    if (!(trigger_pos = malloc(dsl_header_size(devc)))) {
+    if (!(trigger_pos = g_try_malloc(dsl_header_size(devc)))) {
         sr_err("%s: USB trigger_pos buffer malloc failed.", __func__);
         return SR_ERR_MALLOC;
     }
 
-    devc->transfers = malloc(sizeof(*devc->transfers) * (num_transfers + 1));
+    devc->transfers = malloc(sizeof(*devc->transfers) *
+                             ((devc->xfer_adaptive ? devc->xfer_max : num_transfers) + 1));
     if (!devc->transfers) {
         sr_err("%s: USB transfer malloc failed.", __func__);
         return SR_ERR_MALLOC;
@@ -2530,13 +3001,14 @@ SR_PRIV int dsl_start_transfers(const struct sr_dev_inst *sdi)
 
     /* data packet transfer */
     for (i = 1; i <= num_transfers; i++) {
-        if (!(buf = malloc(size))) {
+        if (!(buf = g_try_malloc(size))) {
             sr_err("%s: USB transfer buffer malloc failed.", __func__);
             return SR_ERR_MALLOC;
         }
         transfer = libusb_alloc_transfer(0);
         libusb_fill_bulk_transfer(transfer, usb->devhdl,
-                6 | LIBUSB_ENDPOINT_IN, buf, size,
+                6 | LIBUSB_ENDPOINT_IN, buf,
+                devc->xfer_adaptive ? devc->xfer_len : size,
                 (libusb_transfer_cb_fn)receive_transfer, devc, 0);
         if ((ret = libusb_submit_transfer(transfer)) != 0) {
             sr_err("%s: Failed to submit transfer: %s.",
@@ -2548,10 +3020,19 @@ SR_PRIV int dsl_start_transfers(const struct sr_dev_inst *sdi)
             return SR_ERR;
         }
         devc->transfers[i] = transfer;
+        devc->own_buffers[i] = buf;
         devc->submitted_transfers++;
         devc->num_transfers++;
     }
 
+    /* No callback runs before the events are handled */
+    if (sdi->mode == LOGIC) {
+        spares = num_transfers * INGEST_SPARES;
+        if (devc->xfer_adaptive)
+            spares = min(spares, devc->xfer_max);
+        ingest_start(sdi, min(spares, INGEST_RING_SIZE - 1 - num_transfers), size);
+    }
+
     return SR_OK;
 }
 
@@ -41,6 +41,17 @@
 #define NUM_TRIGGER_STAGES	16
 #define NUM_SIMUL_TRANSFERS	64
 #define MAX_EMPTY_POLL      16
+/* Slots of an ingest ring, more than all buffers of a capture */
+#define INGEST_RING_SIZE    512
+/* Spare buffers of the ingest ring, per usb transfer */
+#define INGEST_SPARES       4
+
+/* Stream transfer scheduler, times in ms */
+#define XFER_MIN_TIME       2
+#define XFER_MAX_TOTAL      400
+#define XFER_WINDOW         250
+#define XFER_QUIET_WINDOWS  4
+#define XFER_MAX_MEMORY     SR_MB(64)
 
 #define DSL_REQUIRED_VERSION_MAJOR	2
 #define DSL_REQUIRED_VERSION_MINOR	0
@@ -1085,6 +1096,17 @@ static const struct DSL_profile supported_DSCope[] = {
 
 
 
+/*
+ * Single producer, single consumer ring of transfer buffers.
+ * One slot stays empty to tell a full ring from an empty one.
+ */
+struct DSL_ingest_ring {
+    uint8_t *buf[INGEST_RING_SIZE];
+    uint32_t len[INGEST_RING_SIZE];
+    gint head;
+    gint tail;
+};
+
 enum {
     DSL_ERROR = -1,
     DSL_INIT = 0,
@@ -1182,6 +1204,43 @@ struct DSL_context {
     int empty_poll_count;
 
     int is_loop;
+
+    /* Logic data goes from the usb callback to the ingest thread */
+    GThread *ingest_thread;
+    GMutex ingest_mutex;
+    GCond ingest_cond;
+    struct DSL_ingest_ring ingest_full;
+    struct DSL_ingest_ring ingest_free;
+    gint ingest_stop;
+    gint ingest_idle;
+    gint ingest_starved;
+    unsigned int ingest_buffers;
+    /* Read by the app while the usb thread updates them */
+    gint ingest_hwm;
+    gint ingest_overruns;
+    gint ingest_stalls;
+
+    /* Stream transfer scheduler */
+    gboolean xfer_adaptive;
+    size_t xfer_cap;
+    size_t xfer_len;
+    unsigned int xfer_active;
+    unsigned int xfer_max;
+    unsigned int xfer_lat_ms;
+    unsigned int xfer_need_ms;
+    unsigned int xfer_parked;
+    struct libusb_transfer *xfer_park[NUM_SIMUL_TRANSFERS];
+    int64_t xfer_last_time;
+    int64_t xfer_win_start;
+    int64_t xfer_win_gap;
+    unsigned int xfer_win_queue;
+    uint64_t xfer_win_overruns;
+    int xfer_quiet;
+
+    /* Analog data is received in buffers lent by the receiver */
+    gboolean lend;
+    unsigned int lend_hold; /* transfers to come back before lending again */
+    uint8_t *own_buffers[NUM_SIMUL_TRANSFERS + 1];
 };
 
 /*
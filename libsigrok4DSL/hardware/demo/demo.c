@@ -60,10 +60,12 @@ static void *logic_post_buf = NULL;
 
 #define PATTERN_COUNT 20
 #define RANDOM_NAME "random"
+#define TRACE_EXT ".dstrace"
 
 struct demo_mode_pattern
 {
     char *patterns[PATTERN_COUNT+1];
+    gboolean is_trace[PATTERN_COUNT+1]; // a capture trace, not a .demo file
     int   count;
 };
 
@@ -160,6 +162,14 @@ static int vdev_init(struct sr_dev_inst *sdi)
     vdev->logic_ch_mode_index = LOGIC125x16;
 
     vdev->is_loop = FALSE;
+
+    vdev->trace = NULL;
+    vdev->trace_thread = NULL;
+    vdev->trace_stop = 0;
+    vdev->trace_done = 0;
+    vdev->trace_status = SR_PKT_OK;
+    vdev->trace_probes = 0;
+
     vdev->unit_bits = (sdi->mode == LOGIC) ? 1 : 8;
     
     return SR_OK;
@@ -425,8 +435,10 @@ static int get_pattern_mode_from_file(const char *sub_dir, struct demo_mode_patt
 
     for (i=0; i<max_count; i++){
         info->patterns[i] = NULL;
+        info->is_trace[i] = FALSE;
     }
     info->patterns[max_count] = NULL;
+    info->is_trace[max_count] = FALSE;
 
     info->patterns[0] = RANDOM_NAME;
     num = 1;
@@ -457,6 +469,19 @@ static int get_pattern_mode_from_file(const char *sub_dir, struct demo_mode_patt
                 short_name[str_len] = 0;
                 info->patterns[num++] = g_strdup(short_name);
 
+                if (num >= max_count){
+                    break;
+                }
+            }
+            else if (strcmp(sub_dir, demo_mode_names[LOGIC]) == 0
+                    && g_str_has_suffix(file_path, TRACE_EXT))
+            {
+                str_len = strlen(file_path) - strlen(TRACE_EXT);
+                strncpy(short_name,file_path, sizeof(short_name)-1);
+                short_name[str_len] = 0;
+                info->is_trace[num] = TRUE;
+                info->patterns[num++] = g_strdup(short_name);
+
                 if (num >= max_count){
                     break;
                 }
@@ -512,7 +537,7 @@ static int reset_dsl_path(struct sr_dev_inst *sdi, uint8_t pattern_mode)
         strcat(file_path, demo_mode_names[sdi->mode]);
         strcat(file_path, "/");
         strcat(file_path, info->patterns[pattern_mode]);
-        strcat(file_path,".demo");
+        strcat(file_path, info->is_trace[pattern_mode] ? TRACE_EXT : ".demo");
 
         sdi->path = g_strdup(file_path);
     }
@@ -1279,7 +1304,7 @@ static int hw_dev_acquisition_start(struct sr_dev_inst *sdi,
         return SR_ERR_MALLOC;  
     }
 
-    if(vdev->sample_generator != PATTERN_RANDOM)
+    if(vdev->sample_generator != PATTERN_RANDOM && !is_trace_pattern(sdi))
     {
         if (vdev->archive != NULL){
             sr_err("history archive is not closed.");
@@ -1356,6 +1381,11 @@ static int hw_dev_acquisition_start(struct sr_dev_inst *sdi,
             g_timer_start(run_time);
             sr_session_source_add(-1, 0, 0, receive_data_logic, sdi);
         }
+        else if (is_trace_pattern(sdi)){
+            if (start_trace_replay(sdi) != SR_OK)
+                return SR_ERR;
+            sr_session_source_add(-1, 0, 0, receive_data_trace, sdi);
+        }
         else{
             sr_session_source_add(-1, 0, 0, receive_data_logic_decoder, sdi);
         }
@@ -2521,6 +2551,195 @@ static int close_archive(struct session_vdev *vdev)
     return SR_OK;
 }
 
+static gboolean is_trace_pattern(const struct sr_dev_inst *sdi)
+{
+    struct session_vdev *vdev = sdi->priv;
+    struct demo_mode_pattern *info;
+
+    if (sdi->mode != LOGIC || vdev->sample_generator == PATTERN_RANDOM)
+        return FALSE;
+
+    info = &demo_pattern_array[LOGIC];
+    return vdev->sample_generator < info->count && info->is_trace[vdev->sample_generator];
+}
+
+static int load_trace_session(struct sr_dev_inst *sdi)
+{
+    struct session_vdev *vdev = sdi->priv;
+    struct sr_trace_header header;
+    struct sr_trace *trace;
+    struct sr_channel *probe;
+    uint32_t i;
+
+    trace = sr_trace_open(sdi->path, &header);
+    if (trace == NULL)
+        return SR_ERR;
+    sr_trace_close(trace);
+
+    if (header.mode != LOGIC || header.num_probes == 0
+        || header.num_probes > ARRAY_SIZE(probe_names) - 1) {
+        sr_err("%s: Unsupported trace file:\"%s\"", __func__, sdi->path);
+        return SR_ERR;
+    }
+
+    vdev->samplerate = header.samplerate;
+    vdev->total_samples = header.limit_samples;
+    vdev->num_probes = header.num_probes;
+    vdev->num_blocks = 1;
+    vdev->trace_probes = header.num_probes;
+    samplerates_file[0] = vdev->samplerate;
+    samplecounts_file[0] = vdev->total_samples;
+
+    sr_dev_probes_free(sdi);
+
+    for (i = 0; i < header.num_probes; i++)
+    {
+        if (!(probe = sr_channel_new(i, SR_CHANNEL_LOGIC, TRUE, probe_names[i])))
+        {
+            sr_err("%s: create channel failed", __func__);
+            return SR_ERR;
+        }
+        sdi->channels = g_slist_append(sdi->channels, probe);
+    }
+
+    adjust_samplerate(sdi);
+
+    sr_info("Trace file:%s, probes:%u, samplerate:%llu, samples:%llu",
+        sdi->path, header.num_probes, (u64_t)header.samplerate, (u64_t)header.limit_samples);
+
+    return SR_OK;
+}
+
+/**
+ * Forward the packets of the trace at the pace they were recorded.
+ * DS_TRACE_SPEED scales the pace, 0 replays as fast as the host takes it.
+ */
+static gpointer trace_replay_proc(gpointer data)
+{
+    const struct sr_dev_inst *sdi = data;
+    struct session_vdev *vdev = sdi->priv;
+    struct sr_trace_record record;
+    struct sr_datafeed_packet packet;
+    struct sr_datafeed_logic logic;
+    void *buf = NULL;
+    uint64_t buf_size = 0;
+    uint64_t bytes = 0;
+    gdouble speed = 1;
+    int64_t start_time;
+    int64_t due;
+    int64_t now;
+    int ret;
+
+    if (g_getenv("DS_TRACE_SPEED") != NULL)
+        speed = g_ascii_strtod(g_getenv("DS_TRACE_SPEED"), NULL);
+
+    vdev->trace_status = SR_PKT_OK;
+    start_time = g_get_monotonic_time();
+
+    while (!g_atomic_int_get(&vdev->trace_stop))
+    {
+        ret = sr_trace_read(vdev->trace, &record, &buf, &buf_size);
+        if (ret != SR_OK)
+            break;
+
+        if (speed > 0) {
+            due = start_time + (int64_t)(record.time / speed);
+            now = g_get_monotonic_time();
+            if (due > now)
+                g_usleep(due - now);
+        }
+
+        if (record.type == SR_DF_END) {
+            vdev->trace_status = record.status;
+            break;
+        }
+
+        packet.status = record.status;
+        packet.type = record.type;
+
+        if (record.type == SR_DF_LOGIC) {
+            logic.format = record.format;
+            logic.length = record.length;
+            logic.data = buf;
+            packet.payload = &logic;
+            bytes += record.length;
+        }
+        else if (record.type == SR_DF_TRIGGER) {
+            if (record.length != sizeof(struct ds_trigger_pos))
+                continue;
+            packet.payload = buf;
+        }
+        else {
+            packet.payload = NULL;
+        }
+
+        ds_data_forward(sdi, &packet);
+    }
+
+    sr_info("Trace replay done, sent:%llu bytes in %llu ms.",
+        (u64_t)bytes, (u64_t)((g_get_monotonic_time() - start_time) / 1000));
+
+    g_free(buf);
+    g_atomic_int_set(&vdev->trace_done, 1);
+
+    return NULL;
+}
+
+static int start_trace_replay(struct sr_dev_inst *sdi)
+{
+    struct session_vdev *vdev = sdi->priv;
+    struct sr_trace_header header;
+
+    if (vdev->enabled_probes != (int)vdev->trace_probes) {
+        sr_err("The trace was recorded with %u probes, enable all of them.",
+            vdev->trace_probes);
+        return SR_ERR;
+    }
+
+    vdev->trace = sr_trace_open(sdi->path, &header);
+    if (vdev->trace == NULL)
+        return SR_ERR;
+
+    g_atomic_int_set(&vdev->trace_stop, 0);
+    g_atomic_int_set(&vdev->trace_done, 0);
+
+    vdev->trace_thread = g_thread_new("trace_replay", trace_replay_proc, sdi);
+
+    return SR_OK;
+}
+
+static int receive_data_trace(int fd, int revents, const struct sr_dev_inst *sdi)
+{
+    struct session_vdev *vdev = sdi->priv;
+    struct sr_datafeed_packet packet;
+
+    (void)fd;
+
+    if (revents == -1)
+        g_atomic_int_set(&vdev->trace_stop, 1);
+
+    if (!g_atomic_int_get(&vdev->trace_stop) && !g_atomic_int_get(&vdev->trace_done)) {
+        g_usleep(10000);
+        return TRUE;
+    }
+
+    if (vdev->trace_thread != NULL) {
+        g_thread_join(vdev->trace_thread);
+        vdev->trace_thread = NULL;
+    }
+
+    sr_trace_close(vdev->trace);
+    vdev->trace = NULL;
+
+    packet.type = SR_DF_END;
+    packet.status = g_atomic_int_get(&vdev->trace_stop) ? SR_PKT_OK : vdev->trace_status;
+    packet.payload = NULL;
+    ds_data_forward(sdi, &packet);
+    sr_session_source_remove(-1);
+
+    return TRUE;
+}
+
 static int load_virtual_device_session(struct sr_dev_inst *sdi)
 {
     GKeyFile *kf;
@@ -2543,7 +2762,11 @@ static int load_virtual_device_session(struct sr_dev_inst *sdi)
     switch (sdi->mode)
     {
     case LOGIC:
-        if(vdev->sample_generator != PATTERN_RANDOM)
+        if (is_trace_pattern(sdi))
+        {
+            return load_trace_session(sdi);
+        }
+        else if(vdev->sample_generator != PATTERN_RANDOM)
         {
             archive = unzOpen64(sdi->path);
             if (NULL == archive)
@@ -233,6 +233,14 @@ struct session_vdev
     enum DEMO_LOGIC_CHANNEL_INDEX logic_ch_mode_index;
 
     int is_loop;
+
+    //trace replay
+    struct sr_trace *trace;
+    GThread *trace_thread;
+    gint trace_stop;
+    gint trace_done;
+    int trace_status;
+    uint32_t trace_probes;
 };
 
 #define SESSION_MAX_CHANNEL_COUNT 512
@@ -501,6 +509,14 @@ static void send_error_packet(const struct sr_dev_inst *cb_sdi, struct session_v
 
 static int close_archive(struct session_vdev *vdev);
 
+static gboolean is_trace_pattern(const struct sr_dev_inst *sdi);
+
+static int load_trace_session(struct sr_dev_inst *sdi);
+
+static int start_trace_replay(struct sr_dev_inst *sdi);
+
+static int receive_data_trace(int fd, int revents, const struct sr_dev_inst *sdi);
+
 static int dso_wavelength_updata(struct session_vdev *vdev);
 
 
@@ -50,6 +50,7 @@ static struct sr_config_info sr_config_info_data[] = {
 	{SR_CONF_SAMPLERATE, SR_T_UINT64,"Sample rate"},
     {SR_CONF_LIMIT_SAMPLES, SR_T_UINT64,"Sample count"},
     {SR_CONF_ACTUAL_SAMPLES, SR_T_UINT64,"Sample count-actual"},
+    {SR_CONF_INGEST_HWM, SR_T_UINT64,"Ingest ring high-water mark"},
     {SR_CONF_CLOCK_TYPE, SR_T_BOOL,"Using External Clock"},
     {SR_CONF_CLOCK_EDGE, SR_T_BOOL, "Using Clock Negedge"},
     {SR_CONF_CAPTURE_RATIO, SR_T_UINT64,"Pre-trigger capture ratio"},
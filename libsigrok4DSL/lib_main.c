@@ -45,6 +45,14 @@ char DS_RES_PATH[500];
 
 char DS_USR_PATH[500];
 
+/* A device that captures along with the actived device */
+struct sync_device
+{
+	struct sr_dev_inst *sdi;
+	struct sr_session *session;
+	GThread *collect_thread;
+};
+
 struct sr_lib_context
 {
 	dslib_event_callback_t event_callback;
@@ -59,9 +67,14 @@ struct sr_lib_context
 	struct libusb_device *attach_device_handle;
 	struct libusb_device *detach_device_handle;
 	struct sr_dev_inst *actived_device_instance;
+	GSList *sync_device_list; // struct sync_device* type
 	GThread *hotplug_thread;
 	GThread *collect_thread;
 	ds_datafeed_callback_t data_forward_callback;
+	ds_datafeed_lend_callback_t data_lend_callback;
+	char *trace_path;
+	struct sr_trace *trace_writer;
+	struct sr_soft_trigger *soft_trigger;
 	int callback_thread_count;
 	int is_delay_destory_actived_device;
 	int is_stop_by_detached;
@@ -76,9 +89,18 @@ static void destroy_device_instance(struct sr_dev_inst *dev);
 static void close_device_instance(struct sr_dev_inst *dev);
 static int open_device_instance(struct sr_dev_inst *dev);
 static gpointer collect_run_proc(gpointer data);
+static gpointer sync_collect_run_proc(gpointer data);
+static int start_sync_collect();
+static void stop_sync_collect();
+static void wait_sync_collect();
+static struct sync_device* find_sync_device(ds_device_handle handle);
+static void remove_sync_device(struct sync_device *dev);
 static void post_event_async(int event);
 static void send_event(int event);
 static void make_demo_device_to_list();
+static void soft_trigger_create(const struct sr_dev_inst *sdi);
+static int soft_trigger_forward(const struct sr_dev_inst *sdi,
+							const struct sr_datafeed_packet *packet);
 static void process_attach_event(int isEvent);
 static struct libusb_device* get_new_attached_usb_device();
 static struct libusb_device* get_new_detached_usb_device();
@@ -96,7 +118,12 @@ static struct sr_lib_context lib_ctx = {
 	.attach_device_handle = NULL,
 	.detach_device_handle = NULL,
 	.actived_device_instance = NULL,
+	.sync_device_list = NULL,
 	.data_forward_callback = NULL,
+	.data_lend_callback = NULL,
+	.trace_path = NULL,
+	.trace_writer = NULL,
+	.soft_trigger = NULL,
 	.collect_thread = NULL,
 	.callback_thread_count = 0,
 	.is_delay_destory_actived_device = 0,
@@ -131,6 +158,9 @@ SR_API int ds_lib_init()
 	}
 	lib_ctx.lib_exit_flag = 0;
 
+	if (g_getenv("DS_TRACE_RECORD") != NULL)
+		ds_set_trace_record_file(g_getenv("DS_TRACE_RECORD"));
+
 	// Init trigger.
 	ds_trigger_init();
 
@@ -200,6 +230,10 @@ SR_API int ds_lib_exit()
 	ds_release_actived_device();
 	sr_close_hotplug(lib_ctx.sr_ctx);
 
+	// The sync devices are destroyed with the list.
+	g_slist_free_full(lib_ctx.sync_device_list, g_free);
+	lib_ctx.sync_device_list = NULL;
+
 	lib_ctx.lib_exit_flag = 1; // all thread to exit
 
 	if (lib_ctx.hotplug_thread != NULL)
@@ -229,6 +263,13 @@ SR_API int ds_lib_exit()
 	// Uninit trigger.
 	ds_trigger_destroy();
 
+	sr_trace_close(lib_ctx.trace_writer);
+	lib_ctx.trace_writer = NULL;
+	ds_set_trace_record_file(NULL);
+
+	sr_soft_trigger_free(lib_ctx.soft_trigger);
+	lib_ctx.soft_trigger = NULL;
+
 	if (sr_exit(lib_ctx.sr_ctx) != SR_OK)
 	{
 		sr_err("call sr_exit error");
@@ -278,6 +319,30 @@ SR_API void ds_set_datafeed_callback(ds_datafeed_callback_t cb)
 	lib_ctx.data_forward_callback = cb;
 }
 
+/**
+ * Set the callback that lends receive buffers.
+ */
+SR_API void ds_set_datafeed_lend_callback(ds_datafeed_lend_callback_t cb)
+{
+	lib_ctx.data_lend_callback = cb;
+}
+
+/**
+ * Record the logic captures to a trace file, the demo device replays it.
+ * NULL stops the recording.
+ */
+SR_API int ds_set_trace_record_file(const char *path)
+{
+	g_free(lib_ctx.trace_path);
+	lib_ctx.trace_path = NULL;
+
+	if (path != NULL && *path != '\0'){
+		lib_ctx.trace_path = g_strdup(path);
+		sr_info("Capture trace file: %s", path);
+	}
+	return SR_OK;
+}
+
 /**
  * Get the device list, if the field _handle is 0, the list visited to end.
  * User need call free() to release the buffer. If the list is empty, the out_list is null.
@@ -366,6 +431,12 @@ SR_API int ds_active_device(ds_device_handle handle)
 		return SR_ERR_CALL_STATUS;
 	}
 
+	// A sync device becomes the actived device.
+	if (ds_is_sync_device(handle))
+	{
+		ds_remove_sync_device(handle);
+	}
+
 	pthread_mutex_lock(&lib_ctx.mutext);
 
 	if (lib_ctx.actived_device_instance != NULL)
@@ -607,6 +678,16 @@ SR_API int ds_remove_device(ds_device_handle handle)
 		return SR_ERR_CALL_STATUS;
 	}
 
+	if (ds_is_sync_device(handle))
+	{
+		if (ds_is_collecting())
+		{
+			sr_err("Device is collecting, can't remove it.");
+			return SR_ERR_CALL_STATUS;
+		}
+		ds_remove_sync_device(handle);
+	}
+
 	if (lib_ctx.actived_device_instance != NULL && lib_ctx.is_delay_destory_actived_device && lib_ctx.actived_device_instance->handle == handle)
 	{
 		sr_info("The current device is delayed for destruction, handle:%p", lib_ctx.actived_device_instance->handle);
@@ -764,6 +845,14 @@ SR_API int ds_start_collect()
 		}
 	}
 
+	// The sync devices are armed before the actived device.
+	ret = start_sync_collect();
+	if (ret != SR_OK)
+	{
+		stop_sync_collect();
+		wait_sync_collect();
+		return ret;
+	}
 
 	lib_ctx.collect_thread = g_thread_new("collect_proc", collect_run_proc, (gpointer)0);
 
@@ -783,6 +872,8 @@ static gpointer collect_run_proc(gpointer data)
 
 	send_event(DS_EV_COLLECT_TASK_START);
 
+	sr_thread_sched_apply(DS_THREAD_ACQUISITION, "Collect");
+
 	sr_info("Collect thread start.");
 
 	if (di == NULL || di->driver == NULL || di->driver->dev_acquisition_start == NULL)
@@ -816,6 +907,11 @@ static gpointer collect_run_proc(gpointer data)
 	}
 
 END:
+	// The capture ends with the last device.
+	if (bError)
+		stop_sync_collect();
+	wait_sync_collect();
+
 	sr_info("Collect thread end.");
 	lib_ctx.collect_thread = NULL;
 
@@ -831,6 +927,128 @@ END:
 	return NULL;
 }
 
+static int start_sync_collect()
+{
+	GSList *l;
+	struct sync_device *dev;
+	int ret;
+
+	for (l = lib_ctx.sync_device_list; l; l = l->next)
+	{
+		dev = l->data;
+
+		if (dev->sdi->status != SR_ST_ACTIVE)
+		{
+			ret = open_device_instance(dev->sdi);
+			if (ret != SR_OK)
+			{
+				sr_err("Open sync device error, name:\"%s\"", dev->sdi->name);
+				return ret;
+			}
+		}
+
+		dev->session = sr_session_create(dev->sdi);
+		if (dev->session == NULL)
+		{
+			return SR_ERR_MALLOC;
+		}
+
+		dev->collect_thread = g_thread_new("sync_collect_proc", sync_collect_run_proc, dev);
+	}
+
+	return SR_OK;
+}
+
+static gpointer sync_collect_run_proc(gpointer data)
+{
+	struct sync_device *dev;
+	struct sr_dev_inst *di;
+	struct sr_datafeed_packet packet;
+	int ret;
+
+	dev = (struct sync_device *)data;
+	di = dev->sdi;
+	ret = SR_ERR;
+
+	// The sources of the driver go to the session of the device.
+	sr_session_bind(dev->session);
+
+	sr_thread_sched_apply(DS_THREAD_ACQUISITION, "Sync collect");
+
+	sr_info("Sync collect thread start, name:\"%s\"", di->name);
+
+	if (di->driver == NULL || di->driver->dev_acquisition_start == NULL)
+	{
+		sr_err("The sync device cannot be used.");
+	}
+	else if ((ret = di->driver->dev_acquisition_start(di, (void *)di)) != SR_OK)
+	{
+		sr_err("Failed to start acquisition of sync device: %d", ret);
+	}
+	else if ((ret = sr_session_run()) != SR_OK)
+	{
+		sr_err("Run sync session error!");
+	}
+
+	// Tell the receiver this device has nothing more.
+	if (ret != SR_OK)
+	{
+		packet.type = SR_DF_END;
+		packet.status = SR_PKT_SOURCE_ERROR;
+		packet.payload = NULL;
+		packet.bExportOriginalData = 0;
+		ds_data_forward(di, &packet);
+	}
+
+	sr_session_bind(NULL);
+
+	sr_info("Sync collect thread end, name:\"%s\"", di->name);
+
+	return NULL;
+}
+
+static void stop_sync_collect()
+{
+	GSList *l;
+	struct sync_device *dev;
+
+	pthread_mutex_lock(&lib_ctx.mutext);
+
+	for (l = lib_ctx.sync_device_list; l; l = l->next)
+	{
+		dev = l->data;
+		if (dev->session != NULL)
+			sr_session_abort(dev->session);
+	}
+	pthread_mutex_unlock(&lib_ctx.mutext);
+}
+
+static void wait_sync_collect()
+{
+	GSList *l;
+	struct sync_device *dev;
+	struct sr_session *session;
+
+	for (l = lib_ctx.sync_device_list; l; l = l->next)
+	{
+		dev = l->data;
+
+		if (dev->collect_thread != NULL)
+		{
+			g_thread_join(dev->collect_thread);
+			dev->collect_thread = NULL;
+		}
+
+		// stop_sync_collect() may run on another thread.
+		pthread_mutex_lock(&lib_ctx.mutext);
+		session = dev->session;
+		dev->session = NULL;
+		pthread_mutex_unlock(&lib_ctx.mutext);
+
+		sr_session_free(session);
+	}
+}
+
 /**
  * Stop collect data, but not close the device.
  */
@@ -846,6 +1064,7 @@ SR_API int ds_stop_collect()
 
 	// Stop current session.
 	sr_session_stop();
+	stop_sync_collect();
 
 	// Wait the collect thread ends.
 	if (lib_ctx.collect_thread != NULL)
@@ -897,6 +1116,263 @@ SR_API int ds_release_actived_device()
 	return SR_OK;
 }
 
+/**-------------------sync device ---------------*/
+
+/**
+ * Add a device to capture along with the actived device.
+ * It keeps its own session and collect thread, the data is forwarded
+ * with its own sdi.
+ */
+SR_API int ds_add_sync_device(ds_device_handle handle)
+{
+	GSList *l;
+	struct sr_dev_inst *dev;
+	struct sr_dev_inst *di;
+	struct sync_device *sync_dev;
+	int ret;
+
+	di = NULL;
+
+	if (ds_is_collecting())
+	{
+		sr_err("Error!It's collecting, can not add a sync device.");
+		return SR_ERR_CALL_STATUS;
+	}
+	if (lib_ctx.actived_device_instance != NULL
+		&& lib_ctx.actived_device_instance->handle == handle)
+	{
+		sr_err("The actived device can not sync with itself.");
+		return SR_ERR_ARG;
+	}
+	if (find_sync_device(handle) != NULL)
+	{
+		return SR_ERR_HAVE_DONE;
+	}
+
+	pthread_mutex_lock(&lib_ctx.mutext);
+
+	for (l = lib_ctx.device_list; l; l = l->next)
+	{
+		dev = l->data;
+		if (dev->handle == handle)
+		{
+			di = dev;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&lib_ctx.mutext);
+
+	if (di == NULL)
+	{
+		sr_err("Add sync device error, can't find the device.");
+		return SR_ERR_CALL_STATUS;
+	}
+	if (di->dev_type == DEV_TYPE_FILELOG)
+	{
+		sr_err("A file device can not be a sync device.");
+		return SR_ERR_ARG;
+	}
+
+	if (di->status != SR_ST_ACTIVE)
+	{
+		ret = open_device_instance(di);
+		if (ret != SR_OK)
+		{
+			sr_err("Open sync device error!");
+			return ret;
+		}
+	}
+
+	sync_dev = g_try_malloc0(sizeof(struct sync_device));
+	if (sync_dev == NULL)
+	{
+		sr_err("%s,ERROR:failed to alloc memory.", __func__);
+		close_device_instance(di);
+		return SR_ERR_MALLOC;
+	}
+	sync_dev->sdi = di;
+
+	pthread_mutex_lock(&lib_ctx.mutext);
+	lib_ctx.sync_device_list = g_slist_append(lib_ctx.sync_device_list, sync_dev);
+	pthread_mutex_unlock(&lib_ctx.mutext);
+
+	sr_info("Add sync device, name:\"%s\"", di->name);
+
+	return SR_OK;
+}
+
+/**
+ * Remove a sync device, and close it.
+ */
+SR_API int ds_remove_sync_device(ds_device_handle handle)
+{
+	struct sync_device *sync_dev;
+	struct sr_dev_inst *di;
+
+	if (ds_is_collecting())
+	{
+		sr_err("Error!It's collecting, can not remove a sync device.");
+		return SR_ERR_CALL_STATUS;
+	}
+
+	sync_dev = find_sync_device(handle);
+	if (sync_dev == NULL)
+	{
+		return SR_ERR_CALL_STATUS;
+	}
+
+	di = sync_dev->sdi;
+
+	pthread_mutex_lock(&lib_ctx.mutext);
+	remove_sync_device(sync_dev);
+	pthread_mutex_unlock(&lib_ctx.mutext);
+
+	sr_info("Remove sync device, name:\"%s\"", di->name);
+	close_device_instance(di);
+
+	return SR_OK;
+}
+
+SR_API int ds_is_sync_device(ds_device_handle handle)
+{
+	return find_sync_device(handle) != NULL;
+}
+
+/**
+ * Get the index of a sync device in the sync list by its data,
+ * -1 is the actived device.
+ */
+SR_API int ds_get_sync_device_index(const struct sr_dev_inst *sdi)
+{
+	GSList *l;
+	int index;
+	int ret;
+
+	index = 0;
+	ret = -1;
+
+	pthread_mutex_lock(&lib_ctx.mutext);
+
+	for (l = lib_ctx.sync_device_list; l; l = l->next)
+	{
+		if (((struct sync_device *)l->data)->sdi == sdi)
+		{
+			ret = index;
+			break;
+		}
+		index++;
+	}
+	pthread_mutex_unlock(&lib_ctx.mutext);
+
+	return ret;
+}
+
+/**
+ * Get the sync device list, the same as ds_get_device_list().
+ */
+SR_API int ds_get_sync_device_list(struct ds_device_base_info **out_list, int *out_count)
+{
+	int num;
+	struct ds_device_base_info *p = NULL;
+	GSList *l;
+	struct sr_dev_inst *dev;
+	void *buf = NULL;
+
+	if (out_list == NULL)
+	{
+		return SR_ERR_ARG;
+	}
+	*out_list = NULL;
+
+	if (out_count)
+	{
+		*out_count = 0;
+	}
+
+	pthread_mutex_lock(&lib_ctx.mutext);
+
+	num = g_slist_length(lib_ctx.sync_device_list);
+	if (num == 0)
+	{
+		pthread_mutex_unlock(&lib_ctx.mutext);
+		return SR_OK;
+	}
+
+	buf = malloc(sizeof(struct ds_device_base_info) * (num + 1));
+	if (buf == NULL)
+	{	
+		sr_err("%s,ERROR:failed to alloc memory.", __func__);
+		pthread_mutex_unlock(&lib_ctx.mutext);
+		return SR_ERR_MALLOC;
+	}
+
+	p = (struct ds_device_base_info*)buf;
+
+	for (l = lib_ctx.sync_device_list; l; l = l->next)
+	{
+		dev = ((struct sync_device *)l->data)->sdi;
+		p->handle = dev->handle;
+		strncpy(p->name, (const char*)dev->name, sizeof(p->name) - 1);
+		p->name[sizeof(p->name) - 1] = '\0';
+		p++;
+	}
+
+	p->handle = 0; // is the end
+	p->name[0] = '\0';
+
+	if (out_count)
+	{
+		*out_count = num;
+	}
+
+	pthread_mutex_unlock(&lib_ctx.mutext);
+
+	*out_list = (struct ds_device_base_info*)buf;
+	return SR_OK;
+}
+
+SR_API int ds_get_sync_device_config(ds_device_handle handle, int key, GVariant **data)
+{
+	struct sync_device *sync_dev;
+
+	sync_dev = find_sync_device(handle);
+	if (sync_dev == NULL)
+	{
+		sr_err("It's not a sync device.");
+		return SR_ERR_CALL_STATUS;
+	}
+
+	return sr_config_get(sync_dev->sdi->driver, sync_dev->sdi, NULL, NULL, key, data);
+}
+
+SR_API int ds_set_sync_device_config(ds_device_handle handle, int key, GVariant *data)
+{
+	struct sync_device *sync_dev;
+
+	sync_dev = find_sync_device(handle);
+	if (sync_dev == NULL)
+	{
+		sr_err("It's not a sync device.");
+		return SR_ERR_CALL_STATUS;
+	}
+
+	return sr_config_set(sync_dev->sdi, NULL, NULL, key, data);
+}
+
+SR_API GSList *ds_get_sync_device_channels(ds_device_handle handle)
+{
+	struct sync_device *sync_dev;
+
+	sync_dev = find_sync_device(handle);
+	if (sync_dev != NULL)
+	{
+		return sync_dev->sdi->channels;
+	}
+	return NULL;
+}
+
+/**-------------------sync device end---------------*/
+
 int ds_trigger_is_enabled()
 {
 	GSList *l;
@@ -1152,6 +1628,33 @@ SR_PRIV int ds_data_forward(const struct sr_dev_inst *sdi,
 		return SR_ERR_ARG;
 	}
 
+	if (packet->type == SR_DF_HEADER && lib_ctx.trace_path != NULL
+		&& lib_ctx.trace_writer == NULL
+		&& sdi == lib_ctx.actived_device_instance
+		&& (sdi->path == NULL || strcmp(sdi->path, lib_ctx.trace_path) != 0)){
+		lib_ctx.trace_writer = sr_trace_create(lib_ctx.trace_path, sdi);
+	}
+
+	if (lib_ctx.trace_writer != NULL && sdi == lib_ctx.actived_device_instance){
+		sr_trace_write(lib_ctx.trace_writer, packet);
+
+		if (packet->type == SR_DF_END){
+			sr_trace_close(lib_ctx.trace_writer);
+			lib_ctx.trace_writer = NULL;
+		}
+	}
+
+	if (sdi == lib_ctx.actived_device_instance){
+		if (packet->type == SR_DF_HEADER){
+			sr_soft_trigger_free(lib_ctx.soft_trigger);
+			lib_ctx.soft_trigger = NULL;
+			soft_trigger_create(sdi);
+		}
+
+		if (lib_ctx.soft_trigger != NULL)
+			return soft_trigger_forward(sdi, packet);
+	}
+
 	if (lib_ctx.data_forward_callback != NULL){
 		lib_ctx.data_forward_callback(sdi, packet);
 		return SR_OK;
@@ -1159,6 +1662,102 @@ SR_PRIV int ds_data_forward(const struct sr_dev_inst *sdi,
 	return SR_ERR;
 }
 
+/**
+ * The stream captures and the demo device have no hardware trigger,
+ * the trigger is matched on the host. It only marks the position of
+ * the trigger, the samples before it are not cut.
+ */
+static void soft_trigger_create(const struct sr_dev_inst *sdi)
+{
+	GVariant *gvar;
+	gboolean stream;
+	uint16_t *ch_index;
+	int ch_num;
+	GSList *l;
+	struct sr_channel *ch;
+
+	if (sdi->mode != LOGIC || trigger == NULL || !trigger->trigger_en)
+		return;
+
+	if (sdi->dev_type != DEV_TYPE_DEMO){
+		gvar = NULL;
+		stream = FALSE;
+		if (sr_config_get(sdi->driver, sdi, NULL, NULL, SR_CONF_STREAM, &gvar) == SR_OK
+			&& gvar != NULL){
+			stream = g_variant_get_boolean(gvar);
+			g_variant_unref(gvar);
+		}
+		if (!stream)
+			return;
+	}
+
+	if (sdi->channels == NULL)
+		return;
+
+	ch_index = g_new0(uint16_t, g_slist_length(sdi->channels));
+
+	// The channels in the order of the cross data
+	ch_num = 0;
+	for (l = sdi->channels; l; l = l->next){
+		ch = (struct sr_channel *)l->data;
+		if (ch->type == SR_CHANNEL_LOGIC && ch->enabled)
+			ch_index[ch_num++] = ch->index;
+	}
+
+	lib_ctx.soft_trigger = sr_soft_trigger_new(trigger, ch_index, ch_num);
+	g_free(ch_index);
+}
+
+static int soft_trigger_forward(const struct sr_dev_inst *sdi,
+							const struct sr_datafeed_packet *packet)
+{
+	struct sr_datafeed_packet trig_packet;
+	struct ds_trigger_pos trig_pos;
+	const struct sr_datafeed_logic *logic;
+	uint64_t pos;
+
+	if (lib_ctx.data_forward_callback == NULL)
+		return SR_ERR;
+
+	// The driver reports the start only, the trigger is found here
+	if (packet->type == SR_DF_TRIGGER)
+		return SR_OK;
+
+	if (packet->type == SR_DF_LOGIC && packet->status == SR_PKT_OK){
+		logic = (const struct sr_datafeed_logic *)packet->payload;
+
+		if (sr_soft_trigger_feed(lib_ctx.soft_trigger, logic, &pos)){
+			memset(&trig_pos, 0, sizeof(trig_pos));
+			trig_pos.check_id = DS_SOFT_TRIGGER_CHECK_ID;
+			trig_pos.real_pos = (uint32_t)pos;
+			trig_pos.ram_saddr = (uint32_t)(pos >> 32);
+			trig_pos.status = 0x01;
+
+			memset(&trig_packet, 0, sizeof(trig_packet));
+			trig_packet.type = SR_DF_TRIGGER;
+			trig_packet.status = SR_PKT_OK;
+			trig_packet.payload = &trig_pos;
+			lib_ctx.data_forward_callback(sdi, &trig_packet);
+		}
+	}
+
+	lib_ctx.data_forward_callback(sdi, packet);
+
+	if (packet->type == SR_DF_END){
+		sr_soft_trigger_free(lib_ctx.soft_trigger);
+		lib_ctx.soft_trigger = NULL;
+	}
+	return SR_OK;
+}
+
+SR_PRIV void* ds_data_lend(const struct sr_dev_inst *sdi, int type,
+						uint64_t size, uint64_t ahead)
+{
+	if (sdi != NULL && lib_ctx.data_lend_callback != NULL)
+		return lib_ctx.data_lend_callback(sdi, type, size, ahead);
+	return NULL;
+}
+
 SR_PRIV int current_device_acquisition_stop()
 {
 	struct sr_dev_inst *di;
@@ -1301,6 +1900,11 @@ static void hotplug_event_listen_callback(struct libusb_context *ctx, struct lib
 			lib_ctx.is_stop_by_detached = 1;
 			ds_release_actived_device();
 		}
+		else if (ds_is_sync_device((ds_device_handle)dev) && ds_is_collecting())
+		{
+			sr_info("The collecting sync device is detached, will stop the collect thread.");
+			ds_stop_collect();
+		}
 
 		/**
 		 * Begin to wait the device reconnect, if timeout, will process the detach event.
@@ -1364,6 +1968,7 @@ static void process_attach_event(int isEvent)
 static void process_detach_event()
 {
 	GSList *l;
+	GSList *sl;
 	struct sr_dev_inst *dev;
 	libusb_device *ev_dev;
 	int ev;
@@ -1393,6 +1998,16 @@ static void process_detach_event()
 			// Found the device, and remove it from list.
 			lib_ctx.device_list = g_slist_remove(lib_ctx.device_list, l->data);
 
+			for (sl = lib_ctx.sync_device_list; sl; sl = sl->next)
+			{
+				if (((struct sync_device *)sl->data)->sdi == dev)
+				{
+					sr_info("The sync device is detached, name:\"%s\"", dev->name);
+					remove_sync_device(sl->data);
+					break;
+				}
+			}
+
 			if (dev == lib_ctx.actived_device_instance)
 			{
 				sr_info("The current device will be delayed for destruction, handle:%p", dev->handle);
@@ -1422,6 +2037,9 @@ static gpointer usb_hotplug_process_proc(gpointer data)
 	
 	sr_info("Hotplug thread start!");
 
+	// The usb transfers complete in this thread too
+	sr_thread_sched_apply(DS_THREAD_ACQUISITION, "Hotplug");
+
 	int cur_trans_id = 0;
 
 	while (!lib_ctx.lib_exit_flag)
@@ -1562,6 +2180,38 @@ static int open_device_instance(struct sr_dev_inst *dev)
 	return SR_ERR_CALL_STATUS;
 }
 
+static struct sync_device* find_sync_device(ds_device_handle handle)
+{
+	GSList *l;
+	struct sync_device *dev;
+	struct sync_device *ret;
+
+	ret = NULL;
+	pthread_mutex_lock(&lib_ctx.mutext);
+
+	for (l = lib_ctx.sync_device_list; l; l = l->next)
+	{
+		dev = l->data;
+		if (dev->sdi->handle == handle)
+		{
+			ret = dev;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&lib_ctx.mutext);
+
+	return ret;
+}
+
+/**
+ * Take a device out of the sync list, the caller holds the lock.
+ */
+static void remove_sync_device(struct sync_device *dev)
+{
+	lib_ctx.sync_device_list = g_slist_remove(lib_ctx.sync_device_list, dev);
+	g_free(dev);
+}
+
 static gpointer post_event_proc(gpointer event)
 {
 	if (lib_ctx.event_callback != NULL)
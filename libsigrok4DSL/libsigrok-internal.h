@@ -184,6 +184,9 @@ struct sr_session
 { 
     gboolean running;
 
+	/* The device of a sync session, NULL for the actived device. */
+	struct sr_dev_inst *sdi;
+
 	unsigned int num_sources;
 
 	/*
@@ -336,6 +339,58 @@ SR_PRIV uint16_t ds_trigger_get_edge1(uint16_t stage, uint16_t msc, uint16_t lsc
 SR_PRIV int ds_trigger_init(void);
 SR_PRIV int ds_trigger_destroy(void);
 
+/*--- trace.c -------------------------------------------------*/
+
+#define SR_TRACE_MAGIC "DSTRACE"
+#define SR_TRACE_VERSION 1
+
+struct sr_trace_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t mode;
+	uint64_t samplerate;
+	uint64_t limit_samples;
+	/* The enabled probes, the data of a packet has them all */
+	uint32_t num_probes;
+	uint32_t reserved;
+};
+
+struct sr_trace_record {
+	/* Microseconds since the capture started */
+	uint64_t time;
+	uint16_t type;
+	int16_t status;
+	uint16_t format;
+	uint16_t reserved;
+	uint64_t length;
+};
+
+struct sr_trace;
+
+SR_PRIV struct sr_trace* sr_trace_create(const char *path, const struct sr_dev_inst *sdi);
+SR_PRIV int sr_trace_write(struct sr_trace *trace, const struct sr_datafeed_packet *packet);
+SR_PRIV struct sr_trace* sr_trace_open(const char *path, struct sr_trace_header *header);
+SR_PRIV int sr_trace_read(struct sr_trace *trace, struct sr_trace_record *record,
+						void **buf, uint64_t *buf_size);
+SR_PRIV void sr_trace_close(struct sr_trace *trace);
+
+/*--- sched.c -------------------------------------------------*/
+
+/* Called by a thread of @role when it starts, @name is for the log */
+SR_PRIV void sr_thread_sched_apply(int role, const char *name);
+
+/*--- soft_trigger.c -------------------------------------------------*/
+
+struct sr_soft_trigger;
+
+/* NULL if the trigger has no condition to match on the host */
+SR_PRIV struct sr_soft_trigger* sr_soft_trigger_new(const struct ds_trigger *trig,
+					const uint16_t *ch_index, int ch_num);
+/* Returns 1 when the trigger fires, @pos is the sample from the start */
+SR_PRIV int sr_soft_trigger_feed(struct sr_soft_trigger *st,
+					const struct sr_datafeed_logic *logic, uint64_t *pos);
+SR_PRIV void sr_soft_trigger_free(struct sr_soft_trigger *st);
+
 /*--- hardware/common/serial.c ----------------------------------------------*/
 
 enum {
@@ -395,6 +450,10 @@ SR_PRIV int sr_session_run(void);
 SR_PRIV int sr_session_stop(void); 
 SR_PRIV struct sr_session *sr_session_new(void);
 SR_PRIV int sr_session_destroy(void);
+SR_PRIV struct sr_session *sr_session_create(struct sr_dev_inst *sdi);
+SR_PRIV void sr_session_free(struct sr_session *session);
+SR_PRIV void sr_session_bind(struct sr_session *session);
+SR_PRIV int sr_session_abort(struct sr_session *session);
 
 /**
  * Create a virtual deivce from file.
@@ -416,6 +475,12 @@ SR_PRIV void ds_set_last_error(int error);
 SR_PRIV int ds_data_forward(const struct sr_dev_inst *sdi,
 						const struct sr_datafeed_packet *packet);
 
+/**
+ * Ask the receiver for the place of a packet, NULL for none.
+ */
+SR_PRIV void* ds_data_lend(const struct sr_dev_inst *sdi, int type,
+						uint64_t size, uint64_t ahead);
+
 SR_PRIV int current_device_acquisition_stop();
 
 SR_PRIV int lib_extern_init(struct sr_context *ctx);
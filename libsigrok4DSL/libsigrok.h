@@ -1043,6 +1043,9 @@ enum sr_config_option_id
 
     SR_CONF_DEMO_CHANGE = 30107,
 
+    /** The most transfer buffers queued in the ingest ring of the last capture. */
+    SR_CONF_INGEST_HWM = 30108,
+
 	/*--- Acquisition modes ---------------------------------------------*/
 
 	/**
@@ -1170,6 +1173,9 @@ enum {
     DSO_TRIGGER_FALLING = 1,
 };
 
+/* A trigger found by the host, ram_saddr has the high 32 bits of the position */
+#define DS_SOFT_TRIGGER_CHECK_ID 0x5354524B
+
 struct ds_trigger_pos {
     uint32_t check_id;
     uint32_t real_pos;
@@ -1318,6 +1324,14 @@ enum DS_DEVICE_EVENT_TYPE
 };
 
 
+/* The roles of the acquisition threads, see ds_set_thread_sched() */
+enum DS_THREAD_ROLE
+{
+	DS_THREAD_ACQUISITION = 0, /* the collect and the usb event threads */
+	DS_THREAD_INGEST = 1,      /* the thread that forwards the usb data */
+	DS_THREAD_ROLE_COUNT,
+};
+
 typedef unsigned long long ds_device_handle;
 
 #define NULL_HANDLE		0
@@ -1368,6 +1382,14 @@ typedef void (*dslib_event_callback_t)(int event);
 typedef void (*ds_datafeed_callback_t)(const struct sr_dev_inst *sdi,
 						const struct sr_datafeed_packet *packet);
 
+/**
+ * Lends a buffer of the receiver to the device, the data of a packet type is
+ * received in place. The packet follows ahead bytes of packets in flight.
+ * Returns NULL to have the device use its own buffer.
+ */
+typedef void* (*ds_datafeed_lend_callback_t)(const struct sr_dev_inst *sdi,
+						int type, uint64_t size, uint64_t ahead);
+
 /**
  * Must call first
  */
@@ -1388,6 +1410,27 @@ SR_API void ds_set_event_callback(dslib_event_callback_t cb);
  */
 SR_API void ds_set_datafeed_callback(ds_datafeed_callback_t cb);
 
+/**
+ * Set the callback that lends receive buffers, a packet received in a lent
+ * buffer points into it and needs no copy.
+ */
+SR_API void ds_set_datafeed_lend_callback(ds_datafeed_lend_callback_t cb);
+
+/**
+ * Record the logic captures to a trace file, the demo device replays it.
+ * NULL stops the recording.
+ */
+SR_API int ds_set_trace_record_file(const char *path);
+
+/**
+ * Set the scheduling of the threads of @role, a thread applies it when
+ * it starts. @priority is a real-time priority of 1 to 99, SCHED_FIFO
+ * where permitted, 0 keeps the default policy. @cpu pins the thread,
+ * -1 runs it on any cpu. Call it before ds_lib_init() for the usb
+ * event thread.
+ */
+SR_API int ds_set_thread_sched(int role, int priority, int cpu);
+
 /**
  * Set the firmware binary file directory,
  * User must call it to set the firmware resource directory
@@ -1474,6 +1517,39 @@ SR_API int ds_is_collecting();
  */
 SR_API int ds_release_actived_device();
 
+/**
+ * Add a device to capture along with the actived device.
+ * Each sync device runs its own session and collect thread, its data is
+ * forwarded with its own sdi. ds_start_collect() and ds_stop_collect()
+ * start and stop them all, the collect ends with the last device.
+ */
+SR_API int ds_add_sync_device(ds_device_handle handle);
+
+/**
+ * Remove a sync device, and close it.
+ */
+SR_API int ds_remove_sync_device(ds_device_handle handle);
+
+SR_API int ds_is_sync_device(ds_device_handle handle);
+
+/**
+ * Get the index of the sync device that forwards the data of @sdi,
+ * -1 is the actived device.
+ */
+SR_API int ds_get_sync_device_index(const struct sr_dev_inst *sdi);
+
+/**
+ * Get the sync device list, in the order of ds_get_sync_device_index().
+ * User need call free() to release the buffer.
+ */
+SR_API int ds_get_sync_device_list(struct ds_device_base_info **out_list, int *out_count);
+
+SR_API int ds_get_sync_device_config(ds_device_handle handle, int key, GVariant **data);
+
+SR_API int ds_set_sync_device_config(ds_device_handle handle, int key, GVariant *data);
+
+SR_API GSList *ds_get_sync_device_channels(ds_device_handle handle);
+
 SR_API int ds_get_last_error();
 
 /*---config -----------------------------------------------*/
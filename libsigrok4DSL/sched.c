@@ -0,0 +1,184 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "libsigrok-internal.h"
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <glib.h>
+#include "log.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#undef LOG_PREFIX
+#define LOG_PREFIX "sched: "
+
+/**
+ * @file
+ *
+ * The scheduling of the acquisition threads.
+ *
+ * A thread applies the setting of its role when it starts: a real-time
+ * priority and a cpu to run on. A setting the system does not permit is
+ * logged and the thread runs with the default scheduling.
+ */
+
+struct thread_sched {
+	int priority;	/* 0 keeps the default policy */
+	int cpu;		/* -1 runs on any cpu */
+};
+
+static struct thread_sched sched_table[DS_THREAD_ROLE_COUNT] = {
+	{0, -1},
+	{0, -1},
+};
+
+static GMutex sched_mutex;
+
+SR_API int ds_set_thread_sched(int role, int priority, int cpu)
+{
+	if (role < 0 || role >= DS_THREAD_ROLE_COUNT) {
+		sr_err("%s: invalid thread role %d.", __func__, role);
+		return SR_ERR_ARG;
+	}
+	if (priority < 0 || priority > 99 || cpu < -1) {
+		sr_err("%s: invalid priority %d or cpu %d.", __func__, priority, cpu);
+		return SR_ERR_ARG;
+	}
+
+	g_mutex_lock(&sched_mutex);
+	sched_table[role].priority = priority;
+	sched_table[role].cpu = cpu;
+	g_mutex_unlock(&sched_mutex);
+
+	return SR_OK;
+}
+
+#ifdef _WIN32
+
+SR_PRIV void sr_thread_sched_apply(int role, const char *name)
+{
+	struct thread_sched s;
+	HANDLE h;
+
+	assert(role >= 0 && role < DS_THREAD_ROLE_COUNT);
+
+	g_mutex_lock(&sched_mutex);
+	s = sched_table[role];
+	g_mutex_unlock(&sched_mutex);
+
+	h = GetCurrentThread();
+
+	if (s.priority > 0 && !SetThreadPriority(h, THREAD_PRIORITY_TIME_CRITICAL))
+		sr_info("%s thread: failed to raise the priority, error:%lu",
+			name, (unsigned long)GetLastError());
+
+	if (s.cpu >= 0) {
+		if (s.cpu >= (int)(sizeof(DWORD_PTR) * 8) ||
+			SetThreadAffinityMask(h, (DWORD_PTR)1 << s.cpu) == 0) {
+			sr_info("%s thread: can not run on cpu %d, run on any cpu.", name, s.cpu);
+			s.cpu = -1;
+		}
+	}
+
+	sr_info("%s thread: priority:%d, cpu:%d", name, GetThreadPriority(h), s.cpu);
+}
+
+#else
+
+static const char* policy_name(int policy)
+{
+	switch (policy) {
+	case SCHED_FIFO:
+		return "SCHED_FIFO";
+	case SCHED_RR:
+		return "SCHED_RR";
+	case SCHED_OTHER:
+		return "SCHED_OTHER";
+	}
+	return "unknown";
+}
+
+SR_PRIV void sr_thread_sched_apply(int role, const char *name)
+{
+	struct thread_sched s;
+	struct sched_param param;
+	int policy;
+	int ret;
+
+	assert(role >= 0 && role < DS_THREAD_ROLE_COUNT);
+
+	g_mutex_lock(&sched_mutex);
+	s = sched_table[role];
+	g_mutex_unlock(&sched_mutex);
+
+	if (s.priority > 0) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = s.priority;
+		if (param.sched_priority < sched_get_priority_min(SCHED_FIFO))
+			param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+		if (param.sched_priority > sched_get_priority_max(SCHED_FIFO))
+			param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+
+		// Without the permission it keeps the default policy
+		ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if (ret != 0)
+			sr_info("%s thread: SCHED_FIFO is not permitted, %s", name, strerror(ret));
+	}
+
+	if (s.cpu >= 0) {
+#ifdef __linux__
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		ret = EINVAL;
+		if (s.cpu < CPU_SETSIZE) {
+			CPU_SET(s.cpu, &set);
+			ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		}
+		if (ret != 0) {
+			sr_info("%s thread: can not run on cpu %d, run on any cpu.", name, s.cpu);
+			s.cpu = -1;
+		}
+#else
+		sr_info("%s thread: cpu pinning is not supported, run on any cpu.", name);
+		s.cpu = -1;
+#endif
+	}
+
+	if (pthread_getschedparam(pthread_self(), &policy, &param) != 0) {
+		policy = -1;
+		param.sched_priority = 0;
+	}
+
+	sr_info("%s thread: policy:%s, priority:%d, cpu:%d",
+		name, policy_name(policy), param.sched_priority, s.cpu);
+}
+
+#endif
@@ -31,9 +31,11 @@
 #undef LOG_PREFIX
 #define LOG_PREFIX "session: "
 
-/* There can only be one session at a time. */
-/* 'session' is not static, it's used elsewhere (via 'extern'). */
-static struct sr_session *session = NULL;
+/* The session of the actived device. */
+static struct sr_session *main_session = NULL;
+
+/* The session a collect thread adds its sources to, see sr_session_bind(). */
+static GPrivate thread_session;
  
 /**
  * @file
@@ -60,20 +62,9 @@ struct source {
 	gintptr poll_object;
 };
 
-/**
- * Create a new session.
- *
- * @todo Should it use the file-global "session" variable or take an argument?
- *       The same question applies to all the other session functions.
- *
- * @return A pointer to the newly allocated session, or NULL upon errors.
- */
-SR_PRIV struct sr_session *sr_session_new(void)
+static struct sr_session *session_alloc(struct sr_dev_inst *sdi)
 {
-	if (session != NULL){
-		sr_detail("Destroy the old session.");
-		sr_session_destroy(); // Destory the old.
-	}
+	struct sr_session *session;
 
 	session = malloc(sizeof(struct sr_session));
 	if (session == NULL) {
@@ -82,6 +73,7 @@ SR_PRIV struct sr_session *sr_session_new(void)
 	}
 	memset(session, 0, sizeof(struct sr_session));
 
+	session->sdi = sdi;
 	session->source_timeout = -1;
     session->running = FALSE;
 	session->abort_session = FALSE;
@@ -90,20 +82,8 @@ SR_PRIV struct sr_session *sr_session_new(void)
 	return session;
 }
 
-/**
- * Destroy the current session.
- *
- * This frees up all memory used by the session.
- *
- * @return SR_OK upon success, SR_ERR_BUG if no session exists.
- */
-SR_PRIV int sr_session_destroy(void)
+static void session_free(struct sr_session *session)
 {
-	if (session == NULL) {
-		//sr_detail("%s: session was NULL", __func__);
-		return SR_ERR_BUG;
-	} 
-
     if (session->sources) {
         g_free(session->sources);
         session->sources = NULL;
@@ -119,11 +99,110 @@ SR_PRIV int sr_session_destroy(void)
     g_mutex_clear(&session->stop_mutex);
 
 	g_free(session);
-	session = NULL;
+}
+
+static struct sr_session *cur_session(void)
+{
+	struct sr_session *session;
+
+	session = g_private_get(&thread_session);
+	if (session == NULL)
+		session = main_session;
+
+	return session;
+}
+
+static void session_acquisition_stop(struct sr_session *session)
+{
+	struct sr_dev_inst *sdi;
+
+	sdi = session->sdi;
+
+	if (sdi == NULL)
+		current_device_acquisition_stop();
+	else if (sdi->driver && sdi->driver->dev_acquisition_stop)
+		sdi->driver->dev_acquisition_stop(sdi, (void *)sdi);
+}
+
+/**
+ * Create a new session, the session of the actived device.
+ *
+ * A sync device has a session of its own, see sr_session_create(). The
+ * other session functions work on the session of the calling thread.
+ *
+ * @return A pointer to the newly allocated session, or NULL upon errors.
+ */
+SR_PRIV struct sr_session *sr_session_new(void)
+{
+	if (main_session != NULL){
+		sr_detail("Destroy the old session.");
+		sr_session_destroy(); // Destory the old.
+	}
+
+	main_session = session_alloc(NULL);
+
+	return main_session;
+}
+
+/**
+ * Destroy the session of the actived device.
+ *
+ * This frees up all memory used by the session.
+ *
+ * @return SR_OK upon success, SR_ERR_BUG if no session exists.
+ */
+SR_PRIV int sr_session_destroy(void)
+{
+	if (main_session == NULL) {
+		//sr_detail("%s: session was NULL", __func__);
+		return SR_ERR_BUG;
+	} 
+
+	session_free(main_session);
+	main_session = NULL;
 
 	return SR_OK;
 }
 
+/**
+ * Create the session of a sync device. It runs on its own collect thread,
+ * which calls sr_session_bind() before the acquisition starts.
+ */
+SR_PRIV struct sr_session *sr_session_create(struct sr_dev_inst *sdi)
+{
+	assert(sdi);
+	return session_alloc(sdi);
+}
+
+SR_PRIV void sr_session_free(struct sr_session *session)
+{
+	if (session != NULL)
+		session_free(session);
+}
+
+/**
+ * The sources added by the calling thread go to @session,
+ * NULL goes back to the session of the actived device.
+ */
+SR_PRIV void sr_session_bind(struct sr_session *session)
+{
+	g_private_set(&thread_session, session);
+}
+
+/**
+ * Stop a sync session. Unlike sr_session_stop(), it is kept when the
+ * session is not running yet, so the run that follows ends at once.
+ */
+SR_PRIV int sr_session_abort(struct sr_session *session)
+{
+	assert(session);
+
+    g_mutex_lock(&session->stop_mutex);
+    session->abort_session = TRUE;
+    g_mutex_unlock(&session->stop_mutex);
+
+	return SR_OK;
+}
 
 /**
  * Call every device in the session's callback.
@@ -145,6 +224,9 @@ static int sr_session_iteration(gboolean block)
 {
 	unsigned int i;
 	int ret;
+	struct sr_session *session;
+
+	session = cur_session();
 
 	if (session == NULL){
 		sr_err("sr_session_iteration(), session is null.");
@@ -175,7 +257,7 @@ static int sr_session_iteration(gboolean block)
         g_mutex_lock(&session->stop_mutex);
 		if (session->abort_session) {
 			sr_info("Collection task aborted.");
-			current_device_acquisition_stop();
+			session_acquisition_stop(session);
 			/* But once is enough. */
 			session->abort_session = FALSE;
 		}
@@ -192,6 +274,10 @@ static int sr_session_iteration(gboolean block)
  */
 SR_PRIV int sr_session_run(void)
 {
+	struct sr_session *session;
+
+	session = cur_session();
+
 	if (session == NULL) {
 		sr_err("%s: session was NULL; a session must be "
 		       "created first, before running it.", __func__);
@@ -225,7 +311,7 @@ SR_PRIV int sr_session_run(void)
 	}
 
     g_mutex_lock(&session->stop_mutex);
-    current_device_acquisition_stop();
+    session_acquisition_stop(session);
     session->abort_session = FALSE;
     session->running = FALSE;
     g_mutex_unlock(&session->stop_mutex);
@@ -247,15 +333,15 @@ SR_PRIV int sr_session_run(void)
  */
 SR_PRIV int sr_session_stop(void)
 {
-	if (!session) {
+	if (!main_session) {
 		sr_err("%s: session was NULL", __func__);
 		return SR_ERR_BUG;
 	}
 
-    g_mutex_lock(&session->stop_mutex);
-    if (session->running)
-        session->abort_session = TRUE;  
-    g_mutex_unlock(&session->stop_mutex);
+    g_mutex_lock(&main_session->stop_mutex);
+    if (main_session->running)
+        main_session->abort_session = TRUE;  
+    g_mutex_unlock(&main_session->stop_mutex);
 
 	return SR_OK;
 }
@@ -339,6 +425,9 @@ static int _sr_session_source_add(GPollFD *pollfd, int timeout,
 {
 	struct source *new_sources, *s;
 	GPollFD *new_pollfds;
+	struct sr_session *session;
+
+	session = cur_session();
 
 	if (!cb) {
 		sr_err("%s: cb was NULL", __func__);
@@ -465,6 +554,9 @@ static int _sr_session_source_remove(gintptr poll_object)
 	struct source *new_sources;
 	GPollFD *new_pollfds;
 	unsigned int old;
+	struct sr_session *session;
+
+	session = cur_session();
 
 	if (session == NULL){
 		sr_err("_sr_session_source_remove(), session is null.");
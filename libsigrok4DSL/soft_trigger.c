@@ -0,0 +1,423 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "libsigrok-internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <glib.h>
+#include "log.h"
+
+#undef LOG_PREFIX
+#define LOG_PREFIX "soft_trigger: "
+
+/**
+ * @file
+ *
+ * Evaluate the trigger on the host.
+ *
+ * The stream captures and the demo device have no hardware trigger, the
+ * logic packets are matched against struct ds_trigger as they come. A
+ * group of LA_CROSS_DATA holds 64 samples of each channel in one word,
+ * so a condition is matched on 64 samples with a few bit operations:
+ * bit i of a word is sample i, the sample before it is bit i of
+ * (word << 1) with the last sample of the previous word shifted in.
+ *
+ * The simple trigger and the stages of the advanced trigger are
+ * supported. A stage matches expression 0 and expression 1 with Or or
+ * And, each one can be inverted, and it completes after the count of
+ * matching samples, or of contiguous matching samples. The next stage
+ * starts with the sample after it.
+ *
+ * The trigger only marks a position: all the samples are forwarded, the
+ * ones before the trigger are not cut to the pre-trigger depth. The
+ * SR_DF_TRIGGER packet of the driver is dropped while it is active.
+ */
+
+/* The channel is not in the data, it reads as 0 */
+#define NO_ORDER 0xFFFF
+
+struct soft_trigger_op {
+	uint16_t order;	/* the word of the channel in a group */
+	char cond;		/* '0', '1', 'R', 'F' or 'C' */
+};
+
+struct soft_trigger_expr {
+	struct soft_trigger_op ops[MaxTriggerProbes];
+	int op_num;
+	int inv;
+};
+
+struct soft_trigger_stage {
+	struct soft_trigger_expr expr[2];
+	int expr_num;
+	int logic_and;
+	int contiguous;
+	uint32_t count;
+};
+
+struct sr_soft_trigger {
+	struct soft_trigger_stage stages[TriggerStages + 1];
+	int stage_num;
+	int cur_stage;
+	uint32_t matched;	/* samples of the current stage, or of the current run */
+	uint16_t channel_num;
+	uint64_t *carry;	/* the last sample of each channel, in bit 0 */
+	int has_carry;
+	uint64_t *group;	/* a group split by the packets */
+	uint64_t group_bytes;
+	uint64_t group_fill;
+	uint64_t sample_count;	/* samples before the next group */
+	int fired;
+};
+
+static int channel_order(const uint16_t *ch_index, int ch_num, int index)
+{
+	int i;
+
+	for (i = 0; i < ch_num; i++) {
+		if (ch_index[i] == index)
+			return i;
+	}
+	return NO_ORDER;
+}
+
+static void make_expr(struct soft_trigger_expr *expr, const char *conds,
+					const uint16_t *ch_index, int ch_num)
+{
+	int i;
+	char c;
+
+	expr->op_num = 0;
+
+	for (i = 0; i < MaxTriggerProbes; i++) {
+		c = conds[i];
+		if (c != '0' && c != '1' && c != 'R' && c != 'F' && c != 'C')
+			continue;
+
+		expr->ops[expr->op_num].order = channel_order(ch_index, ch_num, i);
+		expr->ops[expr->op_num].cond = c;
+		expr->op_num++;
+
+		if (expr->ops[expr->op_num - 1].order == NO_ORDER)
+			sr_info("The channel %d of the trigger is disabled, it reads as 0.", i);
+	}
+}
+
+SR_PRIV struct sr_soft_trigger* sr_soft_trigger_new(const struct ds_trigger *trig,
+					const uint16_t *ch_index, int ch_num)
+{
+	struct sr_soft_trigger *st;
+	struct soft_trigger_stage *stage;
+	int i;
+	int op_num;
+
+	assert(trig);
+	assert(ch_index);
+
+	if (!trig->trigger_en || ch_num <= 0)
+		return NULL;
+
+	if (trig->trigger_mode == SERIAL_TRIGGER) {
+		sr_info("The serial trigger is not evaluated on the host.");
+		return NULL;
+	}
+
+	if (!(st = g_try_malloc0(sizeof(struct sr_soft_trigger)))) {
+		sr_err("%s,ERROR:failed to alloc memory.", __func__);
+		return NULL;
+	}
+
+	op_num = 0;
+
+	if (trig->trigger_mode == SIMPLE_TRIGGER) {
+		stage = &st->stages[0];
+		make_expr(&stage->expr[0], trig->trigger0[TriggerStages], ch_index, ch_num);
+		stage->expr_num = 1;
+		stage->logic_and = 1;
+		stage->count = 1;
+		st->stage_num = 1;
+		op_num = stage->expr[0].op_num;
+	}
+	else {
+		st->stage_num = trig->trigger_stages + 1;
+
+		for (i = 0; i < st->stage_num; i++) {
+			stage = &st->stages[i];
+			make_expr(&stage->expr[0], trig->trigger0[i], ch_index, ch_num);
+			make_expr(&stage->expr[1], trig->trigger1[i], ch_index, ch_num);
+			stage->expr[0].inv = trig->trigger0_inv[i];
+			stage->expr[1].inv = trig->trigger1_inv[i];
+			stage->expr_num = 2;
+			stage->logic_and = trig->trigger_logic[i] & 1;
+			stage->contiguous = (trig->trigger_logic[i] >> 1) & 1;
+			stage->count = trig->trigger0_count[i] > 0 ? trig->trigger0_count[i] : 1;
+			op_num += stage->expr[0].op_num + stage->expr[1].op_num;
+
+			// An expression of all X has no part in the stage
+			if (stage->expr[0].op_num == 0 && stage->expr[1].op_num > 0)
+				stage->expr[0] = stage->expr[1];
+			if (stage->expr[0].op_num == 0 || stage->expr[1].op_num == 0)
+				stage->expr_num = 1;
+		}
+	}
+
+	// Nothing to wait for, the capture is not triggered
+	if (op_num == 0) {
+		g_free(st);
+		return NULL;
+	}
+
+	st->channel_num = ch_num;
+	st->group_bytes = ch_num * sizeof(uint64_t);
+	st->carry = g_try_malloc0(ch_num * sizeof(uint64_t));
+	st->group = g_try_malloc0(st->group_bytes);
+
+	if (st->carry == NULL || st->group == NULL) {
+		sr_err("%s,ERROR:failed to alloc memory.", __func__);
+		sr_soft_trigger_free(st);
+		return NULL;
+	}
+
+	sr_info("Software trigger, stages:%d, channels:%d", st->stage_num, ch_num);
+
+	return st;
+}
+
+SR_PRIV void sr_soft_trigger_free(struct sr_soft_trigger *st)
+{
+	if (st == NULL)
+		return;
+
+	g_free(st->carry);
+	g_free(st->group);
+	g_free(st);
+}
+
+static inline uint64_t expr_match(const struct soft_trigger_expr *expr,
+					const uint64_t *words, const uint64_t *carry)
+{
+	uint64_t m = ~0ULL;
+	uint64_t w, p;
+	int i;
+
+	for (i = 0; i < expr->op_num; i++) {
+		const struct soft_trigger_op *op = &expr->ops[i];
+
+		if (op->order == NO_ORDER) {
+			w = 0;
+			p = 0;
+		}
+		else {
+			w = words[op->order];
+			p = (w << 1) | carry[op->order];
+		}
+
+		switch (op->cond) {
+		case '1':
+			m &= w;
+			break;
+		case '0':
+			m &= ~w;
+			break;
+		case 'R':
+			m &= w & ~p;
+			break;
+		case 'F':
+			m &= ~w & p;
+			break;
+		case 'C':
+			m &= w ^ p;
+			break;
+		}
+	}
+
+	return expr->inv ? ~m : m;
+}
+
+static inline uint64_t stage_match(const struct soft_trigger_stage *stage,
+					const uint64_t *words, const uint64_t *carry)
+{
+	uint64_t m = expr_match(&stage->expr[0], words, carry);
+
+	if (stage->expr_num > 1) {
+		if (stage->logic_and)
+			m &= expr_match(&stage->expr[1], words, carry);
+		else
+			m |= expr_match(&stage->expr[1], words, carry);
+	}
+	return m;
+}
+
+/*
+ * Go on with the current stage from bit @start of the matches @m.
+ * Returns the bit that completes the stage, or 64.
+ */
+static int stage_advance(struct sr_soft_trigger *st, const struct soft_trigger_stage *stage,
+					uint64_t m, int start)
+{
+	uint64_t rest, zeros;
+	uint32_t need;
+	int n, end;
+
+	if (!stage->contiguous) {
+		rest = m & (~0ULL << start);
+		n = __builtin_popcountll(rest);
+		need = stage->count - st->matched;
+
+		if ((uint32_t)n < need) {
+			st->matched += n;
+			return 64;
+		}
+
+		while (--need > 0)
+			rest &= rest - 1;
+		return __builtin_ctzll(rest);
+	}
+
+	while (start < 64) {
+		rest = m & (~0ULL << start);
+
+		if (!(rest & (1ULL << start))) {
+			st->matched = 0;
+			if (rest == 0)
+				return 64;
+			start = __builtin_ctzll(rest);
+			continue;
+		}
+
+		zeros = ~m & (~0ULL << start);
+		end = zeros ? __builtin_ctzll(zeros) : 64;
+
+		if (st->matched + (uint32_t)(end - start) >= stage->count)
+			return start + (int)(stage->count - st->matched) - 1;
+
+		st->matched += end - start;
+		start = end;
+	}
+	return 64;
+}
+
+/* Match a group, returns the trigger bit or 64 */
+static int match_group(struct sr_soft_trigger *st, const uint64_t *words)
+{
+	const struct soft_trigger_stage *stage;
+	uint64_t m;
+	int start = 0;
+	int bit = 64;
+	int i;
+
+	if (!st->has_carry) {
+		for (i = 0; i < st->channel_num; i++)
+			st->carry[i] = words[i] & 1;
+		st->has_carry = 1;
+	}
+
+	while (st->cur_stage < st->stage_num && start < 64) {
+		stage = &st->stages[st->cur_stage];
+		m = stage_match(stage, words, st->carry);
+
+		// The most used case, one match of one stage
+		if (stage->count == 1) {
+			m &= ~0ULL << start;
+			bit = m ? __builtin_ctzll(m) : 64;
+		}
+		else {
+			bit = stage_advance(st, stage, m, start);
+		}
+
+		if (bit == 64)
+			break;
+
+		st->cur_stage++;
+		st->matched = 0;
+		start = bit + 1;
+	}
+
+	for (i = 0; i < st->channel_num; i++)
+		st->carry[i] = words[i] >> 63;
+
+	return st->cur_stage == st->stage_num ? bit : 64;
+}
+
+SR_PRIV int sr_soft_trigger_feed(struct sr_soft_trigger *st,
+					const struct sr_datafeed_logic *logic, uint64_t *pos)
+{
+	const uint8_t *data;
+	uint64_t len, n;
+	int bit;
+
+	assert(st);
+	assert(logic);
+	assert(pos);
+
+	if (st->fired || logic->format != LA_CROSS_DATA || logic->data == NULL)
+		return 0;
+
+	data = logic->data;
+	len = logic->length;
+
+	// Complete the group the last packet left
+	if (st->group_fill > 0) {
+		n = MIN(st->group_bytes - st->group_fill, len);
+		memcpy((uint8_t *)st->group + st->group_fill, data, n);
+		st->group_fill += n;
+		data += n;
+		len -= n;
+
+		if (st->group_fill < st->group_bytes)
+			return 0;
+
+		st->group_fill = 0;
+		bit = match_group(st, st->group);
+		if (bit < 64)
+			goto FIRED;
+		st->sample_count += 64;
+	}
+
+	while (len >= st->group_bytes) {
+		// A packet is not aligned to the words
+		if (((uintptr_t)data & 7) != 0) {
+			memcpy(st->group, data, st->group_bytes);
+			bit = match_group(st, st->group);
+		}
+		else {
+			bit = match_group(st, (const uint64_t *)data);
+		}
+		if (bit < 64)
+			goto FIRED;
+
+		st->sample_count += 64;
+		data += st->group_bytes;
+		len -= st->group_bytes;
+	}
+
+	if (len > 0) {
+		memcpy(st->group, data, len);
+		st->group_fill = len;
+	}
+	return 0;
+
+FIRED:
+	st->fired = 1;
+	*pos = st->sample_count + bit;
+	sr_info("Software trigger at sample %llu", (u64_t)*pos);
+	return 1;
+}
@@ -0,0 +1,245 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "libsigrok-internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "log.h"
+
+#undef LOG_PREFIX
+#define LOG_PREFIX "trace: "
+
+/**
+ * @file
+ *
+ * Record and read capture traces.
+ *
+ * A trace keeps the datafeed packets of a logic capture as the device
+ * sent them: the size of every packet, the time it came, the trigger
+ * position and the end status. The demo device replays it.
+ *
+ * Layout: a struct sr_trace_header, then for every packet a struct
+ * sr_trace_record and its payload. The payload is the data of a logic
+ * packet or a struct ds_trigger_pos.
+ */
+
+struct sr_trace {
+	FILE *fp;
+	GMutex mutex;
+	int64_t start_time;
+};
+
+static int64_t trace_now(void)
+{
+	return g_get_monotonic_time();
+}
+
+static uint64_t get_config_u64(const struct sr_dev_inst *sdi, int key)
+{
+	GVariant *data = NULL;
+	uint64_t v = 0;
+
+	if (sr_config_get(sdi->driver, sdi, NULL, NULL, key, &data) == SR_OK && data != NULL) {
+		v = g_variant_get_uint64(data);
+		g_variant_unref(data);
+	}
+	return v;
+}
+
+SR_PRIV struct sr_trace* sr_trace_create(const char *path, const struct sr_dev_inst *sdi)
+{
+	struct sr_trace *trace;
+	struct sr_trace_header header;
+	struct sr_channel *probe;
+	GSList *l;
+
+	assert(path);
+	assert(sdi);
+
+	if (sdi->mode != LOGIC) {
+		sr_info("Only logic captures are recorded.");
+		return NULL;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SR_TRACE_MAGIC, sizeof(header.magic));
+	header.version = SR_TRACE_VERSION;
+	header.mode = sdi->mode;
+	header.samplerate = get_config_u64(sdi, SR_CONF_SAMPLERATE);
+	header.limit_samples = get_config_u64(sdi, SR_CONF_LIMIT_SAMPLES);
+
+	for (l = sdi->channels; l; l = l->next) {
+		probe = (struct sr_channel *)l->data;
+		if (probe->type == SR_CHANNEL_LOGIC && probe->enabled)
+			header.num_probes++;
+	}
+
+	if (!(trace = g_try_malloc0(sizeof(struct sr_trace)))) {
+		sr_err("%s,ERROR:failed to alloc memory.", __func__);
+		return NULL;
+	}
+
+	if (!(trace->fp = g_fopen(path, "wb"))) {
+		sr_err("Failed to create the trace file: %s", path);
+		g_free(trace);
+		return NULL;
+	}
+
+	if (fwrite(&header, sizeof(header), 1, trace->fp) != 1) {
+		sr_err("Failed to write the trace file: %s", path);
+		fclose(trace->fp);
+		g_free(trace);
+		return NULL;
+	}
+
+	g_mutex_init(&trace->mutex);
+	trace->start_time = trace_now();
+
+	sr_info("Record the capture trace to %s, probes:%u, samplerate:%llu",
+			path, header.num_probes, (u64_t)header.samplerate);
+
+	return trace;
+}
+
+SR_PRIV int sr_trace_write(struct sr_trace *trace, const struct sr_datafeed_packet *packet)
+{
+	struct sr_trace_record record;
+	const struct sr_datafeed_logic *logic;
+	const void *payload = NULL;
+	int ret = SR_OK;
+
+	assert(trace);
+	assert(packet);
+
+	memset(&record, 0, sizeof(record));
+	record.type = packet->type;
+	record.status = packet->status;
+
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		record.format = logic->format;
+		record.length = logic->length;
+		payload = logic->data;
+		break;
+	case SR_DF_TRIGGER:
+		record.length = sizeof(struct ds_trigger_pos);
+		payload = packet->payload;
+		break;
+	case SR_DF_END:
+	case SR_DF_OVERFLOW:
+		break;
+	default:
+		return SR_OK;
+	}
+
+	if (payload == NULL)
+		record.length = 0;
+
+	g_mutex_lock(&trace->mutex);
+
+	record.time = trace_now() - trace->start_time;
+
+	if (fwrite(&record, sizeof(record), 1, trace->fp) != 1 ||
+		(record.length > 0 && fwrite(payload, record.length, 1, trace->fp) != 1)) {
+		sr_err("%s: failed to write the trace file.", __func__);
+		ret = SR_ERR;
+	}
+
+	g_mutex_unlock(&trace->mutex);
+
+	return ret;
+}
+
+SR_PRIV struct sr_trace* sr_trace_open(const char *path, struct sr_trace_header *header)
+{
+	struct sr_trace *trace;
+
+	assert(path);
+	assert(header);
+
+	if (!(trace = g_try_malloc0(sizeof(struct sr_trace)))) {
+		sr_err("%s,ERROR:failed to alloc memory.", __func__);
+		return NULL;
+	}
+
+	if (!(trace->fp = g_fopen(path, "rb"))) {
+		sr_err("Failed to open the trace file: %s", path);
+		g_free(trace);
+		return NULL;
+	}
+
+	if (fread(header, sizeof(*header), 1, trace->fp) != 1 ||
+		memcmp(header->magic, SR_TRACE_MAGIC, sizeof(header->magic)) != 0 ||
+		header->version != SR_TRACE_VERSION) {
+		sr_err("Not a trace file: %s", path);
+		fclose(trace->fp);
+		g_free(trace);
+		return NULL;
+	}
+
+	g_mutex_init(&trace->mutex);
+
+	return trace;
+}
+
+SR_PRIV int sr_trace_read(struct sr_trace *trace, struct sr_trace_record *record,
+						void **buf, uint64_t *buf_size)
+{
+	void *p;
+
+	assert(trace);
+	assert(record);
+	assert(buf);
+	assert(buf_size);
+
+	if (fread(record, sizeof(*record), 1, trace->fp) != 1)
+		return SR_ERR;
+
+	if (record->length > *buf_size) {
+		if (!(p = g_try_realloc(*buf, record->length))) {
+			sr_err("%s,ERROR:failed to alloc memory.", __func__);
+			return SR_ERR_MALLOC;
+		}
+		*buf = p;
+		*buf_size = record->length;
+	}
+
+	if (record->length > 0 && fread(*buf, record->length, 1, trace->fp) != 1) {
+		sr_err("%s: the trace file is truncated.", __func__);
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+SR_PRIV void sr_trace_close(struct sr_trace *trace)
+{
+	if (trace == NULL)
+		return;
+
+	fclose(trace->fp);
+	g_mutex_clear(&trace->mutex);
+	g_free(trace);
+}
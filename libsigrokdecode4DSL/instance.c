@@ -26,12 +26,14 @@
 #include <inttypes.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <assert.h>
 #include "log.h"
 
 /** @cond PRIVATE */
 
 extern SRD_PRIV GSList *sessions;
+extern SRD_PRIV GMutex sessions_mutex;
 
 /** @endcond */
 
@@ -449,7 +451,9 @@ SRD_API struct srd_decoder_inst *srd_inst_new(struct srd_session *sess,
 	g_mutex_init(&di->data_mutex);
 
 	/* Instance takes input from a frontend by default. */
+	g_mutex_lock(&sessions_mutex);
 	sess->di_list = g_slist_append(sess->di_list, di);
+	g_mutex_unlock(&sessions_mutex);
 	srd_dbg("Creating new %s instance %s.", decoder_id, di->inst_id);
 
 	return di;
@@ -499,6 +503,23 @@ static void srd_inst_join_decode_thread(struct srd_decoder_inst *di)
 	g_mutex_init(&di->data_mutex);
 }
 
+/*
+ * Make decode() return at its next wait(), without joining the thread.
+ * A pending srd_inst_decode() returns as well.
+ */
+SRD_PRIV void srd_inst_request_stop(struct srd_decoder_inst *di)
+{
+	if (!di)
+		return;
+
+	g_mutex_lock(&di->data_mutex);
+	di->want_wait_terminate = TRUE;
+	di->is_task_stop_signal = TRUE;
+	g_cond_signal(&di->got_new_samples_cond);
+	g_cond_signal(&di->handled_all_samples_cond);
+	g_mutex_unlock(&di->data_mutex);
+}
+
 static void srd_inst_reset_state(struct srd_decoder_inst *di)
 {
 	if (!di)
@@ -513,6 +534,7 @@ static void srd_inst_reset_state(struct srd_decoder_inst *di)
 	di->inbuf = NULL;
 	di->inbuflen = 0;
 	di->abs_cur_samplenum = 0;
+	di->idle_end_samplenum = 0;
 	oldpins_array_free(di);
 	di->got_new_samples = FALSE;
 	di->handled_all_samples = FALSE;
@@ -547,7 +569,9 @@ SRD_API int srd_inst_stack(struct srd_session *sess,
 
 	if (g_slist_find(sess->di_list, di_top)) {
 		/* Remove from the unstacked list. */
+		g_mutex_lock(&sessions_mutex);
 		sess->di_list = g_slist_remove(sess->di_list, di_top);
+		g_mutex_unlock(&sessions_mutex);
 	}
 
 	/*
@@ -572,7 +596,9 @@ SRD_API int srd_inst_stack(struct srd_session *sess,
 			di_top->inst_id, di_bottom->inst_id);
 
 	/* Stack on top of source di. */
+	g_mutex_lock(&sessions_mutex);
 	di_bottom->next_di = g_slist_append(di_bottom->next_di, di_top);
+	g_mutex_unlock(&sessions_mutex);
 
 	srd_dbg("Stacking %s onto %s.", di_top->inst_id, di_bottom->inst_id);
 
@@ -724,6 +750,8 @@ SRD_PRIV int srd_inst_start(struct srd_decoder_inst *di, char **error)
     /* skip zero flag */
     di->skip_zero = FALSE;
 
+    di->idle_end_samplenum = 0;
+
 	/* Set self.samplenum to 0. */
 	PyObject_SetAttrString(di->py_inst, "samplenum", PyLong_FromLong(0));
 
@@ -924,17 +952,302 @@ static gboolean all_terms_match(struct srd_decoder_inst *di,
 
 	for (l = cond; l; l = l->next) {
 		term = l->data;
-        if (!term_matches(di, term, skip_allow))
+        if (!term_matches(di, term, skip_allow)) {
+            di->skip_zero = FALSE;
 			return FALSE;
+        }
 	}
 
+    /*
+     * A skip of zero matches the sample of the last match, find_match()
+     * went on to the next one. Go back once: the skip of a condition that
+     * failed is dropped, and the later conditions do not go back again.
+     */
     if (di->skip_zero) {
         di->abs_cur_samplenum--;
         di->skip_zero = FALSE;
+        di->abs_cur_matched = FALSE;
     }
 	return TRUE;
 }
 
+/*
+ * The word at a time matcher.
+ *
+ * The terms of the conditions are compiled to 64 bit masks of the
+ * samples they match: bit i is the sample abs_cur_samplenum + i, and
+ * the sample before it is bit i of (word << 1) with the old pin shifted
+ * in. A word that no condition matches is passed over at once, an idle
+ * line costs a few operations per 64 samples. A single skip term matches
+ * after its count of samples, it is not checked sample by sample.
+ *
+ * The matcher only finds the next sample that can match. That sample is
+ * checked by the per sample code, so the matches are the same as before.
+ */
+#define FAST_MAX_CONDS 32
+#define FAST_MAX_TERMS 32
+
+/* FALSE checks every sample, the matcher test compares both ways. */
+SRD_PRIV gboolean srd_fast_match = TRUE;
+
+struct fast_cond {
+	int num_terms;
+	int types[FAST_MAX_TERMS];
+	int slots[FAST_MAX_TERMS];	/* index of the channel in fast_matcher */
+	struct srd_term *skip;		/* the term of a skip condition */
+};
+
+struct fast_matcher {
+	int num_conds;
+	struct fast_cond conds[FAST_MAX_CONDS];
+	int num_slots;
+	int channels[FAST_MAX_TERMS];
+	gboolean edge_slots[FAST_MAX_TERMS];	/* the channel has an edge term */
+	gboolean edge_only;	/* each condition has an edge term */
+};
+
+static gboolean fast_matcher_compile(const struct srd_decoder_inst *di,
+		struct fast_matcher *fm)
+{
+	const GSList *l, *ll;
+	struct srd_term *term;
+	struct fast_cond *fc;
+	gboolean has_edge;
+	int i;
+
+	fm->num_conds = 0;
+	fm->num_slots = 0;
+	fm->edge_only = TRUE;
+
+	for (l = di->condition_list; l; l = l->next) {
+		if (!l->data)
+			continue;
+		if (fm->num_conds == FAST_MAX_CONDS)
+			return FALSE;
+
+		fc = &fm->conds[fm->num_conds++];
+		fc->num_terms = 0;
+		fc->skip = NULL;
+		has_edge = FALSE;
+
+		for (ll = l->data; ll; ll = ll->next) {
+			term = ll->data;
+
+			/* The count of a skip term among others depends on them */
+			if (term->type == SRD_TERM_SKIP) {
+				if (ll != l->data || ll->next)
+					return FALSE;
+				fc->skip = term;
+				continue;
+			}
+			if (term->type < SRD_TERM_HIGH || term->type > SRD_TERM_NO_EDGE)
+				return FALSE;
+			if (term->channel < 0 || term->channel >= di->dec_num_channels)
+				return FALSE;
+			if (fc->num_terms == FAST_MAX_TERMS)
+				return FALSE;
+
+			for (i = 0; i < fm->num_slots; i++) {
+				if (fm->channels[i] == term->channel)
+					break;
+			}
+			if (i == fm->num_slots) {
+				if (fm->num_slots == FAST_MAX_TERMS)
+					return FALSE;
+				fm->edge_slots[fm->num_slots] = FALSE;
+				fm->channels[fm->num_slots++] = term->channel;
+			}
+
+			if (term->type == SRD_TERM_RISING_EDGE || term->type == SRD_TERM_FALLING_EDGE
+				|| term->type == SRD_TERM_EITHER_EDGE) {
+				fm->edge_slots[i] = TRUE;
+				has_edge = TRUE;
+			}
+
+			fc->types[fc->num_terms] = term->type;
+			fc->slots[fc->num_terms] = i;
+			fc->num_terms++;
+		}
+
+		if (!has_edge)
+			fm->edge_only = FALSE;
+	}
+
+	return fm->num_conds > 0;
+}
+
+/* The 64 samples of a channel from @samplenum on, the bits after the chunk are garbage. */
+static inline uint64_t fast_load_samples(const struct srd_decoder_inst *di,
+		int ch, uint64_t samplenum, uint64_t nbytes)
+{
+	const uint8_t *p;
+	uint64_t offset, byte, v;
+	int shift, i, n;
+
+	if (*(di->inbuf + ch) == NULL)
+		return *(di->inbuf_const + ch) ? ~0ULL : 0;
+
+	offset = samplenum - di->abs_start_samplenum;
+	byte = offset / 8;
+	shift = offset % 8;
+	p = *(di->inbuf + ch) + byte;
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+	if (byte + 8 <= nbytes) {
+		memcpy(&v, p, 8);
+	}
+	else
+#endif
+	{
+		v = 0;
+		n = (int)MIN(nbytes - byte, 8);
+		for (i = 0; i < n; i++)
+			v |= (uint64_t)p[i] << (i * 8);
+	}
+
+	v >>= shift;
+	if (shift > 0 && byte + 8 < nbytes)
+		v |= (uint64_t)p[8] << (64 - shift);
+
+	return v;
+}
+
+/*
+ * Move di->abs_cur_samplenum to the next sample where a condition can
+ * match, or to the end of the chunk. The old pins and the skip counts
+ * are updated as the per sample code does for the samples passed over.
+ */
+static void fast_skip_to_candidate(struct srd_decoder_inst *di,
+		const struct fast_matcher *fm)
+{
+	const struct fast_cond *fc;
+	uint64_t words[FAST_MAX_TERMS];
+	uint64_t carry[FAST_MAX_TERMS];
+	uint64_t start, cur, end, nbytes, n, valid, any, m, w, pw, d;
+	int c, t, i;
+
+	start = di->abs_cur_samplenum;
+	cur = start;
+	end = di->abs_end_samplenum;
+	nbytes = (end - di->abs_start_samplenum + 7) / 8;
+
+	for (i = 0; i < fm->num_slots; i++)
+		carry[i] = di->old_pins_array->data[fm->channels[i]] ? 1 : 0;
+
+	while (cur < end) {
+		n = MIN(end - cur, 64);
+		valid = (n == 64) ? ~0ULL : (1ULL << n) - 1;
+		any = 0;
+
+		for (i = 0; i < fm->num_slots; i++)
+			words[i] = fast_load_samples(di, fm->channels[i], cur, nbytes);
+
+		for (c = 0; c < fm->num_conds; c++) {
+			fc = &fm->conds[c];
+
+			if (fc->skip) {
+				d = fc->skip->num_samples_to_skip - fc->skip->num_samples_already_skipped;
+				d -= cur - start;
+				if (d < n)
+					any |= 1ULL << d;
+				continue;
+			}
+
+			m = valid;
+			for (t = 0; t < fc->num_terms && m; t++) {
+				w = words[fc->slots[t]];
+				pw = (w << 1) | carry[fc->slots[t]];
+
+				switch (fc->types[t]) {
+				case SRD_TERM_HIGH:
+					m &= w;
+					break;
+				case SRD_TERM_LOW:
+					m &= ~w;
+					break;
+				case SRD_TERM_RISING_EDGE:
+					m &= w & ~pw;
+					break;
+				case SRD_TERM_FALLING_EDGE:
+					m &= ~w & pw;
+					break;
+				case SRD_TERM_EITHER_EDGE:
+					m &= w ^ pw;
+					break;
+				case SRD_TERM_NO_EDGE:
+					m &= ~(w ^ pw);
+					break;
+				}
+			}
+			any |= m;
+		}
+
+		any &= valid;
+		if (any) {
+			cur += __builtin_ctzll(any);
+			break;
+		}
+
+		for (i = 0; i < fm->num_slots; i++)
+			carry[i] = (words[i] >> (n - 1)) & 1;
+		cur += n;
+	}
+
+	if (cur == start)
+		return;
+
+	for (c = 0; c < fm->num_conds; c++) {
+		if (fm->conds[c].skip)
+			fm->conds[c].skip->num_samples_already_skipped += cur - start;
+	}
+
+	/* The old pins are the samples before the new position */
+	di->abs_cur_samplenum = cur - 1;
+	update_old_pins_array(di);
+	di->abs_cur_samplenum = cur;
+}
+
+/*
+ * At the end of a chunk, conditions that all have an edge term can not
+ * match before the next edge of those channels. The frontend is asked
+ * where it is, see srd_session_idle_end().
+ */
+static void fast_find_idle_end(struct srd_decoder_inst *di,
+		const struct fast_matcher *fm)
+{
+	struct srd_session *sess = di->sess;
+	int channels[FAST_MAX_TERMS];
+	int num_channels = 0;
+	uint64_t end, nbytes, next;
+	int i, ch;
+
+	di->idle_end_samplenum = 0;
+
+	if (!sess || !sess->next_edge_cb || !fm->edge_only || di->abs_cur_matched)
+		return;
+
+	end = di->abs_end_samplenum;
+	nbytes = (end - di->abs_start_samplenum + 7) / 8;
+
+	for (i = 0; i < fm->num_slots; i++) {
+		if (!fm->edge_slots[i])
+			continue;
+
+		/* An edge against the old pin is possible on the next sample */
+		ch = fm->channels[i];
+		if ((fast_load_samples(di, ch, end - 1, nbytes) & 1) != (di->old_pins_array->data[ch] ? 1 : 0))
+			return;
+
+		/* An unassigned channel has no edge */
+		if (di->dec_channelmap[ch] >= 0)
+			channels[num_channels++] = di->dec_channelmap[ch];
+	}
+
+	next = sess->next_edge_cb(end, channels, num_channels, sess->next_edge_cb_data);
+	if (next > end)
+		di->idle_end_samplenum = next;
+}
+
 static gboolean 
 find_match(struct srd_decoder_inst *di)
 {
@@ -942,6 +1255,9 @@ find_match(struct srd_decoder_inst *di)
 	GSList *l, *cond;
     gboolean skip_allow;
     gboolean all_skip_allow = TRUE;
+    gboolean first_sample = TRUE;
+    gboolean use_fast;
+    struct fast_matcher fm;
 
 	/* Caller ensures di != NULL. */
 
@@ -959,6 +1275,7 @@ find_match(struct srd_decoder_inst *di)
 
     /* di->match_array is 0 here. Create a new GArray. */
     di->match_array = 0;
+    di->idle_end_samplenum = 0;
 
 	/* Sample 0: Set di->old_pins_array for SRD_INITIAL_PIN_SAME_AS_SAMPLE0 pins. */
     if (di->first_pos) {
@@ -966,11 +1283,31 @@ find_match(struct srd_decoder_inst *di)
 		update_old_pins_array_initial_pins(di);
     }
 
-    if (di->abs_cur_matched)
+    if (di->abs_cur_matched) {
         di->abs_cur_samplenum++;
 
+        /*
+         * The match was the last sample of the chunk. The next chunk starts
+         * after it, do not move past its first sample when it comes.
+         */
+        if (di->abs_cur_samplenum >= di->abs_end_samplenum) {
+            di->abs_cur_matched = FALSE;
+            return FALSE;
+        }
+    }
+
+    use_fast = srd_fast_match && fast_matcher_compile(di, &fm);
+
     while (di->abs_cur_samplenum < di->abs_end_samplenum) {
 
+        /* After the first sample no all_skip_allow jump can happen, pass over the words that can not match. */
+        if (use_fast && !first_sample) {
+            fast_skip_to_candidate(di, &fm);
+            if (di->abs_cur_samplenum >= di->abs_end_samplenum)
+                break;
+        }
+        first_sample = FALSE;
+
         /* Check whether the current sample matches at least one of the conditions (logical OR). */
         /* IMPORTANT: We need to check all conditions, even if there was a match already! */
         for (l = di->condition_list, j = 0; l; l = l->next, j++) {
@@ -1000,6 +1337,9 @@ find_match(struct srd_decoder_inst *di)
             di->abs_cur_samplenum++;
     }
 
+    if (use_fast)
+        fast_find_idle_end(di, &fm);
+
 	return FALSE;
 }
 
@@ -32,6 +32,13 @@
 extern "C" {
 #endif
 
+/*
+ * Returns the first sample from @start on where one of @channels differs
+ * from the sample before it, or the count of samples if there is none.
+ */
+typedef uint64_t (*srd_next_edge_callback)(uint64_t start, const int *channels,
+					int num_channels, void *cb_data);
+
 struct srd_session {
     int session_id;
 
@@ -43,6 +50,10 @@ struct srd_session {
 
     /* List of frontend callbacks to receive decoder output. */
     GSList *callbacks;
+
+    /* Frontend callback to find the next edge of some channels. */
+    srd_next_edge_callback next_edge_cb;
+    void *next_edge_cb_data;
 };
 
 /**
@@ -315,6 +326,9 @@ struct srd_decoder_inst {
     /** skip zero flag. */
     gboolean skip_zero;
 
+    /** The conditions can not match before this sample, 0 if unknown. */
+    uint64_t idle_end_samplenum;
+
 	/** Indicates the current state of the decoder stack. */
 	int decoder_state;
 
@@ -382,11 +396,15 @@ SRD_API int srd_session_send(struct srd_session *sess,
         uint64_t abs_start_samplenum, uint64_t abs_end_samplenum,
         const uint8_t **inbuf, const uint8_t *inbuf_const, uint64_t inbuflen, char **error);
 SRD_API int srd_session_terminate_reset(struct srd_session *sess);
+SRD_API int srd_session_stop(struct srd_session *sess);
 SRD_API int srd_session_destroy(struct srd_session *sess);
 SRD_API int srd_pd_output_callback_add(struct srd_session *sess,
 		int output_type, srd_pd_output_callback cb, void *cb_data);
 
 SRD_API int srd_session_end(struct srd_session *sess, char **error);
+SRD_API int srd_session_next_edge_callback_set(struct srd_session *sess,
+		srd_next_edge_callback cb, void *cb_data);
+SRD_API uint64_t srd_session_idle_end(struct srd_session *sess);
 
 /* decoder.c */
 SRD_API const GSList *srd_decoder_list(void);
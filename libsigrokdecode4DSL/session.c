@@ -44,6 +44,8 @@ SRD_PRIV int srd_call_sub_decoder_end(struct srd_decoder_inst *di, char **error)
 /** @cond PRIVATE */
 
 SRD_PRIV GSList *sessions = NULL;
+/* The sessions decode on their own threads. */
+SRD_PRIV GMutex sessions_mutex;
 SRD_PRIV int max_session_id = -1;
 
 /** @endcond */
@@ -75,10 +77,11 @@ SRD_API int srd_session_new(struct srd_session **sess)
 	}
 	memset(se, 0, sizeof(struct srd_session));
 
-	se->session_id = ++max_session_id;
-
 	/* Keep a list of all sessions, so we can clean up as needed. */
+	g_mutex_lock(&sessions_mutex);
+	se->session_id = ++max_session_id;
 	sessions = g_slist_append(sessions, se);
+	g_mutex_unlock(&sessions_mutex);
 
 	*sess = se;
 
@@ -330,6 +333,30 @@ SRD_API int srd_session_terminate_reset(struct srd_session *sess)
 	return SRD_OK;
 }
 
+/**
+ * Stop the decoding of a session from another thread.
+ *
+ * The decoders return at their next wait() and a pending srd_session_send()
+ * returns without handling the rest of its chunk, so a large chunk does
+ * not hold up the stop. The session can only be destroyed afterwards.
+ *
+ * @param sess The session to stop. Must not be NULL.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ */
+SRD_API int srd_session_stop(struct srd_session *sess)
+{
+	GSList *d;
+
+	if (!sess)
+		return SRD_ERR_ARG;
+
+	for (d = sess->di_list; d; d = d->next)
+		srd_inst_request_stop(d->data);
+
+	return SRD_OK;
+}
+
 /**
  * Destroy a decoding session.
  *
@@ -349,11 +376,16 @@ SRD_API int srd_session_destroy(struct srd_session *sess)
 		return SRD_ERR_ARG;
 
 	session_id = sess->session_id;
+
+	/* Out of the list first, the other sessions search it for their instances. */
+	g_mutex_lock(&sessions_mutex);
+	sessions = g_slist_remove(sessions, sess);
+	g_mutex_unlock(&sessions_mutex);
+
 	if (sess->di_list)
 		srd_inst_free_all(sess);
 	if (sess->callbacks)
 		g_slist_free_full(sess->callbacks, g_free);
-	sessions = g_slist_remove(sessions, sess);
 	g_free(sess);
 
 	srd_info("Destroyed session %d.", session_id);
@@ -425,6 +457,62 @@ SRD_PRIV struct srd_pd_callback *srd_pd_output_callback_find(
 	return pd_cb;
 }
 
+/**
+ * Register the frontend callback to find the next edge of some channels.
+ *
+ * A decoder that waits for edges only asks it at the end of a chunk.
+ * The samples up to the next edge can not match, the frontend can send
+ * them as one chunk of constants, see srd_session_idle_end().
+ *
+ * @param sess The session to use. Must not be NULL.
+ * @param cb The function to call, NULL to remove it.
+ * @param cb_data Private data for the callback function. Can be NULL.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ */
+SRD_API int srd_session_next_edge_callback_set(struct srd_session *sess,
+		srd_next_edge_callback cb, void *cb_data)
+{
+	if (!sess)
+		return SRD_ERR_ARG;
+
+	sess->next_edge_cb = cb;
+	sess->next_edge_cb_data = cb_data;
+
+	return SRD_OK;
+}
+
+/**
+ * Get the sample before which no decoder of the session can match.
+ *
+ * Valid after srd_session_send() returned. The samples from the end of
+ * that chunk up to the returned one can be sent with all the channels
+ * constant, at the level of the sample before the returned one.
+ *
+ * @param sess The session to use. Must not be NULL.
+ *
+ * @return The sample number, 0 if it is not known.
+ */
+SRD_API uint64_t srd_session_idle_end(struct srd_session *sess)
+{
+	GSList *d;
+	struct srd_decoder_inst *di;
+	uint64_t idle_end = 0;
+
+	if (!sess)
+		return 0;
+
+	for (d = sess->di_list; d; d = d->next) {
+		di = d->data;
+		if (di->idle_end_samplenum == 0)
+			return 0;
+		if (idle_end == 0 || di->idle_end_samplenum < idle_end)
+			idle_end = di->idle_end_samplenum;
+	}
+
+	return idle_end;
+}
+
 SRD_API int srd_session_end(struct srd_session *sess, char **error)
 {
 	GSList *d;
@@ -0,0 +1,498 @@
+/*
+ * This file is part of the libsigrokdecode project.
+ *
+ * Copyright (C) 2022 DreamSourceLab <support@dreamsourcelab.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Regression test of the word at a time matcher and of the idle hint.
+ *
+ * The wait() conditions of a decoder are matched against random signals
+ * sent in random chunks, once sample by sample and once with the word
+ * matcher. The word matcher run also sends the samples up to the idle
+ * end as one chunk of constants, as the frontend does. Both runs must
+ * match the same samples with the same conditions.
+ *
+ * A few fixed cases check the per sample code on its own.
+ *
+ * Usage: matcher-test [seed [trials]]
+ */
+
+#include "libsigrokdecode-internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_CHANNELS 4
+#define MAX_SAMPLES 200000
+
+struct signal {
+	uint64_t samples;
+	int channelmap[NUM_CHANNELS];
+	uint8_t *bits[NUM_CHANNELS];
+};
+
+struct match {
+	uint64_t samplenum;
+	uint64_t match_array;
+};
+
+struct run {
+	struct match *matches;
+	uint64_t num_matches;
+	uint64_t capacity;
+	uint64_t idle_samples;
+};
+
+static uint64_t rand_next(uint64_t *state)
+{
+	/* xorshift64* */
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static uint64_t rand_below(uint64_t *state, uint64_t n)
+{
+	return rand_next(state) % n;
+}
+
+static int sample_at(const struct signal *sig, int ch, uint64_t samplenum)
+{
+	if (sig->channelmap[ch] < 0)
+		return 0;
+	return (sig->bits[ch][samplenum / 8] >> (samplenum % 8)) & 1;
+}
+
+static void signal_gen(struct signal *sig, uint64_t *rs)
+{
+	static const uint64_t max_runs[] = {2, 8, 100, 5000, 100000};
+	uint64_t i, run, max_run;
+	int ch, level;
+
+	sig->samples = 1 + rand_below(rs, MAX_SAMPLES);
+
+	for (ch = 0; ch < NUM_CHANNELS; ch++) {
+		/* The last channel is not assigned now and then */
+		sig->channelmap[ch] = (ch == NUM_CHANNELS - 1 && rand_below(rs, 4) == 0) ? -1 : ch;
+		sig->bits[ch] = g_malloc0(sig->samples / 8 + 1);
+
+		max_run = max_runs[rand_below(rs, G_N_ELEMENTS(max_runs))];
+		level = rand_below(rs, 2);
+		run = 0;
+		for (i = 0; i < sig->samples; i++) {
+			if (run == 0) {
+				level = !level;
+				run = 1 + rand_below(rs, max_run);
+			}
+			if (level)
+				sig->bits[ch][i / 8] |= 1 << (i % 8);
+			run--;
+		}
+	}
+}
+
+static void signal_free(struct signal *sig)
+{
+	int ch;
+
+	for (ch = 0; ch < NUM_CHANNELS; ch++)
+		g_free(sig->bits[ch]);
+}
+
+/* The conditions of the next wait(), as set_new_condition_list() does */
+static void conditions_gen(struct srd_decoder_inst *di, uint64_t *rs)
+{
+	static const uint64_t max_skips[] = {1, 3, 64, 1000, 100000};
+	GSList *term_list;
+	struct srd_term *term;
+	int num_conds, num_terms, i, j;
+
+	condition_list_free(di);
+
+	num_conds = 1 + rand_below(rs, 3);
+	for (i = 0; i < num_conds; i++) {
+		term_list = NULL;
+
+		if (rand_below(rs, 4) == 0) {
+			term = g_malloc0(sizeof(struct srd_term));
+			term->type = SRD_TERM_SKIP;
+			term->num_samples_to_skip = rand_below(rs, max_skips[rand_below(rs, G_N_ELEMENTS(max_skips))]);
+			term->num_samples_already_skipped = di->abs_cur_matched ? (term->num_samples_to_skip != 0) : 0;
+			term_list = g_slist_append(term_list, term);
+
+			/* A skip among other terms is left to the per sample code */
+			if (rand_below(rs, 8) != 0) {
+				di->condition_list = g_slist_append(di->condition_list, term_list);
+				continue;
+			}
+		}
+
+		num_terms = 1 + rand_below(rs, 3);
+		for (j = 0; j < num_terms; j++) {
+			term = g_malloc0(sizeof(struct srd_term));
+			term->type = SRD_TERM_HIGH + rand_below(rs, SRD_TERM_NO_EDGE - SRD_TERM_HIGH + 1);
+			term->channel = rand_below(rs, NUM_CHANNELS);
+			term_list = g_slist_append(term_list, term);
+		}
+		di->condition_list = g_slist_append(di->condition_list, term_list);
+	}
+}
+
+/* The frontend side of the idle hint, see DecoderStack::next_edge_callback() */
+static uint64_t next_edge(uint64_t start, const int *channels,
+		int num_channels, void *cb_data)
+{
+	const struct signal *sig = cb_data;
+	uint64_t i;
+	int c;
+
+	if (start == 0 || start >= sig->samples)
+		return start;
+
+	for (i = start; i < sig->samples; i++) {
+		for (c = 0; c < num_channels; c++) {
+			if (sample_at(sig, channels[c], i) != sample_at(sig, channels[c], i - 1))
+				return i;
+		}
+	}
+
+	return sig->samples;
+}
+
+static struct srd_decoder_inst *inst_new(struct srd_session *sess,
+		const struct signal *sig)
+{
+	struct srd_decoder_inst *di;
+
+	memset(sess, 0, sizeof(*sess));
+
+	di = g_malloc0(sizeof(struct srd_decoder_inst));
+	di->sess = sess;
+	di->dec_num_channels = NUM_CHANNELS;
+	di->dec_channelmap = (int *)sig->channelmap;
+	di->first_pos = TRUE;
+	sess->di_list = g_slist_append(NULL, di);
+
+	di->old_pins_array = g_array_sized_new(FALSE, TRUE, sizeof(uint8_t), NUM_CHANNELS);
+	g_array_set_size(di->old_pins_array, NUM_CHANNELS);
+
+	return di;
+}
+
+static void inst_free(struct srd_session *sess, struct srd_decoder_inst *di)
+{
+	condition_list_free(di);
+	g_array_free(di->old_pins_array, TRUE);
+	g_slist_free(sess->di_list);
+	g_free(di);
+}
+
+/* As srd_inst_decode() */
+static void inst_chunk(struct srd_decoder_inst *di, uint64_t start, uint64_t end,
+		const uint8_t **inbuf, const uint8_t *inbuf_const)
+{
+	if (di->first_pos)
+		di->abs_cur_samplenum = start;
+	di->abs_start_samplenum = start & ~7ULL;
+	di->abs_end_samplenum = end;
+	di->inbuf = inbuf;
+	di->inbuf_const = inbuf_const;
+	di->inbuflen = end - start;
+}
+
+static void decode(const struct signal *sig, uint64_t seed, gboolean fast,
+		struct run *run)
+{
+	struct srd_session sess;
+	struct srd_decoder_inst *di;
+	const uint8_t *inbuf[NUM_CHANNELS];
+	uint8_t inbuf_const[NUM_CHANNELS];
+	uint64_t cond_rs, chunk_rs, pin_rs;
+	uint64_t i, chunk_end, boundary, idle_end;
+	gboolean found_match, need_conds;
+	int ch;
+
+	/* Both runs get the same conditions and chunk boundaries */
+	cond_rs = seed;
+	pin_rs = seed ^ 0x5555;
+	chunk_rs = seed ^ 0xaaaa;
+
+	di = inst_new(&sess, sig);
+	if (fast) {
+		sess.next_edge_cb = next_edge;
+		sess.next_edge_cb_data = (void *)sig;
+	}
+
+	for (ch = 0; ch < NUM_CHANNELS; ch++)
+		di->old_pins_array->data[ch] = SRD_INITIAL_PIN_LOW + rand_below(&pin_rs, 3);
+
+	srd_fast_match = fast;
+	run->capacity = 1024;
+	run->matches = g_malloc(sizeof(struct match) * run->capacity);
+	run->num_matches = 0;
+	run->idle_samples = 0;
+	need_conds = TRUE;
+	boundary = 0;
+	idle_end = 0;
+
+	for (i = 0; i < sig->samples; i = chunk_end) {
+		if (idle_end > i) {
+			chunk_end = MIN(idle_end, sig->samples);
+			for (ch = 0; ch < NUM_CHANNELS; ch++) {
+				inbuf[ch] = NULL;
+				inbuf_const[ch] = sample_at(sig, ch, chunk_end - 1);
+			}
+			run->idle_samples += chunk_end - i;
+		} else {
+			while (boundary <= i)
+				boundary += 1 + rand_below(&chunk_rs, 3000);
+			chunk_end = MIN(boundary, sig->samples);
+			for (ch = 0; ch < NUM_CHANNELS; ch++) {
+				inbuf[ch] = (sig->channelmap[ch] < 0) ? NULL : sig->bits[ch] + i / 8;
+				inbuf_const[ch] = sample_at(sig, ch, i);
+			}
+		}
+
+		inst_chunk(di, i, chunk_end, inbuf, inbuf_const);
+
+		/* As Decoder_wait(), each match returns to the decoder for its next wait() */
+		while (1) {
+			if (need_conds) {
+				conditions_gen(di, &cond_rs);
+				need_conds = FALSE;
+			}
+
+			process_samples_until_condition_match(di, &found_match);
+			if (!found_match)
+				break;
+
+			if (run->num_matches == run->capacity) {
+				run->capacity *= 2;
+				run->matches = g_realloc(run->matches, sizeof(struct match) * run->capacity);
+			}
+			run->matches[run->num_matches].samplenum = di->abs_cur_samplenum;
+			run->matches[run->num_matches].match_array = di->match_array;
+			run->num_matches++;
+			need_conds = TRUE;
+		}
+
+		idle_end = srd_session_idle_end(&sess);
+		di->inbuf = NULL;
+	}
+
+	inst_free(&sess, di);
+}
+
+/* A fixed case: channel 0 rises once, the other channels stay low */
+struct fixed {
+	struct srd_session sess;
+	struct srd_decoder_inst *di;
+	struct signal sig;
+	const uint8_t *inbuf[NUM_CHANNELS];
+	uint8_t inbuf_const[NUM_CHANNELS];
+	const uint64_t *bounds;
+	int chunk;
+};
+
+static void fixed_chunk(struct fixed *f)
+{
+	uint64_t start = f->bounds[f->chunk];
+	int ch;
+
+	for (ch = 0; ch < NUM_CHANNELS; ch++) {
+		f->inbuf[ch] = f->sig.bits[ch] + start / 8;
+		f->inbuf_const[ch] = sample_at(&f->sig, ch, start);
+	}
+	inst_chunk(f->di, start, f->bounds[f->chunk + 1], f->inbuf, f->inbuf_const);
+}
+
+/* @bounds are the chunks, the last one ends at @samples */
+static void fixed_init(struct fixed *f, uint64_t samples, uint64_t rise,
+		const uint64_t *bounds)
+{
+	uint64_t i;
+	int ch;
+
+	f->sig.samples = samples;
+	for (ch = 0; ch < NUM_CHANNELS; ch++) {
+		f->sig.channelmap[ch] = ch;
+		f->sig.bits[ch] = g_malloc0(samples / 8 + 1);
+	}
+	for (i = rise; i < samples; i++)
+		f->sig.bits[0][i / 8] |= 1 << (i % 8);
+
+	f->di = inst_new(&f->sess, &f->sig);
+	for (ch = 0; ch < NUM_CHANNELS; ch++)
+		f->di->old_pins_array->data[ch] = SRD_INITIAL_PIN_LOW;
+
+	f->bounds = bounds;
+	f->chunk = 0;
+	fixed_chunk(f);
+}
+
+static void fixed_free(struct fixed *f)
+{
+	inst_free(&f->sess, f->di);
+	signal_free(&f->sig);
+}
+
+/* A term of the condition @terms, as set_new_condition_list() makes it */
+static GSList *term_add(struct srd_decoder_inst *di, GSList *terms,
+		int type, int channel, uint64_t skip)
+{
+	struct srd_term *term = g_malloc0(sizeof(struct srd_term));
+
+	term->type = type;
+	term->channel = channel;
+	term->num_samples_to_skip = skip;
+	term->num_samples_already_skipped = di->abs_cur_matched ? (skip != 0) : 0;
+
+	return g_slist_append(terms, term);
+}
+
+/* The next match goes to @samplenum with @match_array, across the chunks */
+static int fixed_wait(struct fixed *f, const char *name,
+		uint64_t samplenum, uint64_t match_array)
+{
+	gboolean found_match;
+
+	while (1) {
+		process_samples_until_condition_match(f->di, &found_match);
+		if (found_match || f->bounds[f->chunk + 1] == f->sig.samples)
+			break;
+		f->chunk++;
+		fixed_chunk(f);
+	}
+
+	if (found_match && f->di->abs_cur_samplenum == samplenum
+		&& f->di->match_array == match_array)
+		return 0;
+
+	printf("%s: want %" PRIu64 "/0x%" PRIx64 ", got %s%" PRIu64 "/0x%" PRIx64 "\n",
+		name, samplenum, match_array, found_match ? "" : "no match ",
+		f->di->abs_cur_samplenum, f->di->match_array);
+	return 1;
+}
+
+static int test_skip_zero(void)
+{
+	static const uint64_t bounds[] = {0, 64};
+	struct fixed f;
+	struct srd_decoder_inst *di;
+	int ret = 0;
+
+	fixed_init(&f, 64, 10, bounds);
+	di = f.di;
+
+	di->condition_list = g_slist_append(NULL,
+		term_add(di, NULL, SRD_TERM_RISING_EDGE, 0, 0));
+	ret |= fixed_wait(&f, "skip zero: edge", 10, 0x1);
+
+	/* Both conditions match the sample of the last match, it goes back once */
+	condition_list_free(di);
+	di->condition_list = g_slist_append(NULL, term_add(di, NULL, SRD_TERM_SKIP, 0, 0));
+	di->condition_list = g_slist_append(di->condition_list, term_add(di, NULL, SRD_TERM_SKIP, 0, 0));
+	ret |= fixed_wait(&f, "skip zero: two skips", 10, 0x3);
+
+	/* The skip of a condition that fails does not take the next condition back */
+	condition_list_free(di);
+	di->condition_list = g_slist_append(NULL,
+		term_add(di, term_add(di, NULL, SRD_TERM_SKIP, 0, 0), SRD_TERM_HIGH, 1, 0));
+	di->condition_list = g_slist_append(di->condition_list,
+		term_add(di, NULL, SRD_TERM_HIGH, 0, 0));
+	ret |= fixed_wait(&f, "skip zero: failed skip", 11, 0x2);
+
+	fixed_free(&f);
+	return ret;
+}
+
+static int test_chunk_end(void)
+{
+	static const uint64_t bounds[] = {0, 11, 64};
+	struct fixed f;
+	struct srd_decoder_inst *di;
+	int ret = 0;
+
+	fixed_init(&f, 64, 10, bounds);
+	di = f.di;
+
+	/* The edge is the last sample of the first chunk */
+	di->condition_list = g_slist_append(NULL,
+		term_add(di, NULL, SRD_TERM_RISING_EDGE, 0, 0));
+	ret |= fixed_wait(&f, "chunk end: edge", 10, 0x1);
+
+	/* The next wait() starts at the first sample of the next chunk */
+	condition_list_free(di);
+	di->condition_list = g_slist_append(NULL,
+		term_add(di, NULL, SRD_TERM_HIGH, 0, 0));
+	ret |= fixed_wait(&f, "chunk end: next chunk", 11, 0x1);
+
+	fixed_free(&f);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	struct signal sig;
+	struct run slow, fast;
+	uint64_t seed, trials, trial, rs, i, matches, idle;
+	int ret = 0;
+
+	seed = (argc > 1) ? strtoull(argv[1], NULL, 0) : 1;
+	trials = (argc > 2) ? strtoull(argv[2], NULL, 0) : 200;
+	matches = 0;
+	idle = 0;
+
+	if (test_skip_zero() != 0 || test_chunk_end() != 0)
+		return 1;
+
+	for (trial = 0; trial < trials && ret == 0; trial++) {
+		rs = seed * 0x9E3779B97F4A7C15ULL + trial + 1;
+		signal_gen(&sig, &rs);
+
+		decode(&sig, rs, FALSE, &slow);
+		decode(&sig, rs, TRUE, &fast);
+
+		for (i = 0; i < MIN(slow.num_matches, fast.num_matches); i++) {
+			if (slow.matches[i].samplenum != fast.matches[i].samplenum
+				|| slow.matches[i].match_array != fast.matches[i].match_array)
+				break;
+		}
+		if (i < slow.num_matches || i < fast.num_matches) {
+			printf("trial %" PRIu64 " (seed %" PRIu64 "): match %" PRIu64 " differs,"
+				" per sample %" PRIu64 "/0x%" PRIx64 ", word %" PRIu64 "/0x%" PRIx64 "\n",
+				trial, seed, i,
+				i < slow.num_matches ? slow.matches[i].samplenum : 0,
+				i < slow.num_matches ? slow.matches[i].match_array : 0,
+				i < fast.num_matches ? fast.matches[i].samplenum : 0,
+				i < fast.num_matches ? fast.matches[i].match_array : 0);
+			ret = 1;
+		}
+
+		matches += slow.num_matches;
+		idle += fast.idle_samples;
+		g_free(slow.matches);
+		g_free(fast.matches);
+		signal_free(&sig);
+	}
+
+	printf("%" PRIu64 " trials, %" PRIu64 " matches, %" PRIu64 " idle samples: %s\n",
+		trial, matches, idle, ret ? "FAILED" : "ok");
+
+	return ret;
+}
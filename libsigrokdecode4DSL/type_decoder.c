@@ -27,6 +27,7 @@
 
 /** @cond PRIVATE */
 extern SRD_PRIV GSList *sessions;
+extern SRD_PRIV GMutex sessions_mutex;
 /** @endcond */
 
 typedef struct {
@@ -396,11 +397,15 @@ static inline struct srd_decoder_inst *srd_inst_find_by_obj(
 	struct srd_session *sess;
 	GSList *l;
 
+	g_mutex_lock(&sessions_mutex);
+
 	/* Performance shortcut: Handle the most common case first. */
 	sess = sessions->data;
-	di = sess->di_list->data;
-	if (di->py_inst == obj)
+	di = sess->di_list ? sess->di_list->data : NULL;
+	if (di && di->py_inst == obj) {
+		g_mutex_unlock(&sessions_mutex);
 		return di;
+	}
 
 	di = NULL;
 	for (l = sessions; di == NULL && l != NULL; l = l->next) {
@@ -408,6 +413,8 @@ static inline struct srd_decoder_inst *srd_inst_find_by_obj(
 		di = srd_sess_inst_find_by_obj(sess, stack, obj);
 	}
 
+	g_mutex_unlock(&sessions_mutex);
+
 	return di;
 }
 